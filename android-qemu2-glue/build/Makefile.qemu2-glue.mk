@@ -46,6 +46,7 @@ LOCAL_SRC_FILES := \
     qemu-user-event-agent-impl.c \
     qemu-vm-operations-impl.cpp \
     snapshot_compression.cpp \
+    snapshot_compression_codec.cpp \
     telephony/modem_init.c \
     utils/stream.cpp \
 
@@ -53,6 +54,24 @@ LOCAL_SRC_FILES := $(LOCAL_SRC_FILES:%=android-qemu2-glue/%)
 
 $(call end-emulator-library)
 
+####
+# Benchmark for the snapshot RAM compression settings above.
+#
+$(call start-emulator-benchmark,snapshot_compression$(BUILD_TARGET_SUFFIX)_benchmark)
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH) \
+    $(ANDROID_EMU_INCLUDES) \
+    $(LZ4_INCLUDES) \
+
+LOCAL_SRC_FILES := \
+    android-qemu2-glue/snapshot_compression_benchmark.cpp \
+    android-qemu2-glue/snapshot_compression_codec.cpp \
+
+LOCAL_STATIC_LIBRARIES := emulator-lz4
+
+$(call end-emulator-benchmark)
+
 QEMU2_GLUE_STATIC_LIBRARIES := \
     libqemu2-glue \
     emulator-libui \
@@ -358,6 +358,7 @@ QEMU2_COMMON_SOURCES_linux-x86_64 := \
     audio/paaudio.c \
     backends/hostmem-file.c \
     backends/rng-random.c \
+    block/io_uring.c \
     block/raw-posix.c \
     fsdev/qemu-fsdev-dummy.c \
     fsdev/qemu-fsdev-opts.c \
@@ -32,6 +32,7 @@
 #define CONFIG_ACCEPT4 1
 #define CONFIG_SPLICE 1
 #define CONFIG_EVENTFD 1
+#define CONFIG_LINUX_IO_URING 1
 #define CONFIG_FALLOCATE 1
 #define CONFIG_POSIX_FALLOCATE 1
 #define CONFIG_SYNC_FILE_RANGE 1
@@ -172,6 +172,10 @@ static const GoldfishPipeServiceOps goldfish_pipe_service_ops = {
             QemuFileStream stream(file);
             android_goldfish_dma_ops.load_mappings(&stream);
         },
+        // guest_can_transfer_unlocked()
+        [](GoldfishHostPipe* hostPipe) -> bool {
+            return android_pipe_guest_can_transfer_unlocked(hostPipe);
+        },
 };
 
 // These callbacks are called from the pipe service into the virtual device.
@@ -30,6 +30,7 @@
 #include "android/featurecontrol/feature_control.h"
 #include "android/filesystems/ext4_resize.h"
 #include "android/filesystems/ext4_utils.h"
+#include "android/filesystems/qcow2_overlay.h"
 #include "android/globals.h"
 #include "android/help.h"
 #include "android/kernel/kernel_utils.h"
@@ -304,6 +305,31 @@ static int createUserData(AvdInfo* avd,
     if (needCopyDataPartition && path_exists(hw->disk_dataPartition_initPath)) {
         D("Creating: %s\n", hw->disk_dataPartition_path);
 
+        // QEMU opens userdata through its block layer, which reads a QCOW2
+        // image as well as a raw one. If the initial filesystem is already
+        // large enough, an overlay backed by it saves copying the whole
+        // image; otherwise resize2fs needs a raw copy to grow. ARC
+        // concatenates raw partitions, so it always gets a copy.
+        // The overlay records which image it was made from, so that main()
+        // refuses to boot it on top of another one.
+        System::FileSize initSize = 0;
+        if (!hw->hw_arc &&
+            System::get()->pathFileSize(hw->disk_dataPartition_initPath,
+                                        &initSize) &&
+            initSize >= static_cast<System::FileSize>(
+                                android_hw->disk_dataPartition_size)) {
+            ScopedCPtr<char> initPath(
+                    path_get_absolute(hw->disk_dataPartition_initPath));
+            int ret = android_createQcow2Overlay(hw->disk_dataPartition_path,
+                                                 initPath.get(), initSize);
+            if (ret < 0) {
+                derror("Could not create %s: %s", hw->disk_dataPartition_path,
+                       strerror(-ret));
+                return 1;
+            }
+            return 0;
+        }
+
         if (path_copy_file(hw->disk_dataPartition_path,
                            hw->disk_dataPartition_initPath) < 0) {
             derror("Could not create %s: %s", hw->disk_dataPartition_path,
@@ -489,6 +515,14 @@ class PartitionParameters {
             }
         }
 
+#ifdef CONFIG_LINUX
+        // Submit disk I/O through io_uring; QEMU goes back to linux-aio or
+        // its thread pool by itself if the host kernel is too old for it.
+        if (fc::isEnabled(fc::IoUring)) {
+            driveParam += ",aio=io_uring";
+        }
+#endif
+
 // Move the disk operations into the dedicated 'disk thread', and
 // enable modern notification mode for the hosts that support it (Linux).
 #if defined(TARGET_X86_64) || defined(TARGET_I386)
@@ -867,6 +901,30 @@ extern "C" int main(int argc, char** argv) {
       int ret = createUserData(avd, dataPath, hw);
       if (ret != 0)
         return ret;
+    } else if (!hw->hw_arc &&
+               android_pathIsQcow2Image(hw->disk_dataPartition_path)) {
+        // userdata-qemu.img is an overlay of the initial data partition
+        // (see createUserData()), which only holds the blocks the guest
+        // wrote: it is garbage on top of any other initial image, e.g. one
+        // a system image update replaced. It can't be resized either;
+        // -wipe-data recreates it.
+        switch (android_checkQcow2OverlayBacking(
+                hw->disk_dataPartition_path)) {
+            case ANDROID_QCOW2_BACKING_MISSING:
+                derror("%s is an overlay of an initial data partition "
+                       "that can't be found anymore, it may have been "
+                       "moved. Restore it, or use -wipe-data to start over.",
+                       hw->disk_dataPartition_path);
+                return 1;
+            case ANDROID_QCOW2_BACKING_CHANGED:
+                derror("%s is an overlay of an initial data partition "
+                       "that has changed since, e.g. with a system image "
+                       "update. Use -wipe-data to start over.",
+                       hw->disk_dataPartition_path);
+                return 1;
+            default:
+                break;
+        }
     } else if (!hw->hw_arc) {
         // Resize userdata-qemu.img if the size is smaller than what
         // config.ini says. This can happen as user wants a larger data
@@ -14,38 +14,39 @@
 
 #include "android-qemu2-glue/snapshot_compression.h"
 
-#include <type_traits>
+#include "android-qemu2-glue/snapshot_compression_codec.h"
+#include "android/base/system/System.h"
+
+#include <algorithm>
 
 extern "C" {
 #include "qemu/osdep.h"
 #include "migration/migration.h"
-}
-
-#include "lz4.h"
-
-#include <cassert>
-
-static ssize_t max_compressed_size(ssize_t size) {
-    return LZ4_compressBound(size);
-}
-
-static ssize_t compress(uint8_t *dest, ssize_t dest_size,
-                        const uint8_t *data, ssize_t size, int level) {
-    return LZ4_compress_fast((const char*)data, (char*)dest, size, dest_size, 1);
-}
-
-static ssize_t uncompress(uint8_t *dest, ssize_t dest_size,
-                          const uint8_t *data, ssize_t size) {
-    int res = LZ4_decompress_safe((const char*)data, (char*)dest, size, dest_size);
-    assert(res == dest_size);
-    return res;
+#include "qapi/error.h"
+#include "qmp-commands.h"
 }
 
 void qemu_snapshot_compression_setup() {
     MigrationCompressionOps ops = {
-        max_compressed_size,
-        compress,
-        uncompress
+        snapshot_max_compressed_size,
+        snapshot_compress,
+        snapshot_uncompress
     };
     migrate_set_compression_ops(&ops);
+
+    // RAM is (de)compressed in batches of pages by independent threads, so
+    // use all host cores instead of QEMU's default of 8/2 threads.
+    // Migration parameters are limited to 255 threads.
+    const int threads = std::min(
+            std::max(1, android::base::System::get()->getCpuCoreCount()), 255);
+    MigrationParameters params = {};
+    params.has_compress_threads = true;
+    params.compress_threads = threads;
+    params.has_decompress_threads = true;
+    params.decompress_threads = threads;
+    Error* err = nullptr;
+    qmp_migrate_set_parameters(&params, &err);
+    if (err) {
+        error_report_err(err);
+    }
 }
@@ -0,0 +1,182 @@
+// Copyright 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A benchmark for the snapshot RAM compression path: it compresses and
+// decompresses a synthetic RAM image with the page codec that
+// qemu_snapshot_compression_setup() installs, from N threads each taking
+// batches of pages and writing into their own output buffer, the way
+// migration/ram.c hands them out. ram.c itself can only be built as part
+// of a QEMU target, so the thread handoff is modeled here.
+
+#include "android-qemu2-glue/snapshot_compression_codec.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int kPageSize = 4096;
+constexpr int kImagePages = 16384;  // 64 MB
+
+// Builds a RAM image that looks roughly like a booted guest: code and
+// text-like pages, sparse pages with a few live words, and incompressible
+// pages (already compressed assets, random data). Zero pages are skipped
+// by the migration code before compression so there are none here.
+const std::vector<uint8_t>& ramImage() {
+    static const std::vector<uint8_t> image = [] {
+        std::vector<uint8_t> ram(size_t(kImagePages) * kPageSize);
+        uint32_t seed = 0x12345678;
+        auto next = [&seed] {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        };
+        static const char kText[] =
+                "android.app.ActivityThread.main com.android.server "
+                "ldr r0, [r1, #4] mov r2, r3 bl 0x7f001234 ";
+        for (int page = 0; page < kImagePages; ++page) {
+            uint8_t* p = &ram[size_t(page) * kPageSize];
+            switch (page % 3) {
+                case 0:
+                    for (int i = 0; i < kPageSize; ++i) {
+                        p[i] = kText[(i + page) % (sizeof(kText) - 1)] ^
+                               ((next() & 0x1f) == 0 ? next() : 0);
+                    }
+                    break;
+                case 1:
+                    for (int i = 0; i < 32; ++i) {
+                        const uint32_t word = next();
+                        memcpy(p + (next() % (kPageSize / 4)) * 4, &word, 4);
+                    }
+                    break;
+                default:
+                    for (int i = 0; i < kPageSize; ++i) {
+                        p[i] = uint8_t(next());
+                    }
+                    break;
+            }
+        }
+        return ram;
+    }();
+    return image;
+}
+
+struct CompressedImage {
+    std::vector<std::vector<uint8_t>> pages;
+};
+
+const CompressedImage& compressedImage() {
+    static const CompressedImage image = [] {
+        CompressedImage res;
+        const auto& ram = ramImage();
+        std::vector<uint8_t> buf(snapshot_max_compressed_size(kPageSize));
+        for (int page = 0; page < kImagePages; ++page) {
+            const int size = snapshot_compress(
+                    buf.data(), buf.size(),
+                    &ram[size_t(page) * kPageSize], kPageSize, 1);
+            res.pages.emplace_back(buf.begin(), buf.begin() + size);
+        }
+        return res;
+    }();
+    return image;
+}
+
+// Runs |work(firstPage, count, threadIndex)| over the whole image on
+// |threads| threads, each grabbing |batch| pages at a time.
+template <class Work>
+void runBatches(int threads, int batch, Work&& work) {
+    std::atomic<int> nextPage(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            for (;;) {
+                const int first = nextPage.fetch_add(batch);
+                if (first >= kImagePages) {
+                    break;
+                }
+                work(first, std::min(batch, kImagePages - first), t);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// range_x: thread count, range_y: pages per batch.
+void BM_SnapshotCompress(benchmark::State& state) {
+    const auto& ram = ramImage();
+    const int threads = state.range_x();
+    const int batch = state.range_y();
+    const int bound = snapshot_max_compressed_size(kPageSize);
+    std::vector<std::vector<uint8_t>> outputs(
+            threads, std::vector<uint8_t>(size_t(batch) * (bound + 4)));
+
+    while (state.KeepRunning()) {
+        runBatches(threads, batch, [&](int first, int count, int t) {
+            uint8_t* out = outputs[t].data();
+            for (int i = 0; i < count; ++i) {
+                const int size = snapshot_compress(
+                        out + 4, bound,
+                        &ram[size_t(first + i) * kPageSize], kPageSize, 1);
+                memcpy(out, &size, 4);
+                out += 4 + size;
+            }
+            benchmark::DoNotOptimize(outputs[t].data());
+        });
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+void BM_SnapshotDecompress(benchmark::State& state) {
+    const auto& compressed = compressedImage();
+    const int threads = state.range_x();
+    const int batch = state.range_y();
+    std::vector<uint8_t> ram(size_t(kImagePages) * kPageSize);
+
+    while (state.KeepRunning()) {
+        runBatches(threads, batch, [&](int first, int count, int) {
+            for (int i = 0; i < count; ++i) {
+                const auto& page = compressed.pages[first + i];
+                snapshot_uncompress(
+                        &ram[size_t(first + i) * kPageSize], kPageSize,
+                        page.data(), page.size());
+            }
+        });
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+void threadsAndBatches(benchmark::internal::Benchmark* b) {
+    const int maxThreads =
+            std::max(1, int(std::thread::hardware_concurrency()));
+    for (int batch : {1, 16}) {
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            b->ArgPair(threads, batch);
+        }
+    }
+    b->UseRealTime();
+}
+
+}  // namespace
+
+BENCHMARK(BM_SnapshotCompress)->Apply(threadsAndBatches);
+BENCHMARK(BM_SnapshotDecompress)->Apply(threadsAndBatches);
+
+BENCHMARK_MAIN()
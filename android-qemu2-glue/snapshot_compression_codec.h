@@ -0,0 +1,36 @@
+// Copyright 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+ANDROID_BEGIN_HEADER
+
+// The RAM page codec that qemu_snapshot_compression_setup() installs as
+// the migration compression ops. It doesn't depend on QEMU, so that the
+// snapshot compression benchmark runs the same code.
+
+ssize_t snapshot_max_compressed_size(ssize_t size);
+
+ssize_t snapshot_compress(uint8_t* dest, ssize_t dest_size,
+                          const uint8_t* data, ssize_t size, int level);
+
+ssize_t snapshot_uncompress(uint8_t* dest, ssize_t dest_size,
+                            const uint8_t* data, ssize_t size);
+
+ANDROID_END_HEADER
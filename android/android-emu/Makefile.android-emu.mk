@@ -111,6 +111,7 @@ LOCAL_C_INCLUDES := \
 
 LOCAL_SRC_FILES := \
     android/base/Debug.cpp \
+    android/base/files/CacheFiles.cpp \
     android/base/files/CompressingStream.cpp \
     android/base/files/DecompressingStream.cpp \
     android/base/files/Fd.cpp \
@@ -349,9 +350,11 @@ LOCAL_SRC_FILES := \
     android/filesystems/ext4_resize.cpp \
     android/filesystems/ext4_utils.cpp \
     android/filesystems/fstab_parser.cpp \
+    android/filesystems/image_cache.cpp \
     android/filesystems/internal/PartitionConfigBackend.cpp \
     android/filesystems/partition_config.cpp \
     android/filesystems/partition_types.cpp \
+    android/filesystems/qcow2_overlay.cpp \
     android/filesystems/ramdisk_extractor.cpp \
     android/framebuffer.c \
     android/gps/GpxParser.cpp \
@@ -586,6 +589,7 @@ LOCAL_SRC_FILES := \
   android/base/containers/Lookup_unittest.cpp \
   android/base/containers/SmallVector_unittest.cpp \
   android/base/EintrWrapper_unittest.cpp \
+  android/base/files/CacheFiles_unittest.cpp \
   android/base/files/IniFile_unittest.cpp \
   android/base/files/InplaceStream_unittest.cpp \
   android/base/files/MemStream_unittest.cpp \
@@ -661,8 +665,10 @@ LOCAL_SRC_FILES := \
   android/filesystems/ext4_resize_unittest.cpp \
   android/filesystems/ext4_utils_unittest.cpp \
   android/filesystems/fstab_parser_unittest.cpp \
+  android/filesystems/image_cache_unittest.cpp \
   android/filesystems/partition_config_unittest.cpp \
   android/filesystems/partition_types_unittest.cpp \
+  android/filesystems/qcow2_overlay_unittest.cpp \
   android/filesystems/ramdisk_extractor_unittest.cpp \
   android/filesystems/testing/TestSupport.cpp \
   android/gps/GpxParser_unittest.cpp \
@@ -776,6 +782,63 @@ $(call local-link-static-c++lib)
 
 $(call end-emulator-program)
 
+####
+# Benchmark for the network shaper and delayer.
+#
+$(call start-emulator-benchmark,android_emu_shaper$(BUILD_TARGET_SUFFIX)_benchmark)
+
+LOCAL_C_INCLUDES := \
+    $(ANDROID_EMU_INCLUDES) \
+
+LOCAL_LDLIBS += \
+    $(ANDROID_EMU_LDLIBS) \
+
+LOCAL_SRC_FILES := \
+    android/shaper_benchmark.cpp \
+
+LOCAL_STATIC_LIBRARIES := $(ANDROID_EMU_STATIC_LIBRARIES)
+
+$(call end-emulator-benchmark)
+
+####
+# Benchmark for adb data transfers through the guest pipe.
+#
+$(call start-emulator-benchmark,android_emu_adb$(BUILD_TARGET_SUFFIX)_benchmark)
+
+LOCAL_C_INCLUDES := \
+    $(ANDROID_EMU_INCLUDES) \
+
+LOCAL_LDLIBS += \
+    $(ANDROID_EMU_LDLIBS) \
+
+LOCAL_SRC_FILES := \
+    android/emulation/AdbGuestPipe_benchmark.cpp \
+    android/emulation/testing/TestAndroidPipeDevice.cpp \
+
+LOCAL_STATIC_LIBRARIES := $(ANDROID_EMU_STATIC_LIBRARIES)
+
+$(call end-emulator-benchmark)
+
+####
+# Latency and throughput baseline for the Android pipe services.
+#
+$(call start-emulator-benchmark,android_emu_pipe$(BUILD_TARGET_SUFFIX)_benchmark)
+
+LOCAL_C_INCLUDES := \
+    $(ANDROID_EMU_INCLUDES) \
+    $(EMUGL_INCLUDES) \
+
+LOCAL_LDLIBS += \
+    $(ANDROID_EMU_LDLIBS) \
+
+LOCAL_SRC_FILES := \
+    android/emulation/AndroidPipe_benchmark.cpp \
+    android/emulation/testing/TestAndroidPipeDevice.cpp \
+
+LOCAL_STATIC_LIBRARIES := $(ANDROID_EMU_STATIC_LIBRARIES)
+
+$(call end-emulator-benchmark)
+
 ##############################################################################
 #
 #  emulator-libui
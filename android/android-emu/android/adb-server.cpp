@@ -21,6 +21,8 @@
 #include "android/emulation/AdbHostListener.h"
 #include "android/emulation/AdbHostServer.h"
 #include "android/emulation/AndroidPipe.h"
+#include "android/metrics/PeriodicReporter.h"
+#include "android/metrics/proto/studio_stats.pb.h"
 #include "android/utils/debug.h"
 
 #include <memory>
@@ -36,6 +38,8 @@ using android::emulation::AdbHostListener;
 using android::emulation::AdbHostServer;
 using android::AndroidPipe;
 
+static constexpr uint32_t kAdbStatsReportIntervalMs = 5 * 60 * 1000;
+
 // Global variables used here.
 struct Globals {
     Globals() : hostListener(AdbHostServer::getClientPort()) {}
@@ -46,6 +50,26 @@ struct Globals {
         hostListener.setGuestAgent(adbGuestPipeService);
         AndroidPipe::Service::add(adbGuestPipeService);
 
+        android::metrics::PeriodicReporter::get().addTask(
+                kAdbStatsReportIntervalMs,
+                [](android_studio::AndroidStudioEvent* event) {
+                    const AdbGuestPipe::Stats stats = AdbGuestPipe::stats();
+                    if (!stats.guestToHostBytes && !stats.hostToGuestBytes) {
+                        return false;
+                    }
+                    auto proto = event->mutable_emulator_performance_stats()
+                                         ->mutable_adb_pipe();
+                    proto->set_guest_to_host_bytes(stats.guestToHostBytes);
+                    proto->set_host_to_guest_bytes(stats.hostToGuestBytes);
+                    proto->set_guest_to_host_transfers(
+                            stats.guestToHostTransfers);
+                    proto->set_host_to_guest_transfers(
+                            stats.hostToGuestTransfers);
+                    proto->set_guest_to_host_wakeups(stats.guestToHostWakeups);
+                    proto->set_host_to_guest_wakeups(stats.hostToGuestWakeups);
+                    return true;
+                });
+
         // Register adb-debug pipe service.
         android::base::Stream* debugStream = nullptr;
         if (VERBOSE_CHECK(adb)) {
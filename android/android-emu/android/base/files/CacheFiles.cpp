@@ -0,0 +1,81 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/files/CacheFiles.h"
+
+#include "android/base/misc/StringUtils.h"
+#include "android/base/StringFormat.h"
+#include "android/base/system/System.h"
+#include "android/utils/file_io.h"
+#include "android/utils/path.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include <stdio.h>
+
+namespace android {
+namespace base {
+
+bool publishCacheFile(const std::string& path,
+                      const std::function<bool(const char* tempPath)>& fill) {
+    static std::atomic<unsigned> sTempFileCount = {0};
+
+    // Each writer, in this process or another one, gets its own file.
+    const std::string tempPath =
+            StringFormat("%s.%d.%u.tmp", path,
+                         (int)System::get()->getCurrentProcessId(),
+                         sTempFileCount++);
+    const bool filled = fill(tempPath.c_str());
+    if (filled && ::rename(tempPath.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+    android_unlink(tempPath.c_str());
+    // On Windows, rename() fails if the entry already exists, which means
+    // another writer just stored it.
+    return path_exists(path.c_str());
+}
+
+void pruneCacheDir(StringView dirPath,
+                   StringView suffix,
+                   size_t maxCount,
+                   size_t keepCount,
+                   StringView keepPath) {
+    const auto system = System::get();
+    std::vector<std::pair<System::Duration, std::string>> entries;
+    for (auto& path : system->scanDirEntries(dirPath, true)) {
+        if (!endsWith(path, suffix)) {
+            continue;
+        }
+        const auto mtime = system->pathModificationTime(path);
+        entries.emplace_back(mtime ? *mtime : 0, std::move(path));
+    }
+    if (entries.size() <= maxCount) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end());
+    size_t excess = entries.size() - std::min(keepCount, maxCount);
+    for (const auto& entry : entries) {
+        if (excess == 0) {
+            break;
+        }
+        if (entry.second == keepPath) {
+            continue;
+        }
+        system->deleteFile(entry.second);
+        --excess;
+    }
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,45 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/StringView.h"
+
+#include <functional>
+#include <string>
+
+#include <stddef.h>
+
+// Helpers for on-disk caches that keep one file per entry in a directory,
+// shared by the threads of an emulator and by other emulator instances.
+
+namespace android {
+namespace base {
+
+// Stores a new cache entry at |path|. |fill| is called with the path of
+// a temporary file next to |path|, and must write the whole entry into it.
+// That file is then renamed to |path|, so readers only ever see complete
+// entries, even when several writers store the same entry at once.
+// Returns true if |path| holds a complete entry on return.
+bool publishCacheFile(const std::string& path,
+                      const std::function<bool(const char* tempPath)>& fill);
+
+// If |dirPath| contains more than |maxCount| files whose name ends with
+// |suffix|, deletes the least recently modified ones until only
+// |keepCount| are left. |keepPath|, if any, is never deleted.
+void pruneCacheDir(StringView dirPath,
+                   StringView suffix,
+                   size_t maxCount,
+                   size_t keepCount,
+                   StringView keepPath = StringView());
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,99 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/files/CacheFiles.h"
+
+#include "android/base/files/PathUtils.h"
+#include "android/base/misc/FileUtils.h"
+#include "android/base/testing/TestTempDir.h"
+#include "android/utils/path.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+namespace android {
+namespace base {
+
+static bool writeFile(const char* path, const char* contents) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const bool ok = fputs(contents, file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+TEST(CacheFiles, publish) {
+    TestTempDir dir("cachefiles");
+    const std::string path = PathUtils::join(dir.pathString(), "entry.bin");
+
+    std::string tempPath;
+    EXPECT_TRUE(publishCacheFile(path, [&tempPath](const char* temp) {
+        tempPath = temp;
+        return writeFile(temp, "first");
+    }));
+    EXPECT_NE(path, tempPath);
+    EXPECT_FALSE(path_exists(tempPath.c_str()));
+    EXPECT_EQ(std::string("first"), *readFileIntoString(path));
+
+    // A failed fill leaves the existing entry alone, and no temporary file.
+    EXPECT_TRUE(publishCacheFile(path, [&tempPath](const char* temp) {
+        tempPath = temp;
+        writeFile(temp, "partial");
+        return false;
+    }));
+    EXPECT_FALSE(path_exists(tempPath.c_str()));
+    EXPECT_EQ(std::string("first"), *readFileIntoString(path));
+
+    // Each call gets its own temporary file.
+    std::string otherTempPath;
+    publishCacheFile(path, [&otherTempPath](const char* temp) {
+        otherTempPath = temp;
+        return false;
+    });
+    EXPECT_NE(tempPath, otherTempPath);
+
+    const std::string missing = PathUtils::join(dir.pathString(), "missing");
+    EXPECT_FALSE(publishCacheFile(
+            missing, [](const char* temp) { return false; }));
+    EXPECT_FALSE(path_exists(missing.c_str()));
+}
+
+TEST(CacheFiles, prune) {
+    TestTempDir dir("cachefiles");
+    // Created in order, so that the modification times (or the names, if
+    // they're the same) sort from the oldest to the newest.
+    const char* const names[] = {"a.bin", "b.bin", "c.bin", "d.bin", "e.bin"};
+    for (const char* name : names) {
+        ASSERT_TRUE(dir.makeSubFile(name));
+    }
+    ASSERT_TRUE(dir.makeSubFile("other.txt"));
+
+    // Nothing to do up to |maxCount| entries.
+    pruneCacheDir(dir.pathString(), ".bin", 5, 2);
+    for (const char* name : names) {
+        EXPECT_TRUE(path_exists(dir.makeSubPath(name).c_str())) << name;
+    }
+
+    // The oldest ones go first, but never |keepPath|.
+    const std::string keepPath = PathUtils::join(dir.pathString(), "a.bin");
+    pruneCacheDir(dir.pathString(), ".bin", 4, 2, keepPath);
+    EXPECT_TRUE(path_exists(dir.makeSubPath("a.bin").c_str()));
+    EXPECT_FALSE(path_exists(dir.makeSubPath("b.bin").c_str()));
+    EXPECT_FALSE(path_exists(dir.makeSubPath("c.bin").c_str()));
+    EXPECT_FALSE(path_exists(dir.makeSubPath("d.bin").c_str()));
+    EXPECT_TRUE(path_exists(dir.makeSubPath("e.bin").c_str()));
+    EXPECT_TRUE(path_exists(dir.makeSubPath("other.txt").c_str()));
+}
+
+}  // namespace base
+}  // namespace android
@@ -21,6 +21,7 @@
 #include "android/base/sockets/Winsock.h"
 #else
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <unistd.h>
 #  include <fcntl.h>
 #  include <netdb.h>
@@ -28,6 +29,7 @@
 #  include <netinet/tcp.h>
 #endif
 
+#include <algorithm>
 #include <vector>
 
 #include <stdlib.h>
@@ -456,24 +458,90 @@ ssize_t socketRecv(int socket, void* buffer, size_t bufferLen) {
     return ret;
 }
 
-ssize_t socketSend(int socket, const void* buffer, size_t bufferLen) {
-    errno = 0;
 #ifdef MSG_NOSIGNAL
-    // Prevent SIGPIPE generation on Linux when writing to a broken pipe.
-    // ::send() will return -1/EPIPE instead.
-    const int sendFlags = MSG_NOSIGNAL;
+// Prevent SIGPIPE generation on Linux when writing to a broken pipe.
+// ::send() will return -1/EPIPE instead.
+static const int kSendFlags = MSG_NOSIGNAL;
 #else
-    // For Darwin, this is handled by setting SO_NOSIGPIPE when creating
-    // the socket. On Windows, there is no SIGPIPE signal to consider.
-    const int sendFlags = 0;
+// For Darwin, this is handled by setting SO_NOSIGPIPE when creating
+// the socket. On Windows, there is no SIGPIPE signal to consider.
+static const int kSendFlags = 0;
 #endif
+
+ssize_t socketSend(int socket, const void* buffer, size_t bufferLen) {
+    errno = 0;
     ssize_t ret = ::send(socket,
                          reinterpret_cast<const char*>(buffer),
-                         bufferLen, sendFlags);
+                         bufferLen, kSendFlags);
     ON_SOCKET_ERROR_RETURN_M1(ret);
     return ret;
 }
 
+#ifdef _WIN32
+static int toWsaBuffers(const SocketBuffer* buffers, int count, WSABUF* out) {
+    count = std::min(count, kSocketMaxBuffers);
+    for (int n = 0; n < count; ++n) {
+        out[n].buf = static_cast<CHAR*>(buffers[n].data);
+        out[n].len = static_cast<ULONG>(buffers[n].size);
+    }
+    return count;
+}
+
+ssize_t socketSendV(int socket, const SocketBuffer* buffers, int count) {
+    WSABUF wsaBuffers[kSocketMaxBuffers];
+    DWORD sent = 0;
+    errno = 0;
+    int ret = ::WSASend(socket, wsaBuffers,
+                        toWsaBuffers(buffers, count, wsaBuffers), &sent, 0,
+                        nullptr, nullptr);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return static_cast<ssize_t>(sent);
+}
+
+ssize_t socketRecvV(int socket, const SocketBuffer* buffers, int count) {
+    WSABUF wsaBuffers[kSocketMaxBuffers];
+    DWORD received = 0;
+    DWORD flags = 0;
+    errno = 0;
+    int ret = ::WSARecv(socket, wsaBuffers,
+                        toWsaBuffers(buffers, count, wsaBuffers), &received,
+                        &flags, nullptr, nullptr);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return static_cast<ssize_t>(received);
+}
+#else  // !_WIN32
+static int toIovecs(const SocketBuffer* buffers, int count, struct iovec* out) {
+    count = std::min(count, kSocketMaxBuffers);
+    for (int n = 0; n < count; ++n) {
+        out[n].iov_base = buffers[n].data;
+        out[n].iov_len = buffers[n].size;
+    }
+    return count;
+}
+
+ssize_t socketSendV(int socket, const SocketBuffer* buffers, int count) {
+    struct iovec iov[kSocketMaxBuffers];
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = toIovecs(buffers, count, iov);
+    errno = 0;
+    ssize_t ret = ::sendmsg(socket, &msg, kSendFlags);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return ret;
+}
+
+ssize_t socketRecvV(int socket, const SocketBuffer* buffers, int count) {
+    struct iovec iov[kSocketMaxBuffers];
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = toIovecs(buffers, count, iov);
+    errno = 0;
+    ssize_t ret = ::recvmsg(socket, &msg, 0);
+    ON_SOCKET_ERROR_RETURN_M1(ret);
+    return ret;
+}
+#endif  // !_WIN32
+
 bool socketSendAll(int socket, const void* buffer, size_t bufferLen) {
     auto buf = static_cast<const char*>(buffer);
     while (bufferLen > 0) {
@@ -33,6 +33,23 @@ ssize_t socketRecv(int socket, void* buffer, size_t bufferLen);
 // writing to a broken pipe (but errno will be set to EPIPE).
 ssize_t socketSend(int socket, const void* buffer, size_t bufferLen);
 
+// A buffer descriptor for socketSendV() and socketRecvV().
+struct SocketBuffer {
+    void* data;
+    size_t size;
+};
+
+// Maximum number of buffers transferred by a single socketSendV() or
+// socketRecvV() call. Extra buffers are simply ignored.
+constexpr int kSocketMaxBuffers = 64;
+
+// Scatter/gather versions of socketSend() and socketRecv(), transferring
+// data from/to up to kSocketMaxBuffers |buffers| with a single system call.
+// Return values and error handling are the same as the single buffer
+// versions.
+ssize_t socketSendV(int socket, const SocketBuffer* buffers, int count);
+ssize_t socketRecvV(int socket, const SocketBuffer* buffers, int count);
+
 // Same as socketSend() but loop around transient writes.
 // Returns true if all bytes were sent, false otherwise.
 bool socketSendAll(int socket, const void* buffer, size_t bufferLen);
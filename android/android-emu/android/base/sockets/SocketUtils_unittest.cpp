@@ -62,6 +62,29 @@ TEST(SocketUtils, socketRecvAll) {
     socketClose(sock[0]);
 }
 
+TEST(SocketUtils, socketSendVRecvV) {
+    char kHello[] = "Hello ";
+    char kWorld[] = "World!";
+    const SocketBuffer sendBuffers[] = {
+            {kHello, sizeof(kHello) - 1U}, {kWorld, sizeof(kWorld) - 1U}};
+
+    int sock[2];
+    ASSERT_EQ(0, socketCreatePair(&sock[0], &sock[1]));
+
+    EXPECT_EQ(12, socketSendV(sock[0], sendBuffers, 2));
+
+    char first[5] = {};
+    char second[7] = {};
+    const SocketBuffer recvBuffers[] = {{first, sizeof(first)},
+                                        {second, sizeof(second)}};
+    EXPECT_EQ(12, socketRecvV(sock[1], recvBuffers, 2));
+    EXPECT_EQ(0, memcmp("Hello", first, 5));
+    EXPECT_EQ(0, memcmp(" World!", second, 7));
+
+    socketClose(sock[1]);
+    socketClose(sock[0]);
+}
+
 TEST(SocketUtils, socketGetPort) {
     ScopedSocket s0;
     // Find a free TCP IPv4 port and bind to it.
@@ -34,6 +34,7 @@
 #include "android/network/control.h"
 #include "android/network/constants.h"
 #include "android/network/globals.h"
+#include "android/opengles.h"
 #include "android/shaper.h"
 #include "android/tcpdump.h"
 #include "android/telephony/modem_driver.h"
@@ -52,6 +53,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -2816,6 +2818,92 @@ static int do_rotate_90_clockwise(ControlClient client, char* args) {
     return (int)client->global->emu_agent->rotate90Clockwise();
 }
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                              G P U   C O M M A N D S                            ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static void
+write_gpu_latency( ControlClient  client, const char*  name,
+                   const emugl::LatencyHistogram&  latency )
+{
+    control_write( client, "  %-16s %" PRIu64 ", p50 %" PRIu64 " us, "
+                   "p99 %" PRIu64 " us, max %" PRIu64 " us\r\n",
+                   name, latency.count, latency.percentileUs(50),
+                   latency.percentileUs(99), latency.maxUs );
+}
+
+static int
+do_gpu_stats( ControlClient  client, char*  args )
+{
+    const emugl::RendererPtr& renderer = android_getOpenglesRenderer();
+    if (!renderer) {
+        control_write( client, "KO: GPU emulation is not running\r\n" );
+        return -1;
+    }
+
+    if (args) {
+        if (!strcmp(args, "on") || !strcmp(args, "off")) {
+            renderer->setStatsEnabled(!strcmp(args, "on"));
+            return 0;
+        }
+        control_write( client, "KO: bad argument, try 'gpu stats [on|off]'\r\n" );
+        return -1;
+    }
+
+    const emugl::RendererStats stats = renderer->getStats();
+    if (!stats.enabled) {
+        control_write( client, "GPU statistics are off, "
+                       "use 'gpu stats on' to collect them\r\n" );
+    }
+    control_write( client, "  decoded          %" PRIu64 " bytes, %" PRIu64
+                   " GLESv1, %" PRIu64 " GLESv2, %" PRIu64
+                   " renderControl commands\r\n",
+                   stats.bytesDecoded, stats.gles1Commands,
+                   stats.gles2Commands, stats.renderControlCommands );
+    control_write( client, "  color buffers    %" PRIu64 " uploads (%" PRIu64
+                   " bytes), %" PRIu64 " readbacks (%" PRIu64 " bytes)\r\n",
+                   stats.colorBufferUploads, stats.colorBufferUploadBytes,
+                   stats.colorBufferReadbacks, stats.colorBufferReadbackBytes );
+    control_write( client, "  posts            %" PRIu64 ", %" PRIu64
+                   " dropped, post to present avg %" PRIu64 " us, max %"
+                   PRIu64 " us\r\n",
+                   stats.posts, stats.droppedPosts, stats.postLatencyAvgUs,
+                   stats.postLatencyMaxUs );
+    control_write( client, "  fence waits      %" PRIu64 ", avg %" PRIu64
+                   " us, max %" PRIu64 " us, %u pending (max %u)\r\n",
+                   stats.fenceWaits, stats.fenceWaitAvgUs,
+                   stats.fenceWaitMaxUs, stats.fenceQueueDepth,
+                   stats.fenceQueueDepthMax );
+    write_gpu_latency( client, "sync waits", stats.syncWaitLatency );
+    write_gpu_latency( client, "decode passes", stats.decodeLatency );
+
+    for (const auto& thread : stats.renderThreads) {
+        control_write( client, "  render thread %" PRIu64 ": %" PRIu64
+                       " bytes, %" PRIu64 " commands\r\n",
+                       thread.id, thread.bytesDecoded, thread.commands );
+        write_gpu_latency( client, "  sync waits", thread.syncWaitLatency );
+        write_gpu_latency( client, "  decode passes", thread.decodeLatency );
+    }
+    return 0;
+}
+
+static const CommandDefRec  gpu_commands[] =
+{
+    { "stats", "show or collect GPU emulation statistics",
+    "'gpu stats' shows what the GPU emulation did since its statistics were turned on:\r\n"
+    "guest commands decoded, color buffer transfers, posted frames and sync waits,\r\n"
+    "with latencies over all render threads and per render thread\r\n"
+    "'gpu stats on' and 'gpu stats off' turn the statistics on and off; they are off\r\n"
+    "by default unless ANDROID_EMUGL_RENDER_STATS is set\r\n",
+    NULL, do_gpu_stats, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 /* NOTE: The names of all commands are listed when the 'help' command
  *       is received.
  *       Android Studio uses the 'help' command and requires that the
@@ -2902,6 +2990,10 @@ extern const CommandDefRec main_commands[] = {
         {"rotate", "rotate the screen clockwise by 90 degrees", NULL, NULL,
          do_rotate_90_clockwise, NULL},
 
+        {"gpu", "GPU emulation commands",
+         "allows you to query the GPU emulation statistics\r\n", NULL, NULL,
+         gpu_commands},
+
         {NULL, NULL, NULL, NULL, NULL, NULL}};
 
 }  // namespace
@@ -159,6 +159,20 @@ using android::base::Lock;
 using android::base::ScopedSocketWatch;
 using android::base::StringView;
 
+AdbGuestPipe::AtomicStats AdbGuestPipe::sStats;
+
+// static
+AdbGuestPipe::Stats AdbGuestPipe::stats() {
+    Stats result;
+    result.guestToHostBytes = sStats.guestToHostBytes;
+    result.hostToGuestBytes = sStats.hostToGuestBytes;
+    result.guestToHostTransfers = sStats.guestToHostTransfers;
+    result.hostToGuestTransfers = sStats.hostToGuestTransfers;
+    result.guestToHostWakeups = sStats.guestToHostWakeups;
+    result.hostToGuestWakeups = sStats.hostToGuestWakeups;
+    return result;
+}
+
 #if DEBUG >= 2
 static int bufferBytes(const AndroidPipeBuffer* buffers, int count) {
     int result = 0;
@@ -393,65 +407,68 @@ void AdbGuestPipe::onHostSocketEvent(unsigned events) {
     if ((events & FdWatch::kEventRead) != 0) {
         wakeFlags |= PIPE_WAKE_READ;
         mHostSocket->dontWantRead();
+        sStats.hostToGuestWakeups++;
     }
     if ((events & FdWatch::kEventWrite) != 0) {
         wakeFlags |= PIPE_WAKE_WRITE;
         mHostSocket->dontWantWrite();
+        sStats.guestToHostWakeups++;
     }
     if (wakeFlags) {
         signalWake(wakeFlags);
     }
 }
 
+// Fill |out| with descriptors for the non-empty ones of the |numBuffers|
+// pipe |buffers|, and return their count. 0 means there is nothing to
+// transfer, which must not be mistaken for the end of the stream.
+static int toSocketBuffers(const AndroidPipeBuffer* buffers,
+                           int numBuffers,
+                           android::base::SocketBuffer* out) {
+    int count = 0;
+    for (int n = 0; n < numBuffers && count < android::base::kSocketMaxBuffers;
+         ++n) {
+        if (buffers[n].size) {
+            out[count].data = buffers[n].data;
+            out[count].size = buffers[n].size;
+            ++count;
+        }
+    }
+    return count;
+}
+
 int AdbGuestPipe::onGuestRecvData(AndroidPipeBuffer* buffers, int numBuffers) {
     DD("%s: [%p] numBuffers=%d bytes=%d", __func__, this, numBuffers,
         bufferBytes(buffers, numBuffers));
     CHECK(mState == State::ProxyingData);
-    int result = 0;
-    while (numBuffers > 0) {
-        uint8_t* data = buffers[0].data;
-        size_t dataSize = buffers[0].size;
-        DD("%s: [%p] dataSize=%d", __func__, this, (int)dataSize);
-        while (dataSize > 0) {
-            ssize_t len;
-            {
-                ScopedVmUnlock unlockBql;
-                len = android::base::socketRecv(mHostSocket->fd(),
-                                                data, dataSize);
-            }
-            if (len > 0) {
-                data += len;
-                dataSize -= len;
-                result += static_cast<int>(len);
-                if (dataSize != 0) {
-                    return result; // got less than requested -> no more data.
-                } else {
-                    break;
-                }
-            }
-            if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                if (result == 0) {
-                    mHostSocket->dontWantRead();
-                    return PIPE_ERROR_AGAIN;
-                }
-            } else {
-                // End of stream or i/o error means the guest has closed
-                // the connection.
-                if (result == 0) {
-                    mHostSocket.reset();
-                    mState = State::ClosedByHost;
-                    DINIT("%s: [%p] Adb closed by host",__func__, this);
-                    return PIPE_ERROR_IO;
-                }
-            }
-            // Some data was received so report it, the guest will have
-            // to try again to get an error.
-            return result;
-        }
-        buffers++;
-        numBuffers--;
+    // Read into all guest buffers at once: this is a single system call and
+    // a single VM lock round-trip, however many pages the guest provided.
+    android::base::SocketBuffer socketBuffers[android::base::kSocketMaxBuffers];
+    const int count = toSocketBuffers(buffers, numBuffers, socketBuffers);
+    if (!count) {
+        return 0;
     }
-    return result;
+    ssize_t len;
+    {
+        ScopedVmUnlock unlockBql;
+        len = android::base::socketRecvV(mHostSocket->fd(), socketBuffers,
+                                         count);
+    }
+    if (len > 0) {
+        sStats.hostToGuestBytes += len;
+        sStats.hostToGuestTransfers++;
+        return static_cast<int>(len);
+    }
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        mHostSocket->dontWantRead();
+        return PIPE_ERROR_AGAIN;
+    }
+    // End of stream or i/o error means the guest has closed
+    // the connection.
+    mHostSocket.reset();
+    mState = State::ClosedByHost;
+    DINIT("%s: [%p] Adb closed by host",__func__, this);
+    return PIPE_ERROR_IO;
 }
 
 int AdbGuestPipe::onGuestSendData(const AndroidPipeBuffer* buffers,
@@ -459,50 +476,32 @@ int AdbGuestPipe::onGuestSendData(const AndroidPipeBuffer* buffers,
     DD("%s: [%p] numBuffers=%d bytes=%d", __func__, this, numBuffers,
         bufferBytes(buffers, numBuffers));
     CHECK(mState == State::ProxyingData);
-    int result = 0;
-    while (numBuffers > 0) {
-        const uint8_t* data = buffers[0].data;
-        size_t dataSize = buffers[0].size;
-        while (dataSize > 0) {
-            ssize_t len;
-            {
-                ScopedVmUnlock unlockBql;
-                len = android::base::socketSend(mHostSocket->fd(),
-                                                data, dataSize);
-            }
-            if (len > 0) {
-                data += len;
-                dataSize -= len;
-                result += static_cast<int>(len);
-                if (dataSize != 0) {
-                    return result; // sent less than requested -> no more room.
-                } else {
-                    break;
-                }
-            }
-            if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                if (result == 0) {
-                    mHostSocket->dontWantWrite();
-                    return PIPE_ERROR_AGAIN;
-                }
-            } else {
-                // End of stream or i/o error means the guest has closed
-                // the connection.
-                if (result == 0) {
-                    mHostSocket.reset();
-                    mState = State::ClosedByHost;
-                    DINIT("%s: [%p] Adb closed by host",__func__, this);
-                    return PIPE_ERROR_IO;
-                }
-            }
-            // Some data was received so report it, the guest will have
-            // to try again to get an error.
-            return result;
-        }
-        buffers++;
-        numBuffers--;
+    android::base::SocketBuffer socketBuffers[android::base::kSocketMaxBuffers];
+    const int count = toSocketBuffers(buffers, numBuffers, socketBuffers);
+    if (!count) {
+        return 0;
     }
-    return result;
+    ssize_t len;
+    {
+        ScopedVmUnlock unlockBql;
+        len = android::base::socketSendV(mHostSocket->fd(), socketBuffers,
+                                         count);
+    }
+    if (len > 0) {
+        sStats.guestToHostBytes += len;
+        sStats.guestToHostTransfers++;
+        return static_cast<int>(len);
+    }
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        mHostSocket->dontWantWrite();
+        return PIPE_ERROR_AGAIN;
+    }
+    // End of stream or i/o error means the guest has closed
+    // the connection.
+    mHostSocket.reset();
+    mState = State::ClosedByHost;
+    DINIT("%s: [%p] Adb closed by host",__func__, this);
+    return PIPE_ERROR_IO;
 }
 
 int AdbGuestPipe::onGuestRecvReply(AndroidPipeBuffer* buffers, int numBuffers) {
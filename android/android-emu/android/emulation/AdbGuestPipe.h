@@ -19,8 +19,11 @@
 #include "android/featurecontrol/feature_control.h"
 #include "android/featurecontrol/FeatureControl.h"
 
+#include <atomic>
 #include <vector>
 
+#include <stdint.h>
+
 namespace android {
 namespace emulation {
 
@@ -139,6 +142,21 @@ public:
 
     void resetConnection();
 
+    // Data transfer counters for all adb pipes since the emulator started,
+    // per direction. A transfer is a single socket read or write, and a
+    // wakeup is the host socket becoming readable (host to guest) or
+    // writable (guest to host) after the guest had to wait for it.
+    struct Stats {
+        uint64_t guestToHostBytes = 0;
+        uint64_t hostToGuestBytes = 0;
+        uint64_t guestToHostTransfers = 0;
+        uint64_t hostToGuestTransfers = 0;
+        uint64_t guestToHostWakeups = 0;
+        uint64_t hostToGuestWakeups = 0;
+    };
+
+    static Stats stats();
+
 private:
     AdbGuestPipe(void* mHwPipe, Service* service, AdbHostAgent* hostAgent)
         : AndroidPipe(mHwPipe, service), mHostAgent(hostAgent) {
@@ -192,6 +210,17 @@ private:
     // whether one already occured or not.
     void waitForHostConnection();
 
+    // Pipes are serviced from several vCPU threads.
+    struct AtomicStats {
+        std::atomic<uint64_t> guestToHostBytes{0};
+        std::atomic<uint64_t> hostToGuestBytes{0};
+        std::atomic<uint64_t> guestToHostTransfers{0};
+        std::atomic<uint64_t> hostToGuestTransfers{0};
+        std::atomic<uint64_t> guestToHostWakeups{0};
+        std::atomic<uint64_t> hostToGuestWakeups{0};
+    };
+    static AtomicStats sStats;
+
     // Command/reply buffer and cursor.
     char mBuffer[16];        // the command being accepted or reply being sent.
     size_t mBufferSize = 0;  // size of valid bytes in mBuffer.
@@ -0,0 +1,205 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A benchmark for bulk transfers through AdbGuestPipe, e.g. 'adb push' or
+// 'adb pull'. The guest adbd is emulated with TestAndroidPipeDevice, handing
+// the pipe |range_x| page-sized buffers per transfer like the goldfish pipe
+// device does, and the host adb server with a thread on the other end of a
+// socket pair.
+
+#include "android/emulation/AdbGuestPipe.h"
+
+#include "android/base/Log.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+#include "android/base/sockets/SocketWaiter.h"
+#include "android/base/StringFormat.h"
+#include "android/emulation/android_pipe_device.h"
+#include "android/emulation/testing/TestAndroidPipeDevice.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using android::AndroidPipe;
+using android::TestAndroidPipeDevice;
+using android::base::ScopedSocket;
+using android::base::SocketWaiter;
+using android::emulation::AdbGuestAgent;
+using android::emulation::AdbGuestPipe;
+using android::emulation::AdbHostAgent;
+
+using TestGuest = TestAndroidPipeDevice::Guest;
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kTransferSize = 16 * 1024 * 1024;
+constexpr size_t kHostChunkSize = 64 * 1024;
+
+class FakeAdbHostAgent : public AdbHostAgent {
+public:
+    void startListening() override {}
+    void stopListening() override {}
+    void notifyServer() override {}
+};
+
+// A connected adb pipe, with |hostSocket| playing the adb server side.
+class AdbConnection {
+public:
+    AdbConnection() {
+        auto service = new AdbGuestPipe::Service(&mHostAgent);
+        AndroidPipe::Service::add(service);
+
+        mGuest.reset(TestGuest::create());
+        CHECK(mGuest->connect("qemud:adb") == 0);
+        CHECK(mGuest->write("accept", 6) == 6);
+
+        int hostSocket, pipeSocket;
+        CHECK(android::base::socketCreatePair(&hostSocket, &pipeSocket) == 0);
+        android::base::socketSetBlocking(hostSocket);
+        mHostSocket.reset(hostSocket);
+        mPipeSocket = pipeSocket;
+        service->onHostConnection(ScopedSocket(pipeSocket));
+
+        char reply[2];
+        CHECK(mGuest->read(reply, 2) == 2);
+        CHECK(mGuest->write("start", 5) == 5);
+
+        mWaiter.reset(SocketWaiter::create());
+    }
+
+    ~AdbConnection() { mGuest->close(); }
+
+    int hostSocket() const { return mHostSocket.get(); }
+
+    // Transfer data between the guest and the host with |buffers|, waiting
+    // for the host socket when it would block, like a vCPU waiting for the
+    // pipe's wake interrupt.
+    int guestTransfer(std::vector<AndroidPipeBuffer>& buffers, bool recv) {
+        for (;;) {
+            const int ret =
+                    recv ? android_pipe_guest_recv(mGuest->getPipe(),
+                                                   buffers.data(),
+                                                   buffers.size())
+                         : android_pipe_guest_send(mGuest->getPipe(),
+                                                   buffers.data(),
+                                                   buffers.size());
+            if (ret != PIPE_ERROR_AGAIN) {
+                return ret;
+            }
+            mWaiter->update(mPipeSocket, recv ? SocketWaiter::kEventRead
+                                              : SocketWaiter::kEventWrite);
+            mWaiter->wait(100);
+        }
+    }
+
+private:
+    TestAndroidPipeDevice mDevice;
+    FakeAdbHostAgent mHostAgent;
+    std::unique_ptr<TestGuest> mGuest;
+    ScopedSocket mHostSocket;
+    int mPipeSocket = -1;
+    std::unique_ptr<SocketWaiter> mWaiter;
+};
+
+std::vector<AndroidPipeBuffer> makeGuestBuffers(std::vector<uint8_t>* storage,
+                                                int count) {
+    storage->resize(count * kPageSize);
+    std::vector<AndroidPipeBuffer> buffers(count);
+    for (int n = 0; n < count; ++n) {
+        buffers[n].data = storage->data() + n * kPageSize;
+        buffers[n].size = kPageSize;
+    }
+    return buffers;
+}
+
+void setTransferLabel(benchmark::State& state,
+                      const AdbGuestPipe::Stats& before,
+                      bool recv) {
+    const auto after = AdbGuestPipe::stats();
+    const uint64_t bytes = recv
+            ? after.hostToGuestBytes - before.hostToGuestBytes
+            : after.guestToHostBytes - before.guestToHostBytes;
+    const uint64_t transfers =
+            recv ? after.hostToGuestTransfers - before.hostToGuestTransfers
+                 : after.guestToHostTransfers - before.guestToHostTransfers;
+    if (transfers) {
+        state.SetLabel(android::base::StringFormat(
+                "%.0f bytes/transfer", double(bytes) / transfers));
+    }
+}
+
+// Host to guest, i.e. 'adb pull'.
+void BM_AdbGuestPipeHostToGuest(benchmark::State& state) {
+    AdbConnection connection;
+    std::vector<uint8_t> storage;
+    auto buffers = makeGuestBuffers(&storage, state.range_x());
+    const auto before = AdbGuestPipe::stats();
+
+    while (state.KeepRunning()) {
+        std::thread host([&connection] {
+            std::vector<uint8_t> chunk(kHostChunkSize, 0x55);
+            for (size_t sent = 0; sent < kTransferSize;
+                 sent += chunk.size()) {
+                android::base::socketSendAll(connection.hostSocket(),
+                                             chunk.data(), chunk.size());
+            }
+        });
+        size_t received = 0;
+        while (received < kTransferSize) {
+            const int ret = connection.guestTransfer(buffers, true);
+            CHECK(ret > 0);
+            received += ret;
+        }
+        host.join();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * kTransferSize);
+    setTransferLabel(state, before, true);
+}
+
+// Guest to host, i.e. 'adb push' and 'adb install'.
+void BM_AdbGuestPipeGuestToHost(benchmark::State& state) {
+    AdbConnection connection;
+    std::vector<uint8_t> storage;
+    auto buffers = makeGuestBuffers(&storage, state.range_x());
+    const auto before = AdbGuestPipe::stats();
+
+    while (state.KeepRunning()) {
+        std::thread host([&connection] {
+            std::vector<uint8_t> chunk(kHostChunkSize);
+            for (size_t received = 0; received < kTransferSize;) {
+                const ssize_t ret = android::base::socketRecv(
+                        connection.hostSocket(), chunk.data(), chunk.size());
+                CHECK(ret > 0);
+                received += ret;
+            }
+        });
+        size_t sent = 0;
+        while (sent < kTransferSize) {
+            const int ret = connection.guestTransfer(buffers, false);
+            CHECK(ret > 0);
+            sent += ret;
+        }
+        host.join();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * kTransferSize);
+    setTransferLabel(state, before, false);
+}
+
+}  // namespace
+
+BENCHMARK(BM_AdbGuestPipeHostToGuest)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+BENCHMARK(BM_AdbGuestPipeGuestToHost)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+
+BENCHMARK_MAIN()
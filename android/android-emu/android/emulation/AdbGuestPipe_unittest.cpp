@@ -148,11 +148,12 @@ private:
 // slices for the ConnectorThread to write properly.
 int blockingRead(TestGuest* guest, void* buffer, size_t size) {
     int ret = guest->read(buffer, size);
-    if (ret != PIPE_ERROR_AGAIN) {
-        return ret;
+    // The data is sent from another thread: give it up to a second.
+    for (int n = 0; ret == PIPE_ERROR_AGAIN && n < 500; ++n) {
+        android::base::ThreadLooper::get()->runWithTimeoutMs(2);
+        ret = guest->read(buffer, size);
     }
-    android::base::ThreadLooper::get()->runWithTimeoutMs(2);
-    return guest->read(buffer, size);
+    return ret;
 }
 
 }  // namespace
@@ -192,6 +193,35 @@ TEST(AdbGuestPipe, createOneGuest) {
     EXPECT_EQ(1, guest->write("x", 1));
 }
 
+TEST(AdbGuestPipe, zeroLengthTransfers) {
+    TestAndroidPipeDevice testDevice;
+
+    MockAdbHostAgent adbHost;
+
+    auto guest = TestGuest::create();
+    EXPECT_TRUE(guest);
+    EXPECT_EQ(0, guest->connect("qemud:adb"));
+    EXPECT_EQ(6, guest->write("accept", 6));
+
+    static constexpr StringView kMessage = "Hello World!";
+    adbHost.createFakeConnection(kMessage);
+
+    char reply[3] = {};
+    EXPECT_EQ(2, guest->read(reply, 2));
+    EXPECT_STREQ("ok", reply);
+    EXPECT_EQ(5, guest->write("start", 5));
+
+    char buffer[kMessage.size() + 1] = {};
+    const ssize_t expectedSize = static_cast<ssize_t>(kMessage.size());
+    EXPECT_EQ(expectedSize, blockingRead(guest, buffer, kMessage.size()));
+    EXPECT_STREQ(kMessage.c_str(), buffer);
+
+    // Transfers of no bytes at all don't close the connection.
+    EXPECT_EQ(0, guest->read(buffer, 0));
+    EXPECT_EQ(0, guest->write("x", 0));
+    EXPECT_EQ(1, guest->write("x", 1));
+}
+
 TEST(AdbGuestPipe, createGuestWithBadAcceptCommand) {
     TestAndroidPipeDevice testDevice;
 
@@ -693,19 +693,28 @@ unsigned android_pipe_guest_poll(void* internalPipe) {
     return pipe->onGuestPoll();
 }
 
+bool android_pipe_guest_can_transfer_unlocked(void* internalPipe) {
+    auto pipe = static_cast<AndroidPipe*>(internalPipe);
+    return pipe->canTransferWithoutVmLock();
+}
+
 int android_pipe_guest_recv(void* internalPipe,
                             AndroidPipeBuffer* buffers,
                             int numBuffers) {
-    CHECK_VM_STATE_LOCK();
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
+    if (!pipe->canTransferWithoutVmLock()) {
+        CHECK_VM_STATE_LOCK();
+    }
     return pipe->onGuestRecv(buffers, numBuffers);
 }
 
 int android_pipe_guest_send(void* internalPipe,
                             const AndroidPipeBuffer* buffers,
                             int numBuffers) {
-    CHECK_VM_STATE_LOCK();
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
+    if (!pipe->canTransferWithoutVmLock()) {
+        CHECK_VM_STATE_LOCK();
+    }
     return pipe->onGuestSend(buffers, numBuffers);
 }
 
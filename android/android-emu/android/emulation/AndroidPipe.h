@@ -102,6 +102,15 @@ public:
         // false.
         virtual bool canLoad() const { return false; }
 
+        // Returns true if the onGuestRecv() and onGuestSend() methods of
+        // this service's pipes can be called without the VM lock held,
+        // i.e. they only touch the pipe's own state and thread-safe host
+        // objects. The guest never issues concurrent transfers on a single
+        // pipe. The virtual device can then run long or blocking transfers
+        // without stalling the other vCPUs and the main loop. The default
+        // implementation returns false.
+        virtual bool canTransferWithoutVmLock() const { return false; }
+
         // Load a pipe instance from input |stream|. Only called if
         // canLoad() returns true. Default implementation returns nullptr
         // to indicate an error loading the instance.
@@ -180,6 +189,12 @@ public:
     // this pipe.
     void abortPendingOperation();
 
+    // Returns true if onGuestRecv() and onGuestSend() can be called without
+    // the VM lock, see Service::canTransferWithoutVmLock().
+    bool canTransferWithoutVmLock() const {
+        return mService && mService->canTransferWithoutVmLock();
+    }
+
     // Return the name of the AndroidPipe service.
     const char* name() const {
         return mService ? mService->name().c_str() : "<null>";
@@ -0,0 +1,328 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Baseline latency and throughput numbers for the Android pipe services.
+// Guests are emulated with TestAndroidPipeDevice, so these measure the
+// host side of a transfer: AndroidPipe dispatch, the service itself and
+// the wake signals it sends back through PipeWaker. Benchmarks that take
+// a |range_x| use it as the transfer size in bytes, and the ones that run
+// with several threads give each thread its own pipe.
+//
+// In QEMU, vCPU threads only access the pipe device with the global VM
+// lock held. TestAndroidPipeDevice's TestVmLock only counts calls, so each
+// guest operation here takes a real mutex instead: the threads then
+// contend on it like vCPUs do, and the multi-threaded numbers show how
+// well the services scale under that lock rather than without any.
+//
+// The 'opengles' benchmark needs the host renderer libraries; when they
+// can't be loaded, it runs empty with a label saying so.
+
+#include "android/emulation/AndroidPipe.h"
+
+#include "android/base/Log.h"
+#include "android/base/async/ThreadLooper.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+#include "android/base/sockets/SocketWaiter.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/emulation/AdbGuestPipe.h"
+#include "android/emulation/VmLock.h"
+#include "android/emulation/android_pipe_device.h"
+#include "android/emulation/android_pipe_host.h"
+#include "android/emulation/android_pipe_pingpong.h"
+#include "android/emulation/android_pipe_zero.h"
+#include "android/emulation/testing/TestAndroidPipeDevice.h"
+#include "android/opengles.h"
+#include "android/opengles-pipe.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+namespace {
+
+using android::AndroidPipe;
+using android::TestAndroidPipeDevice;
+using android::VmLock;
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::ScopedSocket;
+using android::base::SocketWaiter;
+using android::base::ThreadLooper;
+using android::emulation::AdbGuestPipe;
+using android::emulation::AdbHostAgent;
+
+using TestGuest = TestAndroidPipeDevice::Guest;
+
+// Opcode of rcGetRendererVersion(), the first renderControl command, and
+// the size of a packet without parameters: opcode + total size.
+constexpr uint32_t kRcGetRendererVersion = 10000;
+constexpr uint32_t kRcPacketSize = 8;
+
+class FakeAdbHostAgent : public AdbHostAgent {
+public:
+    void startListening() override {}
+    void stopListening() override {}
+    void notifyServer() override {}
+};
+
+// The pipe device and services shared by all benchmarks. It is created by
+// the first benchmark that needs it, possibly from one of several threads,
+// and lives until the process exits.
+struct PipeBenchmarkDevice {
+    PipeBenchmarkDevice() {
+        android_pipe_add_type_zero();
+        android_pipe_add_type_pingpong();
+        adbService = new AdbGuestPipe::Service(&adbHostAgent);
+        AndroidPipe::Service::add(adbService);
+
+        int glesMajor, glesMinor;
+        hasOpengles = android_initOpenglesEmulation() == 0 &&
+                      android_startOpenglesRenderer(1080, 1920, true, 25,
+                                                    &glesMajor,
+                                                    &glesMinor) == 0;
+        if (hasOpengles) {
+            android_init_opengles_pipe();
+        }
+    }
+
+    TestAndroidPipeDevice device;
+    FakeAdbHostAgent adbHostAgent;
+    AdbGuestPipe::Service* adbService = nullptr;
+    bool hasOpengles = false;
+};
+
+LazyInstance<PipeBenchmarkDevice> sDevice = LAZY_INSTANCE_INIT;
+
+// Stands for the VM lock that guest pipe operations run under.
+LazyInstance<Lock> sGuestLock = LAZY_INSTANCE_INIT;
+
+ssize_t guestRead(TestGuest* guest, void* data, size_t size) {
+    AutoLock lock(sGuestLock.get());
+    return guest->read(data, size);
+}
+
+ssize_t guestWrite(TestGuest* guest, const void* data, size_t size) {
+    AutoLock lock(sGuestLock.get());
+    return guest->write(data, size);
+}
+
+std::unique_ptr<TestGuest> connectGuest(const char* service) {
+    sDevice.get();
+    AutoLock lock(sGuestLock.get());
+    std::unique_ptr<TestGuest> guest(TestGuest::create());
+    CHECK(guest->connect(service) == 0) << "Can't connect to " << service;
+    return guest;
+}
+
+// Read exactly |size| bytes from |guest|, retrying while the service has
+// nothing to send yet, like a guest blocked in read() would.
+void guestReadAll(TestGuest* guest, uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t ret = guestRead(guest, data, size);
+        if (ret == PIPE_ERROR_AGAIN) {
+            continue;
+        }
+        CHECK(ret > 0);
+        data += ret;
+        size -= ret;
+    }
+}
+
+// Bulk guest to host transfers, e.g. a guest streaming data to a service
+// that drops it.
+void BM_ZeroPipeWrite(benchmark::State& state) {
+    auto guest = connectGuest("zero");
+    std::vector<uint8_t> buffer(state.range_x(), 0x55);
+    while (state.KeepRunning()) {
+        CHECK(guestWrite(guest.get(), buffer.data(), buffer.size()) ==
+              ssize_t(buffer.size()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range_x());
+}
+
+// Bulk host to guest transfers.
+void BM_ZeroPipeRead(benchmark::State& state) {
+    auto guest = connectGuest("zero");
+    std::vector<uint8_t> buffer(state.range_x());
+    while (state.KeepRunning()) {
+        CHECK(guestRead(guest.get(), buffer.data(), buffer.size()) ==
+              ssize_t(buffer.size()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range_x());
+}
+
+// Round trips through a service that buffers and echoes everything. The
+// guest asks to be woken up for reading first, so each write also signals
+// a wake through PipeWaker, like it does for a guest blocked in read().
+void BM_PingPongPipeRoundTrip(benchmark::State& state) {
+    auto guest = connectGuest("pingpong");
+    std::vector<uint8_t> out(state.range_x(), 0x55);
+    std::vector<uint8_t> in(state.range_x());
+    while (state.KeepRunning()) {
+        {
+            AutoLock lock(sGuestLock.get());
+            android_pipe_guest_wake_on(guest->getPipe(), PIPE_WAKE_READ);
+        }
+        CHECK(guestWrite(guest.get(), out.data(), out.size()) ==
+              ssize_t(out.size()));
+        guestReadAll(guest.get(), in.data(), in.size());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(int64_t(state.iterations()) * 2 *
+                            state.range_x());
+}
+
+// Round trips through the adb pipe, with a thread echoing everything back
+// on the adb server side of the socket.
+void BM_AdbPipeRoundTrip(benchmark::State& state) {
+    const auto device = sDevice.ptr();
+    std::unique_ptr<TestGuest> guest(TestGuest::create());
+    CHECK(guest->connect("qemud:adb") == 0);
+    CHECK(guest->write("accept", 6) == 6);
+
+    int hostSocket, pipeSocket;
+    CHECK(android::base::socketCreatePair(&hostSocket, &pipeSocket) == 0);
+    android::base::socketSetBlocking(hostSocket);
+    ScopedSocket host(hostSocket);
+    device->adbService->onHostConnection(ScopedSocket(pipeSocket));
+
+    char reply[2];
+    CHECK(guest->read(reply, 2) == 2);
+    CHECK(guest->write("start", 5) == 5);
+
+    std::thread echo([hostSocket] {
+        char buffer[4096];
+        for (;;) {
+            const ssize_t ret =
+                    android::base::socketRecv(hostSocket, buffer,
+                                              sizeof(buffer));
+            if (ret <= 0 ||
+                !android::base::socketSendAll(hostSocket, buffer, ret)) {
+                break;
+            }
+        }
+    });
+
+    std::unique_ptr<SocketWaiter> waiter(SocketWaiter::create());
+    std::vector<uint8_t> out(state.range_x(), 0x55);
+    std::vector<uint8_t> in(state.range_x());
+    while (state.KeepRunning()) {
+        for (size_t sent = 0; sent < out.size();) {
+            const ssize_t ret = guestWrite(guest.get(), out.data() + sent,
+                                           out.size() - sent);
+            if (ret == PIPE_ERROR_AGAIN) {
+                waiter->update(pipeSocket, SocketWaiter::kEventWrite);
+                waiter->wait(100);
+                continue;
+            }
+            CHECK(ret > 0);
+            sent += ret;
+        }
+        for (size_t received = 0; received < in.size();) {
+            const ssize_t ret = guestRead(guest.get(), in.data() + received,
+                                          in.size() - received);
+            if (ret == PIPE_ERROR_AGAIN) {
+                waiter->update(pipeSocket, SocketWaiter::kEventRead);
+                waiter->wait(100);
+                continue;
+            }
+            CHECK(ret > 0);
+            received += ret;
+        }
+    }
+    guest->close();
+    echo.join();
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(int64_t(state.iterations()) * 2 *
+                            state.range_x());
+}
+
+// Round trips to a render thread with a renderControl call that returns
+// right away, i.e. the fixed cost of every synchronous GL call.
+void BM_OpenglesPipeRoundTrip(benchmark::State& state) {
+    if (!sDevice->hasOpengles) {
+        state.SetLabel("no GPU emulation");
+        while (state.KeepRunning()) {
+        }
+        return;
+    }
+    auto guest = connectGuest("opengles");
+    const uint32_t clientFlags = 0;
+    CHECK(guest->write(&clientFlags, sizeof(clientFlags)) ==
+          ssize_t(sizeof(clientFlags)));
+
+    const uint32_t packet[] = {kRcGetRendererVersion, kRcPacketSize};
+    int32_t version = 0;
+    while (state.KeepRunning()) {
+        CHECK(guestWrite(guest.get(), packet, sizeof(packet)) ==
+              ssize_t(sizeof(packet)));
+        guestReadAll(guest.get(), reinterpret_cast<uint8_t*>(&version),
+                     sizeof(version));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Wake signals sent by a service while the current thread holds the VM
+// lock, e.g. from the guest's own read() or write(): PipeWaker calls the
+// device right away.
+void BM_PipeWakeLocked(benchmark::State& state) {
+    auto guest = connectGuest("zero");
+    CHECK(VmLock::get()->isLockedBySelf());
+    while (state.KeepRunning()) {
+        android_pipe_host_signal_wake(guest.get(), PIPE_WAKE_READ);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Wake signals sent by a service thread that doesn't hold the VM lock,
+// e.g. when host data arrives: PipeWaker queues the wake and a main loop
+// timer delivers it. Each iteration covers both sides.
+void BM_PipeWakeDeferred(benchmark::State& state) {
+    auto guest = connectGuest("zero");
+    const auto looper = ThreadLooper::get();
+    VmLock* const vmLock = VmLock::get();
+
+    // Deliver deferred wakes through this thread's looper, then give the
+    // VM lock up so signals take the deferred path.
+    AndroidPipe::initThreading(vmLock);
+    vmLock->unlock();
+    while (state.KeepRunning()) {
+        android_pipe_host_signal_wake(guest.get(), PIPE_WAKE_READ);
+        looper->runWithTimeoutMs(0);
+    }
+    vmLock->lock();
+    state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_ZeroPipeWrite)
+        ->Arg(64)->Arg(4096)->Arg(65536)->Arg(1024 * 1024)
+        ->Threads(1)->Threads(4)->UseRealTime();
+BENCHMARK(BM_ZeroPipeRead)
+        ->Arg(64)->Arg(4096)->Arg(65536)->Arg(1024 * 1024)
+        ->Threads(1)->Threads(4)->UseRealTime();
+BENCHMARK(BM_PingPongPipeRoundTrip)
+        ->Arg(4)->Arg(4096)->Arg(65536)
+        ->Threads(1)->Threads(4)->UseRealTime();
+BENCHMARK(BM_AdbPipeRoundTrip)->Arg(24)->Arg(4096)->Arg(65536)->UseRealTime();
+BENCHMARK(BM_OpenglesPipeRoundTrip)->Threads(1)->Threads(4)->UseRealTime();
+BENCHMARK(BM_PipeWakeLocked);
+BENCHMARK(BM_PipeWakeDeferred);
+
+BENCHMARK_MAIN()
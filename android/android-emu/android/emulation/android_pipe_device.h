@@ -158,6 +158,10 @@ extern void* android_pipe_guest_load_legacy(Stream* file,
 // Call the poll() callback of the client associated with |pipe|.
 extern unsigned android_pipe_guest_poll(void* internal_pipe);
 
+// Returns true if android_pipe_guest_recv() and android_pipe_guest_send() can
+// be called for |pipe| from a thread that doesn't hold the VM lock.
+extern bool android_pipe_guest_can_transfer_unlocked(void* internal_pipe);
+
 // Call the recvBuffers() callback of the client associated with |pipe|.
 extern int android_pipe_guest_recv(void* internal_pipe,
                                    AndroidPipeBuffer* buffers,
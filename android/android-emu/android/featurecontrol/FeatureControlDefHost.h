@@ -32,3 +32,4 @@ FEATURE_CONTROL_ITEM(HVF)
 FEATURE_CONTROL_ITEM(KVM)
 FEATURE_CONTROL_ITEM(HAXM)
 FEATURE_CONTROL_ITEM(FastSnapshotV1)
+FEATURE_CONTROL_ITEM(IoUring)
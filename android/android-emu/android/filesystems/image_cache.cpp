@@ -0,0 +1,229 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/filesystems/image_cache.h"
+
+#include "android/base/files/CacheFiles.h"
+#include "android/base/files/PathUtils.h"
+#include "android/base/files/ScopedFd.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/StringFormat.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+#include "android/emulation/ConfigDirs.h"
+#include "android/utils/file_io.h"
+#include "android/utils/path.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#define DEBUG 0
+
+#if DEBUG
+#  define D(...)   printf(__VA_ARGS__), fflush(stdout)
+#else
+#  define D(...)   ((void)0)
+#endif
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::PathUtils;
+using android::base::ScopedFd;
+using android::base::StringFormat;
+using android::base::System;
+
+namespace {
+
+const char kEntrySuffix[] = ".raw";
+
+// Keep the entries of the last few system images around. A ramdisk
+// uncompresses to a couple of MiB, kernels to a few tens of MiB.
+const size_t kMaxEntries = 16;
+
+// Size of the inflate() output buffer used when filling an entry.
+const size_t kInflateChunkSize = 1024 * 1024;
+
+struct ImageCacheGlobals {
+    ImageCacheGlobals() {
+        dirPath = PathUtils::join(android::ConfigDirs::getUserDirectory(),
+                                  "image-cache");
+    }
+
+    Lock lock;
+    std::string dirPath;  // empty if the cache is disabled.
+};
+
+LazyInstance<ImageCacheGlobals> sGlobals = LAZY_INSTANCE_INIT;
+
+std::string cacheDirectory() {
+    AutoLock lock(sGlobals->lock);
+    return sGlobals->dirPath;
+}
+
+// Map |size| bytes of |fd| read-only, return nullptr on failure.
+const uint8_t* mapFd(int fd, size_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    return ptr == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(ptr);
+}
+
+// Map the whole file at |path|, set |*size| to its size.
+const uint8_t* mapFile(const std::string& path, size_t* size) {
+    const ScopedFd fd(android_open(path.c_str(), O_RDONLY | O_BINARY));
+    System::FileSize fileSize;
+    if (!fd.valid() || !System::get()->fileSize(fd.get(), &fileSize) ||
+        fileSize != static_cast<size_t>(fileSize)) {
+        return nullptr;
+    }
+    *size = static_cast<size_t>(fileSize);
+    return mapFd(fd.get(), *size);
+}
+
+uint32_t computeCrc32(const uint8_t* data, size_t size) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (size > 0) {
+        const uInt chunk = static_cast<uInt>(std::min<size_t>(size, 1U << 30));
+        crc = crc32(crc, data, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+    return static_cast<uint32_t>(crc);
+}
+
+// Inflate the gzip stream in |src| into the file at |dstPath|. Returns
+// true only if the whole stream could be decompressed.
+bool inflateToFile(const uint8_t* src, size_t srcSize, const char* dstPath) {
+    FILE* out = android_fopen(dstPath, "wb");
+    if (!out) {
+        return false;
+    }
+
+    z_stream stream = {};
+    // 15 bits of window, +16 to expect a gzip header and trailer.
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+        fclose(out);
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(kInflateChunkSize);
+    int result = Z_OK;
+    bool ok = true;
+    while (ok && result != Z_STREAM_END) {
+        if (stream.avail_in == 0) {
+            if (srcSize == 0) {
+                break;  // truncated stream.
+            }
+            const uInt chunk =
+                    static_cast<uInt>(std::min<size_t>(srcSize, 1U << 30));
+            stream.next_in = const_cast<Bytef*>(src);
+            stream.avail_in = chunk;
+            src += chunk;
+            srcSize -= chunk;
+        }
+        stream.next_out = buffer.data();
+        stream.avail_out = static_cast<uInt>(buffer.size());
+        result = inflate(&stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END) {
+            break;
+        }
+        const size_t produced = buffer.size() - stream.avail_out;
+        ok = fwrite(buffer.data(), 1, produced, out) == produced;
+    }
+    inflateEnd(&stream);
+
+    ok = ok && result == Z_STREAM_END && stream.total_out > 0;
+    if (fclose(out) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+}  // namespace
+
+void android_imageCacheSetDirectory(const char* dirPath) {
+    AutoLock lock(sGlobals->lock);
+    sGlobals->dirPath = dirPath ? dirPath : "";
+}
+
+bool android_imageCacheMapGzip(const char* filePath,
+                               uint64_t offset,
+                               const uint8_t** data,
+                               size_t* size) {
+    *data = nullptr;
+    *size = 0;
+
+    const std::string dirPath = cacheDirectory();
+    if (dirPath.empty()) {
+        return false;
+    }
+
+    size_t srcSize = 0;
+    const uint8_t* src = mapFile(filePath, &srcSize);
+    if (!src) {
+        return false;
+    }
+    if (offset >= srcSize) {
+        android_imageCacheUnmap(src, srcSize);
+        return false;
+    }
+
+    // Hashing the compressed file is an order of magnitude cheaper than
+    // inflating it, and catches images replaced in place.
+    const std::string entryPath = PathUtils::join(
+            dirPath, StringFormat("%08x-%llx-%llx%s", computeCrc32(src, srcSize),
+                                  (unsigned long long)srcSize,
+                                  (unsigned long long)offset, kEntrySuffix));
+
+    *data = mapFile(entryPath, size);
+    if (*data) {
+        D("Image cache hit for %s: %s\n", filePath, entryPath.c_str());
+        android_imageCacheUnmap(src, srcSize);
+        return true;
+    }
+
+    D("Image cache miss for %s, filling %s\n", filePath, entryPath.c_str());
+    bool filled = false;
+    if (path_mkdir_if_needed(dirPath.c_str(), 0755) == 0) {
+        // Several instances may fill the same entry at once.
+        filled = android::base::publishCacheFile(
+                entryPath, [src, srcSize, offset](const char* tempPath) {
+                    return inflateToFile(src + offset, srcSize - offset,
+                                         tempPath);
+                });
+    }
+    android_imageCacheUnmap(src, srcSize);
+    if (!filled) {
+        D("Could not fill image cache entry %s\n", entryPath.c_str());
+        return false;
+    }
+
+    // Keep the entry that was just filled.
+    android::base::pruneCacheDir(dirPath, kEntrySuffix, kMaxEntries,
+                                 kMaxEntries, entryPath);
+    *data = mapFile(entryPath, size);
+    return *data != nullptr;
+}
+
+void android_imageCacheUnmap(const uint8_t* data, size_t size) {
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+}
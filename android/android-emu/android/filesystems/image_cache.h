@@ -0,0 +1,47 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+ANDROID_BEGIN_HEADER
+
+// A small on-disk cache of decompressed system image content, such as the
+// cpio archive inside ramdisk.img or the payload of a compressed kernel.
+// Entries are keyed by the CRC32 and size of the compressed file, so an
+// updated system image never hits a stale entry, and several emulator
+// instances started from the same image only ever decompress it once.
+
+// Change the directory used to store cache entries. The default is the
+// 'image-cache' sub-directory of the user's Android configuration
+// directory. Passing NULL disables the cache.
+void android_imageCacheSetDirectory(const char* dirPath);
+
+// Map the decompressed content of the gzip stream that starts |offset|
+// bytes into |filePath|, decompressing it into the cache first if needed.
+// On success, return true and set |*data| and |*size| to a read-only
+// mapping that must be released with android_imageCacheUnmap(). On
+// failure, or if the cache is disabled, return false: callers should
+// then decompress the file themselves.
+bool android_imageCacheMapGzip(const char* filePath,
+                               uint64_t offset,
+                               const uint8_t** data,
+                               size_t* size);
+
+// Release a mapping returned by android_imageCacheMapGzip().
+void android_imageCacheUnmap(const uint8_t* data, size_t size);
+
+ANDROID_END_HEADER
@@ -0,0 +1,149 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/filesystems/image_cache.h"
+
+#include "android/base/files/PathUtils.h"
+#include "android/base/misc/FileUtils.h"
+#include "android/base/system/System.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string>
+#include <zlib.h>
+
+using android::base::PathUtils;
+using android::base::System;
+using android::base::TestTempDir;
+
+namespace {
+
+std::string gzipCompress(const std::string& data) {
+    z_stream stream = {};
+    EXPECT_EQ(Z_OK, deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16,
+                                 8, Z_DEFAULT_STRATEGY));
+    std::string result(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&result[0];
+    stream.avail_out = result.size();
+    EXPECT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+class ImageCacheTest : public ::testing::Test {
+protected:
+    ImageCacheTest() : mDir("image_cache") {
+        mCacheDir = mDir.makeSubPath("cache");
+        android_imageCacheSetDirectory(mCacheDir.c_str());
+    }
+
+    ~ImageCacheTest() { android_imageCacheSetDirectory(nullptr); }
+
+    std::string writeFile(const char* name, const std::string& content) {
+        const std::string path = mDir.makeSubPath(name);
+        FILE* file = fopen(path.c_str(), "wb");
+        EXPECT_TRUE(file);
+        EXPECT_EQ(content.size(),
+                  fwrite(content.data(), 1, content.size(), file));
+        fclose(file);
+        return path;
+    }
+
+    // Return the decompressed content, or "<none>" if the cache failed.
+    std::string map(const std::string& path, uint64_t offset = 0) {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        if (!android_imageCacheMapGzip(path.c_str(), offset, &data, &size)) {
+            EXPECT_FALSE(data);
+            return "<none>";
+        }
+        std::string result(reinterpret_cast<const char*>(data), size);
+        android_imageCacheUnmap(data, size);
+        return result;
+    }
+
+    size_t entryCount() const {
+        return System::get()->scanDirEntries(mCacheDir).size();
+    }
+
+    TestTempDir mDir;
+    std::string mCacheDir;
+};
+
+}  // namespace
+
+TEST_F(ImageCacheTest, MapGzip) {
+    std::string content;
+    for (int n = 0; n < 100000; ++n) {
+        content += std::to_string(n);
+    }
+    const std::string path = writeFile("ramdisk.img", gzipCompress(content));
+
+    EXPECT_EQ(content, map(path));
+    EXPECT_EQ(1U, entryCount());
+
+    // The second time around, the entry is used as-is.
+    const std::string entry = PathUtils::join(
+            mCacheDir, System::get()->scanDirEntries(mCacheDir)[0]);
+    EXPECT_EQ(content.size(), android::readFileIntoString(entry)->size());
+    EXPECT_EQ(content, map(path));
+    EXPECT_EQ(1U, entryCount());
+
+    // Changing the image creates a new entry.
+    writeFile("ramdisk.img", gzipCompress(content + "!"));
+    EXPECT_EQ(content + "!", map(path));
+    EXPECT_EQ(2U, entryCount());
+}
+
+TEST_F(ImageCacheTest, MapGzipAtOffset) {
+    const std::string content = "Linux version 4.4.0";
+    const std::string path = writeFile(
+            "kernel", "boot sector" + gzipCompress(content) + "trailing data");
+
+    EXPECT_EQ(content, map(path, 11));
+    EXPECT_EQ("<none>", map(path, 1));
+    EXPECT_EQ("<none>", map(path, 1000));
+}
+
+TEST_F(ImageCacheTest, BadImages) {
+    EXPECT_EQ("<none>", map(mDir.makeSubPath("missing")));
+    EXPECT_EQ("<none>", map(writeFile("empty", "")));
+    EXPECT_EQ("<none>", map(writeFile("plain", "not compressed")));
+
+    std::string truncated = gzipCompress(std::string(100000, 'x'));
+    truncated.resize(truncated.size() / 2);
+    EXPECT_EQ("<none>", map(writeFile("truncated", truncated)));
+
+    // Nothing is left behind by failed attempts.
+    EXPECT_EQ(0U, entryCount());
+}
+
+TEST_F(ImageCacheTest, Disabled) {
+    const std::string path = writeFile("ramdisk.img", gzipCompress("foo"));
+    android_imageCacheSetDirectory(nullptr);
+    EXPECT_EQ("<none>", map(path));
+    EXPECT_FALSE(System::get()->pathExists(mCacheDir));
+}
+
+TEST_F(ImageCacheTest, Prune) {
+    const std::string path = mDir.makeSubPath("ramdisk.img");
+    for (int n = 0; n < 20; ++n) {
+        const std::string content = "image #" + std::to_string(n);
+        writeFile("ramdisk.img", gzipCompress(content));
+        EXPECT_EQ(content, map(path));
+    }
+    EXPECT_EQ(16U, entryCount());
+}
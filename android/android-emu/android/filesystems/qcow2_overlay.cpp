@@ -0,0 +1,222 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/filesystems/qcow2_overlay.h"
+
+#include "android/base/files/ScopedStdioFile.h"
+#include "android/utils/file_io.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// The layout is the one 'qemu-img create -f qcow2 -b <backing>' produces
+// (version 3, 64 KiB clusters, 16-bit refcounts), minus the optional bits,
+// plus an extension recording the identity of the backing file:
+//
+//   cluster 0     header, extensions, backing file name
+//   cluster 1     refcount table, with a single entry
+//   cluster 2     refcount block, covering the metadata clusters
+//   cluster 3...  L1 table, all entries unallocated
+//
+// QEMU allocates L2 tables and data clusters on the first guest writes.
+const uint32_t kQcow2Magic = ('Q' << 24) | ('F' << 16) | ('I' << 8) | 0xfb;
+const uint32_t kQcow2Version = 3;
+const uint32_t kClusterBits = 16;
+const uint64_t kClusterSize = 1ULL << kClusterBits;
+const uint32_t kRefcountOrder = 4;
+const uint32_t kHeaderLength = 104;
+const uint32_t kExtBackingFormat = 0xE2792ACA;
+const char kBackingFormat[] = "raw";
+// QEMU ignores, and keeps, header extensions it doesn't know about. This
+// one holds the size and modification time (in seconds) of the backing
+// file, both as 64-bit values.
+const uint32_t kExtBackingIdentity = 0x616E6462;  // 'andb'
+const uint32_t kBackingIdentitySize = 16;
+
+const uint64_t kRefcountTableCluster = 1;
+const uint64_t kRefcountBlockCluster = 2;
+const uint64_t kL1TableCluster = 3;
+
+// Bytes of guest data covered by one L1 entry, i.e. by one L2 table.
+const uint64_t kL1EntryCoverage = kClusterSize * (kClusterSize / 8);
+
+void put32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+void put64(uint8_t* p, uint64_t v) {
+    put32(p, static_cast<uint32_t>(v >> 32));
+    put32(p + 4, static_cast<uint32_t>(v));
+}
+
+uint32_t get32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint64_t get64(const uint8_t* p) {
+    return (uint64_t(get32(p)) << 32) | get32(p + 4);
+}
+
+}  // namespace
+
+int android_createQcow2Overlay(const char* overlayPath,
+                               const char* backingPath,
+                               uint64_t virtualSize) {
+    virtualSize = (virtualSize + 511) & ~511ULL;
+    const size_t backingLen = strlen(backingPath);
+    const uint64_t l1Size =
+            (virtualSize + kL1EntryCoverage - 1) / kL1EntryCoverage;
+    const uint64_t l1Clusters = (l1Size * 8 + kClusterSize - 1) / kClusterSize;
+    const uint64_t totalClusters = kL1TableCluster + l1Clusters;
+
+    // Header extensions are 8-byte aligned, the name goes right after them.
+    const size_t extFormatSize = (sizeof(kBackingFormat) - 1 + 7) & ~7;
+    const size_t extIdentityOffset = kHeaderLength + 8 + extFormatSize;
+    const size_t backingOffset =
+            extIdentityOffset + 8 + kBackingIdentitySize + 8;
+    if (backingLen == 0 || backingOffset + backingLen > kClusterSize ||
+        // A single refcount block is enough for 2 TiB of metadata, and
+        // this L1 table covers 4 PiB per cluster.
+        totalClusters > kClusterSize / 2) {
+        return -EINVAL;
+    }
+
+    struct stat backingStat;
+    if (android_stat(backingPath, &backingStat) < 0) {
+        return -errno;
+    }
+
+    std::vector<uint8_t> image(totalClusters * kClusterSize);
+    uint8_t* header = image.data();
+    put32(header + 0, kQcow2Magic);
+    put32(header + 4, kQcow2Version);
+    put64(header + 8, backingOffset);
+    put32(header + 16, static_cast<uint32_t>(backingLen));
+    put32(header + 20, kClusterBits);
+    put64(header + 24, virtualSize);
+    put32(header + 32, 0);  // no encryption
+    put32(header + 36, static_cast<uint32_t>(l1Size));
+    put64(header + 40, kL1TableCluster * kClusterSize);
+    put64(header + 48, kRefcountTableCluster * kClusterSize);
+    put32(header + 56, 1);  // refcount table clusters
+    put32(header + 60, 0);  // no snapshots
+    put64(header + 64, 0);
+    // Incompatible, compatible and autoclear features are all 0.
+    put32(header + 96, kRefcountOrder);
+    put32(header + 100, kHeaderLength);
+
+    // Tell QEMU not to probe the backing file: a raw image whose first
+    // sector happens to look like another format must stay raw.
+    uint8_t* ext = header + kHeaderLength;
+    put32(ext, kExtBackingFormat);
+    put32(ext + 4, sizeof(kBackingFormat) - 1);
+    memcpy(ext + 8, kBackingFormat, sizeof(kBackingFormat) - 1);
+    ext = header + extIdentityOffset;
+    put32(ext, kExtBackingIdentity);
+    put32(ext + 4, kBackingIdentitySize);
+    put64(ext + 8, static_cast<uint64_t>(backingStat.st_size));
+    put64(ext + 16, static_cast<uint64_t>(backingStat.st_mtime));
+    // The end-of-extensions marker is all zeroes.
+    memcpy(header + backingOffset, backingPath, backingLen);
+
+    put64(image.data() + kRefcountTableCluster * kClusterSize,
+          kRefcountBlockCluster * kClusterSize);
+    uint8_t* refcounts = image.data() + kRefcountBlockCluster * kClusterSize;
+    for (uint64_t n = 0; n < totalClusters; ++n) {
+        refcounts[n * 2 + 1] = 1;  // 16-bit big-endian refcount of 1
+    }
+
+    android::base::ScopedStdioFile file(android_fopen(overlayPath, "wb"));
+    if (!file.get()) {
+        return -errno;
+    }
+    if (fwrite(image.data(), image.size(), 1, file.get()) != 1 ||
+        fflush(file.get()) != 0) {
+        const int err = errno;
+        file.reset();
+        android_unlink(overlayPath);
+        return -err;
+    }
+    return 0;
+}
+
+bool android_pathIsQcow2Image(const char* filePath) {
+    android::base::ScopedStdioFile file(android_fopen(filePath, "rb"));
+    uint8_t magic[4];
+    if (!file.get() || fread(magic, sizeof(magic), 1, file.get()) != 1) {
+        return false;
+    }
+    uint8_t expected[4];
+    put32(expected, kQcow2Magic);
+    return !memcmp(magic, expected, sizeof(magic));
+}
+
+AndroidQcow2BackingState android_checkQcow2OverlayBacking(
+        const char* overlayPath) {
+    // QEMU keeps the header, its extensions and the backing file name in
+    // the first cluster, which is the size of ours when it rewrites them.
+    android::base::ScopedStdioFile file(android_fopen(overlayPath, "rb"));
+    if (!file.get()) {
+        return ANDROID_QCOW2_BACKING_UNKNOWN;
+    }
+    std::vector<uint8_t> header(kClusterSize);
+    const size_t size = fread(header.data(), 1, header.size(), file.get());
+    const uint8_t* const p = header.data();
+    if (size < kHeaderLength || get32(p) != kQcow2Magic ||
+        get32(p + 4) < kQcow2Version) {
+        return ANDROID_QCOW2_BACKING_UNKNOWN;
+    }
+    const uint64_t backingOffset = get64(p + 8);
+    const uint32_t backingLen = get32(p + 16);
+    if (backingLen == 0 || backingOffset > size ||
+        backingLen > size - backingOffset) {
+        return ANDROID_QCOW2_BACKING_UNKNOWN;
+    }
+
+    const uint8_t* identity = nullptr;
+    for (uint64_t pos = get32(p + 100); pos + 8 <= size;) {
+        const uint32_t magic = get32(p + pos);
+        const uint32_t len = get32(p + pos + 4);
+        if (magic == 0 || len > size - pos - 8) {
+            break;
+        }
+        if (magic == kExtBackingIdentity && len == kBackingIdentitySize) {
+            identity = p + pos + 8;
+            break;
+        }
+        pos += 8 + ((len + 7ULL) & ~7ULL);
+    }
+    if (!identity) {
+        return ANDROID_QCOW2_BACKING_UNKNOWN;
+    }
+
+    const std::string backingPath(
+            reinterpret_cast<const char*>(p + backingOffset), backingLen);
+    struct stat backingStat;
+    if (android_stat(backingPath.c_str(), &backingStat) < 0) {
+        return ANDROID_QCOW2_BACKING_MISSING;
+    }
+    if (get64(identity) != static_cast<uint64_t>(backingStat.st_size) ||
+        get64(identity + 8) != static_cast<uint64_t>(backingStat.st_mtime)) {
+        return ANDROID_QCOW2_BACKING_CHANGED;
+    }
+    return ANDROID_QCOW2_BACKING_OK;
+}
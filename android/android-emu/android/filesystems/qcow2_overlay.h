@@ -0,0 +1,57 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+ANDROID_BEGIN_HEADER
+
+// Create a new QCOW2 image file at |overlayPath| that uses the raw image
+// at |backingPath| as its backing file. The overlay is |virtualSize| bytes
+// large (rounded up to a 512-byte sector) and doesn't contain any data:
+// reads go to the backing file, or return zeroes past its end, and writes
+// only ever touch the overlay. |backingPath| is stored as-is, so it should
+// be absolute. The size and modification time of the backing file are
+// recorded too, see android_checkQcow2OverlayBacking().
+// Returns 0 on success, or -errno on failure.
+int android_createQcow2Overlay(const char* overlayPath,
+                               const char* backingPath,
+                               uint64_t virtualSize);
+
+// State of the backing file of a QCOW2 overlay, as returned by
+// android_checkQcow2OverlayBacking().
+typedef enum {
+    // The backing file still has the size and modification time it had
+    // when the overlay was created.
+    ANDROID_QCOW2_BACKING_OK = 0,
+    // The overlay doesn't record the identity of its backing file, e.g.
+    // because it wasn't created by android_createQcow2Overlay().
+    ANDROID_QCOW2_BACKING_UNKNOWN,
+    // The backing file doesn't exist anymore, e.g. it was moved.
+    ANDROID_QCOW2_BACKING_MISSING,
+    // The backing file was modified or replaced.
+    ANDROID_QCOW2_BACKING_CHANGED,
+} AndroidQcow2BackingState;
+
+// Check that the backing file of the overlay at |overlayPath| is the one
+// it was created with. An overlay only stores the blocks written through
+// it, so it is only consistent with the exact contents it was created on.
+AndroidQcow2BackingState android_checkQcow2OverlayBacking(
+        const char* overlayPath);
+
+// Returns true iff the file at |filePath| starts with a QCOW2 header.
+bool android_pathIsQcow2Image(const char* filePath);
+
+ANDROID_END_HEADER
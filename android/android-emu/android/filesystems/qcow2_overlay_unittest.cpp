@@ -0,0 +1,160 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/filesystems/qcow2_overlay.h"
+
+#include "android/base/misc/FileUtils.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string>
+
+using android::base::TestTempDir;
+
+namespace {
+
+uint32_t get32(const std::string& data, size_t offset) {
+    const auto p = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint64_t get64(const std::string& data, size_t offset) {
+    return (uint64_t(get32(data, offset)) << 32) | get32(data, offset + 4);
+}
+
+uint16_t getRefcount(const std::string& data, uint64_t cluster) {
+    const uint64_t table = get64(data, 48);
+    const uint64_t block = get64(data, table);
+    const auto p = reinterpret_cast<const uint8_t*>(data.data()) + block;
+    return (p[cluster * 2] << 8) | p[cluster * 2 + 1];
+}
+
+// Replaces the file at |path| with |size| bytes of zeroes.
+bool writeFile(const std::string& path, size_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const std::string data(size, '\0');
+    const bool ok = fwrite(data.data(), 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+}  // namespace
+
+TEST(Qcow2Overlay, Create) {
+    TestTempDir dir("qcow2_overlay");
+    const std::string overlay = dir.makeSubPath("userdata.qcow2");
+    const std::string backing = dir.makeSubPath("userdata.img");
+    ASSERT_TRUE(writeFile(backing, 4096));
+    // Needs three L1 entries of 512 MiB each.
+    const uint64_t size = 1536ULL * 1024 * 1024 - 1000;
+
+    ASSERT_EQ(0, android_createQcow2Overlay(overlay.c_str(), backing.c_str(),
+                                            size));
+    EXPECT_TRUE(android_pathIsQcow2Image(overlay.c_str()));
+
+    auto data = android::readFileIntoString(overlay);
+    ASSERT_TRUE(data);
+    const uint32_t clusterSize = 1U << get32(*data, 20);
+    ASSERT_EQ(0U, data->size() % clusterSize);
+    const uint64_t clusters = data->size() / clusterSize;
+
+    EXPECT_EQ(3U, get32(*data, 4));                // version
+    EXPECT_EQ((size + 511) & ~511ULL, get64(*data, 24));
+    EXPECT_EQ(0U, get32(*data, 32));               // no encryption
+    EXPECT_EQ(3U, get32(*data, 36));               // L1 entries
+    EXPECT_EQ(0U, get32(*data, 60));               // no snapshots
+    EXPECT_EQ(0U, get64(*data, 72));               // no incompatible features
+    EXPECT_EQ(4U, get32(*data, 96));               // 16-bit refcounts
+    EXPECT_EQ(104U, get32(*data, 100));            // header length
+
+    // Backing file name and format.
+    const uint64_t backingOffset = get64(*data, 8);
+    EXPECT_EQ(backing, data->substr(backingOffset, get32(*data, 16)));
+    EXPECT_EQ(0xE2792ACAU, get32(*data, 104));
+    EXPECT_EQ(3U, get32(*data, 108));
+    EXPECT_EQ("raw", data->substr(112, 3));
+    // Backing file identity.
+    EXPECT_EQ(0x616E6462U, get32(*data, 120));
+    EXPECT_EQ(16U, get32(*data, 124));
+    EXPECT_EQ(4096U, get64(*data, 128));
+    EXPECT_EQ(0U, get64(*data, 144));              // end of extensions
+
+    // The L1 table is empty, so all reads go to the backing file.
+    const uint64_t l1Offset = get64(*data, 40);
+    EXPECT_EQ(0U, l1Offset % clusterSize);
+    for (uint32_t n = 0; n < 3; ++n) {
+        EXPECT_EQ(0U, get64(*data, l1Offset + n * 8));
+    }
+
+    // Each cluster of the file is used exactly once, nothing else is.
+    EXPECT_EQ(1U, get32(*data, 56));               // refcount table clusters
+    for (uint64_t n = 0; n < clusters; ++n) {
+        EXPECT_EQ(1U, getRefcount(*data, n)) << "cluster " << n;
+    }
+    EXPECT_EQ(0U, getRefcount(*data, clusters));
+}
+
+TEST(Qcow2Overlay, BadBackingPath) {
+    TestTempDir dir("qcow2_overlay");
+    const std::string overlay = dir.makeSubPath("overlay.qcow2");
+
+    EXPECT_EQ(-EINVAL, android_createQcow2Overlay(overlay.c_str(), "", 4096));
+    EXPECT_EQ(-EINVAL, android_createQcow2Overlay(
+                               overlay.c_str(),
+                               std::string(100000, 'x').c_str(), 4096));
+    EXPECT_EQ(-ENOENT,
+              android_createQcow2Overlay(
+                      overlay.c_str(), dir.makeSubPath("missing").c_str(),
+                      4096));
+    EXPECT_FALSE(android_pathIsQcow2Image(overlay.c_str()));
+}
+
+TEST(Qcow2Overlay, CheckBacking) {
+    TestTempDir dir("qcow2_overlay");
+    const std::string overlay = dir.makeSubPath("userdata.qcow2");
+    const std::string backing = dir.makeSubPath("userdata.img");
+    ASSERT_TRUE(writeFile(backing, 4096));
+    ASSERT_EQ(0, android_createQcow2Overlay(overlay.c_str(), backing.c_str(),
+                                            8192));
+    EXPECT_EQ(ANDROID_QCOW2_BACKING_OK,
+              android_checkQcow2OverlayBacking(overlay.c_str()));
+
+    // An updated or replaced image.
+    ASSERT_TRUE(writeFile(backing, 8192));
+    EXPECT_EQ(ANDROID_QCOW2_BACKING_CHANGED,
+              android_checkQcow2OverlayBacking(overlay.c_str()));
+
+    // A moved image.
+    ASSERT_EQ(0, remove(backing.c_str()));
+    EXPECT_EQ(ANDROID_QCOW2_BACKING_MISSING,
+              android_checkQcow2OverlayBacking(overlay.c_str()));
+
+    // Not an overlay at all.
+    EXPECT_EQ(ANDROID_QCOW2_BACKING_UNKNOWN,
+              android_checkQcow2OverlayBacking(
+                      dir.makeSubPath("missing").c_str()));
+    ASSERT_TRUE(writeFile(backing, 4096));
+    EXPECT_EQ(ANDROID_QCOW2_BACKING_UNKNOWN,
+              android_checkQcow2OverlayBacking(backing.c_str()));
+}
+
+TEST(Qcow2Overlay, IsQcow2Image) {
+    TestTempDir dir("qcow2_overlay");
+    EXPECT_FALSE(android_pathIsQcow2Image(dir.makeSubPath("missing").c_str()));
+    ASSERT_TRUE(dir.makeSubFile("empty"));
+    EXPECT_FALSE(android_pathIsQcow2Image(dir.makeSubPath("empty").c_str()));
+}
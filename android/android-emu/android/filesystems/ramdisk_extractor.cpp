@@ -13,6 +13,7 @@
 
 #include "android/base/Compiler.h"
 #include "android/base/Log.h"
+#include "android/filesystems/image_cache.h"
 
 #include <inttypes.h>
 #include <stdio.h>
@@ -30,7 +31,9 @@
 
 // Ramdisk images are gzipped cpio archives using the new ASCII
 // format as described at [1]. Hence this source file first implements
-// a gzip-based input stream class, then 
+// a gzip-based input stream class, and a memory-based one used when the
+// decompressed archive is available from the image cache, then the
+// archive walk itself on top of either of them.
 //
 // [1] http://people.freebsd.org/~kientzle/libarchive/man/cpio.5.txt
 
@@ -62,6 +65,9 @@ public:
             mError = errno;
         } else {
             mError = 0;
+            // The default 8 KiB buffer makes skipping over large entries
+            // very chatty.
+            gzbuffer(mFile, 128 * 1024);
         }
     }
 
@@ -161,6 +167,41 @@ private:
     int mError;
 };
 
+// Same interface as GZipInputStream, reading from a memory buffer.
+class MemoryInputStream {
+public:
+    MemoryInputStream(const uint8_t* data, size_t size)
+        : mPos(data), mEnd(data + size) {}
+
+    int error() const { return mError; }
+
+    bool doRead(void* buffer, size_t len) {
+        if (mError || len > static_cast<size_t>(mEnd - mPos)) {
+            mError = EIO;
+            return false;
+        }
+        memcpy(buffer, mPos, len);
+        mPos += len;
+        return true;
+    }
+
+    bool doSkip(size_t len) {
+        if (mError || len > static_cast<size_t>(mEnd - mPos)) {
+            mError = EIO;
+            return false;
+        }
+        mPos += len;
+        return true;
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(MemoryInputStream);
+
+    const uint8_t* mPos;
+    const uint8_t* mEnd;
+    int mError = 0;
+};
+
 // Parse an hexadecimal string of 8 characters. On success,
 // return true and sets |*value| to its value. On failure,
 // return false.
@@ -185,21 +226,14 @@ bool parse_hex8(const char* input, uint32_t* value) {
     return true;
 }
 
-}  // namespace
-
-bool android_extractRamdiskFile(const char* ramdiskPath,
-                                const char* fileName,
-                                char** out,
-                                size_t* outSize) {
-    *out = NULL;
-    *outSize = 0;
-
-    GZipInputStream input(ramdiskPath);
-    if (input.error()) {
-        errno = input.error();
-        return false;
-    }
-
+// Find |fileName| in the cpio archive read from |input|, see
+// android_extractRamdiskFile() for the meaning of other parameters.
+template <class InputStream>
+bool extractCpioFile(InputStream& input,
+                     const char* ramdiskPath,
+                     const char* fileName,
+                     char** out,
+                     size_t* outSize) {
     // Type of cpio new ASCII header.
     struct cpio_newc_header {
         char c_magic[6];
@@ -311,3 +345,32 @@ bool android_extractRamdiskFile(const char* ramdiskPath,
     errno = input.error();
     return false;
 }
+
+}  // namespace
+
+bool android_extractRamdiskFile(const char* ramdiskPath,
+                                const char* fileName,
+                                char** out,
+                                size_t* outSize) {
+    *out = NULL;
+    *outSize = 0;
+
+    const uint8_t* archive = NULL;
+    size_t archiveSize = 0;
+    if (android_imageCacheMapGzip(ramdiskPath, 0, &archive, &archiveSize)) {
+        MemoryInputStream input(archive, archiveSize);
+        const bool result =
+                extractCpioFile(input, ramdiskPath, fileName, out, outSize);
+        const int savedErrno = errno;
+        android_imageCacheUnmap(archive, archiveSize);
+        errno = savedErrno;
+        return result;
+    }
+
+    GZipInputStream input(ramdiskPath);
+    if (input.error()) {
+        errno = input.error();
+        return false;
+    }
+    return extractCpioFile(input, ramdiskPath, fileName, out, outSize);
+}
@@ -12,6 +12,8 @@
 #include "android/filesystems/ramdisk_extractor.h"
 
 #include "android/base/EintrWrapper.h"
+#include "android/base/testing/TestTempDir.h"
+#include "android/filesystems/image_cache.h"
 #include "android/filesystems/testing/TestSupport.h"
 
 #include <gtest/gtest.h>
@@ -25,7 +27,10 @@ namespace {
 class RamdiskExtractorTest : public ::testing::Test {
 public:
     RamdiskExtractorTest() :
-        mTempFilePath(android::testing::CreateTempFilePath()) {}
+        mTempFilePath(android::testing::CreateTempFilePath()),
+        mCacheDir("ramdisk_extractor") {
+        android_imageCacheSetDirectory(mCacheDir.path());
+    }
 
     bool fillData(const void* data, size_t dataSize) {
         FILE* file = ::fopen(mTempFilePath.c_str(), "wb");
@@ -42,12 +47,14 @@ public:
         if (!mTempFilePath.empty()) {
             HANDLE_EINTR(unlink(mTempFilePath.c_str()));
         }
+        android_imageCacheSetDirectory(NULL);
     }
 
     const char* path() const { return mTempFilePath.c_str(); }
 
 private:
     std::string mTempFilePath;
+    android::base::TestTempDir mCacheDir;
 };
 
 }  // namespace
@@ -100,3 +107,20 @@ TEST_F(RamdiskExtractorTest, MissingFile) {
     EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize));
     EXPECT_FALSE(android_extractRamdiskFile(path(), "zoolander", &out, &outSize));
 }
+
+TEST_F(RamdiskExtractorTest, FindFooWithoutCache) {
+    static const char kExpected[] = "Hello World!\n";
+    static const size_t kExpectedSize = sizeof(kExpected) - 1U;
+    char* out = NULL;
+    size_t outSize = 0;
+
+    android_imageCacheSetDirectory(NULL);
+    EXPECT_TRUE(fillData(kTestRamdiskImage, kTestRamdiskImageSize));
+    EXPECT_TRUE(android_extractRamdiskFile(path(), "foo", &out, &outSize));
+    EXPECT_EQ(kExpectedSize, outSize);
+    EXPECT_TRUE(out);
+    EXPECT_TRUE(!memcmp(out, kExpected, outSize));
+    free(out);
+    EXPECT_FALSE(android_extractRamdiskFile(path(), "zoolander", &out,
+                                            &outSize));
+}
@@ -18,6 +18,7 @@
 #include "android/base/memory/ScopedPtr.h"
 #include "android/base/misc/StringUtils.h"
 #include "android/base/system/System.h"
+#include "android/filesystems/image_cache.h"
 #include "android/kernel/kernel_utils_testing.h"
 #include "android/uncompress.h"
 #include "android/utils/file_data.h"
@@ -103,11 +104,21 @@ const char* android_kernelSerialDevicePrefix(KernelVersion kernelVersion) {
     return "ttyS";
 }
 
-bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
-                                           size_t kernelFileSize,
-                                           char* dst /*[dstLen]*/,
-                                           size_t dstLen) {
+// Implementation of android_imageProbeKernelVersionString(). If not null,
+// |kernelPath| is the file |kernelFileData| was mapped from, and is used to
+// look up the decompressed kernel in the image cache.
+static bool probeKernelVersionString(const char* kernelPath,
+                                     const uint8_t* kernelFileData,
+                                     size_t kernelFileSize,
+                                     char* dst /*[dstLen]*/,
+                                     size_t dstLen) {
     std::vector<uint8_t> uncompressed;
+    // The decompressed kernel mapped from the image cache, if any.
+    struct CachedImage {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        ~CachedImage() { android_imageCacheUnmap(data, size); }
+    } cached;
 
     const uint8_t* uncompressedKernel = NULL;
     size_t uncompressedKernelLen = 0;
@@ -171,7 +182,13 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
                     kernelFileData, (compressedKernel - kernelFileData),
                     kLinuxVersionPrefix.data(), kLinuxVersionPrefix.size());
 
-            if (!versionStringStart) {
+            if (!versionStringStart && kernelPath &&
+                android_imageCacheMapGzip(kernelPath,
+                                          compressedKernel - kernelFileData,
+                                          &cached.data, &cached.size)) {
+                uncompressedKernel = cached.data;
+                uncompressedKernelLen = cached.size;
+            } else if (!versionStringStart) {
                 size_t compressedKernelLen =
                         kernelFileSize - (compressedKernel - kernelFileData);
 
@@ -211,6 +228,14 @@ bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
     return true;
 }
 
+bool android_imageProbeKernelVersionString(const uint8_t* kernelFileData,
+                                           size_t kernelFileSize,
+                                           char* dst /*[dstLen]*/,
+                                           size_t dstLen) {
+    return probeKernelVersionString(nullptr, kernelFileData, kernelFileSize,
+                                    dst, dstLen);
+}
+
 bool android_pathProbeKernelVersionString(const char* kernelPath,
                                           char* dst /*[dstLen]*/,
                                           size_t dstLen) {
@@ -230,6 +255,7 @@ bool android_pathProbeKernelVersionString(const char* kernelPath,
         return false;
     }
 
-    return android_imageProbeKernelVersionString(
-            (const uint8_t*)kernelFileMap.get(), size, dst, dstLen);
+    return probeKernelVersionString(kernelPath,
+                                    (const uint8_t*)kernelFileMap.get(), size,
+                                    dst, dstLen);
 }
@@ -358,6 +358,8 @@ static android_studio::EmulatorFeatureFlagState::EmulatorFeatureFlag toClearcutF
             return android_studio::EmulatorFeatureFlagState::HAXM;
         case android::featurecontrol::FastSnapshotV1:
             return android_studio::EmulatorFeatureFlagState::FAST_SNAPSHOT_V1;
+        case android::featurecontrol::IoUring:
+            return android_studio::EmulatorFeatureFlagState::IO_URING;
         case android::featurecontrol::Feature_n_items:
             return android_studio::EmulatorFeatureFlagState::EMULATOR_FEATURE_FLAG_UNSPECIFIED;
     }
@@ -70,6 +70,12 @@ public:
 
         bool canLoad() const override { return true; }
 
+        // Transfers only touch the pipe's read buffer and its RenderChannel,
+        // which is shared with the render thread and has its own locking.
+        // writeToHost() blocks while the channel is full, so doing that
+        // without the VM lock matters.
+        bool canTransferWithoutVmLock() const override { return true; }
+
         virtual void preLoad(android::base::Stream* stream) override {
 #ifdef SNAPSHOT_PROFILE
             mLoadStartTime = android::base::System::get()->getUnixTimeUs();
@@ -13,7 +13,9 @@
 #include "android/opengl/gpuinfo.h"
 
 #include "android/base/StringFormat.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/system/System.h"
+#include "android/emulation/ConfigDirs.h"
 #include "android/globals.h"
 #include "android/opengl/EmuglBackendList.h"
 #include "android/skin/winsys.h"
@@ -34,6 +36,8 @@
 #define D(...)  ((void)0)
 #endif
 
+using android::ConfigDirs;
+using android::base::PathUtils;
 using android::base::RunOptions;
 using android::base::StringFormat;
 using android::base::System;
@@ -376,6 +380,14 @@ void emuglConfig_setupEnv(const EmuglConfig* config) {
         return;
     }
 
+    // The GLES translator caches shader translations and program binaries
+    // in this directory, see ShaderCache.h.
+    if (system->envGet("ANDROID_EMUGL_SHADER_CACHE").empty()) {
+        system->envSet("ANDROID_EMUGL_SHADER_CACHE",
+                       PathUtils::join(ConfigDirs::getUserDirectory(),
+                                       "shader-cache"));
+    }
+
     // $EXEC_DIR/<lib>/ is already added to the library search path by default,
     // since generic libraries are bundled there. We may need more though:
     resetBackendList(config->bitness);
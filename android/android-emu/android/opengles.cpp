@@ -12,10 +12,13 @@
 
 #include "android/opengles.h"
 
+#include "android/base/system/System.h"
 #include "android/crashreport/crash-handler.h"
 #include "android/emulation/GoldfishDma.h"
 #include "android/featurecontrol/FeatureControl.h"
 #include "android/globals.h"
+#include "android/metrics/PeriodicReporter.h"
+#include "android/metrics/proto/studio_stats.pb.h"
 #include "android/opengl/emugl_config.h"
 #include "android/opengl/logger.h"
 #include "android/snapshot/PathUtils.h"
@@ -79,6 +82,61 @@ static bool sEgl2egl;
 static emugl::RenderLibPtr sRenderLib = nullptr;
 static emugl::RendererPtr sRenderer = nullptr;
 
+static constexpr uint32_t kRendererStatsReportIntervalMs = 5 * 60 * 1000;
+
+// Reports the renderer statistics with the other metrics, if they were
+// turned on.
+static void reportRendererStats() {
+    static bool registered = false;
+    if (registered) {
+        return;
+    }
+    registered = true;
+
+    android::metrics::PeriodicReporter::get().addTask(
+            kRendererStatsReportIntervalMs,
+            [](android_studio::AndroidStudioEvent* event) {
+                if (!sRenderer) {
+                    return false;
+                }
+                const emugl::RendererStats stats = sRenderer->getStats();
+                if (!stats.enabled) {
+                    return false;
+                }
+                auto proto = event->mutable_emulator_performance_stats()
+                                     ->mutable_renderer();
+                proto->set_bytes_decoded(stats.bytesDecoded);
+                proto->set_gles1_commands(stats.gles1Commands);
+                proto->set_gles2_commands(stats.gles2Commands);
+                proto->set_render_control_commands(
+                        stats.renderControlCommands);
+                proto->set_color_buffer_uploads(stats.colorBufferUploads);
+                proto->set_color_buffer_upload_bytes(
+                        stats.colorBufferUploadBytes);
+                proto->set_color_buffer_readbacks(stats.colorBufferReadbacks);
+                proto->set_color_buffer_readback_bytes(
+                        stats.colorBufferReadbackBytes);
+                proto->set_posts(stats.posts);
+                proto->set_dropped_posts(stats.droppedPosts);
+                proto->set_post_latency_avg_us(stats.postLatencyAvgUs);
+                proto->set_post_latency_max_us(stats.postLatencyMaxUs);
+                proto->set_fence_waits(stats.fenceWaits);
+                proto->set_fence_wait_avg_us(stats.fenceWaitAvgUs);
+                proto->set_fence_wait_max_us(stats.fenceWaitMaxUs);
+                proto->set_fence_queue_depth(stats.fenceQueueDepth);
+                proto->set_fence_queue_depth_max(stats.fenceQueueDepthMax);
+                proto->set_sync_waits(stats.syncWaitLatency.count);
+                proto->set_sync_wait_p50_us(
+                        stats.syncWaitLatency.percentileUs(50));
+                proto->set_sync_wait_p99_us(
+                        stats.syncWaitLatency.percentileUs(99));
+                proto->set_decode_p50_us(stats.decodeLatency.percentileUs(50));
+                proto->set_decode_p99_us(stats.decodeLatency.percentileUs(99));
+                proto->set_render_threads(stats.renderThreads.size());
+                return true;
+            });
+}
+
 int android_initOpenglesEmulation() {
     char* error = NULL;
 
@@ -177,6 +235,14 @@ android_startOpenglesRenderer(int width, int height, bool guestPhoneApi, int gue
         return -1;
     }
 
+    // Renderer statistics are opt-in, see the 'gpu stats' console command.
+    if (!android::base::System::get()
+                 ->envGet("ANDROID_EMUGL_RENDER_STATS")
+                 .empty()) {
+        sRenderer->setStatsEnabled(true);
+    }
+    reportRendererStats();
+
     // after initRenderer is a success, the maximum GLES API is calculated depending
     // on feature control and host GPU support. Set the obtained GLES version here.
     if (glesMajorVersion_out && glesMinorVersion_out)
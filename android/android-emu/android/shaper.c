@@ -23,7 +23,7 @@ NetShaper  android_net_shaper_out;
 NetDelay   android_net_delay_in;
 
 #define  SHAPER_CLOCK        LOOPER_CLOCK_REALTIME
-#define  SHAPER_CLOCK_UNIT   1000.
+#define  SHAPER_CLOCK_UNIT   1e9   /* the shaper accounts time in ns */
 
 static int
 _packet_is_internal( const uint8_t*  data, size_t  size )
@@ -60,27 +60,67 @@ _packet_is_internal( const uint8_t*  data, size_t  size )
  * direction of the user vlan.
  */
 typedef struct QueuedPacketRec_ {
-    Duration                   expiration;
+    int64_t                    expiration;
     struct QueuedPacketRec_*   next;
     size_t                     size;
     void*                      opaque;
     void*                      data;
+    int                        pooled;   /* slot of PACKET_POOL_SLOT_SIZE bytes */
 } QueuedPacketRec, *QueuedPacket;
 
+/* queued packets are recycled through a small per-object free list, so
+ * that a shaper under load doesn't hit malloc() for every frame. each
+ * pooled packet has room for a full Ethernet frame; larger ones (which
+ * can't happen with the current NIC models) get their own allocation.
+ */
+#define  PACKET_POOL_SLOT_SIZE   2048
+#define  PACKET_POOL_MAX_FREE    1024
+
+typedef struct {
+    QueuedPacket   free_list;
+    int            num_free;
+} QueuedPacketPool;
+
+static void
+queued_packet_pool_init( QueuedPacketPool*  pool )
+{
+    pool->free_list = NULL;
+    pool->num_free  = 0;
+}
+
+static void
+queued_packet_pool_done( QueuedPacketPool*  pool )
+{
+    while (pool->free_list) {
+        QueuedPacket  packet = pool->free_list;
+        pool->free_list = packet->next;
+        free(packet);
+    }
+    pool->num_free = 0;
+}
 
 static QueuedPacket
-queued_packet_create( const void*   data,
-                      size_t        size,
-                      void*         opaque,
-                      int           do_copy )
+queued_packet_create( QueuedPacketPool*  pool,
+                      const void*        data,
+                      size_t             size,
+                      void*              opaque,
+                      int                do_copy )
 {
     QueuedPacket   packet;
-    size_t         packet_size = sizeof(*packet);
-
-    if (do_copy)
-        packet_size += size;
 
-    packet = malloc(packet_size);
+    if (!do_copy || size <= PACKET_POOL_SLOT_SIZE) {
+        packet = pool->free_list;
+        if (packet) {
+            pool->free_list = packet->next;
+            pool->num_free--;
+        } else {
+            packet = malloc(sizeof(*packet) + PACKET_POOL_SLOT_SIZE);
+        }
+        packet->pooled = 1;
+    } else {
+        packet = malloc(sizeof(*packet) + size);
+        packet->pooled = 0;
+    }
     packet->next       = NULL;
     packet->expiration = 0;
     packet->size       = (size_t)size;
@@ -96,27 +136,55 @@ queued_packet_create( const void*   data,
 }
 
 static void
-queued_packet_free( QueuedPacket  packet )
+queued_packet_free( QueuedPacketPool*  pool, QueuedPacket  packet )
 {
     if (packet) {
-        free( packet );
+        if (packet->pooled && pool->num_free < PACKET_POOL_MAX_FREE) {
+            packet->next    = pool->free_list;
+            pool->free_list = packet;
+            pool->num_free++;
+        } else {
+            free( packet );
+        }
     }
 }
 
+/* since a packet is only queued while the shaper is blocked, and each one
+ * pushes 'block_until' further, expiration dates are increasing along the
+ * queue: new packets are simply appended at its tail. time is accounted
+ * in nanoseconds, otherwise the transmission time of a packet would round
+ * down to 0 at rates above ~10 Mbit/s and the shaper would let everything
+ * through.
+ */
 typedef struct NetShaperRec_ {
     QueuedPacket   packets;   /* list of queued packets, ordered by expiration date */
+    QueuedPacket   packets_tail;
     int            num_packets;
     int            active;    /* is this shaper active ? */
-    Duration       block_until;
+    int64_t        block_until;
     double         max_rate;  /* max rate expressed in bytes/second */
     double         inv_rate;  /* inverse of max rate                */
     LoopTimer*     timer;     /* timer */
+    QueuedPacketPool  pool;
 
     int                do_copy;
     NetShaperSendFunc  send_func;
 
 } NetShaperRec;
 
+static int64_t
+netshaper_now( void )
+{
+    return (int64_t)looper_nowNsWithClock(looper_getForThread(), SHAPER_CLOCK);
+}
+
+/* program the shaper's millisecond timer for a nanosecond deadline */
+static void
+netshaper_arm( NetShaper  shaper, int64_t  expiration )
+{
+    loopTimer_startAbsolute(shaper->timer,
+                            (Duration)((expiration + 999999) / 1000000));
+}
 
 void
 netshaper_destroy( NetShaper  shaper )
@@ -128,8 +196,10 @@ netshaper_destroy( NetShaper  shaper )
             QueuedPacket  packet = shaper->packets;
             shaper->packets = packet->next;
             packet->next    = NULL;
-            queued_packet_free(packet);
+            queued_packet_free(&shaper->pool, packet);
         }
+        shaper->packets_tail = NULL;
+        queued_packet_pool_done(&shaper->pool);
 
         loopTimer_stop(shaper->timer);
         loopTimer_free(shaper->timer);
@@ -144,27 +214,28 @@ netshaper_expires(void* opaque, LoopTimer* unused)
 {
     NetShaper shaper = (NetShaper)opaque;
     QueuedPacket  packet;
+    int64_t       now;
 
     if (opaque == NULL) {
         crashhandler_die("netshaper_expires() with opaque==NULL");
     }
 
+    now = netshaper_now();
     while ((packet = shaper->packets) != NULL) {
-       Duration now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-
        if (packet->expiration > now)
            break;
 
        shaper->packets = packet->next;
+       if (shaper->packets == NULL)
+           shaper->packets_tail = NULL;
        shaper->send_func( packet->data, packet->size, packet->opaque );
-       queued_packet_free(packet);
+       queued_packet_free(&shaper->pool, packet);
        shaper->num_packets--;
    }
 
    /* reprogram timer if needed */
    if (shaper->packets) {
-       shaper->block_until = shaper->packets->expiration;
-       loopTimer_startAbsolute(shaper->timer, shaper->block_until);
+       netshaper_arm(shaper, shaper->packets->expiration);
    } else {
        shaper->block_until = -1;
    }
@@ -179,9 +250,12 @@ netshaper_create( int                do_copy,
 
     shaper->active = 0;
     shaper->packets = NULL;
+    shaper->packets_tail = NULL;
     shaper->num_packets = 0;
     shaper->timer = loopTimer_newWithClock(
             looper_getForThread(), netshaper_expires, shaper, SHAPER_CLOCK);
+    queued_packet_pool_init(&shaper->pool);
+    shaper->do_copy   = do_copy;
     shaper->send_func = send_func;
     shaper->max_rate  = 1e6;
     shaper->inv_rate  = 0.;
@@ -202,13 +276,15 @@ netshaper_set_rate( NetShaper  shaper,
         QueuedPacket  packet = shaper->packets;
         shaper->packets = packet->next;
         shaper->send_func(packet->data, packet->size, packet->opaque);
-        free(packet);
-        shaper->num_packets = 0;
+        queued_packet_free(&shaper->pool, packet);
     }
+    shaper->packets_tail = NULL;
+    shaper->num_packets  = 0;
+    loopTimer_stop(shaper->timer);
 
     shaper->max_rate = rate;
     if (rate > 1.) {
-        shaper->inv_rate = (8.*SHAPER_CLOCK_UNIT)/rate;  /* our clock time is in ms */
+        shaper->inv_rate = (8.*SHAPER_CLOCK_UNIT)/rate;  /* our clock time is in ns */
         shaper->active   = 1;                            /* for the real-time clock */
     } else {
         shaper->active = 0;
@@ -223,50 +299,39 @@ netshaper_send_aux( NetShaper  shaper,
                     size_t     size,
                     void*      opaque )
 {
-    Duration now;
+    int64_t  now;
 
     if (!shaper->active || _packet_is_internal(data, size)) {
         shaper->send_func( data, size, opaque );
         return;
     }
 
-    now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
+    now = netshaper_now();
     if (now >= shaper->block_until) {
         shaper->send_func( data, size, opaque );
-        shaper->block_until = now + size*shaper->inv_rate;
-        //fprintf(stderr, "NETSHAPER: block for %.2fms\n", (shaper->block_until - now)*1.0 );
+        shaper->block_until = now + (int64_t)(size*shaper->inv_rate);
         return;
     }
 
-    /* create new packet, add it to the queue */
+    /* create new packet, append it to the queue */
     {
         QueuedPacket   packet;
 
-        packet = queued_packet_create( data, size, opaque, shaper->do_copy );
+        packet = queued_packet_create( &shaper->pool, data, size, opaque,
+                                       shaper->do_copy );
 
         packet->expiration = shaper->block_until;
 
-        {
-            QueuedPacket  *pnode, node;
-
-            pnode = &shaper->packets;
-            for (;;) {
-                node = *pnode;
-                if (node == NULL || node->expiration > packet->expiration )
-                    break;
-                pnode = &node->next;
-            }
-            packet->next = *pnode;
-            *pnode       = packet;
-
-            if (packet == shaper->packets) {
-                loopTimer_startAbsolute(shaper->timer, packet->expiration);
-            }
+        if (shaper->packets_tail) {
+            shaper->packets_tail->next = packet;
+        } else {
+            shaper->packets = packet;
+            netshaper_arm(shaper, packet->expiration);
         }
+        shaper->packets_tail = packet;
         shaper->num_packets += 1;
     }
-    shaper->block_until += size*shaper->inv_rate;
-    //fprintf(stderr, "NETSHAPER: block2 for %.2fms\n", (shaper->block_until - now)*1.0 );
+    shaper->block_until += (int64_t)(size*shaper->inv_rate);
 }
 
 void
@@ -281,16 +346,13 @@ netshaper_send( NetShaper  shaper,
 int
 netshaper_can_send( NetShaper  shaper )
 {
-    Duration now;
-
     if (!shaper->active || shaper->block_until < 0)
         return 1;
 
     if (shaper->packets)
         return 0;
 
-    now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-    return (now >= shaper->block_until);
+    return (netshaper_now() >= shaper->block_until);
 }
 
 
@@ -303,7 +365,9 @@ netshaper_can_send( NetShaper  shaper )
  */
 typedef struct SessionRec_ {
     Duration              expiration;
-    struct SessionRec_*   next;
+    struct SessionRec_*   next;          /* next in hash bucket */
+    struct SessionRec_*   wheel_next;    /* next in timer wheel slot, if delayed */
+    struct SessionRec_**  wheel_pprev;
     unsigned              src_ip;
     unsigned              dst_ip;
     unsigned short        src_port;
@@ -317,20 +381,6 @@ typedef struct SessionRec_ {
 #define  _PROTOCOL_UDP   17
 
 
-
-static void
-session_free( Session  session )
-{
-    if (session) {
-        if (session->packet) {
-            queued_packet_free(session->packet);
-            session->packet = NULL;
-        }
-        free( session );
-    }
-}
-
-
 #if 0  /* useful for debugging */
 static const char*
 session_to_string( Session  session )
@@ -395,24 +445,238 @@ _packet_SYN_flags( const void*  _data, size_t   size, Session  info )
 }
 
 
+/* delayed sessions are kept in a hierarchical timer wheel with millisecond
+ * ticks: level 0 has one slot per tick for the next 64ms, and each level
+ * above covers 64 times the range of the previous one with slots as wide
+ * as the whole level below. when the clock enters a new slot of an upper
+ * level, its sessions are moved down ("cascaded") to the levels below.
+ * insertion and removal are O(1), and expiration only touches the slots
+ * that have elapsed, instead of every session.
+ */
+#define  WHEEL_BITS     6
+#define  WHEEL_SIZE     (1 << WHEEL_BITS)
+#define  WHEEL_MASK     (WHEEL_SIZE - 1)
+#define  WHEEL_LEVELS   4
+#define  WHEEL_RANGE    ((Duration)1 << (WHEEL_BITS*WHEEL_LEVELS))
+
+typedef struct {
+    Duration   now;       /* last tick processed */
+    int        count;
+    Session    slots[WHEEL_LEVELS][WHEEL_SIZE];
+} TimerWheel;
+
+static void
+timer_wheel_init( TimerWheel*  wheel, Duration  now )
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+static void
+timer_wheel_link( TimerWheel*  wheel, Session  session )
+{
+    Duration   expiration = session->expiration;
+    Duration   delta;
+    Session*   slot;
+    int        level;
+
+    if (expiration < wheel->now)
+        expiration = wheel->now;
+    else if (expiration - wheel->now >= WHEEL_RANGE)
+        expiration = wheel->now + WHEEL_RANGE - 1;
+
+    delta = expiration - wheel->now;
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        if (delta < ((Duration)1 << (WHEEL_BITS*(level+1))))
+            break;
+    }
+    slot = &wheel->slots[level][(expiration >> (WHEEL_BITS*level)) & WHEEL_MASK];
+
+    session->wheel_next  = *slot;
+    session->wheel_pprev = slot;
+    if (*slot)
+        (*slot)->wheel_pprev = &session->wheel_next;
+    *slot = session;
+}
+
+static void
+timer_wheel_add( TimerWheel*  wheel, Session  session )
+{
+    /* the slot of the current tick has already been processed */
+    if (session->expiration <= wheel->now)
+        session->expiration = wheel->now + 1;
+
+    timer_wheel_link(wheel, session);
+    wheel->count++;
+}
+
+static void
+timer_wheel_remove( TimerWheel*  wheel, Session  session )
+{
+    if (session->wheel_pprev == NULL)
+        return;
+
+    *session->wheel_pprev = session->wheel_next;
+    if (session->wheel_next)
+        session->wheel_next->wheel_pprev = session->wheel_pprev;
+    session->wheel_next  = NULL;
+    session->wheel_pprev = NULL;
+    wheel->count--;
+}
+
+/* advance the wheel up to 'now', and return the list of sessions that
+ * expired, linked through their 'wheel_next' field. */
+static Session
+timer_wheel_advance( TimerWheel*  wheel, Duration  now )
+{
+    Session  expired = NULL;
+
+    if (wheel->count == 0) {
+        if (now > wheel->now)
+            wheel->now = now;
+        return NULL;
+    }
+
+    while (wheel->now < now) {
+        Duration  tick = ++wheel->now;
+        Session*  slot;
+        Session   session;
+        int       level;
+
+        for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((tick & (((Duration)1 << (WHEEL_BITS*level)) - 1)) != 0)
+                continue;
+
+            slot    = &wheel->slots[level][(tick >> (WHEEL_BITS*level)) & WHEEL_MASK];
+            session = *slot;
+            *slot   = NULL;
+            while (session) {
+                Session  next = session->wheel_next;
+                timer_wheel_link(wheel, session);
+                session = next;
+            }
+        }
+
+        slot    = &wheel->slots[0][tick & WHEEL_MASK];
+        session = *slot;
+        *slot   = NULL;
+        while (session) {
+            Session  next = session->wheel_next;
+            session->wheel_next  = expired;
+            session->wheel_pprev = NULL;
+            expired = session;
+            wheel->count--;
+            session = next;
+        }
+        if (wheel->count == 0) {
+            wheel->now = now;
+            break;
+        }
+    }
+    return expired;
+}
+
+/* return the next tick at which timer_wheel_advance() has something to do,
+ * either expiring or cascading sessions, or DURATION_INFINITE. */
+static Duration
+timer_wheel_next( TimerWheel*  wheel )
+{
+    Duration  next = DURATION_INFINITE;
+    int       level, k;
+
+    if (wheel->count == 0)
+        return next;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        int       shift = WHEEL_BITS*level;
+        Duration  base  = (wheel->now >> shift) << shift;
+
+        for (k = 1; k <= WHEEL_SIZE; k++) {
+            Duration  tick = base + ((Duration)k << shift);
+
+            if (tick >= next)
+                break;
+            if (wheel->slots[level][(tick >> shift) & WHEEL_MASK]) {
+                next = tick;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+
+/* sessions are looked up by their 5-tuple in a chained hash table, which
+ * doubles in size when its load factor goes above 2. */
+#define  SESSION_HASH_MIN_SIZE   64
+
 typedef struct NetDelayRec_
 {
-    Session     sessions;
+    Session*    buckets;
+    unsigned    num_buckets;   /* always a power of 2 */
     int         num_sessions;
+    TimerWheel  wheel;
     LoopTimer*  timer;
     int         active;
     int         min_ms;
     int         max_ms;
+    QueuedPacketPool  pool;
 
     NetShaperSendFunc  send_func;
 
 } NetDelayRec;
 
 
+static void
+session_free( NetDelay  delay, Session  session )
+{
+    if (session) {
+        timer_wheel_remove(&delay->wheel, session);
+        if (session->packet) {
+            queued_packet_free(&delay->pool, session->packet);
+            session->packet = NULL;
+        }
+        free( session );
+    }
+}
+
+static unsigned
+session_hash( Session  info )
+{
+    uint32_t  h;
+
+    h  = info->src_ip * 0x9e3779b1u;
+    h ^= info->dst_ip * 0x85ebca6bu;
+    h ^= (((uint32_t)info->src_port << 16) | info->dst_port) * 0xc2b2ae35u;
+    h ^= info->protocol;
+    return h ^ (h >> 16);
+}
+
+static void
+netdelay_resize( NetDelay  delay, unsigned  num_buckets )
+{
+    Session*  buckets = calloc(num_buckets, sizeof(*buckets));
+    unsigned  nn;
+
+    for (nn = 0; nn < delay->num_buckets; nn++) {
+        Session  session = delay->buckets[nn];
+        while (session) {
+            Session   next = session->next;
+            Session*  slot = &buckets[session_hash(session) & (num_buckets - 1)];
+            session->next = *slot;
+            *slot = session;
+            session = next;
+        }
+    }
+    free(delay->buckets);
+    delay->buckets     = buckets;
+    delay->num_buckets = num_buckets;
+}
+
 static Session*
 netdelay_lookup_session( NetDelay  delay, Session  info )
 {
-    Session*  pnode = &delay->sessions;
+    Session*  pnode = &delay->buckets[session_hash(info) & (delay->num_buckets - 1)];
     Session   node;
 
     for (;;) {
@@ -432,6 +696,26 @@ netdelay_lookup_session( NetDelay  delay, Session  info )
     return pnode;
 }
 
+/* remove all sessions, sending their delayed packet if 'flush' is set */
+static void
+netdelay_clear_sessions( NetDelay  delay, int  flush )
+{
+    unsigned  nn;
+
+    for (nn = 0; nn < delay->num_buckets; nn++) {
+        while (delay->buckets[nn]) {
+            Session  session = delay->buckets[nn];
+            delay->buckets[nn] = session->next;
+            session->next = NULL;
+            if (flush && session->packet) {
+                QueuedPacket  packet = session->packet;
+                delay->send_func( packet->data, packet->size, packet->opaque );
+            }
+            session_free(delay, session);
+            delay->num_sessions--;
+        }
+    }
+}
 
 
 /* called by the delay's timer on expiration */
@@ -439,36 +723,30 @@ static void
 netdelay_expires(void* opaque, LoopTimer* unused)
 {
     NetDelay delay = (NetDelay)opaque;
-    Session  session;
     Duration now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-    int      rearm = 0;
-    Duration rearm_time = 0;
+    Duration next;
+    Session  session;
 
-    for (session = delay->sessions; session != NULL; session = session->next)
-    {
+    session = timer_wheel_advance(&delay->wheel, now);
+    while (session != NULL) {
+        Session       next_session = session->wheel_next;
         QueuedPacket  packet = session->packet;
 
-        if (packet == NULL)
-            continue;
-
-        if (session->expiration <= now) {
+        session->wheel_next = NULL;
+        if (packet != NULL) {
             /* send the SYN packet now */
-                    //fprintf(stderr, "NetDelay:RST: sending creation for %s\n", session_to_string(session) );
             delay->send_func( packet->data, packet->size, packet->opaque );
             session->packet = NULL;
-            queued_packet_free( packet );
-        } else {
-            if (!rearm) {
-                rearm      = 1;
-                rearm_time = session->expiration;
-            }
-            else if ( session->expiration < rearm_time )
-                rearm_time = session->expiration;
+            queued_packet_free( &delay->pool, packet );
         }
+        session = next_session;
     }
 
-    if (rearm) {
-        loopTimer_startAbsolute(delay->timer, rearm_time);
+    next = timer_wheel_next(&delay->wheel);
+    if (next != DURATION_INFINITE) {
+        loopTimer_startAbsolute(delay->timer, next);
+    } else {
+        loopTimer_stop(delay->timer);
     }
 }
 
@@ -478,10 +756,14 @@ netdelay_create( NetShaperSendFunc  send_func )
 {
     NetDelay  delay = malloc(sizeof(*delay));
 
-    delay->sessions     = NULL;
+    delay->num_buckets  = SESSION_HASH_MIN_SIZE;
+    delay->buckets      = calloc(delay->num_buckets, sizeof(*delay->buckets));
     delay->num_sessions = 0;
     delay->timer = loopTimer_newWithClock(
             looper_getForThread(), netdelay_expires, delay, SHAPER_CLOCK);
+    timer_wheel_init(&delay->wheel,
+                     looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK));
+    queued_packet_pool_init(&delay->pool);
     delay->active = 0;
     delay->min_ms = 0;
     delay->max_ms = 0;
@@ -496,17 +778,8 @@ void
 netdelay_set_latency( NetDelay  delay, int  min_ms, int  max_ms )
 {
     /* when changing the latency, accept all sessions */
-    while (delay->sessions) {
-        Session  session = delay->sessions;
-        delay->sessions = session->next;
-        session->next = NULL;
-        if (session->packet) {
-            QueuedPacket  packet = session->packet;
-            delay->send_func( packet->data, packet->size, packet->opaque );
-        }
-        session_free(session);
-        delay->num_sessions--;
-    }
+    netdelay_clear_sessions(delay, 1);
+    loopTimer_stop(delay->timer);
 
     delay->min_ms = min_ms;
     delay->max_ms = max_ms;
@@ -533,10 +806,8 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
             Session*  lookup  = netdelay_lookup_session( delay, info );
             Session   session = *lookup;
             if (session != NULL) {
-                //fprintf(stderr, "NetDelay:RST: dropping %s\n", session_to_string(info) );
-
                 *lookup = session->next;
-                session_free( session );
+                session_free( delay, session );
                 delay->num_sessions -= 1;
             }
         }
@@ -551,7 +822,6 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                    /* this is a SYN re-transmission, since we didn't
                     * send the original SYN packet yet, just eat this one
                     */
-                    //fprintf(stderr, "NetDelay:RST: swallow SYN re-send for %s\n", session_to_string(info) );
                     return;
                 }
             } else {
@@ -562,11 +832,10 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                  if (range > 0)
                     latency += rand() % range;
 
-                    //fprintf(stderr, "NetDelay:RST: delay creation for %s\n", session_to_string(info) );
                 session = malloc( sizeof(*session) );
 
-                session->next        = delay->sessions;
-                delay->sessions      = session;
+                session->next = *lookup;
+                *lookup       = session;
                 delay->num_sessions += 1;
 
                 session->expiration = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK) + latency;
@@ -577,9 +846,18 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                 session->dst_port = info->dst_port;
                 session->protocol = info->protocol;
 
-                session->packet = queued_packet_create( data, size, opaque, 1 );
+                session->packet = queued_packet_create( &delay->pool, data, size, opaque, 1 );
 
+                /* bring the wheel up to date before adding to it */
+                session->wheel_next  = NULL;
+                session->wheel_pprev = NULL;
                 netdelay_expires(delay, delay->timer);
+                timer_wheel_add(&delay->wheel, session);
+                loopTimer_startAbsolute(delay->timer,
+                                        timer_wheel_next(&delay->wheel));
+
+                if ((unsigned)delay->num_sessions > 2*delay->num_buckets)
+                    netdelay_resize(delay, 2*delay->num_buckets);
                 return;
             }
         }
@@ -593,12 +871,10 @@ void
 netdelay_destroy( NetDelay  delay )
 {
     if (delay) {
-        while (delay->sessions) {
-            Session  session = delay->sessions;
-            delay->sessions = session->next;
-            session_free(session);
-            delay->num_sessions -= 1;
-        }
+        netdelay_clear_sessions(delay, 0);
+        free(delay->buckets);
+        delay->buckets = NULL;
+        queued_packet_pool_done(&delay->pool);
         loopTimer_stop(delay->timer);
         loopTimer_free(delay->timer);
         delay->timer = NULL;
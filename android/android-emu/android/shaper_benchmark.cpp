@@ -0,0 +1,165 @@
+// Copyright 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A benchmark for the network shaper and delayer of android/shaper.c, fed
+// with full size TCP frames at gigabit rates, the way net-android.cpp uses
+// them between the guest NIC and slirp.
+
+#include "android/shaper.h"
+#include "android/utils/looper.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr size_t kFrameSize = 1514;
+
+size_t gDelivered = 0;
+
+void countPacket(void*, size_t size, void*) {
+    gDelivered += size;
+}
+
+// Builds an Ethernet + IPv4 + TCP frame from 192.168.0.1:|srcPort| to
+// 192.168.0.2:80, with the given TCP |flags|.
+std::vector<uint8_t> makeFrame(int srcPort, uint8_t flags) {
+    std::vector<uint8_t> frame(kFrameSize);
+    uint8_t* ip = &frame[14];
+    uint8_t* tcp = ip + 20;
+
+    frame[12] = 0x08;  // ETH_P_IP
+    ip[0] = 0x45;
+    ip[8] = 64;  // TTL
+    ip[9] = 6;   // TCP
+    memcpy(ip + 12, "\xc0\xa8\x00\x01", 4);
+    memcpy(ip + 16, "\xc0\xa8\x00\x02", 4);
+    tcp[0] = uint8_t(srcPort >> 8);
+    tcp[1] = uint8_t(srcPort);
+    tcp[3] = 80;
+    tcp[12] = 0x50;
+    tcp[13] = flags;
+    return frame;
+}
+
+// Runs the current thread's looper until |bytes| have gone through.
+void drain(size_t bytes) {
+    Looper* looper = looper_getForThread();
+    while (gDelivered < bytes) {
+        looper_runWithDeadline(looper, looper_now(looper) + 1);
+    }
+}
+
+// Cost of queueing packets behind a blocked shaper and flushing them.
+// range_x: number of queued packets.
+void BM_NetShaperQueue(benchmark::State& state) {
+    const int count = state.range_x();
+    auto frame = makeFrame(1024, 0x10);
+    NetShaper shaper = netshaper_create(1, countPacket);
+
+    while (state.KeepRunning()) {
+        // Slow enough for everything past the first packet to be queued.
+        netshaper_set_rate(shaper, 1e3);
+        for (int i = 0; i < count; ++i) {
+            netshaper_send(shaper, frame.data(), frame.size());
+        }
+        netshaper_set_rate(shaper, 0);
+    }
+    netshaper_destroy(shaper);
+    state.SetItemsProcessed(int64_t(state.iterations()) * count);
+}
+
+// Sends bursts of frames through a shaper limited to range_x Mbit/s and
+// waits for all of them, so the reported rate should be the configured
+// one unless the shaper can't keep up.
+void BM_NetShaperThroughput(benchmark::State& state) {
+    constexpr int kBurst = 256;
+    auto frame = makeFrame(1024, 0x10);
+    NetShaper shaper = netshaper_create(1, countPacket);
+    netshaper_set_rate(shaper, state.range_x() * 1e6);
+
+    gDelivered = 0;
+    size_t sent = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < kBurst; ++i) {
+            netshaper_send(shaper, frame.data(), frame.size());
+        }
+        sent += kBurst * frame.size();
+        drain(sent);
+    }
+    netshaper_destroy(shaper);
+    state.SetBytesProcessed(int64_t(sent));
+    state.SetItemsProcessed(int64_t(state.iterations()) * kBurst);
+}
+
+// Connection churn in a delayer that already holds range_x delayed
+// connections: each iteration opens a new one and resets it before its
+// SYN went out, which is a session lookup, insertion in the timer wheel
+// and removal from both.
+void BM_NetDelaySynRst(benchmark::State& state) {
+    const int background = state.range_x();
+    NetDelay delay = netdelay_create(countPacket);
+    netdelay_set_latency(delay, 60000, 120000);
+
+    for (int i = 0; i < background; ++i) {
+        auto syn = makeFrame(1024 + i % 60000, 0x02);
+        syn[14 + 15] = uint8_t(i / 60000);  // vary the source address
+        netdelay_send(delay, syn.data(), syn.size());
+    }
+
+    auto syn = makeFrame(65000, 0x02);
+    auto rst = makeFrame(65000, 0x04);
+    while (state.KeepRunning()) {
+        netdelay_send(delay, syn.data(), syn.size());
+        netdelay_send(delay, rst.data(), rst.size());
+    }
+    netdelay_destroy(delay);
+    state.SetItemsProcessed(int64_t(state.iterations()) * 2);
+}
+
+// Time for a delayer to release range_x connections opened together, with
+// latencies spread over 1 to 50 ms.
+void BM_NetDelayRelease(benchmark::State& state) {
+    const int count = state.range_x();
+    std::vector<std::vector<uint8_t>> syns;
+    for (int i = 0; i < count; ++i) {
+        syns.push_back(makeFrame(1024 + i, 0x02));
+    }
+    NetDelay delay = netdelay_create(countPacket);
+
+    gDelivered = 0;
+    size_t sent = 0;
+    while (state.KeepRunning()) {
+        netdelay_set_latency(delay, 1, 50);
+        for (const auto& syn : syns) {
+            netdelay_send(delay, syn.data(), syn.size());
+        }
+        sent += count * kFrameSize;
+        drain(sent);
+    }
+    netdelay_destroy(delay);
+    state.SetItemsProcessed(int64_t(state.iterations()) * count);
+}
+
+}  // namespace
+
+BENCHMARK(BM_NetShaperQueue)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_NetShaperThroughput)->Arg(100)->Arg(1000)->Arg(10000)->UseRealTime();
+BENCHMARK(BM_NetDelaySynRst)->Arg(16)->Arg(1024)->Arg(65536);
+BENCHMARK(BM_NetDelayRelease)->Arg(64)->Arg(4096)->UseRealTime();
+
+BENCHMARK_MAIN()
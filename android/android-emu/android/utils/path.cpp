@@ -22,6 +22,7 @@
 #include "android/base/files/ScopedFileHandle.h"
 #include "android/base/system/Win32UnicodeString.h"
 
+#include <algorithm>
 #include <memory>
 #include <stdio.h>
 #include <string.h>
@@ -46,6 +47,11 @@
 #include <signal.h>
 #endif
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef __APPLE__
 #include <copyfile.h>
 #endif
@@ -413,6 +419,240 @@ APosixStatus path_copy_file_impl(const char*  dest, const char*  source) {
     return result;
 }
 
+#ifdef __linux__
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#define SEEK_HOLE 4
+#endif
+
+/* Disk images are mostly empty, so the Linux version of path_copy_file()
+ * avoids copying (or even reading) their zeros where it can:
+ *
+ *   - If both files are on a filesystem with reflink support (btrfs, xfs),
+ *     the destination simply shares the source's extents.
+ *
+ *   - If the source is sparse, only its data extents (as reported by
+ *     SEEK_DATA / SEEK_HOLE) are copied, with copy_file_range() so that
+ *     the data doesn't go through user space.
+ *
+ *   - Otherwise, the file is read by large chunks and only the blocks
+ *     that are not all zeroes are written, making the destination sparse.
+ *
+ * In all cases the destination is finally truncated to the source's size.
+ */
+static const size_t kCopyBufferSize = 1024 * 1024;
+static const size_t kCopyZeroBlockSize = 4096;
+
+struct LinuxFileCopy {
+    const char* source;
+    int fs;
+    int fd;
+    off_t size;
+    bool useKernelCopy = true;
+    std::unique_ptr<char[]> buffer;
+    off_t copied = 0;   /* bytes of the source done so far */
+    off_t written = 0;  /* bytes written to the destination */
+    off_t nextReport = 0;
+};
+
+static void copy_report_progress(LinuxFileCopy* copy) {
+    static const off_t kReportInterval = 512 * 1024 * 1024;
+    if (copy->size < kReportInterval || copy->copied < copy->nextReport) {
+        return;
+    }
+    copy->nextReport = copy->copied + kReportInterval;
+    D("Copying '%s': %lld of %lld MB", copy->source,
+      (long long)(copy->copied >> 20), (long long)(copy->size >> 20));
+}
+
+static bool copy_is_zero(const char* data, size_t size) {
+    return data[0] == 0 && memcmp(data, data + 1, size - 1) == 0;
+}
+
+static bool copy_pwrite_all(int fd, const char* data, size_t size,
+                            off_t offset) {
+    while (size > 0) {
+        const ssize_t ret = HANDLE_EINTR(pwrite(fd, data, size, offset));
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        size -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+/* Copy [offset, end) through user space, skipping zero blocks. */
+static int copy_range_buffered(LinuxFileCopy* copy, off_t offset, off_t end) {
+    if (!copy->buffer) {
+        copy->buffer.reset(new char[kCopyBufferSize]);
+    }
+    char* const buf = copy->buffer.get();
+    while (offset < end) {
+        const size_t chunk = std::min<off_t>(end - offset, kCopyBufferSize);
+        const ssize_t len = HANDLE_EINTR(pread(copy->fs, buf, chunk, offset));
+        if (len < 0) {
+            return -1;
+        }
+        if (len == 0) {
+            /* the source was truncated under us: don't let the caller pad
+             * the copy with zeros */
+            errno = EIO;
+            return -1;
+        }
+        /* write runs of non-zero blocks */
+        ssize_t runStart = -1;
+        for (ssize_t pos = 0; pos < len || runStart >= 0;) {
+            const size_t block = std::min<size_t>(len - pos,
+                                                  kCopyZeroBlockSize);
+            const bool isData = block > 0 && !copy_is_zero(buf + pos, block);
+            if (isData && runStart < 0) {
+                runStart = pos;
+            } else if (!isData && runStart >= 0) {
+                const size_t runLen = pos - runStart;
+                if (!copy_pwrite_all(copy->fd, buf + runStart, runLen,
+                                     offset + runStart)) {
+                    return -1;
+                }
+                copy->written += runLen;
+                runStart = -1;
+            }
+            pos += block;
+        }
+        offset += len;
+        copy->copied += len;
+        copy_report_progress(copy);
+    }
+    return 0;
+}
+
+/* Copy [offset, end) with copy_file_range(), or fall back to
+ * copy_range_buffered() if the kernel or filesystems don't support it. */
+static int copy_range(LinuxFileCopy* copy, off_t offset, off_t end) {
+#ifdef __NR_copy_file_range
+    while (copy->useKernelCopy && offset < end) {
+        loff_t inOffset = offset;
+        loff_t outOffset = offset;
+        const size_t chunk = std::min<off_t>(end - offset, 1 << 30);
+        const ssize_t len = HANDLE_EINTR(syscall(__NR_copy_file_range,
+                copy->fs, &inOffset, copy->fd, &outOffset, chunk, 0));
+        if (len < 0) {
+            if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+                errno != EOPNOTSUPP) {
+                return -1;
+            }
+            copy->useKernelCopy = false;
+            break;
+        }
+        if (len == 0) {
+            /* some filesystems (e.g. procfs, FUSE) copy nothing instead of
+             * failing: let pread() tell that from a truncated source */
+            copy->useKernelCopy = false;
+            break;
+        }
+        offset += len;
+        copy->copied += len;
+        copy->written += len;
+        copy_report_progress(copy);
+    }
+#endif  // __NR_copy_file_range
+    return copy_range_buffered(copy, offset, end);
+}
+
+static APosixStatus path_copy_file_linux(const char* dest, const char* source) {
+    const int fs = HANDLE_EINTR(open(source, O_RDONLY | O_CLOEXEC));
+    if (fs < 0) {
+        return -1;
+    }
+    const int fd = HANDLE_EINTR(open(dest, O_WRONLY | O_CREAT | O_TRUNC |
+                                     O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd < 0) {
+        close(fs);
+        return -1;
+    }
+
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    LinuxFileCopy copy;
+    copy.source = source;
+    copy.fs = fs;
+    copy.fd = fd;
+
+    int result = 0;
+    const char* method;
+    struct stat st;
+    if (HANDLE_EINTR(fstat(fs, &st)) < 0) {
+        result = -1;
+        method = "none";
+    } else if (ioctl(fd, FICLONE, fs) == 0) {
+        method = "reflink";
+        copy.size = copy.copied = st.st_size;
+    } else {
+        copy.size = st.st_size;
+        posix_fadvise(fs, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+
+        /* SEEK_HOLE returns the file size if there are no holes, and fails
+         * if the filesystem doesn't know about them. */
+        const off_t firstHole = lseek(fs, 0, SEEK_HOLE);
+        if (firstHole >= 0 && firstHole < st.st_size) {
+            method = "sparse";
+            off_t pos = 0;
+            while (result == 0 && pos < st.st_size) {
+                const off_t data = lseek(fs, pos, SEEK_DATA);
+                if (data < 0) {
+                    /* ENXIO means there is only a hole past |pos| */
+                    result = (errno == ENXIO) ? 0 : -1;
+                    break;
+                }
+                off_t hole = lseek(fs, data, SEEK_HOLE);
+                if (hole < 0) {
+                    hole = st.st_size;
+                }
+                copy.copied += data - pos;
+                result = copy_range(&copy, data, hole);
+                pos = hole;
+            }
+        } else {
+            method = "sparsify";
+            result = copy_range_buffered(&copy, 0, st.st_size);
+        }
+        if (result == 0 &&
+            HANDLE_EINTR(ftruncate(fd, st.st_size)) < 0) {
+            result = -1;
+        }
+        if (result == 0 && !strcmp(method, "sparse") && !copy.useKernelCopy) {
+            method = "sparse, buffered";
+        }
+    }
+
+    if (result < 0) {
+        D("Failed to copy '%s' to '%s': %s (%d)",
+          source, dest, strerror(errno), errno);
+    } else if (VERBOSE_CHECK(init)) {
+        struct timespec endTime;
+        clock_gettime(CLOCK_MONOTONIC, &endTime);
+        const double seconds = (endTime.tv_sec - startTime.tv_sec) +
+                               (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+        D("Copied '%s' to '%s' (%s): %lld MB, %lld MB written in %.2f s, "
+          "%.1f MB/s", source, dest, method, (long long)(copy.size >> 20),
+          (long long)(copy.written >> 20), seconds,
+          seconds > 0 ? copy.size / seconds / (1024 * 1024) : 0.);
+    }
+
+    close(fs);
+    close(fd);
+    return result;
+}
+
+#endif  // __linux__
+
 APosixStatus
 path_copy_file( const char*  dest, const char*  source )
 {
@@ -449,7 +689,7 @@ path_copy_file( const char*  dest, const char*  source )
     }
     return 0;
 #else  // linux
-    return path_copy_file_impl<65536>(dest, source);
+    return path_copy_file_linux(dest, source);
 #endif
 }
 
@@ -11,11 +11,14 @@
 
 #include "android/utils/path.h"
 
+#include "android/base/misc/FileUtils.h"
 #include "android/base/testing/TestSystem.h"
 #include "android/base/testing/TestTempDir.h"
 
 #include "gtest/gtest.h"
 
+#include <stdio.h>
+
 using android::base::TestTempDir;
 
 namespace android {
@@ -117,5 +120,48 @@ TEST(Path, EscapePath) {
     free(result);
 }
 
+TEST(Path, CopyFile) {
+    TestTempDir dir("path_copy_file");
+    const std::string source = dir.makeSubPath("source");
+    const std::string dest = dir.makeSubPath("dest");
+
+    // Data, a hole, more data spanning a partial block, and a hole up to
+    // the end of the file: the copy must read back identical.
+    std::string expected(3 * 1024 * 1024 + 12345, '\0');
+    for (size_t i = 0; i < 100000; ++i) {
+        expected[i] = char(i * 7 + 1);
+    }
+    for (size_t i = 2 * 1024 * 1024; i < 2 * 1024 * 1024 + 5000; ++i) {
+        expected[i] = char(i * 13 + 1);
+    }
+    FILE* file = fopen(source.c_str(), "wb");
+    ASSERT_TRUE(file);
+    EXPECT_EQ(100000U, fwrite(expected.data(), 1, 100000, file));
+    fseek(file, 2 * 1024 * 1024, SEEK_SET);
+    EXPECT_EQ(5000U, fwrite(expected.data() + 2 * 1024 * 1024, 1, 5000, file));
+    fseek(file, expected.size() - 1, SEEK_SET);
+    EXPECT_EQ(1U, fwrite("", 1, 1, file));
+    fclose(file);
+
+    ASSERT_EQ(0, path_copy_file(dest.c_str(), source.c_str()));
+    auto copied = readFileIntoString(dest);
+    ASSERT_TRUE(copied);
+    EXPECT_EQ(expected.size(), copied->size());
+    EXPECT_TRUE(expected == *copied);
+
+    // Copying over an existing, larger file truncates it.
+    file = fopen(source.c_str(), "wb");
+    ASSERT_TRUE(file);
+    EXPECT_EQ(5U, fwrite("hello", 1, 5, file));
+    fclose(file);
+    ASSERT_EQ(0, path_copy_file(dest.c_str(), source.c_str()));
+    copied = readFileIntoString(dest);
+    ASSERT_TRUE(copied);
+    EXPECT_EQ(std::string("hello"), *copied);
+
+    EXPECT_EQ(-1, path_copy_file(dest.c_str(),
+                                 dir.makeSubPath("missing").c_str()));
+}
+
 }  // namespace path
 }  // namespace android
@@ -14,6 +14,7 @@
 #pragma once
 
 #include "OpenglRender/RenderChannel.h"
+#include "OpenglRender/RendererStats.h"
 #include "OpenglRender/render_api_platform_types.h"
 #include "android/base/files/Stream.h"
 #include "android/snapshot/common.h"
@@ -180,6 +181,12 @@ public:
                       const android::snapshot::ITextureLoaderPtr& textureLoader) = 0;
     // Fill GLES usage protobuf
     virtual void fillGLESUsages(android_studio::EmulatorGLESUsages*) = 0;
+
+    // Turns on or off counting the work done by the renderer, which is off
+    // by default as it adds to the processing of every guest command buffer.
+    virtual void setStatsEnabled(bool enabled) = 0;
+    // Returns what the renderer counted so far, see RendererStats.
+    virtual RendererStats getStats() = 0;
 protected:
     ~Renderer() = default;
 };
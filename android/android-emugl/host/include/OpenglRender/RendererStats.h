@@ -0,0 +1,126 @@
+// Copyright (C) 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace emugl {
+
+// A distribution of latencies in power-of-two buckets: bucket |i| counts
+// the samples of [2^i, 2^(i+1)) microseconds, except for the first one that
+// also counts anything shorter and the last one anything longer.
+struct LatencyHistogram {
+    static constexpr int kBuckets = 24;
+
+    uint64_t buckets[kBuckets] = {};
+    uint64_t count = 0;
+    uint64_t totalUs = 0;
+    uint64_t maxUs = 0;
+
+    static int bucketOf(uint64_t us) {
+        int bucket = 0;
+        while (us > 1 && bucket < kBuckets - 1) {
+            us >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void add(const LatencyHistogram& other) {
+        for (int i = 0; i < kBuckets; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        totalUs += other.totalUs;
+        if (other.maxUs > maxUs) {
+            maxUs = other.maxUs;
+        }
+    }
+
+    // Returns an upper bound of the |percentile|th (0 to 100) latency: the
+    // end of its bucket, or |maxUs| if smaller. 0 if there are no samples.
+    uint64_t percentileUs(double percentile) const {
+        if (!count) {
+            return 0;
+        }
+        const uint64_t rank = (uint64_t)(count * percentile / 100.0);
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += buckets[i];
+            if (seen > rank) {
+                const uint64_t end = 2ULL << i;
+                return end < maxUs ? end : maxUs;
+            }
+        }
+        return maxUs;
+    }
+};
+
+// What the renderer did since its statistics were enabled, see
+// Renderer::setStatsEnabled(). The per-thread counts only cover the render
+// threads running right now, while the totals also include those that
+// exited since.
+struct RendererStats {
+    bool enabled = false;
+
+    // Guest command stream decoding, with the number of commands per
+    // decoder.
+    uint64_t bytesDecoded = 0;
+    uint64_t gles1Commands = 0;
+    uint64_t gles2Commands = 0;
+    uint64_t renderControlCommands = 0;
+
+    // Guest pixel transfers to and from color buffers.
+    uint64_t colorBufferUploads = 0;
+    uint64_t colorBufferUploadBytes = 0;
+    uint64_t colorBufferReadbacks = 0;
+    uint64_t colorBufferReadbackBytes = 0;
+
+    // Frames posted by the guest, and those replaced by a newer one before
+    // they could be displayed.
+    uint64_t posts = 0;
+    uint64_t droppedPosts = 0;
+    // Time from post to present of the last frames displayed.
+    uint64_t postLatencyAvgUs = 0;
+    uint64_t postLatencyMaxUs = 0;
+
+    // Guest waits on sync objects, on the render threads.
+    LatencyHistogram syncWaitLatency;
+    // Guest native fences waited on by the sync threads, from the wait
+    // request to the signal.
+    uint64_t fenceWaits = 0;
+    uint64_t fenceWaitAvgUs = 0;
+    uint64_t fenceWaitMaxUs = 0;
+    // Fences waited on right now, and at most at once.
+    uint32_t fenceQueueDepth = 0;
+    uint32_t fenceQueueDepthMax = 0;
+
+    // Time to decode a buffer of commands read from the guest, over all
+    // render threads.
+    LatencyHistogram decodeLatency;
+
+    struct RenderThread {
+        // Sequential, in the order the render threads were started.
+        uint64_t id = 0;
+        uint64_t bytesDecoded = 0;
+        uint64_t commands = 0;
+        LatencyHistogram decodeLatency;
+        LatencyHistogram syncWaitLatency;
+    };
+    std::vector<RenderThread> renderThreads;
+};
+
+}  // namespace emugl
@@ -445,7 +445,7 @@ void CoreProfileEngine::setupArrayForDraw(
         gl.glEnableVertexAttribArray(attribNum);
         gl.glBindBuffer(GL_ARRAY_BUFFER, getVboFor(arrayType));
 
-        GLESConversionArrays arrs;
+        GLESConversionArrays arrs(mCtx->conversionArena());
 
         bool convert = mCtx->doConvert(arrs, first, count, indicesType, indices, !isIndexed, p, arrayType);
         ArrayData currentArr = arrs.getCurrentArray();
@@ -1830,7 +1830,7 @@ void GLEScmContext::drawArrays(GLenum mode, GLint first, GLsizei count) {
         core().clientActiveTexture(activeTexture);
         core().drawArrays(mode, first, count);
     } else {
-        GLESConversionArrays tmpArrs;
+        GLESConversionArrays tmpArrs(conversionArena());
 
         setupArraysPointers(tmpArrs,first,count,0,NULL,true);
 
@@ -1886,7 +1886,7 @@ void GLEScmContext::drawElements(GLenum mode, GLsizei count, GLenum type, const
         core().clientActiveTexture(activeTexture);
         core().drawElements(mode, count, type, indices);
     } else {
-        GLESConversionArrays tmpArrs;
+        GLESConversionArrays tmpArrs(conversionArena());
 
         setupArraysPointers(tmpArrs,0,count,type,indices,false);
         if(mode == GL_POINTS && isArrEnabled(GL_POINT_SIZE_ARRAY_OES)){
@@ -649,12 +649,17 @@ GL_API void GL_APIENTRY  glCompressedTexSubImage2D( GLenum target, GLint level,
     GLES_CM_TRACE()
     SET_ERROR_IF(!(GLEScmValidate::texCompImgFrmt(format) && GLEScmValidate::textureTargetEx(target)),GL_INVALID_ENUM);
     SET_ERROR_IF(level < 0 || level > log2(ctx->getMaxTexSize()),GL_INVALID_VALUE)
+    SET_ERROR_IF(imageSize < (GLsizei)getPaletteSizeBytes(format),GL_INVALID_VALUE);
     SET_ERROR_IF(!data,GL_INVALID_OPERATION);
 
+    // |data| only holds the updated region of |level|, which is decoded
+    // into the context's scratch arena.
     GLenum uncompressedFrmt;
-    unsigned char* uncompressed = uncompressTexture(format,uncompressedFrmt,width,height,imageSize,data,level);
+    GLESConversionScratch scratch(ctx->conversionArena());
+    unsigned char* uncompressed = (unsigned char*)scratch.alloc(
+            getPaletteDecodedSize(format,uncompressedFrmt,width,height,0));
+    uncompressTexture(format,width,height,imageSize,data,0,uncompressed);
     ctx->dispatcher().glTexSubImage2D(target,level,xoffset,yoffset,width,height,uncompressedFrmt,GL_UNSIGNED_BYTE,uncompressed);
-    delete uncompressed;
     TextureData* texData = getTextureTargetData(target);
     if (texData) {
         texData->makeDirty();
@@ -10,11 +10,14 @@
 // GNU General Public License for more details.
 
 #include "ANGLEShaderParser.h"
+#include "ShaderCache.h"
 
+#include "android/base/files/MemStream.h"
 #include "android/base/synchronization/Lock.h"
 
 #include <map>
 #include <string>
+#include <utility>
 
 #define SH_GLES31_SPEC ((ShShaderSpec)0x8B88)
 #define GL_COMPUTE_SHADER 0x91B9
@@ -24,6 +27,12 @@ namespace ANGLEShaderParser {
 ShBuiltInResources kResources;
 bool kInitialized = false;
 
+// The parameters of initializeResources(), which affect translation.
+static std::string sResourcesKey;
+
+// Bump when the layout of cached translations changes.
+static const int kTranslationCacheVersion = 1;
+
 struct ShaderSpecKey {
     GLenum shaderType;
     int esslVersion;
@@ -127,6 +136,17 @@ void initializeResources(
     kResources.OES_standard_derivatives = 1;
     kResources.OES_EGL_image_external = 0;
     kResources.EXT_gpu_shader5 = 1;
+
+    const int params[] = {
+            attribs, uniformVectors, varyingVectors, vertexTextureImageUnits,
+            combinedTexImageUnits, textureImageUnits, fragmentUniformVectors,
+            drawBuffers, fragmentPrecisionHigh, vertexOutputComponents,
+            fragmentInputComponents, minProgramTexelOffset,
+            maxProgramTexelOffset, maxDualSourceDrawBuffers};
+    sResourcesKey.clear();
+    for (int param : params) {
+        sResourcesKey += std::to_string(param) + ",";
+    }
 }
 
 bool globalInitialize(
@@ -191,6 +211,182 @@ static void getShaderLinkInfo(ShHandle compilerHandle,
     if (interfaceBlocks) linkInfo->interfaceBlocks = *interfaceBlocks;
 }
 
+using android::base::MemStream;
+using android::base::Stream;
+
+static void saveVariable(Stream* stream, const sh::ShaderVariable& var) {
+    stream->putBe32(var.type);
+    stream->putBe32(var.precision);
+    stream->putString(var.name);
+    stream->putString(var.mappedName);
+    stream->putBe32(var.arraySize);
+    stream->putByte(var.staticUse);
+    stream->putString(var.structName);
+    stream->putBe32(var.fields.size());
+    for (const auto& field : var.fields) {
+        saveVariable(stream, field);
+    }
+}
+
+static void loadVariable(Stream* stream, sh::ShaderVariable* var) {
+    var->type = stream->getBe32();
+    var->precision = stream->getBe32();
+    var->name = stream->getString();
+    var->mappedName = stream->getString();
+    var->arraySize = stream->getBe32();
+    var->staticUse = stream->getByte();
+    var->structName = stream->getString();
+    var->fields.resize(stream->getBe32());
+    for (auto& field : var->fields) {
+        loadVariable(stream, &field);
+    }
+}
+
+// Members of the variable types that ShaderVariable doesn't have.
+static void saveExtra(Stream*, const sh::Uniform&) {}
+static void loadExtra(Stream*, sh::Uniform*) {}
+
+static void saveExtra(Stream* stream, const sh::Varying& var) {
+    stream->putBe32(var.interpolation);
+    stream->putByte(var.isInvariant);
+}
+static void loadExtra(Stream* stream, sh::Varying* var) {
+    var->interpolation = (sh::InterpolationType)stream->getBe32();
+    var->isInvariant = stream->getByte();
+}
+
+static void saveExtra(Stream* stream, const sh::Attribute& var) {
+    stream->putBe32(var.location);
+}
+static void loadExtra(Stream* stream, sh::Attribute* var) {
+    var->location = stream->getBe32();
+}
+
+static void saveExtra(Stream* stream, const sh::OutputVariable& var) {
+    stream->putBe32(var.location);
+}
+static void loadExtra(Stream* stream, sh::OutputVariable* var) {
+    var->location = stream->getBe32();
+}
+
+template <class T>
+static void saveVariables(Stream* stream, const std::vector<T>& vars) {
+    stream->putBe32(vars.size());
+    for (const auto& var : vars) {
+        saveVariable(stream, var);
+        saveExtra(stream, var);
+    }
+}
+
+template <class T>
+static void loadVariables(Stream* stream, std::vector<T>* vars) {
+    vars->resize(stream->getBe32());
+    for (auto& var : *vars) {
+        loadVariable(stream, &var);
+        loadExtra(stream, &var);
+    }
+}
+
+static void saveInterfaceBlocks(Stream* stream,
+                                const std::vector<sh::InterfaceBlock>& blocks) {
+    stream->putBe32(blocks.size());
+    for (const auto& block : blocks) {
+        stream->putString(block.name);
+        stream->putString(block.mappedName);
+        stream->putString(block.instanceName);
+        stream->putBe32(block.arraySize);
+        stream->putBe32(block.layout);
+        stream->putByte(block.isRowMajorLayout);
+        stream->putByte(block.staticUse);
+        stream->putBe32(block.fields.size());
+        for (const auto& field : block.fields) {
+            saveVariable(stream, field);
+            stream->putByte(field.isRowMajorLayout);
+        }
+    }
+}
+
+static void loadInterfaceBlocks(Stream* stream,
+                                std::vector<sh::InterfaceBlock>* blocks) {
+    blocks->resize(stream->getBe32());
+    for (auto& block : *blocks) {
+        block.name = stream->getString();
+        block.mappedName = stream->getString();
+        block.instanceName = stream->getString();
+        block.arraySize = stream->getBe32();
+        block.layout = (sh::BlockLayoutType)stream->getBe32();
+        block.isRowMajorLayout = stream->getByte();
+        block.staticUse = stream->getByte();
+        block.fields.resize(stream->getBe32());
+        for (auto& field : block.fields) {
+            loadVariable(stream, &field);
+            field.isRowMajorLayout = stream->getByte();
+        }
+    }
+}
+
+// A cached translation holds everything translate() returns.
+static std::string saveTranslation(bool valid,
+                                   const std::string& infolog,
+                                   const std::string& objCode,
+                                   const ShaderLinkInfo& linkInfo) {
+    MemStream stream;
+    stream.putByte(valid);
+    stream.putString(infolog);
+    stream.putString(objCode);
+    saveVariables(&stream, linkInfo.uniforms);
+    saveVariables(&stream, linkInfo.varyings);
+    saveVariables(&stream, linkInfo.attributes);
+    saveVariables(&stream, linkInfo.outputVars);
+    saveInterfaceBlocks(&stream, linkInfo.interfaceBlocks);
+    stream.putBe32(linkInfo.nameMap.size());
+    for (const auto& elt : linkInfo.nameMap) {
+        stream.putString(elt.first);
+        stream.putString(elt.second);
+    }
+    const auto& buffer = stream.buffer();
+    return std::string(buffer.data(), stream.writtenSize());
+}
+
+static bool loadTranslation(const std::string& entry,
+                            std::string* outInfolog,
+                            std::string* outObjCode,
+                            ShaderLinkInfo* outShaderLinkInfo) {
+    MemStream stream(MemStream::Buffer(entry.begin(), entry.end()));
+    const bool valid = stream.getByte();
+    *outInfolog = stream.getString();
+    *outObjCode = stream.getString();
+    if (!outShaderLinkInfo) {
+        return valid;
+    }
+    *outShaderLinkInfo = ShaderLinkInfo();
+    loadVariables(&stream, &outShaderLinkInfo->uniforms);
+    loadVariables(&stream, &outShaderLinkInfo->varyings);
+    loadVariables(&stream, &outShaderLinkInfo->attributes);
+    loadVariables(&stream, &outShaderLinkInfo->outputVars);
+    loadInterfaceBlocks(&stream, &outShaderLinkInfo->interfaceBlocks);
+    for (uint32_t count = stream.getBe32(); count > 0; --count) {
+        std::string name = stream.getString();
+        std::string mappedName = stream.getString();
+        outShaderLinkInfo->nameMapReverse[mappedName] = name;
+        outShaderLinkInfo->nameMap[std::move(name)] = std::move(mappedName);
+    }
+    return valid;
+}
+
+// Everything a translation depends on: the translator, its resources and
+// output profile, and the shader itself.
+static std::string translationCacheKey(bool hostUsesCoreProfile,
+                                       int esslVersion,
+                                       const char* src,
+                                       GLenum shaderType) {
+    return std::to_string(kTranslationCacheVersion) + "," +
+           std::to_string(ANGLE_SH_VERSION) + "," + sResourcesKey +
+           std::to_string(hostUsesCoreProfile) + "," +
+           std::to_string(esslVersion) + "," + std::to_string(shaderType) +
+           "\n" + src;
+}
+
 bool translate(bool hostUsesCoreProfile,
                int esslVersion,
                const char* src,
@@ -220,8 +416,24 @@ bool translate(bool hostUsesCoreProfile,
         return false;
     }
 
+    // The same shaders are translated every time an app starts, and the
+    // cache is shared by all render threads, so look it up before taking
+    // the compiler lock.
+    std::string cacheKey;
+    if (ShaderCache::enabled()) {
+        cacheKey = translationCacheKey(hostUsesCoreProfile, esslVersion, src,
+                                       shaderType);
+        std::string entry;
+        if (ShaderCache::get("essl", cacheKey, &entry)) {
+            return loadTranslation(entry, outInfolog, outObjCode,
+                                   outShaderLinkInfo);
+        }
+    }
+
     // ANGLE may crash if multiple RenderThreads attempt to compile shaders
-    // at the same time.
+    // at the same time, even on different compiler handles: the translator
+    // keeps process-wide state that ShCompile() updates, such as the
+    // counter that numbers the symbols it parses.
     android::base::AutoLock autolock(kCompilerLock);
 
     ShaderSpecKey key;
@@ -249,7 +461,23 @@ bool translate(bool hostUsesCoreProfile,
 
     if (outShaderLinkInfo) getShaderLinkInfo(compilerHandle, outShaderLinkInfo);
 
+    std::string cacheEntry;
+    if (!cacheKey.empty()) {
+        ShaderLinkInfo linkInfo;
+        if (!outShaderLinkInfo) {
+            getShaderLinkInfo(compilerHandle, &linkInfo);
+        }
+        cacheEntry = saveTranslation(res, *outInfolog, *outObjCode,
+                                     outShaderLinkInfo ? *outShaderLinkInfo
+                                                       : linkInfo);
+    }
+
     ShClearResults(compilerHandle);
+    autolock.unlock();
+
+    if (!cacheKey.empty()) {
+        ShaderCache::put("essl", cacheKey, cacheEntry);
+    }
 
     return res;
 }
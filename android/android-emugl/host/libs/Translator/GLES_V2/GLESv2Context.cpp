@@ -473,7 +473,7 @@ void GLESv2Context::drawWithEmulations(
     }
 
     if (needClientVBOSetup) {
-        GLESConversionArrays tmpArrs;
+        GLESConversionArrays tmpArrs(conversionArena());
         setupArraysPointers(tmpArrs, 0, count, type, indices, false);
         if (needAtt0PreDrawValidation()) {
             if (indices) {
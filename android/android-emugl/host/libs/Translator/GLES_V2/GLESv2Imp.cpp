@@ -44,9 +44,12 @@
 #include "emugl/common/crash_reporter.h"
 
 #include "ANGLEShaderParser.h"
+#include "ShaderCache.h"
 
 #include <stdio.h>
+#include <string.h>
 
+#include <map>
 #include <numeric>
 #include <unordered_map>
 
@@ -2747,6 +2750,85 @@ GL_APICALL void  GL_APIENTRY glLineWidth(GLfloat width){
 #endif
 }
 
+// Program binaries are cached by the sources the host driver compiled,
+// the attribute bindings and the driver itself. Returns an empty key if
+// the cache is disabled, or the host can't save program binaries.
+static std::string sProgramBinaryCacheKey(GLEScontext* ctx,
+                                          ProgramData* programData,
+                                          ShaderParser* vertSp,
+                                          ShaderParser* fragSp) {
+    if (!ShaderCache::enabled() ||
+        programData->hasTransformFeedbackVaryings() ||
+        !ctx->dispatcher().glProgramBinary ||
+        !ctx->dispatcher().glGetProgramBinary) {
+        return std::string();
+    }
+    GLint numFormats = 0;
+    ctx->dispatcher().glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats <= 0) {
+        return std::string();
+    }
+
+    std::string key;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const GLubyte* str = ctx->dispatcher().glGetString(name);
+        key += str ? (const char*)str : "";
+        key += "\n";
+    }
+    const std::map<std::string, GLuint> attribLocs(
+            programData->boundAttribLocs.begin(),
+            programData->boundAttribLocs.end());
+    for (const auto& attrib : attribLocs) {
+        key += attrib.first + "=" + std::to_string(attrib.second) + "\n";
+    }
+    key += vertSp->getCompiledSrc();
+    key += '\0';
+    key += fragSp->getCompiledSrc();
+    return key;
+}
+
+// Entries hold the binary format, followed by the binary itself.
+static bool sLoadProgramBinary(GLEScontext* ctx, GLuint globalProgramName,
+                               const std::string& cacheKey) {
+    std::string entry;
+    GLenum format;
+    if (cacheKey.empty() || !ShaderCache::get("program", cacheKey, &entry) ||
+        entry.size() <= sizeof(format)) {
+        return false;
+    }
+    memcpy(&format, entry.data(), sizeof(format));
+    ctx->dispatcher().glProgramBinary(globalProgramName, format,
+                                      entry.data() + sizeof(format),
+                                      entry.size() - sizeof(format));
+    // The driver rejects binaries it can't use anymore, e.g. after an
+    // update that kept its version strings.
+    GLint linkStatus = GL_FALSE;
+    ctx->dispatcher().glGetProgramiv(globalProgramName, GL_LINK_STATUS,
+                                     &linkStatus);
+    return linkStatus == GL_TRUE;
+}
+
+static void sSaveProgramBinary(GLEScontext* ctx, GLuint globalProgramName,
+                               const std::string& cacheKey) {
+    GLint length = 0;
+    ctx->dispatcher().glGetProgramiv(globalProgramName,
+                                     GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    GLenum format = 0;
+    GLsizei written = 0;
+    std::string entry(sizeof(format) + length, '\0');
+    ctx->dispatcher().glGetProgramBinary(globalProgramName, length, &written,
+                                         &format, &entry[sizeof(format)]);
+    if (written <= 0) {
+        return;
+    }
+    memcpy(&entry[0], &format, sizeof(format));
+    entry.resize(sizeof(format) + written);
+    ShaderCache::put("program", cacheKey, entry);
+}
+
 GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
     GET_CTX_V2();
     GLint linkStatus = GL_FALSE;
@@ -2778,8 +2860,26 @@ GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
 
                 if(fragSp->getCompileStatus() && vertSp->getCompileStatus()) {
                     if (programData->validateLink(fragSp, vertSp)) {
-                        ctx->dispatcher().glLinkProgram(globalProgramName);
-                        ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+                        const std::string cacheKey = sProgramBinaryCacheKey(
+                                ctx, programData, vertSp, fragSp);
+                        if (sLoadProgramBinary(ctx, globalProgramName,
+                                               cacheKey)) {
+                            linkStatus = GL_TRUE;
+                        } else {
+                            if (!cacheKey.empty() &&
+                                ctx->dispatcher().glProgramParameteri) {
+                                ctx->dispatcher().glProgramParameteri(
+                                        globalProgramName,
+                                        GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                        GL_TRUE);
+                            }
+                            ctx->dispatcher().glLinkProgram(globalProgramName);
+                            ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+                            if (linkStatus == GL_TRUE && !cacheKey.empty()) {
+                                sSaveProgramBinary(ctx, globalProgramName,
+                                                   cacheKey);
+                            }
+                        }
                     } else {
                         programData->setLinkStatus(GL_FALSE);
                         programData->setErrInfoLog();
@@ -642,6 +642,11 @@ extern "C" GL_APICALL void GL_APIENTRY glTransformFeedbackVaryings(GLuint progra
     gles30usages->set_is_used(true);
     if (ctx->shareGroup().get()) {
         const GLuint globalProgramName = ctx->shareGroup()->getGlobalName(NamedObjectType::SHADER_OR_PROGRAM, program);
+        auto objData = ctx->shareGroup()->getObjectData(
+                NamedObjectType::SHADER_OR_PROGRAM, program);
+        if (objData && objData->getDataType() == PROGRAM_DATA) {
+            ((ProgramData*)objData)->setHasTransformFeedbackVaryings();
+        }
         ctx->dispatcher().glTransformFeedbackVaryings(globalProgramName, count, varyings, bufferMode);
     }
 }
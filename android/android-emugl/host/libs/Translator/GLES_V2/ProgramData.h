@@ -96,6 +96,12 @@ public:
     bool getDeleteStatus() const { return DeleteStatus; }
     void setDeleteStatus(bool status) { DeleteStatus = status; }
 
+    // Whether glTransformFeedbackVaryings() was called on the program. The
+    // varyings are not part of the program binary cache key, so such
+    // programs are always linked by the driver.
+    bool hasTransformFeedbackVaryings() const { return mHasTransformFeedbackVaryings; }
+    void setHasTransformFeedbackVaryings() { mHasTransformFeedbackVaryings = true; }
+
     // boundAttribLocs stores the attribute locations assigned by
     // glBindAttribLocation.
     // It will take effect after glLinkProgram.
@@ -118,6 +124,7 @@ private:
     std::unordered_map<GLuint, GLuint> mUniformBlockBinding;
     std::vector<std::string> mTransformFeedbacks;
     GLenum mTransformFeedbackBufferMode = 0;
+    bool mHasTransformFeedbackVaryings = false;
 
     int mGlesMajorVersion = 2;
     int mGlesMinorVersion = 0;
@@ -0,0 +1,184 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "ShaderCache.h"
+
+#include "android/base/files/CacheFiles.h"
+#include "android/base/files/PathUtils.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/misc/FileUtils.h"
+#include "android/base/system/System.h"
+#include "android/utils/file_io.h"
+#include "android/utils/path.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+namespace ShaderCache {
+
+using android::base::LazyInstance;
+using android::base::PathUtils;
+using android::base::System;
+
+static const char kEnvVar[] = "ANDROID_EMUGL_SHADER_CACHE";
+static const char kEntrySuffix[] = ".bin";
+static const char kMagic[4] = {'E', 'S', 'C', '1'};
+
+// Games can compile thousands of shaders, and entries are small.
+static const size_t kMaxEntries = 16384;
+
+static uint64_t sHash(const char* data, size_t size, uint64_t hash) {
+    // 64-bit FNV-1a.
+    for (size_t n = 0; n < size; ++n) {
+        hash ^= (uint8_t)data[n];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t sHash(const std::string& str,
+                      uint64_t hash = 0xcbf29ce484222325ULL) {
+    return sHash(str.data(), str.size(), hash);
+}
+
+static void sPutBe32(std::string* out, uint32_t value) {
+    const char bytes[4] = {(char)(value >> 24), (char)(value >> 16),
+                           (char)(value >> 8), (char)value};
+    out->append(bytes, 4);
+}
+
+static void sPutBe64(std::string* out, uint64_t value) {
+    sPutBe32(out, (uint32_t)(value >> 32));
+    sPutBe32(out, (uint32_t)value);
+}
+
+// Bounds-checked reads from an entry file, see sParseEntry().
+struct EntryReader {
+    const std::string& data;
+    size_t pos;
+
+    bool getBe32(uint32_t* value) {
+        if (data.size() - pos < 4) {
+            return false;
+        }
+        const uint8_t* p = (const uint8_t*)data.data() + pos;
+        *value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                 ((uint32_t)p[2] << 8) | p[3];
+        pos += 4;
+        return true;
+    }
+
+    bool getBe64(uint64_t* value) {
+        uint32_t hi, lo;
+        if (!getBe32(&hi) || !getBe32(&lo)) {
+            return false;
+        }
+        *value = ((uint64_t)hi << 32) | lo;
+        return true;
+    }
+
+    bool getString(std::string* value) {
+        uint32_t size;
+        if (!getBe32(&size) || data.size() - pos < size) {
+            return false;
+        }
+        value->assign(data, pos, size);
+        pos += size;
+        return true;
+    }
+};
+
+// Entry files hold the magic, the key, the value and a hash of both, so
+// a truncated or otherwise damaged file is never used.
+static std::string sMakeEntry(const std::string& key,
+                              const std::string& value) {
+    std::string entry(kMagic, sizeof(kMagic));
+    sPutBe32(&entry, key.size());
+    entry += key;
+    sPutBe32(&entry, value.size());
+    entry += value;
+    sPutBe64(&entry, sHash(value, sHash(key)));
+    return entry;
+}
+
+static bool sParseEntry(const std::string& entry,
+                        const std::string& key,
+                        std::string* value) {
+    if (entry.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic))) {
+        return false;
+    }
+    EntryReader reader = {entry, sizeof(kMagic)};
+    std::string entryKey;
+    uint64_t hash;
+    return reader.getString(&entryKey) && entryKey == key &&
+           reader.getString(value) && reader.getBe64(&hash) &&
+           reader.pos == entry.size() && hash == sHash(*value, sHash(key));
+}
+
+struct ShaderCacheState {
+    ShaderCacheState() {
+        const std::string envDir = System::get()->envGet(kEnvVar);
+        if (envDir.empty() ||
+            path_mkdir_if_needed(envDir.c_str(), 0755) != 0) {
+            return;
+        }
+        // Free a quarter of the cache once it's full, so that this doesn't
+        // run on every start.
+        android::base::pruneCacheDir(envDir, kEntrySuffix, kMaxEntries,
+                                     kMaxEntries * 3 / 4);
+        dir = envDir;
+    }
+
+    std::string entryPath(const char* kind, const std::string& key) const {
+        char name[64];
+        snprintf(name, sizeof(name), "%s-%016" PRIx64 "%s", kind,
+                 sHash(key), kEntrySuffix);
+        return PathUtils::join(dir, name);
+    }
+
+    std::string dir;  // empty if the cache is disabled.
+};
+
+static LazyInstance<ShaderCacheState> sState = LAZY_INSTANCE_INIT;
+
+bool enabled() {
+    return !sState->dir.empty();
+}
+
+bool get(const char* kind, const std::string& key, std::string* value) {
+    if (!enabled()) {
+        return false;
+    }
+    const auto entry =
+            android::readFileIntoString(sState->entryPath(kind, key));
+    return entry && sParseEntry(*entry, key, value);
+}
+
+void put(const char* kind, const std::string& key, const std::string& value) {
+    if (!enabled()) {
+        return;
+    }
+    // Render threads of this and other emulator instances may store the
+    // same entry at the same time.
+    const std::string entry = sMakeEntry(key, value);
+    android::base::publishCacheFile(
+            sState->entryPath(kind, key), [&entry](const char* tempPath) {
+                FILE* file = android_fopen(tempPath, "wb");
+                if (!file) {
+                    return false;
+                }
+                bool ok = fwrite(entry.data(), 1, entry.size(), file) ==
+                          entry.size();
+                return fclose(file) == 0 && ok;
+            });
+}
+
+}  // namespace ShaderCache
@@ -0,0 +1,39 @@
+// Copyright 2017 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include <string>
+
+// An on-disk cache for the results of shader translation and program
+// linking, shared by all render threads and emulator instances.
+//
+// Entries are addressed by a hash of their key, and store the complete key
+// so that a lookup never returns the value of a different key. Callers
+// must make the key cover everything the value depends on, e.g. the
+// translator version or the host GL driver.
+//
+// The cache lives in the directory named by ANDROID_EMUGL_SHADER_CACHE,
+// and is disabled if that variable is undefined or empty.
+namespace ShaderCache {
+
+// Returns true if the cache is enabled.
+bool enabled();
+
+// Look up the entry for |key| in the |kind| namespace ("essl", "program").
+// On success, return true and set |*value|.
+bool get(const char* kind, const std::string& key, std::string* value);
+
+// Store |value| as the entry for |key| in the |kind| namespace, replacing
+// any previous one. Failures are silently ignored.
+void put(const char* kind, const std::string& key, const std::string& value);
+
+}  // namespace ShaderCache
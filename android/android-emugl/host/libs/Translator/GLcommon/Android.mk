@@ -6,6 +6,7 @@ host_common_SRC_FILES :=     \
      GLBackgroundLoader.cpp  \
      GLDispatch.cpp          \
      GLutils.cpp             \
+     GLconversion.cpp        \
      GLEScontext.cpp         \
      GLESvalidate.cpp        \
      GLESpointer.cpp         \
@@ -52,8 +53,27 @@ $(call emugl-end-module)
 
 $(call emugl-begin-executable,lib$(BUILD_TARGET_SUFFIX)GLcommon_unittests)
 
-LOCAL_SRC_FILES := Etc2_unittest.cpp
+LOCAL_SRC_FILES := \
+    Etc2_unittest.cpp \
+    GLconversion_unittest.cpp \
+
 $(call emugl-import,libGLcommon libemugl_gtest)
 $(call local-link-static-c++lib)
 $(call emugl-end-module)
 
+### GLcommon benchmarks ########################
+
+ifeq (true,$(BUILD_BENCHMARKS))
+$(call emugl-begin-executable,lib$(BUILD_TARGET_SUFFIX)GLcommon_benchmark)
+
+LOCAL_SRC_FILES := \
+    GLconversion_benchmark.cpp \
+    TextureUtils_benchmark.cpp \
+
+LOCAL_C_INCLUDES += $(GOOGLE_BENCHMARK_INCLUDES)
+LOCAL_STATIC_LIBRARIES += $(GOOGLE_BENCHMARK_STATIC_LIBRARIES)
+LOCAL_LDLIBS += $(GOOGLE_BENCHMARK_LDLIBS)
+$(call emugl-import,libGLcommon)
+$(call local-link-static-c++lib)
+$(call emugl-end-module)
+endif
@@ -15,6 +15,7 @@
 */
 #include <GLcommon/GLESbuffer.h>
 #include <GLcommon/GLEScontext.h>
+#include <GLcommon/GLconversion.h>
 #include <string.h>
 
 bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
@@ -31,6 +32,7 @@ bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
         }
         m_conversionManager.clear();
         m_conversionManager.addRange(Range(0,m_size));
+        invalidateIndexRanges();
         return true;
     }
     return false;
@@ -41,12 +43,35 @@ bool  GLESbuffer::setSubBuffer(GLint offset,GLuint size,const GLvoid* data) {
     memcpy(m_data+offset,data,size);
     m_conversionManager.addRange(Range(offset,size));
     m_conversionManager.merge();
+    invalidateIndexRanges();
     return true;
 }
 
 void  GLESbuffer::getConversions(const RangeList& rIn,RangeList& rOut) {
         m_conversionManager.delRanges(rIn,rOut);
         rOut.merge();
+        // The caller converts these ranges in place.
+        if (!rOut.empty()) {
+            invalidateIndexRanges();
+        }
+}
+
+unsigned int GLESbuffer::findMaxIndex(GLuint offset,GLsizei count,GLenum type) {
+    for (int i = 0; i < m_indexRangeCount; i++) {
+        const IndexRange& range = m_indexRanges[i];
+        if (range.offset == offset && range.count == count &&
+            range.type == type) {
+            return range.maxIndex;
+        }
+    }
+    const unsigned int maxIndex =
+            findMaxIndexOf(type, m_data + offset, count);
+    m_indexRanges[m_nextIndexRange] = {offset, count, type, maxIndex};
+    m_nextIndexRange = (m_nextIndexRange + 1) % kIndexRangeCacheSize;
+    if (m_indexRangeCount < kIndexRangeCacheSize) {
+        m_indexRangeCount++;
+    }
+    return maxIndex;
 }
 
 GLESbuffer::~GLESbuffer() {
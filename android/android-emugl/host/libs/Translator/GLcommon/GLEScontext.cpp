@@ -19,6 +19,7 @@
 #include "android/base/containers/Lookup.h"
 #include "android/base/files/StreamSerializing.h"
 
+#include <GLcommon/GLconversion.h>
 #include <GLcommon/GLconversion_macros.h>
 #include <GLcommon/GLSnapshotSerializers.h>
 #include <GLcommon/GLESmacros.h>
@@ -92,32 +93,70 @@ void VAOState::onSave(android::base::Stream* stream) const {
     stream->putByte(everBound);
 }
 
-GLESConversionArrays::~GLESConversionArrays() {
-    for(auto it = m_arrays.begin(); it != m_arrays.end(); ++it) {
-        if((*it).second.allocated){
-            if((*it).second.type == GL_FLOAT){
-                GLfloat* p = (GLfloat *)((*it).second.data);
-                if(p) delete[] p;
-            } else if((*it).second.type == GL_SHORT){
-                GLshort* p = (GLshort *)((*it).second.data);
-                if(p) delete[] p;
-            }
-        }
+void* GLESConversionArena::alloc(size_t bytes) {
+    static const size_t kMinBlockSize = 64 * 1024;
+    bytes = (bytes + 15) & ~size_t(15);
+    if (m_blocks.empty() || m_blocks.back().size - m_used < bytes) {
+        size_t size = m_blocks.empty() ? kMinBlockSize
+                                       : m_blocks.back().size * 2;
+        if (size < bytes) size = bytes;
+        // new[] only guarantees alignment for fundamental types.
+        m_blocks.push_back({std::unique_ptr<unsigned char[]>(
+                                    new unsigned char[size + 15]),
+                            size});
+        m_used = 0;
+    }
+    unsigned char* base = m_blocks.back().data.get();
+    base = (unsigned char*)(((uintptr_t)base + 15) & ~uintptr_t(15));
+    void* result = base + m_used;
+    m_used += bytes;
+    return result;
+}
+
+void GLESConversionArena::reset() {
+    // Don't hold on to the memory of an unusually large draw call.
+    static const size_t kMaxRetainedSize = 16 * 1024 * 1024;
+    size_t total = 0;
+    for (const auto& block : m_blocks) {
+        total += block.size;
     }
+    if (total > kMaxRetainedSize) {
+        m_blocks.clear();
+    } else if (m_blocks.size() > 1) {
+        // Replace the blocks by one that fits all of them next time.
+        m_blocks.clear();
+        m_blocks.push_back({std::unique_ptr<unsigned char[]>(
+                                    new unsigned char[total + 15]),
+                            total});
+    }
+    m_used = 0;
+}
+
+GLESConversionArrays::GLESConversionArrays(GLESConversionArena& arena)
+    : m_arena(arena) {
+    m_arena.addUser();
+}
+
+GLESConversionArrays::~GLESConversionArrays() {
+    m_arena.removeUser();
 }
 
 void GLESConversionArrays::allocArr(unsigned int size,GLenum type){
     if(type == GL_FIXED){
-        m_arrays[m_current].data = new GLfloat[size];
+        m_arrays[m_current].data = m_arena.alloc(size * sizeof(GLfloat));
         m_arrays[m_current].type = GL_FLOAT;
     } else if(type == GL_BYTE){
-        m_arrays[m_current].data = new GLshort[size];
+        m_arrays[m_current].data = m_arena.alloc(size * sizeof(GLshort));
         m_arrays[m_current].type = GL_SHORT;
     }
     m_arrays[m_current].stride = 0;
     m_arrays[m_current].allocated = true;
 }
 
+void* GLESConversionArrays::allocScratch(size_t bytes) {
+    return m_arena.alloc(bytes);
+}
+
 void GLESConversionArrays::setArr(void* data,unsigned int stride,GLenum type){
    m_arrays[m_current].type = type;
    m_arrays[m_current].data = data;
@@ -911,6 +950,12 @@ const GLESpointer* GLEScontext::getPointer(GLenum arrType) {
 }
 
 static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
+    // Tightly packed arrays are converted in one go.
+    if (strideIn == strideOut) {
+        convertFixedToFloat((const GLfixed*)dataIn, (GLfloat*)dataOut,
+                            nBytes / sizeof(GLfloat));
+        return;
+    }
 
     for(unsigned int i = 0; i < nBytes;i+=strideOut) {
         const GLfixed* fixed_data = (const GLfixed *)dataIn;
@@ -936,6 +981,11 @@ static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,vo
 }
 
 static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
+    if (strideIn * sizeof(GLshort) == strideOut) {
+        convertByteToShort((const GLbyte*)dataIn, (GLshort*)dataOut,
+                           nBytes / sizeof(GLshort));
+        return;
+    }
 
     for(unsigned int i = 0; i < nBytes;i+=strideOut) {
         const GLbyte* byte_data = (const GLbyte *)dataIn;
@@ -1032,40 +1082,40 @@ void GLEScontext::convertDirectVBO(GLESConversionArrays& cArrs,GLint first,GLsiz
         p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
 
         if(conversions.size()) { // there are some elements to convert
-           indices = new GLuint[count];
+           indices = (GLuint*)cArrs.allocScratch(count * sizeof(GLuint));
            int nIndices = bytesRangesToIndices(conversions,p,indices); //converting bytes ranges by offset to indices in this array
            convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_INT,indices,stride,attribSize);
         }
     }
-    if(indices) delete[] indices;
     cArrs.setArr(data,p->getStride(),GL_FLOAT);
 }
 
 unsigned int GLEScontext::findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices) {
-    //finding max index
-    unsigned int max = 0;
-    if(type == GL_UNSIGNED_BYTE) {
-        GLubyte*  b_indices  =(GLubyte *)indices;
-        for(int i=0;i<count;i++) {
-            if(b_indices[i] > max) max = b_indices[i];
-        }
-    } else if (type == GL_UNSIGNED_SHORT) {
-        GLushort* us_indices =(GLushort *)indices;
-        for(int i=0;i<count;i++) {
-            if(us_indices[i] > max) max = us_indices[i];
-        }
-    } else { // type == GL_UNSIGNED_INT
-        GLuint* ui_indices =(GLuint *)indices;
-        for(int i=0;i<count;i++) {
-            if(ui_indices[i] > max) max = ui_indices[i];
+    return findMaxIndexOf(type, indices, count);
+}
+
+unsigned int GLEScontext::findMaxElementIndex(GLsizei count,GLenum type,const GLvoid* indices) {
+    GLuint bufferName = getBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    if (bufferName) {
+        GLESbuffer* vbo = static_cast<GLESbuffer*>(
+                m_shareGroup->getObjectData(NamedObjectType::VERTEXBUFFER,
+                                            bufferName));
+        // The name may have been bound without ever getting data.
+        const unsigned char* data =
+                vbo ? (const unsigned char*)vbo->getData() : nullptr;
+        const unsigned char* start = (const unsigned char*)indices;
+        const size_t bytes = (size_t)count * (type == GL_UNSIGNED_BYTE ? 1 :
+                                              type == GL_UNSIGNED_SHORT ? 2 : 4);
+        if (data && start >= data && start + bytes <= data + vbo->getSize()) {
+            return vbo->findMaxIndex(start - data, count, type);
         }
     }
-    return max;
+    return findMaxIndex(count, type, indices);
 }
 
 void GLEScontext::convertIndirect(GLESConversionArrays& cArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p) {
     GLenum type    = p->getType();
-    int maxElements = findMaxIndex(count,indices_type,indices) + 1;
+    int maxElements = findMaxElementIndex(count,indices_type,indices) + 1;
 
     int attribSize = p->getSize();
     int size = attribSize * maxElements;
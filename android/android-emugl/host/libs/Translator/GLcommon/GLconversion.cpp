@@ -0,0 +1,264 @@
+/*
+* Copyright (C) 2017 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/GLconversion.h>
+
+#include <GLcommon/GLconversion_macros.h>
+
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define GL_CONVERSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+void convertFixedToFloat(const GLfixed* in, GLfloat* out, size_t count) {
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    // Scaling by 2^-16 is exact, so this matches X2F()'s division.
+    const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i fixed = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(fixed), scale));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = X2F(in[i]);
+    }
+}
+
+void convertByteToShort(const GLbyte* in, GLshort* out, size_t count) {
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        const __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+        // Sign-extend by interleaving each byte with its sign.
+        const __m128i sign = _mm_cmpgt_epi8(zero, bytes);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi8(bytes, sign));
+        _mm_storeu_si128((__m128i*)(out + i + 8),
+                         _mm_unpackhi_epi8(bytes, sign));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = B2S(in[i]);
+    }
+}
+
+#ifdef GL_CONVERSION_SSE2
+// Returns the largest of the lanes of |v|, seen as 32-bit integers, after
+// undoing the |bias| that made them comparable as signed integers.
+static unsigned int maxLane32(__m128i v, uint32_t bias) {
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    uint32_t max = 0;
+    for (int i = 0; i < 4; i++) {
+        if ((lanes[i] ^ bias) > max) max = lanes[i] ^ bias;
+    }
+    return max;
+}
+#endif
+
+static unsigned int findMaxUbyte(const GLubyte* indices, size_t count) {
+    unsigned int max = 0;
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    if (count >= 16) {
+        __m128i vmax = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            vmax = _mm_max_epu8(vmax,
+                    _mm_loadu_si128((const __m128i*)(indices + i)));
+        }
+        // Fold the 16 lanes down to 4, then widen them.
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+        const __m128i zero = _mm_setzero_si128();
+        vmax = _mm_unpacklo_epi16(_mm_unpacklo_epi8(vmax, zero), zero);
+        max = maxLane32(vmax, 0);
+    }
+#endif
+    for (; i < count; i++) {
+        if (indices[i] > max) max = indices[i];
+    }
+    return max;
+}
+
+static unsigned int findMaxUshort(const GLushort* indices, size_t count) {
+    unsigned int max = 0;
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    if (count >= 8) {
+        // SSE2 only has a signed 16-bit max, so flip the sign bits first.
+        const __m128i bias = _mm_set1_epi16((short)0x8000);
+        __m128i vmax = _mm_set1_epi16((short)0x8000);
+        for (; i + 8 <= count; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(indices + i));
+            vmax = _mm_max_epi16(vmax, _mm_xor_si128(v, bias));
+        }
+        // Fold with shuffles rather than shifts: a zero shifted in would
+        // stand for 0x8000 here.
+        vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, 0x4e));
+        vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, 0xb1));
+        vmax = _mm_xor_si128(vmax, bias);
+        vmax = _mm_unpacklo_epi16(vmax, _mm_setzero_si128());
+        max = maxLane32(vmax, 0);
+    }
+#endif
+    for (; i < count; i++) {
+        if (indices[i] > max) max = indices[i];
+    }
+    return max;
+}
+
+static unsigned int findMaxUint(const GLuint* indices, size_t count) {
+    unsigned int max = 0;
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    if (count >= 4) {
+        // Same as above, with a select instead of the missing 32-bit max.
+        const __m128i bias = _mm_set1_epi32((int)0x80000000);
+        __m128i vmax = bias;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i v = _mm_xor_si128(
+                    _mm_loadu_si128((const __m128i*)(indices + i)), bias);
+            const __m128i greater = _mm_cmpgt_epi32(v, vmax);
+            vmax = _mm_or_si128(_mm_and_si128(greater, v),
+                                _mm_andnot_si128(greater, vmax));
+        }
+        max = maxLane32(vmax, 0x80000000u);
+    }
+#endif
+    for (; i < count; i++) {
+        if (indices[i] > max) max = indices[i];
+    }
+    return max;
+}
+
+unsigned int findMaxIndexOf(GLenum type, const GLvoid* indices, size_t count) {
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+            return findMaxUbyte((const GLubyte*)indices, count);
+        case GL_UNSIGNED_SHORT:
+            return findMaxUshort((const GLushort*)indices, count);
+        default:  // GL_UNSIGNED_INT
+            return findMaxUint((const GLuint*)indices, count);
+    }
+}
+
+// c * 255 / 31 and c * 255 / 63 without the divisions, exact for 5 and
+// 6-bit values.
+static inline GLubyte expand5(unsigned int c) { return (c * 1053) >> 7; }
+static inline GLubyte expand6(unsigned int c) { return (c * 259 + 3) >> 6; }
+static inline GLubyte expand4(unsigned int c) { return c * 17; }
+
+static inline void storeRGBA8(GLubyte* out, GLubyte r, GLubyte g, GLubyte b,
+                              GLubyte a) {
+    out[0] = r;
+    out[1] = g;
+    out[2] = b;
+    out[3] = a;
+}
+
+#ifdef GL_CONVERSION_SSE2
+// The SSE2 versions of the above, on 8 components in 16-bit lanes.
+static inline __m128i expand5x8(__m128i c) {
+    return _mm_srli_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(1053)), 7);
+}
+
+static inline __m128i expand6x8(__m128i c) {
+    return _mm_srli_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(259)),
+                          _mm_set1_epi16(3)),
+            6);
+}
+
+static inline __m128i expand4x8(__m128i c) {
+    return _mm_mullo_epi16(c, _mm_set1_epi16(17));
+}
+
+// Stores the 8 texels whose 8-bit components are in the 16-bit lanes of
+// |r|, |g|, |b| and |a|.
+static inline void storeRGBA8x8(GLubyte* out, __m128i r, __m128i g, __m128i b,
+                                __m128i a) {
+    const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    const __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(rg, ba));
+}
+#endif
+
+void convertRGB565ToRGBA8(const GLushort* in, GLubyte* out, size_t count) {
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    const __m128i opaque = _mm_set1_epi16(0xff);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        storeRGBA8x8(out + i * 4,
+                     expand5x8(_mm_srli_epi16(v, 11)),
+                     expand6x8(_mm_and_si128(_mm_srli_epi16(v, 5), mask6)),
+                     expand5x8(_mm_and_si128(v, mask5)),
+                     opaque);
+    }
+#endif
+    for (; i < count; i++) {
+        const unsigned int v = in[i];
+        storeRGBA8(out + i * 4, expand5(v >> 11), expand6((v >> 5) & 0x3f),
+                   expand5(v & 0x1f), 0xff);
+    }
+}
+
+void convertRGBA4444ToRGBA8(const GLushort* in, GLubyte* out, size_t count) {
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    const __m128i mask4 = _mm_set1_epi16(0xf);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        storeRGBA8x8(out + i * 4,
+                     expand4x8(_mm_srli_epi16(v, 12)),
+                     expand4x8(_mm_and_si128(_mm_srli_epi16(v, 8), mask4)),
+                     expand4x8(_mm_and_si128(_mm_srli_epi16(v, 4), mask4)),
+                     expand4x8(_mm_and_si128(v, mask4)));
+    }
+#endif
+    for (; i < count; i++) {
+        const unsigned int v = in[i];
+        storeRGBA8(out + i * 4, expand4(v >> 12), expand4((v >> 8) & 0xf),
+                   expand4((v >> 4) & 0xf), expand4(v & 0xf));
+    }
+}
+
+void convertRGBA5551ToRGBA8(const GLushort* in, GLubyte* out, size_t count) {
+    size_t i = 0;
+#ifdef GL_CONVERSION_SSE2
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask1 = _mm_set1_epi16(0x1);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        storeRGBA8x8(out + i * 4,
+                     expand5x8(_mm_srli_epi16(v, 11)),
+                     expand5x8(_mm_and_si128(_mm_srli_epi16(v, 6), mask5)),
+                     expand5x8(_mm_and_si128(_mm_srli_epi16(v, 1), mask5)),
+                     _mm_mullo_epi16(_mm_and_si128(v, mask1),
+                                     _mm_set1_epi16(0xff)));
+    }
+#endif
+    for (; i < count; i++) {
+        const unsigned int v = in[i];
+        storeRGBA8(out + i * 4, expand5(v >> 11), expand5((v >> 6) & 0x1f),
+                   expand5((v >> 1) & 0x1f), (v & 0x1) * 0xff);
+    }
+}
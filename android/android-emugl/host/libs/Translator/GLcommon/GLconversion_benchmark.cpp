@@ -0,0 +1,161 @@
+/*
+* Copyright (C) 2017 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// The per-draw work done for GLES1 client arrays, over draw sizes typical
+// of legacy games: |range_x| is the number of vertices or indices of a draw,
+// from a single quad to a large mesh.
+
+#include <GLcommon/GLconversion.h>
+#include <GLcommon/GLconversion_macros.h>
+#include <GLcommon/GLESbuffer.h>
+#include <GLcommon/GLEScontext.h>
+
+#include "benchmark/benchmark_api.h"
+
+#include <vector>
+
+namespace {
+
+// Indices of |quads| quads, as drawn by sprite batchers.
+std::vector<GLushort> quadIndices(int quads) {
+    std::vector<GLushort> indices;
+    for (int q = 0; q < quads; q++) {
+        const GLushort base = q * 4;
+        const GLushort quad[] = {base, GLushort(base + 1), GLushort(base + 2),
+                                 base, GLushort(base + 2), GLushort(base + 3)};
+        indices.insert(indices.end(), quad, quad + 6);
+    }
+    return indices;
+}
+
+void BM_FindMaxIndex(benchmark::State& state) {
+    const auto indices = quadIndices(state.range_x() / 6);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(GLEScontext::findMaxIndex(
+                indices.size(), GL_UNSIGNED_SHORT, indices.data()));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * indices.size());
+}
+
+// A frame of draws from an index buffer: 8 batches of |range_x| indices,
+// drawn again each frame without any change to the buffer.
+void BM_FindMaxIndexBufferFrame(benchmark::State& state) {
+    const int kBatches = 8;
+    const auto indices = quadIndices(kBatches * state.range_x() / 6);
+    GLESbuffer buffer;
+    buffer.setBuffer(indices.size() * sizeof(GLushort), GL_STATIC_DRAW,
+                     indices.data());
+    const GLsizei count = indices.size() / kBatches;
+    while (state.KeepRunning()) {
+        for (int b = 0; b < kBatches; b++) {
+            benchmark::DoNotOptimize(buffer.findMaxIndex(
+                    b * count * sizeof(GLushort), count, GL_UNSIGNED_SHORT));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * indices.size());
+}
+
+// Interleaved with a glBufferSubData() per frame, so every draw misses.
+void BM_FindMaxIndexBufferUpdated(benchmark::State& state) {
+    const auto indices = quadIndices(state.range_x() / 6);
+    GLESbuffer buffer;
+    buffer.setBuffer(indices.size() * sizeof(GLushort), GL_DYNAMIC_DRAW,
+                     indices.data());
+    while (state.KeepRunning()) {
+        buffer.setSubBuffer(0, sizeof(GLushort), indices.data());
+        benchmark::DoNotOptimize(
+                buffer.findMaxIndex(0, indices.size(), GL_UNSIGNED_SHORT));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * indices.size());
+}
+
+// Positions as vec3 GL_FIXED.
+void BM_ConvertFixedToFloat(benchmark::State& state) {
+    std::vector<GLfixed> in(state.range_x() * 3, 0x12345);
+    std::vector<GLfloat> out(in.size());
+    while (state.KeepRunning()) {
+        convertFixedToFloat(in.data(), out.data(), in.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * in.size() *
+                            sizeof(GLfixed));
+}
+
+// The same with the X2F() loop the kernel replaces, for comparison.
+void BM_ConvertFixedToFloatScalar(benchmark::State& state) {
+    std::vector<GLfixed> in(state.range_x() * 3, 0x12345);
+    std::vector<GLfloat> out(in.size());
+    while (state.KeepRunning()) {
+        GLfloat* volatile dst = out.data();
+        for (size_t i = 0; i < in.size(); i++) {
+            dst[i] = X2F(in[i]);
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * in.size() *
+                            sizeof(GLfixed));
+}
+
+// Texture coordinates as vec2 GL_BYTE.
+void BM_ConvertByteToShort(benchmark::State& state) {
+    std::vector<GLbyte> in(state.range_x() * 2, -3);
+    std::vector<GLshort> out(in.size());
+    while (state.KeepRunning()) {
+        convertByteToShort(in.data(), out.data(), in.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * in.size());
+}
+
+// Allocation of the converted positions, normals and texture coordinates
+// of a draw, with the arena a context keeps across draws...
+void BM_ConversionArraysSharedArena(benchmark::State& state) {
+    GLESConversionArena arena;
+    while (state.KeepRunning()) {
+        GLESConversionArrays arrays(arena);
+        for (int i = 0; i < 3; i++) {
+            arrays.allocArr(state.range_x() * 3, GL_FIXED);
+            benchmark::DoNotOptimize(arrays.getCurrentData());
+            ++arrays;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// ... and with a new one each time.
+void BM_ConversionArraysOwnArena(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        GLESConversionArrays arrays;
+        for (int i = 0; i < 3; i++) {
+            arrays.allocArr(state.range_x() * 3, GL_FIXED);
+            benchmark::DoNotOptimize(arrays.getCurrentData());
+            ++arrays;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_FindMaxIndex)->Arg(6)->Arg(96)->Arg(1536)->Arg(24576);
+BENCHMARK(BM_FindMaxIndexBufferFrame)->Arg(6)->Arg(96)->Arg(1536)->Arg(24576);
+BENCHMARK(BM_FindMaxIndexBufferUpdated)->Arg(96)->Arg(1536)->Arg(24576);
+BENCHMARK(BM_ConvertFixedToFloat)->Arg(4)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_ConvertFixedToFloatScalar)->Arg(4)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_ConvertByteToShort)->Arg(4)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_ConversionArraysSharedArena)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_ConversionArraysOwnArena)->Arg(64)->Arg(1024)->Arg(16384);
+
+BENCHMARK_MAIN()
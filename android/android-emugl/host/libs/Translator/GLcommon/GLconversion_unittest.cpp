@@ -0,0 +1,247 @@
+// Copyright 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/GLconversion.h>
+
+#include <GLcommon/GLconversion_macros.h>
+#include <GLES/glext.h>
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace {
+
+// Enough for a couple of SSE2 iterations of every kernel, plus any tail.
+const size_t kMaxCount = 40;
+
+// A deterministic sequence that covers the whole range of each type.
+uint32_t nextRandom(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state;
+}
+
+template <class T>
+std::vector<T> randomValues(size_t count, uint32_t seed) {
+    std::vector<T> values(count);
+    for (auto& value : values) {
+        value = (T)(nextRandom(&seed) >> 7);
+    }
+    return values;
+}
+
+template <class T>
+unsigned int scalarMax(const std::vector<T>& indices, size_t count) {
+    unsigned int max = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] > max) max = indices[i];
+    }
+    return max;
+}
+
+// Checks findMaxIndexOf() for every count up to kMaxCount, with the
+// largest index at every position, including the scalar tails.
+template <class T>
+void testFindMax(GLenum type, T largest) {
+    for (size_t count = 0; count <= kMaxCount; count++) {
+        std::vector<T> indices = randomValues<T>(count, (uint32_t)count);
+        // Keep the random values below |largest|.
+        for (auto& index : indices) {
+            index = (T)(index % largest);
+        }
+        EXPECT_EQ(scalarMax(indices, count),
+                  findMaxIndexOf(type, indices.data(), count))
+                << "count " << count;
+        for (size_t pos = 0; pos < count; pos++) {
+            std::vector<T> withLargest = indices;
+            withLargest[pos] = largest;
+            EXPECT_EQ((unsigned int)largest,
+                      findMaxIndexOf(type, withLargest.data(), count))
+                    << "count " << count << ", position " << pos;
+        }
+    }
+}
+
+}  // namespace
+
+TEST(GLconversion, findMaxUbyte) {
+    testFindMax<GLubyte>(GL_UNSIGNED_BYTE, 0xFF);
+    testFindMax<GLubyte>(GL_UNSIGNED_BYTE, 0x80);
+    testFindMax<GLubyte>(GL_UNSIGNED_BYTE, 1);
+}
+
+TEST(GLconversion, findMaxUshort) {
+    testFindMax<GLushort>(GL_UNSIGNED_SHORT, 0xFFFF);
+    // Both sides of the sign bit flip.
+    testFindMax<GLushort>(GL_UNSIGNED_SHORT, 0x8000);
+    testFindMax<GLushort>(GL_UNSIGNED_SHORT, 0x7FFF);
+    testFindMax<GLushort>(GL_UNSIGNED_SHORT, 1);
+}
+
+TEST(GLconversion, findMaxUint) {
+    testFindMax<GLuint>(GL_UNSIGNED_INT, 0xFFFFFFFF);
+    testFindMax<GLuint>(GL_UNSIGNED_INT, 0x80000000);
+    testFindMax<GLuint>(GL_UNSIGNED_INT, 0x7FFFFFFF);
+    testFindMax<GLuint>(GL_UNSIGNED_INT, 1);
+}
+
+TEST(GLconversion, findMaxAllZero) {
+    const std::vector<GLuint> zeroes(kMaxCount, 0);
+    for (size_t count = 0; count <= kMaxCount; count++) {
+        EXPECT_EQ(0u, findMaxIndexOf(GL_UNSIGNED_BYTE, zeroes.data(), count));
+        EXPECT_EQ(0u, findMaxIndexOf(GL_UNSIGNED_SHORT, zeroes.data(), count));
+        EXPECT_EQ(0u, findMaxIndexOf(GL_UNSIGNED_INT, zeroes.data(), count));
+    }
+}
+
+TEST(GLconversion, convertFixedToFloat) {
+    for (size_t count = 0; count <= kMaxCount; count++) {
+        std::vector<GLfixed> in = randomValues<GLfixed>(count, (uint32_t)count);
+        // Negative values, and the extremes of the range.
+        for (size_t i = 0; i < count; i += 3) {
+            in[i] = -in[i];
+        }
+        if (count > 1) {
+            in[0] = INT32_MIN;
+            in[count - 1] = INT32_MAX;
+        }
+        std::vector<GLfloat> out(count + 1, -1.0f);
+        convertFixedToFloat(in.data(), out.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(X2F(in[i]), out[i]) << "count " << count << ", " << i;
+        }
+        // Nothing is written past the end.
+        EXPECT_EQ(-1.0f, out[count]);
+    }
+}
+
+TEST(GLconversion, convertByteToShort) {
+    for (size_t count = 0; count <= kMaxCount; count++) {
+        std::vector<GLbyte> in = randomValues<GLbyte>(count, (uint32_t)count);
+        if (count > 2) {
+            in[0] = -128;
+            in[1] = -1;
+            in[count - 1] = 127;
+        }
+        std::vector<GLshort> out(count + 1, 0x5555);
+        convertByteToShort(in.data(), out.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(B2S(in[i]), out[i]) << "count " << count << ", " << i;
+        }
+        EXPECT_EQ(0x5555, out[count]);
+    }
+}
+
+namespace {
+
+// The formulas the palette decoder used per texel before the kernels, with
+// the red component of 5_6_5 read unsigned: it used to come from a signed
+// short, which broke red values of 16 and above.
+void scalarRGB565(GLushort s, GLubyte* out) {
+    out[0] = (s >> 11) * 255 / 31;
+    out[1] = ((s >> 5) & 0x3f) * 255 / 63;
+    out[2] = (s & 0x1f) * 255 / 31;
+    out[3] = 255;
+}
+
+void scalarRGBA4444(GLushort s, GLubyte* out) {
+    out[0] = ((s >> 12) & 0xf) * 255 / 15;
+    out[1] = ((s >> 8) & 0xf) * 255 / 15;
+    out[2] = ((s >> 4) & 0xf) * 255 / 15;
+    out[3] = (s & 0xf) * 255 / 15;
+}
+
+void scalarRGBA5551(GLushort s, GLubyte* out) {
+    out[0] = ((s >> 11) & 0x1f) * 255 / 31;
+    out[1] = ((s >> 6) & 0x1f) * 255 / 31;
+    out[2] = ((s >> 1) & 0x1f) * 255 / 31;
+    out[3] = (s & 0x1) * 255;
+}
+
+typedef void (*ConvertFunc)(const GLushort* in, GLubyte* out, size_t count);
+typedef void (*ScalarFunc)(GLushort s, GLubyte* out);
+
+// Checks |convert| against |scalar| for every 16-bit value, and for every
+// count up to kMaxCount so that the tails are covered too.
+void testConvert16(ConvertFunc convert, ScalarFunc scalar) {
+    std::vector<GLushort> all(0x10000);
+    for (size_t i = 0; i < all.size(); i++) {
+        all[i] = (GLushort)i;
+    }
+    std::vector<GLubyte> out(all.size() * 4);
+    convert(all.data(), out.data(), all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        GLubyte expected[4];
+        scalar(all[i], expected);
+        for (int c = 0; c < 4; c++) {
+            ASSERT_EQ(expected[c], out[i * 4 + c])
+                    << "texel 0x" << std::hex << i << ", component " << c;
+        }
+    }
+
+    for (size_t count = 0; count <= kMaxCount; count++) {
+        std::vector<GLushort> in =
+                randomValues<GLushort>(count, (uint32_t)count);
+        std::vector<GLubyte> tailOut(count * 4 + 4, 0x55);
+        convert(in.data(), tailOut.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            GLubyte expected[4];
+            scalar(in[i], expected);
+            for (int c = 0; c < 4; c++) {
+                EXPECT_EQ(expected[c], tailOut[i * 4 + c])
+                        << "count " << count << ", texel " << i;
+            }
+        }
+        // Nothing is written past the end.
+        for (int c = 0; c < 4; c++) {
+            EXPECT_EQ(0x55, tailOut[count * 4 + c]) << "count " << count;
+        }
+    }
+}
+
+}  // namespace
+
+TEST(GLconversion, convertRGB565ToRGBA8) {
+    testConvert16(convertRGB565ToRGBA8, scalarRGB565);
+}
+
+TEST(GLconversion, convertRGB565ToRGBA8HighRed) {
+    // Red values of 16 and above, which have the sign bit set.
+    for (GLushort red = 16; red < 32; red++) {
+        const GLushort in[3] = {(GLushort)(red << 11),
+                                (GLushort)((red << 11) | 0x7ff),
+                                (GLushort)((red << 11) | 0x3f)};
+        GLubyte out[3 * 4];
+        convertRGB565ToRGBA8(in, out, 3);
+        for (int i = 0; i < 3; i++) {
+            EXPECT_EQ(red * 255 / 31, out[i * 4]) << "red " << red;
+        }
+    }
+    const GLushort white = 0xffff;
+    GLubyte out[4];
+    convertRGB565ToRGBA8(&white, out, 1);
+    EXPECT_EQ(255, out[0]);
+    EXPECT_EQ(255, out[1]);
+    EXPECT_EQ(255, out[2]);
+    EXPECT_EQ(255, out[3]);
+}
+
+TEST(GLconversion, convertRGBA4444ToRGBA8) {
+    testConvert16(convertRGBA4444ToRGBA8, scalarRGBA4444);
+}
+
+TEST(GLconversion, convertRGBA5551ToRGBA8) {
+    testConvert16(convertRGBA5551ToRGBA8, scalarRGBA5551);
+}
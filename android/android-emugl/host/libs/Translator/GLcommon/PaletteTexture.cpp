@@ -14,18 +14,10 @@
 * limitations under the License.
 */
 #include "GLcommon/PaletteTexture.h"
-#include <stdio.h>
 
+#include "GLcommon/GLconversion.h"
 
-
-struct Color
-{
-  Color(unsigned char r, unsigned char g,unsigned char b, unsigned char a):red(r),green(g),blue(b),alpha(a){};
-  unsigned char red;
-  unsigned char green;
-  unsigned char blue;
-  unsigned char alpha;
-};
+#include <string.h>
 
 void getPaletteInfo(GLenum internalFormat,unsigned int& indexSizeBits,unsigned int& colorSizeBytes,GLenum& colorFrmt) {
 
@@ -74,47 +66,89 @@ void getPaletteInfo(GLenum internalFormat,unsigned int& indexSizeBits,unsigned i
     }
 }
 
-
-Color paletteColor(const unsigned char* pallete,unsigned int index,GLenum format)
-{
-        short s;
-        switch(format) {
-        //RGB
+// Expands the |nColors| colors of |palette| to RGBA8 in |colorsOut|.
+static void expandPalette(GLenum internalFormat, const unsigned char* palette,
+                          int nColors, GLubyte* colorsOut) {
+    switch (internalFormat) {
     case GL_PALETTE4_RGB8_OES:
     case GL_PALETTE8_RGB8_OES:
-            return Color(pallete[index],pallete[index+1],pallete[index+2],0);
-    case GL_PALETTE8_R5_G6_B5_OES:
-    case GL_PALETTE4_R5_G6_B5_OES:
-            s = *((short *)(pallete+index));
-            return Color((s >> 11)*255/31,((s >> 5) & 0x3f)*255/63 ,(s & 0x1f)*255/31,0);
-
-        //RGBA
+        for (int i = 0; i < nColors; i++) {
+            memcpy(colorsOut + i * 4, palette + i * 3, 3);
+            colorsOut[i * 4 + 3] = 0xff;
+        }
+        return;
     case GL_PALETTE4_RGBA8_OES:
     case GL_PALETTE8_RGBA8_OES:
-            return Color(pallete[index],pallete[index+1],pallete[index+2],pallete[index+3]);
+        memcpy(colorsOut, palette, nColors * 4);
+        return;
+    }
+
+    // 16-bit colors, copied out first as |palette| may not be aligned.
+    GLushort packed[256];
+    memcpy(packed, palette, nColors * sizeof(GLushort));
+    switch (internalFormat) {
+    case GL_PALETTE4_R5_G6_B5_OES:
+    case GL_PALETTE8_R5_G6_B5_OES:
+        convertRGB565ToRGBA8(packed, colorsOut, nColors);
+        break;
     case GL_PALETTE4_RGBA4_OES:
     case GL_PALETTE8_RGBA4_OES:
-            s = *((short *)(pallete+index));
-            return Color(((s >> 12) & 0xf)*255/15,((s >> 8) & 0xf)*255/15,((s >> 4) & 0xf)*255/15 ,(s & 0xf)*255/15);
+        convertRGBA4444ToRGBA8(packed, colorsOut, nColors);
+        break;
     case GL_PALETTE4_RGB5_A1_OES:
     case GL_PALETTE8_RGB5_A1_OES:
-            s = *((short *)(pallete+index));
-            return Color(((s >> 11) & 0x1f)*255/31,((s >> 6) & 0x1f)*255/31,((s >> 1) & 0x1f)*255/31 ,(s & 0x1) * 255);
-        default:
-            return Color(255,255,255,255);
+        convertRGBA5551ToRGBA8(packed, colorsOut, nColors);
+        break;
+    }
+}
+
+// Writes the |kSize| first bytes of the RGBA8 |colors| of |count| indices,
+// 4-bit ones being packed two per byte, upper bits first.
+template <int kSize>
+static void expandIndices(const GLubyte* colors, const unsigned char* indices,
+                          unsigned int indexSizeBits, int count,
+                          unsigned char* out) {
+    if (indexSizeBits == 8) {
+        for (int i = 0; i < count; i++) {
+            memcpy(out + i * kSize, colors + indices[i] * 4, kSize);
+        }
+        return;
     }
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const unsigned char pair = indices[i / 2];
+        memcpy(out + i * kSize, colors + (pair >> 4) * 4, kSize);
+        memcpy(out + (i + 1) * kSize, colors + (pair & 0xf) * 4, kSize);
+    }
+    if (i < count) {
+        memcpy(out + i * kSize, colors + (indices[i / 2] >> 4) * 4, kSize);
+    }
+}
+
+size_t getPaletteSizeBytes(GLenum internalformat) {
+    unsigned int indexSizeBits = 0;
+    unsigned int colorSizeBytes = 0;
+    GLenum format;
+    getPaletteInfo(internalformat,indexSizeBits,colorSizeBytes,format);
+    return size_t(colorSizeBytes) << indexSizeBits;
+}
+
+size_t getPaletteDecodedSize(GLenum internalformat,GLenum& formatOut,GLsizei width,GLsizei height,GLint level) {
+    unsigned int indexSizeBits = 0;
+    unsigned int colorSizeBytes = 0;
+    getPaletteInfo(internalformat,indexSizeBits,colorSizeBytes,formatOut);
+
+    int colorSizeOut = (formatOut == GL_RGB? 3:4);
+    return size_t(width >> level) * (height >> level) * colorSizeOut;
 }
 
-unsigned char* uncompressTexture(GLenum internalformat,GLenum& formatOut,GLsizei width,GLsizei height,GLsizei imageSize, const GLvoid* data,GLint level) {
+void uncompressTexture(GLenum internalformat,GLsizei width,GLsizei height,GLsizei imageSize, const GLvoid* data,GLint level,unsigned char* pixelsOut) {
 
     unsigned int indexSizeBits = 0;  //the size of the color index in the pallete
     unsigned int colorSizeBytes = 0; //the size of each color cell in the pallete
+    GLenum formatOut;
 
     getPaletteInfo(internalformat,indexSizeBits,colorSizeBytes,formatOut);
-    if(!data)
-    {
-        return NULL;
-    }
 
     const unsigned char* palette = static_cast<const unsigned char *>(data);
 
@@ -134,37 +168,33 @@ unsigned char* uncompressTexture(GLenum internalformat,GLenum& formatOut,GLsizei
 
     int colorSizeOut = (formatOut == GL_RGB? 3:4);
     int nPixels = width*height;
-    unsigned char* pixelsOut = new unsigned char[nPixels*colorSizeOut];
-    if(!pixelsOut) return NULL;
 
     int leftBytes = ((palette + imageSize) /* the end of data pointer*/
                       - imageIndices);
-    int leftPixels = (leftBytes * 8 )/indexSizeBits;
+    // Signed, as there are no indices at all if the palette is truncated.
+    int leftPixels = (leftBytes * 8) / (int)indexSizeBits;
 
     int maxIndices = (leftPixels < nPixels) ? leftPixels:nPixels;
+    if (maxIndices < 0) maxIndices = 0;
+
+    // Expanding the palette once makes each texel a copy. Only read the
+    // colors that are actually there.
+    GLubyte colors[256 * 4];
+    int nColorsIn = nColors;
+    if (imageSize < paletteSizeBytes) {
+        nColorsIn = imageSize > 0 ? imageSize / colorSizeBytes : 0;
+        memset(colors + nColorsIn * 4, 0, (nColors - nColorsIn) * 4);
+    }
+    expandPalette(internalformat, palette, nColorsIn, colors);
 
     //filling the pixels array
-    for(int i =0 ; i < maxIndices ; i++) {
-        int paletteIndex = 0;
-        int indexOut = i*colorSizeOut;
-        if(indexSizeBits == 4) {
-            paletteIndex = (i%2) == 0 ?
-                           imageIndices[i/2] >> 4:  //upper bits
-                           imageIndices[i/2] & 0xf; //lower bits
-        } else {
-            paletteIndex = imageIndices[i];
-        }
-
-        paletteIndex*=colorSizeBytes;
-        Color c = paletteColor(palette,paletteIndex,internalformat);
-
-        pixelsOut[indexOut] = c.red;
-        pixelsOut[indexOut+1] = c.green;
-        pixelsOut[indexOut+2] = c.blue;
-        if(formatOut == GL_RGBA) {
-            pixelsOut[indexOut+3] = c.alpha;
-        }
+    if (colorSizeOut == 4) {
+        expandIndices<4>(colors, imageIndices, indexSizeBits, maxIndices,
+                         pixelsOut);
+    } else {
+        expandIndices<3>(colors, imageIndices, indexSizeBits, maxIndices,
+                         pixelsOut);
     }
-    return pixelsOut;
+    memset(pixelsOut + maxIndices * colorSizeOut, 0,
+           (nPixels - maxIndices) * colorSizeOut);
 }
-
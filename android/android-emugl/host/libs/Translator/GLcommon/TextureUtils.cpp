@@ -18,8 +18,8 @@
 #include <GLcommon/GLDispatch.h>
 #include <GLcommon/GLESvalidate.h>
 #include <stdio.h>
+#include <string.h>
 #include <cmath>
-#include <memory>
 
 int getCompressedFormats(int* formats) {
     if(formats){
@@ -246,31 +246,29 @@ void doCompressedTexImage2D(GLEScontext* ctx, GLenum target, GLint level,
             etc_get_encoded_data_size(etcFormat, width, height);
         SET_ERROR_IF((compressedSize != imageSize), GL_INVALID_VALUE);
 
-        bool emulateCompressedData = false;
-        //if (!data or true) {
+        // Guest UI toolkits upload many small sub-images per frame, so
+        // the decoded texels go to the context's scratch arena.
+        GLESConversionScratch scratch(ctx->conversionArena());
         if (!data) {
-            emulateCompressedData = true;
-            data = new char[compressedSize];
+            void* zeroes = scratch.alloc(compressedSize);
+            memset(zeroes, 0, compressedSize);
+            data = zeroes;
         }
 
         const int32_t align = ctx->getUnpackAlignment()-1;
         const int32_t bpr = ((width * pixelSize) + align) & ~align;
         const size_t size = bpr * height;
 
-        std::unique_ptr<etc1_byte[]> pOut(new etc1_byte[size]);
+        etc1_byte* pOut = (etc1_byte*)scratch.alloc(size);
 
         int res =
             etc2_decode_image(
-                    (const etc1_byte*)data, etcFormat, pOut.get(),
+                    (const etc1_byte*)data, etcFormat, pOut,
                     width, height, bpr);
         SET_ERROR_IF(res!=0, GL_INVALID_VALUE);
 
         glTexImage2DPtr(target, level, convertedInternalFormat,
-                        width, height, border, format, type, pOut.get());
-
-        if (emulateCompressedData) {
-            delete [] (char*)data;
-        }
+                        width, height, border, format, type, pOut);
     } else if (isPaletteFormat(internalformat)) {
         SET_ERROR_IF(
             level > log2(ctx->getMaxTexSize()) ||
@@ -278,24 +276,30 @@ void doCompressedTexImage2D(GLEScontext* ctx, GLenum target, GLint level,
             !GLESvalidate::texImgDim(
                 width, height, ctx->getMaxTexSize() + 2),
             GL_INVALID_VALUE);
+        SET_ERROR_IF(imageSize < (GLsizei)getPaletteSizeBytes(internalformat),
+                     GL_INVALID_VALUE);
         SET_ERROR_IF(!data,GL_INVALID_OPERATION);
 
         int nMipmaps = -level + 1;
         GLsizei tmpWidth  = width;
         GLsizei tmpHeight = height;
 
+        // Each level fits where the first one was decoded.
+        GLenum uncompressedFrmt;
+        GLESConversionScratch scratch(ctx->conversionArena());
+        unsigned char* uncompressed = (unsigned char*)scratch.alloc(
+                getPaletteDecodedSize(internalformat, uncompressedFrmt,
+                                      width, height, 0));
+
         for(int i = 0; i < nMipmaps; i++)
         {
-            GLenum uncompressedFrmt;
-            unsigned char* uncompressed =
-                uncompressTexture(internalformat, uncompressedFrmt,
-                                  width, height, imageSize, data, i);
+            uncompressTexture(internalformat, width, height, imageSize,
+                              data, i, uncompressed);
             glTexImage2DPtr(target, i, uncompressedFrmt,
                             tmpWidth, tmpHeight, border,
                             uncompressedFrmt, GL_UNSIGNED_BYTE, uncompressed);
             tmpWidth /= 2;
             tmpHeight /= 2;
-            delete [] uncompressed;
         }
     } else {
         SET_ERROR_IF(1, GL_INVALID_ENUM);
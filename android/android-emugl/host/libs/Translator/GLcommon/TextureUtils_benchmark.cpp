@@ -0,0 +1,145 @@
+/*
+* Copyright (C) 2017 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// The CPU conversions of texture uploads the host can't take as they are,
+// over image sizes from the small sub-images UI toolkits upload every frame
+// to full textures: |range_x| is the width and height of the image.
+
+#include <GLcommon/GLconversion.h>
+#include <GLcommon/GLEScontext.h>
+#include <GLcommon/PaletteTexture.h>
+#include <GLcommon/etc.h>
+
+#include "benchmark/benchmark_api.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+// 16-bit texels, as in the palettes of GL_PALETTE*_R5_G6_B5_OES and friends.
+std::vector<GLushort> packedTexels(size_t count) {
+    std::vector<GLushort> texels(count);
+    for (size_t i = 0; i < count; i++) {
+        texels[i] = GLushort(i * 0x9e37);
+    }
+    return texels;
+}
+
+void BM_ConvertRGB565ToRGBA8(benchmark::State& state) {
+    const auto in = packedTexels(state.range_x() * state.range_x());
+    std::vector<GLubyte> out(in.size() * 4);
+    while (state.KeepRunning()) {
+        convertRGB565ToRGBA8(in.data(), out.data(), in.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * in.size() *
+                            sizeof(GLushort));
+}
+
+void BM_ConvertRGBA4444ToRGBA8(benchmark::State& state) {
+    const auto in = packedTexels(state.range_x() * state.range_x());
+    std::vector<GLubyte> out(in.size() * 4);
+    while (state.KeepRunning()) {
+        convertRGBA4444ToRGBA8(in.data(), out.data(), in.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * in.size() *
+                            sizeof(GLushort));
+}
+
+// A paletted image of |format|: its palette, then its indices.
+std::vector<unsigned char> palettedImage(GLenum format, int size) {
+    const bool is4Bit = format < GL_PALETTE8_RGB8_OES;
+    const int paletteBytes = (is4Bit ? 16 : 256) * 4;
+    std::vector<unsigned char> image(paletteBytes +
+                                     size * size / (is4Bit ? 2 : 1));
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = (unsigned char)(i * 37);
+    }
+    return image;
+}
+
+// Decoding of paletted images into the scratch arena a context keeps across
+// uploads...
+void BM_UncompressPaletteSharedArena(benchmark::State& state) {
+    const GLenum format = GLenum(state.range_y());
+    const int size = state.range_x();
+    const auto image = palettedImage(format, size);
+    GLESConversionArena arena;
+    while (state.KeepRunning()) {
+        GLESConversionScratch scratch(arena);
+        GLenum formatOut;
+        unsigned char* pixels = (unsigned char*)scratch.alloc(
+                getPaletteDecodedSize(format, formatOut, size, size, 0));
+        uncompressTexture(format, size, size, image.size(), image.data(), 0,
+                          pixels);
+        benchmark::DoNotOptimize(pixels);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * size * size);
+}
+
+// ... and into memory allocated for each upload.
+void BM_UncompressPaletteOwnAllocation(benchmark::State& state) {
+    const GLenum format = GLenum(state.range_y());
+    const int size = state.range_x();
+    const auto image = palettedImage(format, size);
+    while (state.KeepRunning()) {
+        GLenum formatOut;
+        std::unique_ptr<unsigned char[]> pixels(new unsigned char[
+                getPaletteDecodedSize(format, formatOut, size, size, 0)]);
+        uncompressTexture(format, size, size, image.size(), image.data(), 0,
+                          pixels.get());
+        benchmark::DoNotOptimize(pixels.get());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * size * size);
+}
+
+// ETC1 sub-images, decoded into the scratch arena.
+void BM_DecodeEtc1SharedArena(benchmark::State& state) {
+    const int size = state.range_x();
+    std::vector<etc1_byte> image(
+            etc_get_encoded_data_size(EtcRGB8, size, size));
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = etc1_byte(i * 37);
+    }
+    const int pixelSize = etc_get_decoded_pixel_size(EtcRGB8);
+    const int bpr = (size * pixelSize + 3) & ~3;
+    GLESConversionArena arena;
+    while (state.KeepRunning()) {
+        GLESConversionScratch scratch(arena);
+        etc1_byte* pixels = (etc1_byte*)scratch.alloc(bpr * size);
+        etc2_decode_image(image.data(), EtcRGB8, pixels, size, size, bpr);
+        benchmark::DoNotOptimize(pixels);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * size * size);
+}
+
+}  // namespace
+
+BENCHMARK(BM_ConvertRGB565ToRGBA8)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+BENCHMARK(BM_ConvertRGBA4444ToRGBA8)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+BENCHMARK(BM_UncompressPaletteSharedArena)
+        ->ArgPair(16, GL_PALETTE4_R5_G6_B5_OES)
+        ->ArgPair(256, GL_PALETTE4_R5_G6_B5_OES)
+        ->ArgPair(16, GL_PALETTE8_RGBA8_OES)
+        ->ArgPair(256, GL_PALETTE8_RGBA8_OES);
+BENCHMARK(BM_UncompressPaletteOwnAllocation)
+        ->ArgPair(16, GL_PALETTE4_R5_G6_B5_OES)
+        ->ArgPair(256, GL_PALETTE4_R5_G6_B5_OES)
+        ->ArgPair(16, GL_PALETTE8_RGBA8_OES)
+        ->ArgPair(256, GL_PALETTE8_RGBA8_OES);
+BENCHMARK(BM_DecodeEtc1SharedArena)->Arg(16)->Arg(64)->Arg(256);
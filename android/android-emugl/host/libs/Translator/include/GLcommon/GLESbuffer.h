@@ -37,16 +37,36 @@ public:
    bool  setSubBuffer(GLint offset,GLuint size,const GLvoid* data);
    void  getConversions(const RangeList& rIn,RangeList& rOut);
    bool  fullyConverted(){return m_conversionManager.size() == 0;};
+   // Returns the largest of the |count| indices of |type| at |offset|.
+   // Results are cached until the buffer is written to, since games draw
+   // the same ranges of their index buffers every frame.
+   unsigned int findMaxIndex(GLuint offset,GLsizei count,GLenum type);
    void  setBinded(){m_wasBound = true;};
    bool  wasBinded(){return m_wasBound;};
    ~GLESbuffer();
 
 private:
+    struct IndexRange {
+        GLuint       offset;
+        GLsizei      count;
+        GLenum       type;
+        unsigned int maxIndex;
+    };
+    static const int kIndexRangeCacheSize = 8;
+
+    void invalidateIndexRanges() {
+        m_indexRangeCount = 0;
+        m_nextIndexRange = 0;
+    }
+
     GLuint         m_size = 0;
     GLuint         m_usage = GL_STATIC_DRAW;
     unsigned char* m_data = nullptr;
     RangeList      m_conversionManager;
     bool           m_wasBound = false;
+    IndexRange     m_indexRanges[kIndexRangeCacheSize];
+    int            m_indexRangeCount = 0;
+    int            m_nextIndexRange = 0;
 };
 
 typedef emugl::SmartPtr<GLESbuffer> GLESbufferPtr;
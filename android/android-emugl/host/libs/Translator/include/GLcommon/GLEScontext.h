@@ -26,6 +26,7 @@
 #include "ObjectNameSpace.h"
 #include "ShareGroup.h"
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -169,11 +170,55 @@ struct VAOStateRef {
 
 class FramebufferData;
 
+// Scratch memory for the client arrays converted during a draw call.
+// Contexts keep one across draw calls, so that converting arrays doesn't
+// allocate once it has grown to the size of the largest draw.
+class GLESConversionArena
+{
+public:
+    // Returns 16-byte aligned memory that stays valid until reset().
+    void* alloc(size_t bytes);
+    // Frees all allocations, keeping the memory for the next draw call.
+    void reset();
+
+    void addUser() { m_users++; }
+    void removeUser() { if (--m_users == 0) reset(); }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+    std::vector<Block> m_blocks;
+    size_t m_used = 0;
+    int m_users = 0;
+};
+
+// Memory of an arena for the duration of a scope, e.g. for the texels of an
+// upload converted on the CPU.
+class GLESConversionScratch
+{
+public:
+    explicit GLESConversionScratch(GLESConversionArena& arena)
+        : m_arena(arena) { m_arena.addUser(); }
+    ~GLESConversionScratch() { m_arena.removeUser(); }
+
+    void* alloc(size_t bytes) { return m_arena.alloc(bytes); }
+
+private:
+    GLESConversionArena& m_arena;
+};
+
 class GLESConversionArrays
 {
 public:
+    GLESConversionArrays() : GLESConversionArrays(m_ownArena) {}
+    explicit GLESConversionArrays(GLESConversionArena& arena);
+
     void setArr(void* data,unsigned int stride,GLenum type);
     void allocArr(unsigned int size,GLenum type);
+    // Returns scratch memory that lives as long as the arrays.
+    void* allocScratch(size_t bytes);
     ArrayData& operator[](int i);
     void* getCurrentData();
     ArrayData& getCurrentArray();
@@ -182,6 +227,8 @@ public:
 
     ~GLESConversionArrays();
 private:
+    GLESConversionArena m_ownArena;
+    GLESConversionArena& m_arena;
     std::unordered_map<GLenum,ArrayData> m_arrays;
     unsigned int m_current = 0;
 };
@@ -360,6 +407,10 @@ public:
     static bool isAutoMipmapSupported(){return s_glSupport.GL_SGIS_GENERATE_MIPMAP;}
     static TextureTarget GLTextureTargetToLocal(GLenum target);
     static unsigned int findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices);
+    // Like findMaxIndex(), using the cache of the element array buffer when
+    // |indices| points into it.
+    unsigned int findMaxElementIndex(GLsizei count,GLenum type,const GLvoid* indices);
+    GLESConversionArena& conversionArena() { return m_conversionArena; }
 
     virtual bool glGetIntegerv(GLenum pname, GLint *params);
     virtual bool glGetBooleanv(GLenum pname, GLboolean *params);
@@ -615,6 +666,8 @@ private:
 
     std::unordered_map<GLenum, GLenum> m_hints;
 
+    GLESConversionArena m_conversionArena;
+
     bool m_primitiveRestartEnabled = false;
 
 
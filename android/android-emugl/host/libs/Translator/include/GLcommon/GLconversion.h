@@ -0,0 +1,52 @@
+/*
+* Copyright (C) 2017 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef GL_CONVERSION_H
+#define GL_CONVERSION_H
+
+#include <GLES/gl.h>
+
+#include <stddef.h>
+
+// Kernels for the client array conversions and index scans done on every
+// GLES1 draw call. They use SSE2 when available, and give the same results
+// as the scalar X2F() and B2S() macros.
+
+// Converts |count| consecutive GL_FIXED values to floats.
+void convertFixedToFloat(const GLfixed* in, GLfloat* out, size_t count);
+
+// Converts |count| consecutive GL_BYTE values to shorts.
+void convertByteToShort(const GLbyte* in, GLshort* out, size_t count);
+
+// Returns the largest of |count| indices of |type|, which is one of
+// GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, or 0 if |count|
+// is 0.
+unsigned int findMaxIndexOf(GLenum type, const GLvoid* indices, size_t count);
+
+// Kernels for the texels converted on the CPU before an upload, for the
+// formats that the host can't take as they are. The 16-bit packed colors
+// are expanded to 8 bits per component as |c * 255 / max|, truncated.
+
+// Converts |count| GL_UNSIGNED_SHORT_5_6_5 texels to RGBA8, with an alpha
+// of 255.
+void convertRGB565ToRGBA8(const GLushort* in, GLubyte* out, size_t count);
+
+// Converts |count| GL_UNSIGNED_SHORT_4_4_4_4 texels to RGBA8.
+void convertRGBA4444ToRGBA8(const GLushort* in, GLubyte* out, size_t count);
+
+// Converts |count| GL_UNSIGNED_SHORT_5_5_5_1 texels to RGBA8.
+void convertRGBA5551ToRGBA8(const GLushort* in, GLubyte* out, size_t count);
+
+#endif
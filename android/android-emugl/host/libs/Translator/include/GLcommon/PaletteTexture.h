@@ -20,6 +20,20 @@
 
 #define MAX_SUPPORTED_PALETTE 10
 
-unsigned char* uncompressTexture(GLenum internalformat,GLenum& formatOut,GLsizei width,GLsizei height,GLsizei imageSize, const GLvoid* data,GLint level);
+#include <stddef.h>
+
+// Returns the size in bytes of the palette that starts the data of a
+// texture of paletted |internalformat|.
+size_t getPaletteSizeBytes(GLenum internalformat);
+
+// Returns the size in bytes of level |level| of a |width| x |height|
+// texture of paletted |internalformat| once decoded, and in |formatOut| the
+// format it is decoded to: GL_RGB or GL_RGBA, of GL_UNSIGNED_BYTE.
+size_t getPaletteDecodedSize(GLenum internalformat,GLenum& formatOut,GLsizei width,GLsizei height,GLint level);
+
+// Decodes level |level| of the paletted |data| into |pixelsOut|, which must
+// hold getPaletteDecodedSize() bytes. Texels missing from |data| are zeroed,
+// as are the colors missing from a truncated palette.
+void uncompressTexture(GLenum internalformat,GLsizei width,GLsizei height,GLsizei imageSize, const GLvoid* data,GLint level,unsigned char* pixelsOut);
 
 #endif
@@ -31,6 +31,18 @@ struct ShaderConfig {
     return memcmp(this, &rhs, sizeof(rhs)) == 0;
   }
 
+  // A hash of all the bits compared by operator==, used to look variants up
+  // in the shader and program caches.
+  uint32_t Hash() const {
+    // 32-bit FNV-1a.
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(this);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(*this); ++i) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+  }
+
   // TODO(crbug.com/441920): This structure duplicates the TexEnv & TexGen
   // structures somewhat.  It would be nice to eliminate that duplication.
   struct TextureConfig {
@@ -862,25 +862,28 @@ ProgramContext& GlesContext::BindProgramContext(GLenum mode) {
   char buffer[kMaxShaderBufferSize];
 
   const ShaderConfig cfg = ConfigureShader(mode);
+  const uint32_t hash = cfg.Hash();
 
-  GLuint* vs = vertex_shader_cache_.Get(cfg);
-  if (!vs) {
-    GenerateVertexShader(cfg, buffer, sizeof(buffer));
-    const GLuint shader = CompileShader(GL_VERTEX_SHADER, buffer);
-    vs = vertex_shader_cache_.Push(cfg, shader);
-  }
+  // The program is found on almost every draw; the shaders are only needed
+  // to link a new one.
+  ProgramContext* program = program_cache_.Get(cfg, hash);
+  if (!program) {
+    GLuint* vs = vertex_shader_cache_.Get(cfg, hash);
+    if (!vs) {
+      GenerateVertexShader(cfg, buffer, sizeof(buffer));
+      const GLuint shader = CompileShader(GL_VERTEX_SHADER, buffer);
+      vs = vertex_shader_cache_.Push(cfg, hash, shader);
+    }
 
-  GLuint* fs = fragment_shader_cache_.Get(cfg);
-  if (!fs) {
-    GenerateFragmentShader(cfg, buffer, sizeof(buffer));
-    const GLuint shader = CompileShader(GL_FRAGMENT_SHADER, buffer);
-    fs = fragment_shader_cache_.Push(cfg, shader);
-  }
+    GLuint* fs = fragment_shader_cache_.Get(cfg, hash);
+    if (!fs) {
+      GenerateFragmentShader(cfg, buffer, sizeof(buffer));
+      const GLuint shader = CompileShader(GL_FRAGMENT_SHADER, buffer);
+      fs = fragment_shader_cache_.Push(cfg, hash, shader);
+    }
 
-  ProgramContext* program = program_cache_.Get(cfg);
-  if (!program) {
     GLuint id = CompileProgram(*vs, *fs);
-    program = program_cache_.Push(cfg, ProgramContext(this, id));
+    program = program_cache_.Push(cfg, hash, ProgramContext(this, id));
   }
 
   LOG_ALWAYS_FATAL_IF(program == NULL, "Program not created?");
@@ -16,11 +16,17 @@
 #ifndef GRAPHICS_TRANSLATION_GLES_MRU_CACHE_H_
 #define GRAPHICS_TRANSLATION_GLES_MRU_CACHE_H_
 
-#include <list>
-#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
 
 // A container of a limited number of objects that are managed in a most
 // recently used manner and can be looked up by a Key.
+//
+// Lookups are done on every draw call, so objects are indexed by a hash of
+// their Key in an open-addressing table with linear probing: a lookup
+// usually compares a single Key.  The caller computes the hash, so that one
+// hash can be used with several caches sharing the same Key.
 template <typename Key, typename Value>
 class MruCache {
  public:
@@ -28,57 +34,134 @@ class MruCache {
   // they get removed from the cache.
   typedef void (*DestroyFn)(Value* v);
 
-  typedef std::list<std::pair<Key, Value> > Cache;
+  explicit MruCache(size_t limit) { Init(limit, NULL); }
 
-  explicit MruCache(size_t limit) : cache_(), destroy_(NULL), limit_(limit) {}
-
-  MruCache(size_t limit, DestroyFn destroy)
-      : cache_(), destroy_(destroy), limit_(limit) {}
+  MruCache(size_t limit, DestroyFn destroy) { Init(limit, destroy); }
 
   ~MruCache() {
-    if (destroy_) {
-      while (cache_.size() != 0) {
-        destroy_(&cache_.back().second);
-        cache_.pop_back();
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i]) {
+        Destroy(slots_[i]);
       }
     }
   }
 
   Value* GetMostRecentlyUsed() {
-    if (cache_.size() > 0) {
-      return &cache_.front().second;
-    }
-    return NULL;
+    return mru_ ? &mru_->value : NULL;
   }
 
   // Gets a pointer to the object referenced by the Key (or NULL if no such
-  // object).  Will internally move the object to the "front" of the cache.
-  Value* Get(const Key& key) {
-    for (typename Cache::iterator i = cache_.begin(); i != cache_.end(); ++i) {
-      if (i->first == key) {
-        cache_.splice(cache_.begin(), cache_, i);
-        return &i->second;
+  // object).  Will internally mark the object as the most recently used one.
+  Value* Get(const Key& key, uint32_t hash) {
+    for (size_t i = hash & mask_; slots_[i]; i = (i + 1) & mask_) {
+      Entry* entry = slots_[i];
+      if (entry->hash == hash && entry->key == key) {
+        Touch(entry);
+        return &entry->value;
       }
     }
     return NULL;
   }
 
-  // Push an object into the cache referenced by the Key.
-  Value* Push(const Key& key, const Value& value) {
-    if (cache_.size() == limit_) {
-      if (destroy_) {
-        destroy_(&cache_.back().second);
-      }
-      cache_.pop_back();
+  // Push an object into the cache referenced by the Key, which must not be
+  // in the cache already.
+  Value* Push(const Key& key, uint32_t hash, const Value& value) {
+    if (size_ == limit_) {
+      EvictLeastRecentlyUsed();
+    }
+    size_t i = hash & mask_;
+    while (slots_[i]) {
+      i = (i + 1) & mask_;
     }
-    cache_.push_front(std::make_pair(key, value));
-    return &cache_.front().second;
+    Entry* entry = new Entry(key, hash, value);
+    slots_[i] = entry;
+    ++size_;
+    Touch(entry);
+    return &entry->value;
   }
 
  private:
-  Cache cache_;
+  struct Entry {
+    Entry(const Key& k, uint32_t h, const Value& v)
+        : key(k), hash(h), value(v), last_use(0) {}
+
+    Key key;
+    uint32_t hash;
+    Value value;
+    uint64_t last_use;
+  };
+
+  void Init(size_t limit, DestroyFn destroy) {
+    // Keep the table at most half full, so that probe sequences are short.
+    size_t capacity = 1;
+    while (capacity < limit * 2) {
+      capacity *= 2;
+    }
+    slots_.assign(capacity, NULL);
+    mask_ = capacity - 1;
+    destroy_ = destroy;
+    limit_ = limit;
+    size_ = 0;
+    clock_ = 0;
+    mru_ = NULL;
+  }
+
+  void Touch(Entry* entry) {
+    entry->last_use = ++clock_;
+    mru_ = entry;
+  }
+
+  void Destroy(Entry* entry) {
+    if (destroy_) {
+      destroy_(&entry->value);
+    }
+    delete entry;
+  }
+
+  // Only happens when a new shader variant is compiled, so a scan of the
+  // table is cheap in comparison.
+  void EvictLeastRecentlyUsed() {
+    size_t oldest = slots_.size();
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i] && (oldest == slots_.size() ||
+                        slots_[i]->last_use < slots_[oldest]->last_use)) {
+        oldest = i;
+      }
+    }
+    if (oldest == slots_.size()) {
+      return;
+    }
+    if (slots_[oldest] == mru_) {
+      mru_ = NULL;
+    }
+    Destroy(slots_[oldest]);
+    --size_;
+
+    // Shift the following entries of the probe sequence back, so that
+    // lookups never stop at the hole left by the evicted entry.
+    size_t hole = oldest;
+    slots_[hole] = NULL;
+    for (size_t i = (hole + 1) & mask_; slots_[i]; i = (i + 1) & mask_) {
+      const size_t home = slots_[i]->hash & mask_;
+      // The entry can move to the hole unless its home slot lies cyclically
+      // in (hole, i].
+      const bool stays = (hole <= i) ? (home > hole && home <= i)
+                                     : (home > hole || home <= i);
+      if (!stays) {
+        slots_[hole] = slots_[i];
+        slots_[i] = NULL;
+        hole = i;
+      }
+    }
+  }
+
+  std::vector<Entry*> slots_;
+  size_t mask_;
   DestroyFn destroy_;
   size_t limit_;
+  size_t size_;
+  uint64_t clock_;
+  Entry* mru_;
 
   MruCache(const MruCache&);
   MruCache& operator=(const MruCache&);
@@ -34,6 +34,7 @@ host_common_SRC_FILES := \
     RenderControl.cpp \
     RendererImpl.cpp \
     RenderLibImpl.cpp \
+    RenderStats.cpp \
     RenderThread.cpp \
     RenderThreadInfo.cpp \
     render_api.cpp \
@@ -96,8 +97,12 @@ LOCAL_SYMBOL_FILE := render_api.entries
 LOCAL_SRC_FILES := \
     BufferQueue_unittest.cpp \
     ../Translator/GLES_V2/ANGLEShaderParser.cpp \
+    ../Translator/GLES_V2/ShaderCache.cpp \
     OpenGLTestContext.cpp \
     OpenGL_unittest.cpp \
+    PostSlot_unittest.cpp \
+    RenderStats.cpp \
+    RenderStats_unittest.cpp \
     StalePtrRegistry_unittest.cpp \
 
 $(call emugl-import,lib$(BUILD_TARGET_SUFFIX)OpenglRender libemugl_gtest)
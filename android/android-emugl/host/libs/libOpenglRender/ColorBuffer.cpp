@@ -18,7 +18,9 @@
 #include "android/base/memory/ScopedPtr.h"
 
 #include "DispatchTables.h"
+#include "FrameBuffer.h"
 #include "GLcommon/GLutils.h"
+#include "RenderStats.h"
 #include "RenderThreadInfo.h"
 #include "TextureDraw.h"
 #include "TextureResize.h"
@@ -26,6 +28,8 @@
 
 #include "OpenGLESDispatch/EGLDispatch.h"
 
+#include "glUtils.h"
+
 #include <stdio.h>
 #include <string.h>
 
@@ -35,6 +39,8 @@
 #define DEBUG_CB_FBO 1
 #endif
 
+using android::base::AutoLock;
+
 namespace {
 
 // Lazily create and bind a framebuffer object to the current host context.
@@ -71,6 +77,37 @@ void unbindFbo() {
     s_gles2.glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// Size in bytes of |width| pixels of |format| and |type|, tightly packed as
+// in the guest's buffers. 0 for formats the guest can't transfer.
+size_t rowBytes(int width, GLenum format, GLenum type) {
+    return ((size_t)glUtilsPixelBitSize(format, type) * width) >> 3;
+}
+
+// Readbacks into a pixel pack buffer completed by a fence need GLES 3.0.
+bool canReadbackAsync() {
+    return FrameBuffer::getMaxGLESVersion() >= GLES_DISPATCH_MAX_VERSION_3_0;
+}
+
+// How long a read waits for an asynchronous readback before giving up and
+// reading synchronously.
+constexpr GLuint64 kReadbackTimeoutNs = 1000000000ULL;
+
+// Sets GL_PACK_ALIGNMENT of the current context for the lifetime of the
+// object, then restores the previous value.
+class ScopedPackAlignment {
+public:
+    explicit ScopedPackAlignment(GLint alignment) {
+        s_gles2.glGetIntegerv(GL_PACK_ALIGNMENT, &m_previous);
+        s_gles2.glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    }
+    ~ScopedPackAlignment() {
+        s_gles2.glPixelStorei(GL_PACK_ALIGNMENT, m_previous);
+    }
+
+private:
+    GLint m_previous = 4;
+};
+
 }
 
 ColorBuffer::Helper::~Helper() = default;
@@ -199,6 +236,8 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
             break;
         case FRAMEWORK_FORMAT_YV12:
         case FRAMEWORK_FORMAT_YUV_420_888:
+        case FRAMEWORK_FORMAT_NV12:
+        case FRAMEWORK_FORMAT_NV21:
             cb->m_yuv_converter.reset(
                     new YUVConverter(p_width, p_height, cb->m_frameworkFormat));
             break;
@@ -235,6 +274,11 @@ ColorBuffer::~ColorBuffer() {
 
     m_yuv_converter.reset();
 
+    deleteReadback();
+    if (m_readbackPbo) {
+        s_gles2.glDeleteBuffers(1, &m_readbackPbo);
+    }
+
     GLuint tex[2] = {m_tex, m_blitTex};
     s_gles2.glDeleteTextures(2, tex);
 
@@ -254,12 +298,159 @@ void ColorBuffer::readPixels(int x,
     }
 
     touch();
+    RenderStats::onColorBufferReadback(rowBytes(width, p_format, p_type) *
+                                       height);
+
+    if (x == 0 && y == 0 && width == (int)m_width &&
+        height == (int)m_height) {
+        bool done = false;
+        if (m_shadowValid && p_format == m_shadowFormat &&
+            p_type == m_shadowType) {
+            memcpy(pixels, m_shadow.data(), m_shadow.size());
+            done = true;
+        } else {
+            done = finishReadback(p_format, p_type, pixels);
+        }
+        // Have the next GPU write start a readback in this format.
+        m_readByGuest = true;
+        m_readFormat = p_format;
+        m_readType = p_type;
+        if (done) {
+            return;
+        }
+    }
+
     if (bindFbo(&m_fbo, m_tex)) {
         s_gles2.glReadPixels(x, y, width, height, p_format, p_type, pixels);
         unbindFbo();
     }
 }
 
+// Starts reading the whole buffer back into |m_readbackPbo|, if the guest
+// read the previous contents.
+void ColorBuffer::startReadback() {
+    deleteReadback();
+    if (!m_readByGuest || m_boundByGuest || !canReadbackAsync()) {
+        return;
+    }
+    const size_t size = rowBytes(m_width, m_readFormat, m_readType) * m_height;
+    if (!size || !bindFbo(&m_fbo, m_tex)) {
+        return;
+    }
+
+    if (!m_readbackPbo) {
+        s_gles2.glGenBuffers(1, &m_readbackPbo);
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPbo);
+    if (m_readbackPboSize != size) {
+        s_gles2.glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr,
+                             GL_STREAM_READ);
+        m_readbackPboSize = size;
+    }
+    {
+        ScopedPackAlignment packAlignment(1);
+        s_gles2.glReadPixels(0, 0, m_width, m_height, m_readFormat,
+                             m_readType, 0);
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    unbindFbo();
+
+    m_readbackSync = s_gles2.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Get the copy going now rather than at the next read.
+    s_gles2.glFlush();
+    m_readbackValid = true;
+    // Only keep reading back while the guest keeps reading.
+    m_readByGuest = false;
+}
+
+// Waits for the asynchronous readback and copies its result to |pixels|.
+// Returns false if there was none in |p_format| and |p_type|, or if its
+// data is stale.
+bool ColorBuffer::finishReadback(GLenum p_format, GLenum p_type,
+                                 void* pixels) {
+    if (!m_readbackSync || !m_readbackValid || p_format != m_readFormat ||
+        p_type != m_readType) {
+        deleteReadback();
+        return false;
+    }
+
+    bool done = false;
+    const GLenum status = s_gles2.glClientWaitSync(
+            m_readbackSync, GL_SYNC_FLUSH_COMMANDS_BIT, kReadbackTimeoutNs);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackPbo);
+        const void* data = s_gles2.glMapBufferRange(
+                GL_PIXEL_PACK_BUFFER, 0, m_readbackPboSize, GL_MAP_READ_BIT);
+        if (data) {
+            memcpy(pixels, data, m_readbackPboSize);
+            s_gles2.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            done = true;
+        }
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    deleteReadback();
+    return done;
+}
+
+void ColorBuffer::deleteReadback() {
+    if (m_readbackSync) {
+        s_gles2.glDeleteSync(m_readbackSync);
+        m_readbackSync = nullptr;
+    }
+    m_readbackValid = false;
+}
+
+// Doesn't need a current context: the readback itself is only deleted the
+// next time the helper context is. Frees the shadow copy, which the next
+// update of the whole buffer starts again.
+void ColorBuffer::invalidateShadow() {
+    m_shadowValid = false;
+    std::vector<unsigned char>().swap(m_shadow);
+    m_readbackValid = false;
+}
+
+// Uploads the rows of the rectangle that differ from the shadow copy, and
+// updates the latter. Returns false if the shadow copy can't be used for
+// this update, in which case nothing was done.
+bool ColorBuffer::uploadDamage(int x, int y, int width, int height,
+                               GLenum p_format, GLenum p_type,
+                               const void* pixels) {
+    if (!m_shadowValid || p_format != m_shadowFormat ||
+        p_type != m_shadowType) {
+        return false;
+    }
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        x + width > (int)m_width || y + height > (int)m_height) {
+        return false;
+    }
+
+    const size_t stride = rowBytes(m_width, p_format, p_type);
+    const size_t offset = rowBytes(x, p_format, p_type);
+    const size_t row = rowBytes(width, p_format, p_type);
+    const unsigned char* src = static_cast<const unsigned char*>(pixels);
+    int first = -1;
+    int last = -1;
+    for (int r = 0; r < height; r++, src += row) {
+        unsigned char* dst = &m_shadow[(y + r) * stride + offset];
+        if (memcmp(dst, src, row)) {
+            memcpy(dst, src, row);
+            if (first < 0) {
+                first = r;
+            }
+            last = r;
+        }
+    }
+
+    if (first >= 0) {
+        s_gles2.glTexSubImage2D(
+                GL_TEXTURE_2D, 0, x, y + first, width, last - first + 1,
+                p_format, p_type,
+                static_cast<const unsigned char*>(pixels) + first * row);
+    }
+    return true;
+}
+
 void ColorBuffer::reformat(GLint internalformat,
                            GLenum format, GLenum type) {
     s_gles2.glBindTexture(GL_TEXTURE_2D, m_tex);
@@ -287,6 +478,7 @@ void ColorBuffer::reformat(GLint internalformat,
     m_internalFormat = internalformat;
     m_format = format;
     m_type = type;
+    invalidateShadow();
 }
 
 void ColorBuffer::subUpdate(int x,
@@ -302,6 +494,11 @@ void ColorBuffer::subUpdate(int x,
     }
 
     touch();
+    RenderStats::onColorBufferUpload(rowBytes(width, p_format, p_type) *
+                                     height);
+
+    // The data of a readback started before this update would be stale.
+    deleteReadback();
 
     if (m_needFormatCheck) {
         if (p_type != m_type || p_format != m_format) {
@@ -311,8 +508,11 @@ void ColorBuffer::subUpdate(int x,
     }
 
     if (m_frameworkFormat == FRAMEWORK_FORMAT_YV12 ||
-        m_frameworkFormat == FRAMEWORK_FORMAT_YUV_420_888) {
+        m_frameworkFormat == FRAMEWORK_FORMAT_YUV_420_888 ||
+        m_frameworkFormat == FRAMEWORK_FORMAT_NV12 ||
+        m_frameworkFormat == FRAMEWORK_FORMAT_NV21) {
         assert(m_yuv_converter.get());
+        invalidateShadow();
 
         // This FBO will convert the YUV frame to RGB
         // and render it to |m_tex|.
@@ -326,13 +526,30 @@ void ColorBuffer::subUpdate(int x,
         s_gles2.glBindTexture(GL_TEXTURE_2D, m_tex);
         s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-        s_gles2.glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, p_format,
-                                p_type, pixels);
+        if (!uploadDamage(x, y, width, height, p_format, p_type, pixels)) {
+            s_gles2.glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+                                    p_format, p_type, pixels);
+
+            // Updates of the whole buffer start a new shadow copy, which
+            // the following updates are compared against.
+            const size_t size = rowBytes(width, p_format, p_type) * height;
+            if (x == 0 && y == 0 && width == (int)m_width &&
+                height == (int)m_height && size && !m_boundByGuest) {
+                const unsigned char* src =
+                        static_cast<const unsigned char*>(pixels);
+                m_shadow.assign(src, src + size);
+                m_shadowFormat = p_format;
+                m_shadowType = p_type;
+                m_shadowValid = true;
+            } else {
+                invalidateShadow();
+            }
+        }
     }
 
     if (m_fastBlitSupported) {
         s_gles2.glFlush();
-        m_sync = (GLsync)s_egl.eglSetImageFenceANDROID(m_display, m_eglImage);
+        setSync();
     }
 }
 
@@ -345,10 +562,19 @@ bool ColorBuffer::blitFromCurrentReadBuffer() {
     }
 
     touch();
+    invalidateShadow();
 
     if (m_fastBlitSupported) {
         s_egl.eglBlitFromCurrentReadBufferANDROID(m_display, m_eglImage);
-        m_sync = (GLsync)s_egl.eglSetImageFenceANDROID(m_display, m_eglImage);
+        setSync();
+
+        if (m_readByGuest) {
+            RecursiveScopedHelperContext context(m_helper);
+            if (context.isOk()) {
+                waitSync();
+                startReadback();
+            }
+        }
     } else {
         // Copy the content of the current read surface into m_blitEGLImage.
         // This is done by creating a temporary texture, bind it to the EGLImage
@@ -435,6 +661,8 @@ bool ColorBuffer::blitFromCurrentReadBuffer() {
         // Restore previous viewport.
         s_gles2.glViewport(vport[0], vport[1], vport[2], vport[3]);
         unbindFbo();
+
+        startReadback();
     }
 
     return true;
@@ -449,7 +677,8 @@ bool ColorBuffer::bindToTexture() {
         return false;
     }
     touch();
-
+    m_boundByGuest = true;
+    invalidateShadow();
     if (tInfo->currContext->clientVersion() > GLESApi_CM) {
         s_gles2.glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, m_eglImage);
     } else {
@@ -467,6 +696,8 @@ bool ColorBuffer::bindToRenderbuffer() {
         return false;
     }
     touch();
+    m_boundByGuest = true;
+    invalidateShadow();
     if (tInfo->currContext->clientVersion() > GLESApi_CM) {
         s_gles2.glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER_OES,
                                                        m_eglImage);
@@ -481,16 +712,23 @@ GLuint ColorBuffer::scale() {
     return m_resizer->update(m_tex);
 }
 
+void ColorBuffer::setSync() {
+    AutoLock lock(m_syncLock);
+    m_sync = (GLsync)s_egl.eglSetImageFenceANDROID(m_display, m_eglImage);
+}
+
 void ColorBuffer::waitSync() {
+    AutoLock lock(m_syncLock);
     if (m_sync) {
         s_gles2.glWaitSync(m_sync, 0, GL_TIMEOUT_IGNORED);
     }
 }
 
-bool ColorBuffer::post(GLuint tex, float rotation, float dx, float dy) {
+bool ColorBuffer::post(TextureDraw* textureDraw, GLuint tex, float rotation,
+                       float dx, float dy) {
     // NOTE: Do not call m_helper->setupContext() here!
     waitSync();
-    return m_helper->getTextureDraw()->draw(tex, rotation, dx, dy);
+    return textureDraw->draw(tex, rotation, dx, dy);
 }
 
 void ColorBuffer::readback(unsigned char* img) {
@@ -613,6 +851,8 @@ void ColorBuffer::restore() {
             break;
         case FRAMEWORK_FORMAT_YV12:
         case FRAMEWORK_FORMAT_YUV_420_888:
+        case FRAMEWORK_FORMAT_NV12:
+        case FRAMEWORK_FORMAT_NV21:
             m_yuv_converter.reset(
                     new YUVConverter(m_width, m_height, m_frameworkFormat));
             break;
@@ -21,11 +21,13 @@
 #include <GLES/gl.h>
 #include <GLES3/gl3.h>
 #include "android/base/files/Stream.h"
+#include "android/base/synchronization/Lock.h"
 #include "android/snapshot/LazySnapshotObj.h"
 #include "emugl/common/smart_ptr.h"
 #include "RenderContext.h"
 
 #include <memory>
+#include <vector>
 
 #include "FrameworkFormats.h"
 
@@ -152,6 +154,11 @@ public:
     GLuint getHeight() const { return m_height; }
 
     // Read the ColorBuffer instance's pixel values into host memory.
+    // Reads of the whole buffer are served from the CPU shadow copy when
+    // the buffer was only written by subUpdate(). Once the guest read a
+    // buffer, blitFromCurrentReadBuffer() also starts reading its new
+    // contents back asynchronously, so that the next read only waits for
+    // the fence of that readback.
     void readPixels(int x,
                     int y,
                     int width,
@@ -165,6 +172,9 @@ public:
     // and data type.
     // Otherwise, subUpdate() will explicitly convert |pixels|
     // to be in |p_format|.
+    // Updates of the whole buffer start a CPU shadow copy of it. While no
+    // other write invalidates that copy, only the rows of the following
+    // updates that differ from it are uploaded.
     void subUpdate(int x,
                    int y,
                    int width,
@@ -180,14 +190,18 @@ public:
     // Scale the underlying texture of this ColorBuffer to match viewport size.
     // It returns the texture name after scaling.
     GLuint scale();
-    // Post this ColorBuffer to the host native sub-window.
+    // Post this ColorBuffer to the host native sub-window with
+    // |textureDraw|, which belongs to the calling thread.
     // |rotation| is the rotation angle in degrees, clockwise in the GL
     // coordinate space.
-    bool post(GLuint tex, float rotation, float dx, float dy);
+    bool post(TextureDraw* textureDraw, GLuint tex, float rotation, float dx,
+              float dy);
 
     // Bind the current context's EGL_TEXTURE_2D texture to this ColorBuffer's
     // EGLImage. This is intended to implement glEGLImageTargetTexture2DOES()
     // for all GLES versions.
+    // The guest can render to the texture, so this disables the shadow copy
+    // and asynchronous readbacks.
     bool bindToTexture();
 
     // Bind the current context's EGL_RENDERBUFFER_OES render buffer to this
@@ -223,8 +237,18 @@ public:
 
 private:
     ColorBuffer(EGLDisplay display, HandleType hndl, Helper* helper);
+    void setSync();
     void waitSync();
 
+    // Shadow copy and readback management. All but invalidateShadow() need
+    // the helper context to be current.
+    bool uploadDamage(int x, int y, int width, int height,
+                      GLenum p_format, GLenum p_type, const void* pixels);
+    void startReadback();
+    bool finishReadback(GLenum p_format, GLenum p_type, void* pixels);
+    void deleteReadback();
+    void invalidateShadow();
+
 private:
     GLuint m_tex = 0;
     GLuint m_blitTex = 0;
@@ -255,8 +279,36 @@ private:
     std::unique_ptr<YUVConverter> m_yuv_converter;
     HandleType mHndl;
 
+    // The fence of the last write to |m_eglImage|. Setting a new one deletes
+    // the previous one, which the post thread may be about to wait on.
+    android::base::Lock m_syncLock;
     GLsync m_sync = nullptr;
     bool m_fastBlitSupported = false;
+
+    // CPU copy of the whole buffer as uploaded by subUpdate(), tightly
+    // packed in |m_shadowFormat| and |m_shadowType|. Only meaningful while
+    // |m_shadowValid| is true, i.e. until anything else writes the buffer.
+    std::vector<unsigned char> m_shadow;
+    GLenum m_shadowFormat = 0;
+    GLenum m_shadowType = 0;
+    bool m_shadowValid = false;
+    // Whether the guest read the whole buffer, in |m_readFormat| and
+    // |m_readType|, since the last readback was started, i.e. whether it is
+    // worth starting another one.
+    bool m_readByGuest = false;
+    GLenum m_readFormat = 0;
+    GLenum m_readType = 0;
+    // Asynchronous readback of the whole buffer into |m_readbackPbo|, in
+    // |m_readFormat| and |m_readType|, complete once |m_readbackSync| is
+    // signaled. Its data is stale unless |m_readbackValid| is true.
+    GLuint m_readbackPbo = 0;
+    size_t m_readbackPboSize = 0;
+    GLsync m_readbackSync = nullptr;
+    bool m_readbackValid = false;
+    // Set once the buffer is bound as a texture or a renderbuffer: it can
+    // then be rendered to at any time, which neither the shadow copy nor a
+    // readback can keep track of.
+    bool m_boundByGuest = false;
 };
 
 typedef emugl::SmartPtr<ColorBuffer> ColorBufferPtr;
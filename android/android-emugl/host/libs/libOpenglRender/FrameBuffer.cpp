@@ -20,7 +20,9 @@
 #include "GLESVersionDetector.h"
 #include "NativeSubWindow.h"
 #include "RenderControl.h"
+#include "RenderStats.h"
 #include "RenderThreadInfo.h"
+#include "SyncThread.h"
 #include "gles2_dec.h"
 
 #include "OpenGLESDispatch/EGLDispatch.h"
@@ -213,12 +215,20 @@ void FrameBuffer::finalize() {
         // The only visible thing in the framebuffer is subwindow. Everything else
         // will get cleaned when the process exits.
         if (m_useSubWindow) {
+            stopPostThread();
             m_postWorker.reset();
             removeSubWindow_locked();
         }
         return;
     }
 
+    // The sync workers' contexts share with ours.
+    SyncThread::destroySyncThread();
+
+    stopPostThread();
+    m_pendingPost.clearLocked();
+    m_retiredPosts.clear();
+
     m_colorbuffers.clear();
     m_colorBufferDelayedCloseList.clear();
     if (m_useSubWindow) {
@@ -596,9 +606,33 @@ FrameBuffer::sendReadbackWorkerCmd(const Readback& readback) {
 WorkerProcessingResult
 FrameBuffer::postWorkerFunc(const Post& post) {
     switch (post.cmd) {
-        case PostCmd::Post:
-            m_postWorker->post(post.cb);
+        case PostCmd::Post: {
+            // Pace before picking up the frame, so that it is the latest one.
+            m_postWorker->waitForVsync(m_swapInterval);
+
+            PendingPost pending;
+            {
+                AutoLock lock(m_postLock);
+                if (!m_pendingPost.takeLocked(&pending)) {
+                    break;
+                }
+            }
+
+            PostTimings timings = pending.timings;
+            timings.compositeUs = System::get()->getHighResTimeUs();
+            m_postWorker->post(pending.cb.get());
+            timings.presentUs = System::get()->getHighResTimeUs();
+
+            AutoLock lock(m_postLock);
+            m_retiredPosts.push_back(std::move(pending.cb));
+            if (m_postTimings.size() < kPostTimingsCount) {
+                m_postTimings.push_back(timings);
+            } else {
+                m_postTimings[m_nextPostTimings] = timings;
+            }
+            m_nextPostTimings = (m_nextPostTimings + 1) % kPostTimingsCount;
             break;
+        }
         case PostCmd::Viewport:
             m_postWorker->viewport(post.viewport.width,
                                    post.viewport.height);
@@ -606,6 +640,8 @@ FrameBuffer::postWorkerFunc(const Post& post) {
         case PostCmd::Clear:
             m_postWorker->clear();
             break;
+        case PostCmd::Exit:
+            return WorkerProcessingResult::Stop;
         default:
             break;
     }
@@ -618,8 +654,39 @@ void FrameBuffer::sendPostWorkerCmd(FrameBuffer::Post post) {
         m_postThread.start();
     }
 
+    const bool wait = post.cmd != PostCmd::Post;
     m_postThread.enqueue(Post(post));
-    m_postThread.waitQueuedItems();
+    if (wait) {
+        m_postThread.waitQueuedItems();
+    }
+}
+
+void FrameBuffer::stopPostThread() {
+    if (!m_postThread.isStarted()) {
+        return;
+    }
+    Post exitCmd;
+    exitCmd.cmd = PostCmd::Exit;
+    m_postThread.enqueue(Post(exitCmd));
+    m_postThread.join();
+}
+
+std::vector<PostTimings> FrameBuffer::getPostTimings() {
+    AutoLock lock(m_postLock);
+    std::vector<PostTimings> res;
+    res.reserve(m_postTimings.size());
+    // |m_nextPostTimings| is the oldest entry once the ring is full.
+    const size_t start =
+            m_postTimings.size() < kPostTimingsCount ? 0 : m_nextPostTimings;
+    for (size_t i = 0; i < m_postTimings.size(); i++) {
+        res.push_back(m_postTimings[(start + i) % m_postTimings.size()]);
+    }
+    return res;
+}
+
+uint64_t FrameBuffer::getDroppedPostCount() {
+    AutoLock lock(m_postLock);
+    return m_pendingPost.droppedCountLocked();
 }
 
 void FrameBuffer::setPostCallback(
@@ -841,6 +908,10 @@ bool FrameBuffer::removeSubWindow_locked() {
     }
     bool removed = false;
     if (m_subWin) {
+        // The post thread may still be drawing to the window.
+        if (m_postThread.isStarted()) {
+            m_postThread.waitQueuedItems();
+        }
         s_egl.eglMakeCurrent(m_eglDisplay, NULL, NULL, NULL);
         s_egl.eglDestroySurface(m_eglDisplay, m_eglSurface);
         destroySubWindow(m_subWin);
@@ -1629,7 +1700,10 @@ void FrameBuffer::unbindAndDestroyTrivialSharedContext(EGLContext context,
 
 bool FrameBuffer::post(HandleType p_colorbuffer, bool needLockAndBind) {
     bool res = postImpl(p_colorbuffer, needLockAndBind);
-    if (res) setGuestPostedAFrame();
+    if (res) {
+        setGuestPostedAFrame();
+        RenderStats::onPost();
+    }
     return res;
 }
 
@@ -1639,6 +1713,7 @@ bool FrameBuffer::postImpl(HandleType p_colorbuffer, bool needLockAndBind) {
     }
 
     bool ret = false;
+    PostTimings timings;
 
     ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
     if (c == m_colorbuffers.end()) {
@@ -1649,19 +1724,7 @@ bool FrameBuffer::postImpl(HandleType p_colorbuffer, bool needLockAndBind) {
 
     ret = true;
 
-    if (m_subWin) {
-        markOpened(&c->second);
-        c->second.cb->touch();
-
-        Post postCmd;
-        postCmd.cmd = PostCmd::Post;
-        postCmd.cb = c->second.cb.get();
-        sendPostWorkerCmd(postCmd);
-    } else {
-        // If there is no sub-window, don't display anything, the client will
-        // rely on m_onPost to get the pixels instead.
-        ret = true;
-    }
+    timings.postUs = System::get()->getHighResTimeUs();
 
     //
     // output FPS statistics
@@ -1693,14 +1756,46 @@ bool FrameBuffer::postImpl(HandleType p_colorbuffer, bool needLockAndBind) {
                 // do post callback just once to initialize things
                 doPostCallback(m_fbImage);
             } else {
+                timings.readbackUs = System::get()->getHighResTimeUs();
                 m_readbackWorker->doNextReadback(cb.get(), m_fbImage);
             }
         } else {
+            timings.readbackUs = System::get()->getHighResTimeUs();
             (*c).second.cb->readback(m_fbImage);
             doPostCallback(m_fbImage);
         }
     }
 
+    if (m_subWin) {
+        markOpened(&c->second);
+        c->second.cb->touch();
+
+        // Hand the frame over to the post thread, replacing the one it
+        // didn't pick up yet if any; it only needs to be woken up if not.
+        std::vector<ColorBufferPtr> retired;
+        bool wakePostThread;
+        {
+            AutoLock lock(m_postLock);
+            PendingPost dropped;
+            wakePostThread = m_pendingPost.putLocked(
+                    PendingPost{c->second.cb, timings}, &dropped);
+            retired.swap(m_retiredPosts);
+            if (dropped.cb) {
+                retired.push_back(std::move(dropped.cb));
+            }
+        }
+
+        if (wakePostThread) {
+            Post postCmd;
+            postCmd.cmd = PostCmd::Post;
+            sendPostWorkerCmd(postCmd);
+        }
+    } else {
+        // If there is no sub-window, don't display anything, the client will
+        // rely on m_onPost to get the pixels instead.
+        ret = true;
+    }
+
 EXIT:
     if (needLockAndBind) {
         m_lock.unlock();
@@ -1854,6 +1949,16 @@ void FrameBuffer::onSave(Stream* stream,
 bool FrameBuffer::onLoad(Stream* stream,
                          const android::snapshot::ITextureLoaderPtr& textureLoader) {
     AutoLock mutex(m_lock);
+    // The post thread may still be presenting a ColorBuffer about to be
+    // torn down, and the frames waiting for it belong to the old state.
+    if (m_postThread.isStarted()) {
+        m_postThread.waitQueuedItems();
+    }
+    {
+        AutoLock lock(m_postLock);
+        m_pendingPost.clearLocked();
+        m_retiredPosts.clear();
+    }
     // cleanups
     {
         ScopedBind scopedBind(m_colorBufferHelper);
@@ -24,6 +24,7 @@
 #include "emugl/common/mutex.h"
 #include "FbConfig.h"
 #include "GLESVersionDetector.h"
+#include "PostSlot.h"
 #include "PostWorker.h"
 #include "ReadbackWorker.h"
 #include "RenderContext.h"
@@ -35,8 +36,10 @@
 
 #include <EGL/egl.h>
 
+#include <atomic>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <stdint.h>
 
@@ -310,7 +313,20 @@ public:
     // |needLockAndBind| is used to indicate whether the operation requires
     // acquiring/releasing the FrameBuffer instance's lock and binding the
     // contexts. It should be |false| only when called internally.
+    // The sub-window is drawn to by the post thread: this only waits for it
+    // to pick up the frame. If another frame is posted before it does, only
+    // the latest one is shown.
     bool post(HandleType p_colorbuffer, bool needLockAndBind = true);
+
+    // Paces the post thread to present at most one frame every |interval|
+    // periods of a 60Hz clock, or as soon as possible if it is 0.
+    void setSwapInterval(int interval) { m_swapInterval = interval; }
+
+    // Timestamps of the last frames presented to the sub-window, oldest
+    // first, and the number of frames that were replaced by a later one
+    // before they could be presented.
+    std::vector<PostTimings> getPostTimings();
+    uint64_t getDroppedPostCount();
     bool hasGuestPostedAFrame() { return m_guestPostedAFrame; }
 
     // Runs the post callback with |pixels| (good for when the readback
@@ -540,12 +556,13 @@ private:
         Post = 0,
         Viewport = 1,
         Clear = 2,
+        Exit = 3,
     };
 
+    // PostCmd::Post presents |m_pendingPost|, so it doesn't need arguments.
     struct Post {
         PostCmd cmd;
         union {
-            ColorBuffer* cb;
             struct {
                 int width;
                 int height;
@@ -556,7 +573,27 @@ private:
     std::unique_ptr<PostWorker> m_postWorker = {};
     android::base::WorkerThread<Post> m_postThread;
     android::base::WorkerProcessingResult postWorkerFunc(const Post& post);
+    // Waits for the post thread to be done with |post|, except for
+    // PostCmd::Post.
     void sendPostWorkerCmd(Post post);
+    void stopPostThread();
+
+    // The latest posted frame that the post thread didn't pick up yet, and
+    // the frames that were dropped or that it is done with. A ColorBuffer can
+    // only be destroyed with |m_lock| held, so the latter are released by the
+    // next post(). Protected by |m_postLock|, along with the statistics below.
+    struct PendingPost {
+        ColorBufferPtr cb;
+        PostTimings timings;
+    };
+    android::base::Lock m_postLock;
+    emugl::PostSlot<PendingPost> m_pendingPost;
+    std::vector<ColorBufferPtr> m_retiredPosts;
+    // Timings of the last kPostTimingsCount frames presented, as a ring.
+    static constexpr size_t kPostTimingsCount = 64;
+    std::vector<PostTimings> m_postTimings;
+    size_t m_nextPostTimings = 0;
+    std::atomic<int> m_swapInterval = {0};
 
     bool m_fastBlitSupported = false;
 };
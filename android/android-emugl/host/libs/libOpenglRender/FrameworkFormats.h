@@ -16,4 +16,8 @@ enum FrameworkFormat {
     FRAMEWORK_FORMAT_GL_COMPATIBLE = 0,
     FRAMEWORK_FORMAT_YV12 = 1,
     FRAMEWORK_FORMAT_YUV_420_888 = 2,
+    // Semi-planar: a Y plane followed by a single plane of interleaved
+    // U and V (NV12) or V and U (NV21) samples.
+    FRAMEWORK_FORMAT_NV12 = 3,
+    FRAMEWORK_FORMAT_NV21 = 4,
 };
@@ -0,0 +1,73 @@
+// Copyright (C) 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <utility>
+
+#include <stdint.h>
+
+namespace emugl {
+
+// PostSlot hands frames over from the threads that post them to the thread
+// that presents them, keeping only the latest one: a frame posted before
+// the presenting thread took the previous one replaces it, and the latter
+// is counted as dropped.
+//
+// Like BufferQueue, it depends for synchronization on an external lock,
+// which must be held when calling any of its methods.
+template <class Frame>
+class PostSlot {
+public:
+    // Stores |frame| as the latest frame. If the previous one wasn't taken
+    // yet, it is moved to |*dropped|. Returns true iff the slot was empty,
+    // i.e. iff the presenting thread needs to be told about |frame|.
+    bool putLocked(Frame&& frame, Frame* dropped) {
+        const bool wasEmpty = !mHasFrame;
+        if (!wasEmpty) {
+            *dropped = std::move(mFrame);
+            ++mDroppedCount;
+        }
+        mFrame = std::move(frame);
+        mHasFrame = true;
+        return wasEmpty;
+    }
+
+    // Moves the latest frame to |*frame| and empties the slot. Returns
+    // false if it was empty already.
+    bool takeLocked(Frame* frame) {
+        if (!mHasFrame) {
+            return false;
+        }
+        *frame = std::move(mFrame);
+        mFrame = Frame();
+        mHasFrame = false;
+        return true;
+    }
+
+    // Drops the latest frame, if any, without counting it.
+    void clearLocked() {
+        mFrame = Frame();
+        mHasFrame = false;
+    }
+
+    // Number of frames replaced by a later one before they were taken.
+    uint64_t droppedCountLocked() const { return mDroppedCount; }
+
+private:
+    Frame mFrame = Frame();
+    bool mHasFrame = false;
+    uint64_t mDroppedCount = 0;
+};
+
+}  // namespace emugl
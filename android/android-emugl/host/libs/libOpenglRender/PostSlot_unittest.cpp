@@ -0,0 +1,117 @@
+// Copyright (C) 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PostSlot.h"
+
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+namespace emugl {
+
+using android::base::AutoLock;
+using android::base::FunctorThread;
+using android::base::Lock;
+
+TEST(PostSlot, LatestFrameWins) {
+    PostSlot<int> slot;
+    int frame = 0;
+    EXPECT_FALSE(slot.takeLocked(&frame));
+
+    // Only the first frame needs to wake the presenting thread up.
+    int dropped = 0;
+    EXPECT_TRUE(slot.putLocked(1, &dropped));
+    EXPECT_FALSE(slot.putLocked(2, &dropped));
+    EXPECT_EQ(1, dropped);
+    EXPECT_FALSE(slot.putLocked(3, &dropped));
+    EXPECT_EQ(2, dropped);
+
+    EXPECT_TRUE(slot.takeLocked(&frame));
+    EXPECT_EQ(3, frame);
+    EXPECT_FALSE(slot.takeLocked(&frame));
+
+    // Once taken, the next frame wakes the presenting thread up again.
+    EXPECT_TRUE(slot.putLocked(4, &dropped));
+    EXPECT_TRUE(slot.takeLocked(&frame));
+    EXPECT_EQ(4, frame);
+}
+
+TEST(PostSlot, DroppedCount) {
+    PostSlot<int> slot;
+    int frame = 0;
+    int dropped = 0;
+    EXPECT_EQ(0u, slot.droppedCountLocked());
+
+    slot.putLocked(1, &dropped);
+    slot.takeLocked(&frame);
+    slot.putLocked(2, &dropped);
+    slot.takeLocked(&frame);
+    EXPECT_EQ(0u, slot.droppedCountLocked());
+
+    slot.putLocked(3, &dropped);
+    slot.putLocked(4, &dropped);
+    slot.putLocked(5, &dropped);
+    EXPECT_EQ(2u, slot.droppedCountLocked());
+
+    // Clearing the slot isn't counted.
+    slot.clearLocked();
+    EXPECT_FALSE(slot.takeLocked(&frame));
+    EXPECT_EQ(2u, slot.droppedCountLocked());
+}
+
+TEST(PostSlot, Threads) {
+    static const int kFrameCount = 10000;
+    Lock lock;
+    PostSlot<int> slot;
+    int lastPresented = 0;
+    int presentedCount = 0;
+
+    FunctorThread presenter([&]() -> intptr_t {
+        for (;;) {
+            int frame = 0;
+            {
+                AutoLock l(lock);
+                if (!slot.takeLocked(&frame)) {
+                    continue;
+                }
+            }
+            // Frames come in order, and are never presented twice.
+            EXPECT_GT(frame, lastPresented);
+            lastPresented = frame;
+            ++presentedCount;
+            if (frame == kFrameCount) {
+                return 0;
+            }
+        }
+    });
+    presenter.start();
+
+    for (int i = 1; i <= kFrameCount; i++) {
+        int frame = i;
+        int dropped = 0;
+        AutoLock l(lock);
+        slot.putLocked(std::move(frame), &dropped);
+    }
+    presenter.wait();
+
+    // The last frame is always presented, and each frame is either
+    // presented or dropped.
+    EXPECT_EQ(kFrameCount, lastPresented);
+    AutoLock l(lock);
+    EXPECT_EQ((uint64_t)kFrameCount,
+              presentedCount + slot.droppedCountLocked());
+}
+
+}  // namespace emugl
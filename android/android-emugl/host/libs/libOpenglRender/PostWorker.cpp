@@ -4,9 +4,16 @@
 #include "DispatchTables.h"
 #include "FrameBuffer.h"
 #include "RenderThreadInfo.h"
+#include "TextureDraw.h"
 #include "OpenGLESDispatch/EGLDispatch.h"
 #include "OpenGLESDispatch/GLESv2Dispatch.h"
 
+#include "android/base/system/System.h"
+
+using android::base::System;
+
+static const uint64_t kVsyncPeriodUs = 1000000 / 60;
+
 PostWorker::PostWorker(PostWorker::BindSubwinCallback&& cb) :
     mFb(FrameBuffer::getFB()),
     mBindSubwin(cb) {}
@@ -16,6 +23,9 @@ void PostWorker::post(ColorBuffer* cb) {
     if (!m_initialized) {
         m_initialized = mBindSubwin();
     }
+    if (!m_textureDraw) {
+        m_textureDraw.reset(new TextureDraw());
+    }
 
     float dpr = mFb->getDpr();
     int windowWidth = mFb->windowWidth();
@@ -41,7 +51,7 @@ void PostWorker::post(ColorBuffer* cb) {
     //
     // render the color buffer to the window
     //
-    cb->post(tex, zRot, dx, dy);
+    cb->post(m_textureDraw.get(), tex, zRot, dx, dy);
     s_egl.eglSwapBuffers(mFb->getDisplay(), mFb->getWindowSurface());
 }
 
@@ -70,6 +80,34 @@ void PostWorker::clear() {
     s_egl.eglSwapBuffers(mFb->getDisplay(), mFb->getWindowSurface());
 }
 
+// Slots are aligned on the time of the first paced frame, and at least
+// |swapInterval| periods apart: a frame that misses its slot waits for the
+// next one rather than being shown right away.
+void PostWorker::waitForVsync(int swapInterval) {
+    if (swapInterval <= 0) {
+        m_vsyncBaseUs = 0;
+        return;
+    }
+
+    const uint64_t nowUs = System::get()->getHighResTimeUs();
+    if (!m_vsyncBaseUs) {
+        m_vsyncBaseUs = nowUs;
+        m_lastVsyncUs = nowUs;
+        return;
+    }
+
+    const uint64_t periodUs = swapInterval * kVsyncPeriodUs;
+    uint64_t slotUs = m_vsyncBaseUs +
+            (nowUs - m_vsyncBaseUs + periodUs - 1) / periodUs * periodUs;
+    if (slotUs < m_lastVsyncUs + periodUs) {
+        slotUs = m_lastVsyncUs + periodUs;
+    }
+    if (slotUs > nowUs) {
+        System::get()->sleepUs(slotUs - nowUs);
+    }
+    m_lastVsyncUs = slotUs;
+}
+
 PostWorker::~PostWorker() {
     s_egl.eglMakeCurrent(
         mFb->getDisplay(),
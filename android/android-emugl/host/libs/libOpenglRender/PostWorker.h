@@ -6,11 +6,28 @@
 #include <EGL/egl.h>
 
 #include <functional>
+#include <memory>
 #include <vector>
 
+#include <stdint.h>
+
 class ColorBuffer;
 class FrameBuffer;
 class RenderThreadInfo;
+class TextureDraw;
+
+// Timestamps of a posted frame, from System::getHighResTimeUs(), or 0 for
+// the steps it didn't go through.
+struct PostTimings {
+    // The guest posted it.
+    uint64_t postUs = 0;
+    // The readback for the post callback was started.
+    uint64_t readbackUs = 0;
+    // The post thread started drawing it to the sub-window.
+    uint64_t compositeUs = 0;
+    // eglSwapBuffers() returned.
+    uint64_t presentUs = 0;
+};
 
 class PostWorker {
 public:
@@ -20,7 +37,8 @@ public:
     ~PostWorker();
 
     // post: posts the next color buffer.
-    // Assumes framebuffer lock is held.
+    // Runs without the framebuffer lock: it draws with its own TextureDraw,
+    // and ColorBuffer::post() serializes with the writes to |cb|.
     void post(ColorBuffer* cb);
 
     // viewport: (re)initializes viewport dimensions.
@@ -32,6 +50,10 @@ public:
     // if there is no last posted color buffer to show yet.
     void clear();
 
+    // waitForVsync: with a positive |swapInterval|, blocks until the next
+    // presentation slot, every |swapInterval| periods of a 60Hz clock.
+    void waitForVsync(int swapInterval);
+
 private:
     EGLContext mContext;
     EGLSurface mSurf;
@@ -41,7 +63,14 @@ private:
     std::function<bool(void)> mBindSubwin;
 
     bool m_initialized = false;
+    // Not shared with the render threads, which draw with the FrameBuffer's
+    // one while this one is drawing.
+    std::unique_ptr<TextureDraw> m_textureDraw;
     int m_viewportWidth = 0;
     int m_viewportHeight = 0;
+
+    // Start of the presentation slots, and the last slot used.
+    uint64_t m_vsyncBaseUs = 0;
+    uint64_t m_lastVsyncUs = 0;
     DISALLOW_COPY_AND_ASSIGN(PostWorker);
 };
@@ -29,6 +29,7 @@
 
 #include "android/utils/debug.h"
 #include "android/base/StringView.h"
+#include "android/base/system/System.h"
 #include "emugl/common/feature_control.h"
 #include "emugl/common/lazy_instance.h"
 #include "emugl/common/sync_device.h"
@@ -43,6 +44,7 @@
 
 using android::base::AutoLock;
 using android::base::Lock;
+using android::base::System;
 
 #define DEBUG_GRALLOC_SYNC 0
 #define DEBUG_EGL_SYNC 0
@@ -160,7 +162,9 @@ static constexpr android::base::StringView kAsyncSwapStrV3 = "ANDROID_EMU_native
 // DMA version history:
 // "ANDROID_EMU_dma_v1": add dma device and rcUpdateColorBufferDMA and do
 // yv12 conversion on the GPU
+// "ANDROID_EMU_dma_v2": add rcReadColorBufferDMA
 static constexpr android::base::StringView kDmaStr = "ANDROID_EMU_dma_v1";
+static constexpr android::base::StringView kDmaStrV2 = "ANDROID_EMU_dma_v2";
 
 // GLESDynamicVersion: up to 3.1 so far
 static constexpr android::base::StringView kGLESDynamicVersion_2 = "ANDROID_EMU_gles_max_version_2";
@@ -347,6 +351,8 @@ static EGLint rcGetGLString(EGLenum name, void* buffer, EGLint bufferSize)
     if (dmaEnabled && name == GL_EXTENSIONS) {
         glStr += kDmaStr;
         glStr += " ";
+        glStr += kDmaStrV2;
+        glStr += " ";
     }
 
     if (name == GL_EXTENSIONS) {
@@ -486,8 +492,6 @@ static uint32_t rcCreateContext(uint32_t config,
 
 static void rcDestroyContext(uint32_t context)
 {
-    SyncThread::destroySyncThread();
-
     FrameBuffer *fb = FrameBuffer::getFB();
     if (!fb) {
         return;
@@ -649,7 +653,11 @@ static void rcFBPost(uint32_t colorBuffer)
 
 static void rcFBSetSwapInterval(EGLint interval)
 {
-   // XXX: TBD - should be implemented
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return;
+    }
+    fb->setSwapInterval(interval);
 }
 
 static void rcBindTexture(uint32_t colorBuffer)
@@ -738,6 +746,31 @@ static int rcUpdateColorBufferDMA(uint32_t colorBuffer,
     return 0;
 }
 
+// |pixels| points to guest memory through the DMA device, so that the
+// pixels don't go through the pipe. The guest waits for the return value
+// before using them.
+static int rcReadColorBufferDMA(uint32_t colorBuffer,
+                                GLint x, GLint y,
+                                GLint width, GLint height,
+                                GLenum format, GLenum type,
+                                void* pixels, uint32_t pixels_size)
+{
+    FrameBuffer *fb = FrameBuffer::getFB();
+    if (!fb) {
+        return -1;
+    }
+
+    const size_t needed =
+            (((glUtilsPixelBitSize(format, type) * width) >> 3) * height);
+    if (!pixels || pixels_size < needed) {
+        return -1;
+    }
+
+    fb->readColorBuffer(colorBuffer, x, y, width, height, format, type,
+                        pixels);
+    return 0;
+}
+
 static uint32_t rcCreateClientImage(uint32_t context, EGLenum target, GLuint buffer)
 {
     FrameBuffer *fb = FrameBuffer::getFB();
@@ -768,7 +801,7 @@ static void rcSelectChecksumHelper(uint32_t protocol, uint32_t reserved) {
 // when to signal that native fence fd. We use
 // SyncThread for that.
 //
-// The purpose of |rcTriggerWait| is to tell which
+// The purpose of |rcTriggerWait| is to tell the
 // SyncThread which sync object / timeline to signal.
 static void rcTriggerWait(uint64_t eglsync_ptr,
                           uint64_t thread_ptr,
@@ -786,11 +819,10 @@ static void rcTriggerWait(uint64_t eglsync_ptr,
 
 // |rcCreateSyncKHR| implements the guest's
 // |eglCreateSyncKHR| by calling the host's implementation
-// of |eglCreateSyncKHR|. A SyncThread is also started
-// that corresponds to the current rendering thread, for
-// purposes of signaling any native fence fd's that
-// get created in the guest off the sync object
-// created here.
+// of |eglCreateSyncKHR|. The shared SyncThread is also
+// started if needed, for purposes of signaling any
+// native fence fd's that get created in the guest off
+// the sync object created here.
 static void rcCreateSyncKHR(EGLenum type,
                             EGLint* attribs,
                             uint32_t num_attribs,
@@ -816,8 +848,11 @@ static void rcCreateSyncKHR(EGLenum type,
     // This MUST be present, or we get a deadlock effect.
     s_gles2.glFlush();
 
-    if (syncthread_out) *syncthread_out =
-        reinterpret_cast<uint64_t>(SyncThread::getSyncThread());
+    if (syncthread_out) {
+        *syncthread_out =
+            reinterpret_cast<uint64_t>(SyncThread::getSyncThread());
+        RenderThreadInfo::get()->syncThreadAlias = *syncthread_out;
+    }
 
     if (eglsync_out) {
         uint64_t res = (uint64_t)(uintptr_t)fenceSync;
@@ -860,7 +895,13 @@ static EGLint rcClientWaitSyncKHR(uint64_t handle,
         // This context is then cleaned up when the render thread exits.
     }
 
-    return fenceSync->wait(timeout);
+    const bool stats = RenderStats::enabled();
+    const uint64_t startUs = stats ? System::get()->getHighResTimeUs() : 0;
+    const EGLint res = fenceSync->wait(timeout);
+    if (stats) {
+        tInfo->m_stats.onSyncWait(System::get()->getHighResTimeUs() - startUs);
+    }
+    return res;
 }
 
 static void rcWaitSyncKHR(uint64_t handle,
@@ -942,4 +983,5 @@ void initRenderControlContext(renderControl_decoder_context_t *dec)
     dec->rcUpdateColorBufferDMA = rcUpdateColorBufferDMA;
     dec->rcCreateColorBufferDMA = rcCreateColorBufferDMA;
     dec->rcWaitSyncKHR = rcWaitSyncKHR;
+    dec->rcReadColorBufferDMA = rcReadColorBufferDMA;
 }
@@ -0,0 +1,224 @@
+/*
+* Copyright (C) 2017 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "RenderStats.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <string.h>
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using emugl::LatencyHistogram;
+using emugl::RendererStats;
+
+namespace {
+
+// Counters only updated by their owner thread don't need an atomic
+// read-modify-write, just atomic accesses for the readers.
+void bump(std::atomic<uint64_t>* counter, uint64_t value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+}
+
+struct RenderStatsGlobals {
+    std::atomic<uint64_t> colorBufferUploads = {0};
+    std::atomic<uint64_t> colorBufferUploadBytes = {0};
+    std::atomic<uint64_t> colorBufferReadbacks = {0};
+    std::atomic<uint64_t> colorBufferReadbackBytes = {0};
+    std::atomic<uint64_t> posts = {0};
+
+    // Protects the rest.
+    Lock lock;
+    std::vector<RenderStats::Thread*> threads;
+    uint64_t nextThreadId = 1;
+    // What render threads that exited counted.
+    uint64_t exitedBytesDecoded = 0;
+    uint64_t exitedCommands[3] = {};
+    LatencyHistogram exitedDecodeLatency;
+    LatencyHistogram exitedSyncWaitLatency;
+};
+
+}  // namespace
+
+static LazyInstance<RenderStatsGlobals> sGlobals = LAZY_INSTANCE_INIT;
+
+std::atomic<bool> RenderStats::sEnabled = {false};
+
+// static
+void RenderStats::setEnabled(bool enabled) {
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void RenderStats::onColorBufferUpload(size_t bytes) {
+    if (!enabled()) {
+        return;
+    }
+    sGlobals->colorBufferUploads.fetch_add(1, std::memory_order_relaxed);
+    sGlobals->colorBufferUploadBytes.fetch_add(bytes,
+                                               std::memory_order_relaxed);
+}
+
+// static
+void RenderStats::onColorBufferReadback(size_t bytes) {
+    if (!enabled()) {
+        return;
+    }
+    sGlobals->colorBufferReadbacks.fetch_add(1, std::memory_order_relaxed);
+    sGlobals->colorBufferReadbackBytes.fetch_add(bytes,
+                                                 std::memory_order_relaxed);
+}
+
+// static
+void RenderStats::onPost() {
+    if (!enabled()) {
+        return;
+    }
+    sGlobals->posts.fetch_add(1, std::memory_order_relaxed);
+}
+
+// static
+RendererStats RenderStats::get() {
+    RenderStatsGlobals& globals = *sGlobals;
+    RendererStats stats;
+    stats.enabled = enabled();
+    stats.colorBufferUploads =
+            globals.colorBufferUploads.load(std::memory_order_relaxed);
+    stats.colorBufferUploadBytes =
+            globals.colorBufferUploadBytes.load(std::memory_order_relaxed);
+    stats.colorBufferReadbacks =
+            globals.colorBufferReadbacks.load(std::memory_order_relaxed);
+    stats.colorBufferReadbackBytes =
+            globals.colorBufferReadbackBytes.load(std::memory_order_relaxed);
+    stats.posts = globals.posts.load(std::memory_order_relaxed);
+
+    AutoLock lock(globals.lock);
+    uint64_t commands[3];
+    std::copy(globals.exitedCommands, globals.exitedCommands + 3, commands);
+    stats.bytesDecoded = globals.exitedBytesDecoded;
+    stats.decodeLatency = globals.exitedDecodeLatency;
+    stats.syncWaitLatency = globals.exitedSyncWaitLatency;
+
+    for (const Thread* thread : globals.threads) {
+        RendererStats::RenderThread threadStats;
+        threadStats.id = thread->mId;
+        threadStats.bytesDecoded =
+                thread->mBytesDecoded.load(std::memory_order_relaxed);
+        for (int i = 0; i < 3; ++i) {
+            const uint64_t count =
+                    thread->mCommands[i].load(std::memory_order_relaxed);
+            threadStats.commands += count;
+            commands[i] += count;
+        }
+        threadStats.decodeLatency = thread->mDecodeLatency.get();
+        threadStats.syncWaitLatency = thread->mSyncWaitLatency.get();
+
+        stats.bytesDecoded += threadStats.bytesDecoded;
+        stats.decodeLatency.add(threadStats.decodeLatency);
+        stats.syncWaitLatency.add(threadStats.syncWaitLatency);
+        stats.renderThreads.push_back(threadStats);
+    }
+
+    stats.gles1Commands = commands[(int)Decoder::GLESv1];
+    stats.gles2Commands = commands[(int)Decoder::GLESv2];
+    stats.renderControlCommands = commands[(int)Decoder::RenderControl];
+    return stats;
+}
+
+RenderStats::Thread::Thread() {
+    AutoLock lock(sGlobals->lock);
+    mId = sGlobals->nextThreadId++;
+    sGlobals->threads.push_back(this);
+}
+
+RenderStats::Thread::~Thread() {
+    RenderStatsGlobals& globals = *sGlobals;
+    AutoLock lock(globals.lock);
+    globals.threads.erase(
+            std::find(globals.threads.begin(), globals.threads.end(), this));
+    globals.exitedBytesDecoded +=
+            mBytesDecoded.load(std::memory_order_relaxed);
+    for (int i = 0; i < 3; ++i) {
+        globals.exitedCommands[i] +=
+                mCommands[i].load(std::memory_order_relaxed);
+    }
+    globals.exitedDecodeLatency.add(mDecodeLatency.get());
+    globals.exitedSyncWaitLatency.add(mSyncWaitLatency.get());
+}
+
+void RenderStats::Thread::onDecode(Decoder decoder,
+                                   const void* buf,
+                                   size_t bytes) {
+    if (!enabled()) {
+        return;
+    }
+    // The decoders only consume whole commands, each starting with its
+    // opcode and total size.
+    const unsigned char* const ptr = static_cast<const unsigned char*>(buf);
+    uint64_t commands = 0;
+    size_t offset = 0;
+    while (offset + 8 <= bytes) {
+        int32_t packetLen;
+        memcpy(&packetLen, ptr + offset + 4, sizeof(packetLen));
+        if (packetLen < 8 || offset + packetLen > bytes) {
+            break;
+        }
+        offset += packetLen;
+        ++commands;
+    }
+    bump(&mBytesDecoded, bytes);
+    bump(&mCommands[(int)decoder], commands);
+}
+
+void RenderStats::Thread::onDecodePass(uint64_t us) {
+    if (!enabled()) {
+        return;
+    }
+    mDecodeLatency.add(us);
+}
+
+void RenderStats::Thread::onSyncWait(uint64_t us) {
+    if (!enabled()) {
+        return;
+    }
+    mSyncWaitLatency.add(us);
+}
+
+void RenderStats::Thread::Histogram::add(uint64_t us) {
+    bump(&mBuckets[LatencyHistogram::bucketOf(us)], 1);
+    bump(&mCount, 1);
+    bump(&mTotalUs, us);
+    if (us > mMaxUs.load(std::memory_order_relaxed)) {
+        mMaxUs.store(us, std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram RenderStats::Thread::Histogram::get() const {
+    LatencyHistogram histogram;
+    for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+        histogram.buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+    }
+    histogram.count = mCount.load(std::memory_order_relaxed);
+    histogram.totalUs = mTotalUs.load(std::memory_order_relaxed);
+    histogram.maxUs = mMaxUs.load(std::memory_order_relaxed);
+    return histogram;
+}
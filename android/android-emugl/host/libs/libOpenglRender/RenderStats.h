@@ -0,0 +1,85 @@
+/*
+* Copyright (C) 2017 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "OpenglRender/RendererStats.h"
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The counters behind Renderer::getStats().
+// Counting is off until setEnabled(true) is called; until then, the hooks
+// below return right away, so that they can be called on every command
+// buffer. All of them are thread-safe.
+class RenderStats {
+public:
+    enum class Decoder { GLESv1 = 0, GLESv2 = 1, RenderControl = 2 };
+
+    static bool enabled() { return sEnabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    // The guest transferred |bytes| of pixels to or from a ColorBuffer.
+    static void onColorBufferUpload(size_t bytes);
+    static void onColorBufferReadback(size_t bytes);
+    // The guest posted a frame.
+    static void onPost();
+
+    // Returns the counts so far, leaving what other modules keep track of
+    // (posts dropped and fence waits) to the caller.
+    static emugl::RendererStats get();
+
+    // The counters of a single render thread, kept in its RenderThreadInfo.
+    // Only that thread updates them.
+    class Thread {
+    public:
+        Thread();
+        ~Thread();
+
+        // |bytes| of commands for |decoder| were decoded from |buf|.
+        void onDecode(Decoder decoder, const void* buf, size_t bytes);
+        // Decoding a buffer of commands from the guest took |us|.
+        void onDecodePass(uint64_t us);
+        // The guest waited |us| on a sync object.
+        void onSyncWait(uint64_t us);
+
+    private:
+        friend class RenderStats;
+
+        class Histogram {
+        public:
+            void add(uint64_t us);
+            emugl::LatencyHistogram get() const;
+
+        private:
+            std::atomic<uint64_t> mBuckets[emugl::LatencyHistogram::kBuckets] = {};
+            std::atomic<uint64_t> mCount = {0};
+            std::atomic<uint64_t> mTotalUs = {0};
+            std::atomic<uint64_t> mMaxUs = {0};
+        };
+
+        uint64_t mId = 0;
+        std::atomic<uint64_t> mBytesDecoded = {0};
+        std::atomic<uint64_t> mCommands[3] = {};
+        Histogram mDecodeLatency;
+        Histogram mSyncWaitLatency;
+    };
+
+private:
+    static std::atomic<bool> sEnabled;
+};
@@ -0,0 +1,151 @@
+// Copyright (C) 2017 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "RenderStats.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <string.h>
+
+using emugl::LatencyHistogram;
+using emugl::RendererStats;
+
+namespace {
+
+// Appends the header of a command to |buf|, as the guest encoders do:
+// a 32-bit opcode, then the 32-bit size of the whole command.
+void addHeader(std::vector<unsigned char>* buf, int32_t size) {
+    const size_t offset = buf->size();
+    const int32_t opcode = 1;
+    buf->resize(offset + 8);
+    memcpy(&(*buf)[offset], &opcode, sizeof(opcode));
+    memcpy(&(*buf)[offset + 4], &size, sizeof(size));
+}
+
+// Appends a whole command of |size| bytes to |buf|.
+void addCommand(std::vector<unsigned char>* buf, int32_t size) {
+    const size_t offset = buf->size();
+    addHeader(buf, size);
+    buf->resize(offset + size);
+}
+
+// Returns how many GLESv2 commands RenderStats counts in |buf|.
+uint64_t countCommands(const std::vector<unsigned char>& buf,
+                       size_t bytes) {
+    const uint64_t before = RenderStats::get().gles2Commands;
+    RenderStats::Thread thread;
+    thread.onDecode(RenderStats::Decoder::GLESv2, buf.data(), bytes);
+    return RenderStats::get().gles2Commands - before;
+}
+
+}  // namespace
+
+TEST(LatencyHistogram, bucketOf) {
+    EXPECT_EQ(0, LatencyHistogram::bucketOf(0));
+    EXPECT_EQ(0, LatencyHistogram::bucketOf(1));
+    EXPECT_EQ(1, LatencyHistogram::bucketOf(2));
+    EXPECT_EQ(1, LatencyHistogram::bucketOf(3));
+    EXPECT_EQ(10, LatencyHistogram::bucketOf(1024));
+    EXPECT_EQ(LatencyHistogram::kBuckets - 1,
+              LatencyHistogram::bucketOf(~0ULL));
+}
+
+TEST(LatencyHistogram, percentileUs) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(0u, histogram.percentileUs(50));
+
+    // 90 samples in [16, 32) and 10 in [1024, 2048), with a max of 1500.
+    histogram.buckets[LatencyHistogram::bucketOf(20)] = 90;
+    histogram.buckets[LatencyHistogram::bucketOf(1500)] = 10;
+    histogram.count = 100;
+    histogram.maxUs = 1500;
+
+    EXPECT_EQ(32u, histogram.percentileUs(0));
+    EXPECT_EQ(32u, histogram.percentileUs(50));
+    EXPECT_EQ(32u, histogram.percentileUs(89.9));
+    // The end of the last bucket is capped to the max.
+    EXPECT_EQ(1500u, histogram.percentileUs(90));
+    EXPECT_EQ(1500u, histogram.percentileUs(99));
+    EXPECT_EQ(1500u, histogram.percentileUs(100));
+
+    // A single sample.
+    LatencyHistogram single;
+    single.buckets[LatencyHistogram::bucketOf(5)] = 1;
+    single.count = 1;
+    single.maxUs = 5;
+    EXPECT_EQ(5u, single.percentileUs(50));
+    EXPECT_EQ(5u, single.percentileUs(100));
+}
+
+TEST(LatencyHistogram, add) {
+    LatencyHistogram a;
+    a.buckets[1] = 2;
+    a.count = 2;
+    a.totalUs = 6;
+    a.maxUs = 3;
+    LatencyHistogram b;
+    b.buckets[4] = 1;
+    b.count = 1;
+    b.totalUs = 20;
+    b.maxUs = 20;
+
+    a.add(b);
+    EXPECT_EQ(2u, a.buckets[1]);
+    EXPECT_EQ(1u, a.buckets[4]);
+    EXPECT_EQ(3u, a.count);
+    EXPECT_EQ(26u, a.totalUs);
+    EXPECT_EQ(20u, a.maxUs);
+}
+
+TEST(RenderStats, countCommands) {
+    RenderStats::setEnabled(true);
+
+    std::vector<unsigned char> buf;
+    addCommand(&buf, 8);
+    addCommand(&buf, 12);
+    addCommand(&buf, 32);
+    EXPECT_EQ(3u, countCommands(buf, buf.size()));
+
+    // Partial commands aren't counted, however much of them is there.
+    EXPECT_EQ(2u, countCommands(buf, buf.size() - 1));
+    EXPECT_EQ(2u, countCommands(buf, 8 + 12 + 7));
+    EXPECT_EQ(2u, countCommands(buf, 8 + 12 + 8));
+    EXPECT_EQ(0u, countCommands(buf, 0));
+
+    // A size running past the end of the buffer, or one that doesn't even
+    // cover the header, ends the count.
+    std::vector<unsigned char> bad;
+    addCommand(&bad, 8);
+    addHeader(&bad, 0x7fffffff);
+    EXPECT_EQ(1u, countCommands(bad, bad.size()));
+    bad.clear();
+    addCommand(&bad, 8);
+    addHeader(&bad, 4);
+    addCommand(&bad, 8);
+    EXPECT_EQ(1u, countCommands(bad, bad.size()));
+    bad.clear();
+    addHeader(&bad, -8);
+    EXPECT_EQ(0u, countCommands(bad, bad.size()));
+
+    RenderStats::setEnabled(false);
+}
+
+TEST(RenderStats, disabled) {
+    RenderStats::setEnabled(false);
+    std::vector<unsigned char> buf;
+    addCommand(&buf, 8);
+    EXPECT_EQ(0u, countCommands(buf, buf.size()));
+}
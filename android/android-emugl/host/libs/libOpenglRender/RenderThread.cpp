@@ -193,6 +193,10 @@ void consumeBuffersExec(RenderThreadInfo* tInfo,
                     ReadBuffer* readBuf,
                     bool* waitFlag,
                     bool consumeAll){
+  RenderStats::Thread& stats = tInfo->m_stats;
+  const uint64_t startUs = RenderStats::enabled()
+          ? android::base::System::get()->getHighResTimeUs() : 0;
+  bool decoded = false;
   bool progress;
   do {
     progress = false;
@@ -216,6 +220,7 @@ void consumeBuffersExec(RenderThreadInfo* tInfo,
         readBuf->buf(), readBuf->validData(), stream, checksumCalc);
     if (last > 0) {
       progress = true;
+      stats.onDecode(RenderStats::Decoder::GLESv1, readBuf->buf(), last);
       readBuf->consume(last);
     }
 
@@ -229,6 +234,7 @@ void consumeBuffersExec(RenderThreadInfo* tInfo,
 
     if (last > 0) {
       progress = true;
+      stats.onDecode(RenderStats::Decoder::GLESv2, readBuf->buf(), last);
       readBuf->consume(last);
     }
 
@@ -239,12 +245,20 @@ void consumeBuffersExec(RenderThreadInfo* tInfo,
     last = tInfo->m_rcDec.decode(readBuf->buf(), readBuf->validData(),
                                 stream, checksumCalc);
     if (last > 0) {
+      stats.onDecode(RenderStats::Decoder::RenderControl, readBuf->buf(),
+                     last);
       readBuf->consume(last);
       progress = true;
     }
 
+    decoded |= progress;
     *waitFlag = progress;
   } while (progress and consumeAll);
+
+  if (startUs && decoded) {
+    stats.onDecodePass(android::base::System::get()->getHighResTimeUs() -
+                       startUs);
+  }
 }
 
 void consumeBuffers(RenderThreadInfo* tInfo,
@@ -331,9 +345,6 @@ intptr_t RenderThread::main() {
         (void)flags;
     }
 
-    int stats_totalBytes = 0;
-    auto stats_t0 = android::base::System::get()->getHighResTimeUs() / 1000;
-
     //
     // open dump file if RENDER_DUMP_DIR is defined
     //
@@ -397,19 +408,6 @@ intptr_t RenderThread::main() {
            (int)readBuf.validData(), *(int32_t*)readBuf.buf(),
            *(int32_t*)(readBuf.buf() + 4));
 
-        //
-        // log received bandwidth statistics
-        //
-        stats_totalBytes += readBuf.validData();
-        auto dt = android::base::System::get()->getHighResTimeUs() / 1000 - stats_t0;
-        if (dt > 1000) {
-            // float dts = (float)dt / 1000.0f;
-            // printf("Used Bandwidth %5.3f MB/s\n", ((float)stats_totalBytes /
-            // dts) / (1024.0f*1024.0f));
-            stats_totalBytes = 0;
-            stats_t0 = android::base::System::get()->getHighResTimeUs() / 1000;
-        }
-
         //
         // dump stream to file if needed
         //
@@ -429,9 +427,6 @@ intptr_t RenderThread::main() {
     // Don't check for snapshots here: if we're already exiting then snapshot
     // should not contain this thread information at all.
 
-    // exit sync thread, if any.
-    SyncThread::destroySyncThread();
-
     if (!FrameBuffer::getFB()->isShuttingDown()) {
         // Release references to the current thread's context/surfaces if any
         FrameBuffer::getFB()->bindContext(0, 0, 0);
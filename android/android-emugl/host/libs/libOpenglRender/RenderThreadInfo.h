@@ -21,9 +21,8 @@
 #include "WindowSurface.h"
 #include "GLESv1Decoder.h"
 #include "GLESv2Decoder.h"
+#include "RenderStats.h"
 #include "renderControl_dec.h"
-#include "StalePtrRegistry.h"
-#include "SyncThread.h"
 
 #include <unordered_set>
 
@@ -43,10 +42,6 @@ struct RenderThreadInfo {
 
     // Return the current thread's instance, if any, or NULL.
     static RenderThreadInfo* get();
-    // Allocates |syncThread| and updates tracking.
-    void createSyncThread();
-    // The opposite.
-    void destroySyncThread();
 
     // Current EGL context, draw surface and read surface.
     RenderContextPtr currContext;
@@ -66,20 +61,19 @@ struct RenderThreadInfo {
     // all the window surfaces that are created by this render thread
     WindowSurfaceSet                m_windowSet;
 
-    // Sync timeline info + sync thread pointer
-    std::unique_ptr<SyncThread>     syncThread;
-    // Mapping to sync thread pointer value on snapshot save/load
+    // The SyncThread handle given to the guest, if any, for snapshots.
     uint64_t syncThreadAlias = 0;
 
     // The unique id of owner guest process of this render thread
     uint64_t                        m_puid = 0;
 
+    // Counters of the work done for the guest by this render thread.
+    RenderStats::Thread             m_stats;
+
     // Functions to save / load a snapshot
     // They must be called after Framebuffer snapshot
     void onSave(android::base::Stream* stream);
     bool onLoad(android::base::Stream* stream);
-
-    static StalePtrRegistry<SyncThread>* getSyncThreadRegistry();
 };
 
 #endif
@@ -19,6 +19,8 @@
 #include "ErrorLog.h"
 #include "FenceSync.h"
 #include "FrameBuffer.h"
+#include "RenderStats.h"
+#include "SyncThread.h"
 
 #include <algorithm>
 #include <utility>
@@ -286,6 +288,41 @@ void RendererImpl::fillGLESUsages(android_studio::EmulatorGLESUsages* usages) {
     if (fb) fb->fillGLESUsages(usages);
 }
 
+void RendererImpl::setStatsEnabled(bool enabled) {
+    RenderStats::setEnabled(enabled);
+}
+
+RendererStats RendererImpl::getStats() {
+    RendererStats stats = RenderStats::get();
+
+    const SyncThreadStats syncStats = SyncThread::getGlobalStats();
+    stats.fenceWaits = syncStats.waits;
+    stats.fenceWaitAvgUs =
+            syncStats.waits ? syncStats.totalLatencyUs / syncStats.waits : 0;
+    stats.fenceWaitMaxUs = syncStats.maxLatencyUs;
+    stats.fenceQueueDepth = syncStats.queueDepth;
+    stats.fenceQueueDepthMax = syncStats.maxQueueDepth;
+
+    auto fb = FrameBuffer::getFB();
+    if (fb) {
+        stats.droppedPosts = fb->getDroppedPostCount();
+        uint64_t frames = 0;
+        uint64_t totalUs = 0;
+        for (const PostTimings& timings : fb->getPostTimings()) {
+            if (!timings.presentUs) {
+                continue;
+            }
+            const uint64_t latencyUs = timings.presentUs - timings.postUs;
+            ++frames;
+            totalUs += latencyUs;
+            stats.postLatencyMaxUs =
+                    std::max(stats.postLatencyMaxUs, latencyUs);
+        }
+        stats.postLatencyAvgUs = frames ? totalUs / frames : 0;
+    }
+    return stats;
+}
+
 RendererImpl::HardwareStrings RendererImpl::getHardwareStrings() {
     assert(mRenderWindow);
 
@@ -75,6 +75,8 @@ public:
     bool load(android::base::Stream* stream,
               const android::snapshot::ITextureLoaderPtr& textureLoader) final;
     void fillGLESUsages(android_studio::EmulatorGLESUsages*) final;
+    void setStatsEnabled(bool enabled) final;
+    RendererStats getStats() final;
     void consumeRenderThreadBuffers(void* tInfo, void* stream, void* checksumCalc, void* readBuf, bool* waitFlag) final;
 
 private:
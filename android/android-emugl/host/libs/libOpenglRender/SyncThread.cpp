@@ -18,14 +18,20 @@
 
 #include "DispatchTables.h"
 #include "FrameBuffer.h"
-#include "RenderThreadInfo.h"
-#include "StalePtrRegistry.h"
 
 #include "OpenGLESDispatch/EGLDispatch.h"
 
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/synchronization/MessageChannel.h"
+#include "android/base/system/System.h"
 #include "android/utils/debug.h"
 #include "emugl/common/crash_reporter.h"
 #include "emugl/common/sync_device.h"
+#include "emugl/common/thread.h"
+
+#include <deque>
+#include <unordered_map>
 
 #include <sys/time.h>
 
@@ -50,164 +56,144 @@ static uint64_t curr_ms() {
 
 #endif
 
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::System;
+
 static const uint32_t kTimelineInterval = 1;
-static const uint64_t kDefaultTimeoutNsecs = 5ULL * 1000ULL * 1000ULL * 1000ULL;
-
-SyncThread::SyncThread(EGLContext parentContext) :
-    emugl::Thread(android::base::ThreadFlags::MaskSignals, 512 * 1024),
-    mDisplay(EGL_NO_DISPLAY),
-    mContext(0), mSurf(0) {
-    if (parentContext == EGL_NO_CONTEXT) {
-        DPRINT("Warning: attempted to start a SyncThread "
-               "with EGL_NO_CONTEXT as parent context!");
+static const uint64_t kDefaultTimeoutUs = 5ULL * 1000ULL * 1000ULL;
+
+// Number of workers. Each of them waits on any number of fences, so this
+// only needs to be large enough for a stuck fence not to delay the others
+// too much.
+static const size_t kNumWorkers = 2;
+
+// How long a worker blocks on its oldest fence before checking the others
+// and its input again.
+static const uint64_t kWaitSliceNsecs = 2ULL * 1000ULL * 1000ULL;
+
+class SyncThread::Worker : public emugl::Thread {
+public:
+    Worker(SyncThread* parent) :
+        emugl::Thread(android::base::ThreadFlags::MaskSignals, 512 * 1024),
+        mParent(parent) {
+        this->start();
     }
 
-    FrameBuffer *fb = FrameBuffer::getFB();
-    mDisplay = fb->getDisplay();
-
-    this->start();
-
-    initSyncContext();
-}
-
-void SyncThread::triggerWait(FenceSync* fenceSync,
-                             uint64_t timeline) {
-    DPRINT("fenceSyncInfo=0x%llx timeline=0x%lx ...",
-            fenceSync, timeline);
-    SyncThreadCmd to_send;
-    to_send.opCode = SYNC_THREAD_WAIT;
-    to_send.fenceSync = fenceSync;
-    to_send.timeline = timeline;
-    DPRINT("opcode=%u", to_send.opCode);
-    sendAsync(to_send);
-    DPRINT("exit");
-}
+    void send(const SyncThreadCmd& cmd) {
+        DPRINT("send with opcode=%u fenceSyncInfo=0x%llx",
+               cmd.opCode, cmd.fenceSync);
+        mInput.send(cmd);
+    }
 
-void SyncThread::cleanup() {
-    DPRINT("enter");
-    SyncThreadCmd to_send;
-    to_send.opCode = SYNC_THREAD_EXIT;
-    sendAsync(to_send);
-    DPRINT("exit");
-}
+private:
+    // Thread function: waits on the fences of the |SyncThreadCmd| objects
+    // received off the message channel |mInput|, until told to exit.
+    virtual intptr_t main() override final;
 
-// Private methods below////////////////////////////////////////////////////////
+    // Returns false for |SYNC_THREAD_EXIT|.
+    bool addCmd(const SyncThreadCmd& cmd);
+    bool signalReadyFences();
+    bool isDone(SyncThreadCmd* cmd, uint64_t nowUs);
+    void waitForOldestFence();
+    void signalAll();
 
-void SyncThread::initSyncContext() {
-    DPRINT("enter");
-    SyncThreadCmd to_send;
-    to_send.opCode = SYNC_THREAD_INIT;
-    sendAsync(to_send);
-    DPRINT("exit");
-}
+    void doSyncContextInit();
+    void doExit();
 
-intptr_t SyncThread::main() {
-    DPRINT("in sync thread");
+    SyncThread* mParent;
 
-    bool exiting = false;
-    uint32_t num_iter = 0;
+    static const size_t kSyncThreadChannelCapacity = 256;
+    android::base::MessageChannel<SyncThreadCmd, kSyncThreadChannelCapacity>
+            mInput;
 
-    while (!exiting) {
-        SyncThreadCmd cmd = {};
+    // The fences waited on, per timeline, in the order of triggerWait().
+    std::unordered_map<uint64_t, std::deque<SyncThreadCmd>> mTimelines;
+    size_t mNumPending = 0;
+    // Scratch list of the fences of a timeline that are done.
+    std::vector<SyncThreadCmd> mDone;
 
-        DPRINT("waiting to receive command");
-        mInput.receive(&cmd);
-        num_iter++;
+    // EGL objects / object handles specific to
+    // a worker.
+    EGLContext mContext = EGL_NO_CONTEXT;
+    EGLSurface mSurf = EGL_NO_SURFACE;
+};
 
-        DPRINT("sync thread @%p num iter: %u", this, num_iter);
+intptr_t SyncThread::Worker::main() {
+    DPRINT("in sync worker");
 
-        bool need_reply = cmd.needReply;
-        int result = doSyncThreadCmd(&cmd);
+    doSyncContextInit();
 
-        if (need_reply) {
-            DPRINT("sending result");
-            mOutput.send(result);
-            DPRINT("sent result");
+    bool exiting = false;
+    while (!exiting) {
+        SyncThreadCmd cmd;
+
+        // Only block on the input when there is nothing else to wait for.
+        if (!mNumPending) {
+            DPRINT("waiting to receive command");
+            if (!mInput.receive(&cmd) || !addCmd(cmd)) {
+                break;
+            }
+        }
+        while (!exiting && mInput.tryReceive(&cmd)) {
+            exiting = !addCmd(cmd);
         }
 
-        if (cmd.opCode == SYNC_THREAD_EXIT) exiting = true;
+        if (!exiting && !signalReadyFences()) {
+            waitForOldestFence();
+        }
     }
 
-    DPRINT("exited sync thread");
-    return 0;
-}
-
-int SyncThread::sendAndWaitForResult(SyncThreadCmd& cmd) {
-    DPRINT("send with opcode=%d", cmd.opCode);
-    cmd.needReply = true;
-    mInput.send(cmd);
-    int result = -1;
-    mOutput.receive(&result);
-    DPRINT("result=%d", result);
-    return result;
-}
+    // Don't leave the guest waiting on the fences that are left.
+    signalAll();
+    doExit();
 
-void SyncThread::sendAsync(SyncThreadCmd& cmd) {
-    DPRINT("send with opcode=%u fenceSyncInfo=0x%llx",
-           cmd.opCode, cmd.fenceSync);
-    cmd.needReply = false;
-    mInput.send(cmd);
+    DPRINT("exited sync worker");
+    return 0;
 }
 
-void SyncThread::doSyncContextInit() {
-    // |mTLS| is cleaned up on doExit(), which is called
-    // when RenderThreads exit.
-    // Note that this will make the subsequent
-    // FrameBuffer::*** calls use |mTLS| as thread local storage,
-    // because the semantics of the |RenderThreadInfo| constructor
-    // are to both create the object _and_ to set it to
-    // the thread local copy.
-    mTLS = new RenderThreadInfo();
-
-    DPRINT("enter");
-    FrameBuffer::getFB()->createTrivialContext(0, // no share context
-                                               &this->mContext,
-                                               &this->mSurf);
-    FrameBuffer::getFB()->bindContext(mContext, mSurf, mSurf);
-    DPRINT("exit");
+bool SyncThread::Worker::addCmd(const SyncThreadCmd& cmd) {
+    if (cmd.opCode == SYNC_THREAD_EXIT) {
+        DPRINT("exec SYNC_THREAD_EXIT");
+        return false;
+    }
+    DPRINT("exec SYNC_THREAD_WAIT fenceSyncInfo=0x%llx timeline=0x%llx",
+           cmd.fenceSync, cmd.timeline);
+    mTimelines[cmd.timeline].push_back(cmd);
+    ++mNumPending;
+    return true;
 }
 
-void SyncThread::doSyncWait(SyncThreadCmd* cmd) {
-    DPRINT("enter");
-
+// Whether the wait of |cmd| is over. Clears |cmd->fenceSync| if it refers
+// to a FenceSync object that doesn't exist anymore.
+bool SyncThread::Worker::isDone(SyncThreadCmd* cmd, uint64_t nowUs) {
     FenceSync* fenceSync =
         FenceSync::getFromHandle((uint64_t)(uintptr_t)cmd->fenceSync);
-
     if (!fenceSync) {
-        emugl_sync_timeline_inc(cmd->timeline, kTimelineInterval);
-        return;
+        cmd->fenceSync = nullptr;
+        return true;
     }
 
-    EGLint wait_result = 0x0;
-
-    DPRINT("wait on sync obj: %p", cmd->fenceSync);
-    wait_result = cmd->fenceSync->wait(kDefaultTimeoutNsecs);
-
-    DPRINT("done waiting, with wait result=0x%x. "
-           "increment timeline (and signal fence)",
-           wait_result);
-
-    if (wait_result != EGL_CONDITION_SATISFIED_KHR) {
-        DPRINT("error: eglClientWaitSync abnormal exit 0x%x\n",
-               wait_result);
+    EGLint wait_result = fenceSync->wait(0);
+    if (wait_result != EGL_TIMEOUT_EXPIRED_KHR) {
+        if (wait_result != EGL_CONDITION_SATISFIED_KHR) {
+            DPRINT("error: eglClientWaitSync abnormal exit 0x%x\n",
+                   wait_result);
+        }
+        return true;
     }
 
-    DPRINT("issue timeline increment");
-
-    // We always unconditionally increment timeline at this point, even
-    // if the call to eglClientWaitSync returned abnormally.
+    // We always unconditionally increment timeline once a wait is over,
+    // even if it ended abnormally.
     // There are three cases to consider:
-    // - EGL_CONDITION_SATISFIED_KHR: either the sync object is already
-    //   signaled and we need to increment this timeline immediately, or
-    //   we have waited until the object is signaled, and then
-    //   we increment the timeline.
-    // - EGL_TIMEOUT_EXPIRED_KHR: the fence command we put in earlier
-    //   in the OpenGL stream is not actually ever signaled, and we
-    //   end up blocking in the above eglClientWaitSyncKHR call until
-    //   our timeout runs out. In this case, provided we have waited
-    //   for |kDefaultTimeoutNsecs|, the guest will have received all
-    //   relevant error messages about fence fd's not being signaled
-    //   in time, so we are properly emulating bad behavior even if
+    // - EGL_CONDITION_SATISFIED_KHR: the sync object is signaled and we
+    //   need to increment this timeline.
+    // - EGL_TIMEOUT_EXPIRED_KHR for longer than |kDefaultTimeoutUs|: the
+    //   fence command we put in earlier in the OpenGL stream is not actually
+    //   ever signaled. Provided we have waited for that long, the guest will
+    //   have received all relevant error messages about fence fd's not being
+    //   signaled in time, so we are properly emulating bad behavior even if
     //   we now increment the timeline.
     // - EGL_FALSE (error): chances are, the underlying EGL implementation
     //   on the host doesn't actually support fence objects. In this case,
@@ -217,76 +203,209 @@ void SyncThread::doSyncWait(SyncThreadCmd* cmd) {
     //   order frames and scrambled textures in some apps. But, not
     //   incrementing the timeline means that the app's rendering freezes.
     //   So, despite the faulty GPU driver, not incrementing is too heavyweight a response.
+    return nowUs - cmd->startUs >= kDefaultTimeoutUs;
+}
+
+// Increments each timeline by the number of its oldest fences that are
+// signaled, and signals their native fence fd's. Returns false if there
+// were none.
+bool SyncThread::Worker::signalReadyFences() {
+    const uint64_t nowUs = System::get()->getHighResTimeUs();
+    bool signaled = false;
+
+    for (auto it = mTimelines.begin(); it != mTimelines.end();) {
+        std::deque<SyncThreadCmd>& waits = it->second;
+        mDone.clear();
+        while (!waits.empty() && isDone(&waits.front(), nowUs)) {
+            mDone.push_back(waits.front());
+            waits.pop_front();
+        }
+
+        if (!mDone.empty()) {
+            DPRINT("issue timeline increment by %zu", mDone.size());
+            emugl_sync_timeline_inc(it->first,
+                                    mDone.size() * kTimelineInterval);
+            for (const SyncThreadCmd& cmd : mDone) {
+                if (cmd.fenceSync) {
+                    cmd.fenceSync->signaledNativeFd();
+                }
+                mParent->onWaitDone(cmd, nowUs);
+            }
+            mNumPending -= mDone.size();
+            signaled = true;
+        }
+
+        if (waits.empty()) {
+            it = mTimelines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return signaled;
+}
+
+// Blocks until the fence waited on for the longest time is signaled, or
+// for |kWaitSliceNsecs| at most, so that fences signaled out of order and
+// new commands don't wait for it.
+void SyncThread::Worker::waitForOldestFence() {
+    const SyncThreadCmd* oldest = nullptr;
+    for (const auto& timeline : mTimelines) {
+        const SyncThreadCmd& cmd = timeline.second.front();
+        if (!oldest || cmd.startUs < oldest->startUs) {
+            oldest = &cmd;
+        }
+    }
+    if (!oldest) {
+        return;
+    }
 
-    emugl_sync_timeline_inc(cmd->timeline, kTimelineInterval);
-    cmd->fenceSync->signaledNativeFd();
+    FenceSync* fenceSync =
+        FenceSync::getFromHandle((uint64_t)(uintptr_t)oldest->fenceSync);
+    if (fenceSync) {
+        DPRINT("wait on sync obj: %p", fenceSync);
+        fenceSync->wait(kWaitSliceNsecs);
+    }
+}
 
-    DPRINT("done timeline increment");
+// Ends all the waits, as if they timed out.
+void SyncThread::Worker::signalAll() {
+    const uint64_t nowUs = System::get()->getHighResTimeUs();
+    for (auto& timeline : mTimelines) {
+        emugl_sync_timeline_inc(timeline.first,
+                                timeline.second.size() * kTimelineInterval);
+        for (const SyncThreadCmd& cmd : timeline.second) {
+            FenceSync* fenceSync =
+                FenceSync::getFromHandle((uint64_t)(uintptr_t)cmd.fenceSync);
+            if (fenceSync) {
+                fenceSync->signaledNativeFd();
+            }
+            mParent->onWaitDone(cmd, nowUs);
+        }
+    }
+    mTimelines.clear();
+    mNumPending = 0;
+}
 
+void SyncThread::Worker::doSyncContextInit() {
+    DPRINT("enter");
+    // The context is only there for the sake of the host drivers that want
+    // one for eglClientWaitSyncKHR.
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb) {
+        fb->createAndBindTrivialSharedContext(&mContext, &mSurf);
+    }
     DPRINT("exit");
 }
 
-void SyncThread::doExit() {
+void SyncThread::Worker::doExit() {
+    FrameBuffer* fb = FrameBuffer::getFB();
+    if (fb && mContext != EGL_NO_CONTEXT) {
+        fb->unbindAndDestroyTrivialSharedContext(mContext, mSurf);
+    }
+}
+
+// SyncThread///////////////////////////////////////////////////////////////////
 
-    // This sequence parallels the exit sequence
-    // in RenderThread.
-    FrameBuffer::getFB()->bindContext(0, 0, 0);
-    FrameBuffer::getFB()->DestroyWindowSurface(mSurf);
-    FrameBuffer::getFB()->drainWindowSurface();
-    FrameBuffer::getFB()->drainRenderContext();
-    delete mTLS;
+SyncThread::SyncThread() {
+    for (size_t i = 0; i < kNumWorkers; i++) {
+        mWorkers.emplace_back(new Worker(this));
+    }
 }
 
-int SyncThread::doSyncThreadCmd(SyncThreadCmd* cmd) {
-    int result = 0;
-    switch (cmd->opCode) {
-    case SYNC_THREAD_INIT:
-        DPRINT("exec SYNC_THREAD_INIT");
-        doSyncContextInit();
-        break;
-    case SYNC_THREAD_WAIT:
-        DPRINT("exec SYNC_THREAD_WAIT");
-        doSyncWait(cmd);
-        break;
-    case SYNC_THREAD_EXIT:
-        DPRINT("exec SYNC_THREAD_EXIT");
-        doExit();
-        break;
+SyncThread::~SyncThread() {
+    SyncThreadCmd to_send;
+    to_send.opCode = SYNC_THREAD_EXIT;
+    for (auto& worker : mWorkers) {
+        worker->send(to_send);
+    }
+    for (auto& worker : mWorkers) {
+        worker->wait();
     }
-    return result;
 }
 
-// Interface for libOpenglRender TLS
+void SyncThread::triggerWait(FenceSync* fenceSync,
+                             uint64_t timeline) {
+    DPRINT("fenceSyncInfo=0x%llx timeline=0x%lx ...",
+            fenceSync, timeline);
+    SyncThreadCmd to_send;
+    to_send.opCode = SYNC_THREAD_WAIT;
+    to_send.fenceSync = fenceSync;
+    to_send.timeline = timeline;
+    to_send.startUs = System::get()->getHighResTimeUs();
 
-/* static */
-SyncThread* SyncThread::getSyncThread() {
-    RenderThreadInfo* tInfo = RenderThreadInfo::get();
+    const uint32_t depth = ++mQueueDepth;
+    uint32_t maxDepth = mMaxQueueDepth.load(std::memory_order_relaxed);
+    while (depth > maxDepth &&
+           !mMaxQueueDepth.compare_exchange_weak(maxDepth, depth)) {
+    }
 
-    if (!tInfo->syncThread.get()) {
-        DPRINT("starting a sync thread for render thread info=%p", tInfo);
-        tInfo->createSyncThread();
+    // Timeline handles are pointers in the sync device: mix their bits
+    // before picking a worker.
+    const uint64_t hash = timeline * 0x9E3779B97F4A7C15ULL;
+    mWorkers[(hash >> 32) % mWorkers.size()]->send(to_send);
+    DPRINT("exit");
+}
+
+void SyncThread::onWaitDone(const SyncThreadCmd& cmd, uint64_t nowUs) {
+    const uint64_t latencyUs = nowUs - cmd.startUs;
+    ++mWaits;
+    mTotalLatencyUs += latencyUs;
+    uint64_t maxLatencyUs = mMaxLatencyUs.load(std::memory_order_relaxed);
+    while (latencyUs > maxLatencyUs &&
+           !mMaxLatencyUs.compare_exchange_weak(maxLatencyUs, latencyUs)) {
     }
+    --mQueueDepth;
+}
 
-    return tInfo->syncThread.get();
+SyncThreadStats SyncThread::getStats() const {
+    SyncThreadStats stats;
+    stats.waits = mWaits.load(std::memory_order_relaxed);
+    stats.totalLatencyUs = mTotalLatencyUs.load(std::memory_order_relaxed);
+    stats.maxLatencyUs = mMaxLatencyUs.load(std::memory_order_relaxed);
+    stats.queueDepth = mQueueDepth.load(std::memory_order_relaxed);
+    stats.maxQueueDepth = mMaxQueueDepth.load(std::memory_order_relaxed);
+    return stats;
 }
 
-/* static */
-void SyncThread::destroySyncThread() {
-    RenderThreadInfo* tInfo = RenderThreadInfo::get();
+namespace {
+
+struct SyncThreadGlobals {
+    Lock lock;
+    SyncThread* syncThread = nullptr;
+};
 
-    DPRINT("exiting a sync thread for render thread info=%p.", tInfo);
+}  // namespace
 
-    if (!tInfo || !tInfo->syncThread) return;
+static LazyInstance<SyncThreadGlobals> sGlobals = LAZY_INSTANCE_INIT;
+
+/* static */
+SyncThread* SyncThread::getSyncThread() {
+    AutoLock lock(sGlobals->lock);
+    if (!sGlobals->syncThread) {
+        DPRINT("starting the sync thread workers");
+        sGlobals->syncThread = new SyncThread();
+    }
+    return sGlobals->syncThread;
+}
 
-    tInfo->syncThread->cleanup();
-    tInfo->syncThread->wait();
-    tInfo->destroySyncThread();
+/* static */
+void SyncThread::destroySyncThread() {
+    AutoLock lock(sGlobals->lock);
+    DPRINT("exiting the sync thread workers");
+    delete sGlobals->syncThread;
+    sGlobals->syncThread = nullptr;
+}
+
+/* static */
+SyncThreadStats SyncThread::getGlobalStats() {
+    AutoLock lock(sGlobals->lock);
+    if (!sGlobals->syncThread) {
+        return SyncThreadStats();
+    }
+    return sGlobals->syncThread->getStats();
 }
 
 /* static */
-SyncThread* SyncThread::getFromHandle(uint64_t alias) {
-    return RenderThreadInfo::getSyncThreadRegistry()->getPtr(
-            alias,
-            reinterpret_cast<SyncThread*>(alias) /* return cast as default */,
-            true /* remove if getting stale ptr */);
+SyncThread* SyncThread::getFromHandle(uint64_t handle) {
+    return getSyncThread();
 }
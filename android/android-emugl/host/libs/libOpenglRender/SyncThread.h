@@ -22,42 +22,55 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
-#include "android/base/synchronization/Lock.h"
-#include "android/base/synchronization/MessageChannel.h"
-
-#include "emugl/common/thread.h"
+#include <atomic>
+#include <memory>
+#include <vector>
 
 // SyncThread///////////////////////////////////////////////////////////////////
 // The purpose of SyncThread is to track sync device timelines and give out +
 // signal FD's that correspond to the completion of host-side GL fence commands.
-
-// We communicate with the sync thread in 3 ways:
+//
+// There is a single SyncThread, shared by all render threads. It runs a small
+// pool of workers, each with its own EGL context, that wait on many FenceSync
+// objects at once and increment the timelines of those that got signaled in
+// batches. All the waits of a timeline go to the same worker, which handles
+// them in order: incrementing a timeline signals its oldest fence.
+
+// We communicate with the workers in 2 ways:
 enum SyncThreadOpCode {
-    // Nonblocking command to initialize sync thread's contents,
-    // such as the EGL context for sync operations
-    SYNC_THREAD_INIT = 0,
     // Nonblocking command to wait on a given FenceSync object
     // and timeline handle.
     // A fence FD object in the guest is signaled.
     SYNC_THREAD_WAIT = 1,
-    // Blocking command to clean up and exit the sync thread.
+    // Nonblocking command to clean up and exit a worker.
     SYNC_THREAD_EXIT = 2
 };
 
 struct SyncThreadCmd {
-    SyncThreadOpCode opCode = SYNC_THREAD_INIT;
-    bool needReply = false;
+    SyncThreadOpCode opCode = SYNC_THREAD_WAIT;
     FenceSync* fenceSync = nullptr;
     uint64_t timeline = 0;
+    // When triggerWait() was called, for the latency statistics.
+    uint64_t startUs = 0;
+};
+
+// Counters of the fence waits done by the workers.
+struct SyncThreadStats {
+    // Number of fences signaled so far.
+    uint64_t waits = 0;
+    // Time between triggerWait() and the timeline increment, in total
+    // and at most.
+    uint64_t totalLatencyUs = 0;
+    uint64_t maxLatencyUs = 0;
+    // Number of fences waited on right now, and at most.
+    uint32_t queueDepth = 0;
+    uint32_t maxQueueDepth = 0;
 };
 
-struct RenderThreadInfo;
-class SyncThread : public emugl::Thread {
+class SyncThread {
 public:
-    // - constructor: start up the sync thread for a given context.
-    // The initialization of the sync thread is nonblocking.
-    // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_INIT|
-    SyncThread(EGLContext context);
+    ~SyncThread();
+
     // |triggerWait|: async wait with a given FenceSync object.
     // We use the wait() method to do a eglClientWaitSyncKHR.
     // After wait is over, the timeline will be incremented,
@@ -66,68 +79,39 @@ public:
     // knows when to increment timelines / signal native fence FD's.
     void triggerWait(FenceSync* fenceSync,
                      uint64_t timeline);
-    // |cleanup|: for use with destructors and other cleanup functions.
-    // it destroys the sync context and exits the sync thread.
-    // This is blocking; after this function returns, we're sure
-    // the sync thread is gone.
-    // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_EXIT|
-    void cleanup();
-
-    // We assume the invariant that sync threads correspond 1:1
-    // with render threads.
-    // Therefore, we create and destroy sync threads using
-    // only the two functions below, |getSyncThread| and |destroySyncThread|.
-    // - |getSyncThread| looks at render thread's TLS for a sync thread.
-    //   If there isn't one, a sync thread is created and initialized.
-    // - |destroySyncThread| cleans up and deletes the sync thread,
-    //   if there is one started already.
-    //   It is meant to be called whenever render threads exit or
-    //   EGL contexts are destroyed.
+
+    SyncThreadStats getStats() const;
+
+    // |getSyncThread| returns the shared sync thread, starting its workers
+    // on first use.
+    // |destroySyncThread| stops the workers and deletes it, if it was
+    // started. It is blocking, and meant to be called when the FrameBuffer
+    // goes away, as the workers' contexts share with its own.
     static SyncThread* getSyncThread();
     static void destroySyncThread();
 
-    // Safe way to get SyncThread*'s across snapshots.
+    // |getGlobalStats| returns the stats of the shared sync thread, without
+    // starting it: all zeroes if it isn't running.
+    static SyncThreadStats getGlobalStats();
+
+    // Safe way to get SyncThread*'s across snapshots: as there is only one,
+    // every handle given to the guest, including ones from before a
+    // snapshot was loaded, designates it.
     static SyncThread* getFromHandle(uint64_t handle);
 
 private:
-    // |initSyncContext| creates an EGL context expressly for calling
-    // eglClientWaitSyncKHR in the processing caused by |triggerWait|.
-    // This is used by the constructor only. It is non-blocking.
-    // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_INIT|
-    void initSyncContext();
-
-    // Thread function executing all sync commands.
-    // It listens for |SyncThreadCmd| objects off the message channel
-    // |mInput|, and runs them serially.
-    virtual intptr_t main() override final;
-    static const size_t kSyncThreadChannelCapacity = 256;
-    android::base::MessageChannel<SyncThreadCmd, kSyncThreadChannelCapacity> mInput;
-
-    // |mOutput| holds result of cmds in case of blocking commands
-    // that require return results.
-    android::base::MessageChannel<GLint, kSyncThreadChannelCapacity> mOutput;
-
-    // These two functions are used to communicate with the sync thread
-    // from another thread:
-    // - |sendAndWaitForResult| issues |cmd| to the sync thread,
-    //   and blocks until it receives the result of the command.
-    // - |sendAsync| issues |cmd| to the sync thread and does not
-    //   wait for the result, returning immediately after.
-    GLint sendAndWaitForResult(SyncThreadCmd& cmd);
-    void sendAsync(SyncThreadCmd& cmd);
-
-    // |doSyncThreadCmd| and related functions below
-    // execute the actual commands. These run on the sync thread.
-    GLint doSyncThreadCmd(SyncThreadCmd* cmd);
-    void doSyncContextInit();
-    void doSyncWait(SyncThreadCmd* cmd);
-    void doExit();
-
-    // EGL objects / object handles specific to
-    // a sync thread.
-    EGLDisplay mDisplay;
-    RenderThreadInfo* mTLS;
-    uint32_t mContext;
-    uint32_t mSurf;
-};
+    class Worker;
+
+    SyncThread();
 
+    // Called by the workers.
+    void onWaitDone(const SyncThreadCmd& cmd, uint64_t nowUs);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+
+    std::atomic<uint64_t> mWaits = {0};
+    std::atomic<uint64_t> mTotalLatencyUs = {0};
+    std::atomic<uint64_t> mMaxLatencyUs = {0};
+    std::atomic<uint32_t> mQueueDepth = {0};
+    std::atomic<uint32_t> mMaxQueueDepth = {0};
+};
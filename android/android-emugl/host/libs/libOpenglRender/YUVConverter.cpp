@@ -17,6 +17,7 @@
 #include "YUVConverter.h"
 
 #include "DispatchTables.h"
+#include "FrameBuffer.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -27,6 +28,21 @@
     assert(false); \
 } while(0)
 
+// How long an upload waits for the GPU to be done with the buffer it is
+// about to reuse, before letting the driver synchronize instead.
+static constexpr GLuint64 kUploadTimeoutNs = 1000000000ULL;
+
+// Semi-planar formats sample their chroma from a single two-component
+// texture.
+static bool isSemiPlanar(FrameworkFormat format) {
+    return format == FRAMEWORK_FORMAT_NV12 || format == FRAMEWORK_FORMAT_NV21;
+}
+
+// Streaming uploads and vertex array objects need GLES 3.0.
+static bool canUseGLES3() {
+    return FrameBuffer::getMaxGLESVersion() >= GLES_DISPATCH_MAX_VERSION_3_0;
+}
+
 static void getPlanarYUVSizes(int width, int height,
                               FrameworkFormat format,
                               uint32_t* nBytes_out,
@@ -47,7 +63,9 @@ static void getPlanarYUVSizes(int width, int height,
         align = 1;
         break;
     case FRAMEWORK_FORMAT_GL_COMPATIBLE:
-        FATAL("Input not a YUV format!");
+    case FRAMEWORK_FORMAT_NV12:
+    case FRAMEWORK_FORMAT_NV21:
+        FATAL("Input not a planar YUV format!");
     }
 
     // 16-alignment means we need to get the
@@ -64,6 +82,23 @@ static void getPlanarYUVSizes(int width, int height,
     *cHeight_out = cHeight;
 }
 
+// Both planes of a semi-planar buffer have rows of |width| bytes: the
+// chroma rows hold |width / 2| pairs of samples.
+static void getSemiPlanarYUVSizes(int width, int height,
+                                  uint32_t* nBytes_out,
+                                  uint32_t* yStride_out,
+                                  uint32_t* cStride_out,
+                                  uint32_t* cHeight_out) {
+    uint32_t yStride = width;
+    uint32_t cStride = width;
+    uint32_t cHeight = height / 2;
+
+    *nBytes_out = yStride * height + cStride * cHeight;
+    *yStride_out = yStride;
+    *cStride_out = cStride;
+    *cHeight_out = cHeight;
+}
+
 // getYUVSizes(): given |width| and |height|, return
 // the total number of bytes of the YUV-formatted buffer
 // in |nBytes_out|, and store aligned width and C height
@@ -83,6 +118,14 @@ static void getYUVSizes(int width, int height,
                           cStride_out,
                           cHeight_out);
         break;
+    case FRAMEWORK_FORMAT_NV12:
+    case FRAMEWORK_FORMAT_NV21:
+        getSemiPlanarYUVSizes(width, height,
+                              nBytes_out,
+                              yStride_out,
+                              cStride_out,
+                              cHeight_out);
+        break;
     case FRAMEWORK_FORMAT_GL_COMPATIBLE:
         FATAL("Input not a YUV format!");
     }
@@ -118,10 +161,29 @@ static void getPlanarYUVOffsets(int width, int height, FrameworkFormat format,
         *alignwidthc = cStride;
         break;
     case FRAMEWORK_FORMAT_GL_COMPATIBLE:
-        FATAL("Input not a YUV format!");
+    case FRAMEWORK_FORMAT_NV12:
+    case FRAMEWORK_FORMAT_NV21:
+        FATAL("Input not a planar YUV format!");
     }
 }
 
+// The U and V samples of semi-planar formats are interleaved, in a plane
+// that follows the Y plane. |alignwidthc| is in pairs of samples, i.e.
+// in texels of the two-component chroma texture.
+static void getSemiPlanarYUVOffsets(int width, int height,
+                                    uint32_t* yoff, uint32_t* uoff,
+                                    uint32_t* voff, uint32_t* alignwidth,
+                                    uint32_t* alignwidthc) {
+    uint32_t totalSize, yStride, cStride, cHeight;
+    getSemiPlanarYUVSizes(width, height, &totalSize, &yStride, &cStride,
+                          &cHeight);
+    *yoff = 0;
+    *uoff = (*yoff) + yStride * height;
+    *voff = *uoff;
+    *alignwidth = yStride;
+    *alignwidthc = cStride / 2;
+}
+
 // getYUVOffsets(), given a YUV-formatted buffer that is arranged
 // according to the spec
 // https://developer.android.com/reference/android/graphics/ImageFormat.html#YUV
@@ -142,6 +204,12 @@ static void getYUVOffsets(int width, int height, FrameworkFormat format,
                             yoff, uoff, voff,
                             alignwidth, alignwidthc);
         break;
+    case FRAMEWORK_FORMAT_NV12:
+    case FRAMEWORK_FORMAT_NV21:
+        getSemiPlanarYUVOffsets(width, height,
+                                yoff, uoff, voff,
+                                alignwidth, alignwidthc);
+        break;
     case FRAMEWORK_FORMAT_GL_COMPATIBLE:
         FATAL("Input not a YUV format!");
     }
@@ -150,7 +218,8 @@ static void getYUVOffsets(int width, int height, FrameworkFormat format,
 // createYUVGLTex() allocates GPU memory that is enough
 // to hold the raw data of the YV12 buffer.
 // The memory is in the form of an OpenGL texture
-// with one component (GL_LUMINANCE) and
+// with one component (GL_LUMINANCE), or two for the interleaved
+// chroma of semi-planar formats (GL_LUMINANCE_ALPHA),
 // of type GL_UNSIGNED_BYTE.
 // In order to process all Y, U, V components
 // simultaneously in conversion, the simple thing to do
@@ -159,6 +228,7 @@ static void getYUVOffsets(int width, int height, FrameworkFormat format,
 // Returns a new OpenGL texture object in |texName_out|
 // that is to be cleaned up by the caller.
 static void createYUVGLTex(GLenum texture_unit,
+                           GLenum format,
                            GLsizei width,
                            GLsizei height,
                            GLuint* texName_out) {
@@ -169,28 +239,30 @@ static void createYUVGLTex(GLenum texture_unit,
     s_gles2.glBindTexture(GL_TEXTURE_2D, *texName_out);
     s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     s_gles2.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
+    s_gles2.glTexImage2D(GL_TEXTURE_2D, 0, format,
                          width, height, 0,
-                         GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                         format, GL_UNSIGNED_BYTE,
                          NULL);
     s_gles2.glActiveTexture(GL_TEXTURE0);
 }
 
 // subUpdateYUVGLTex() updates a given YUV texture
 // at the coordinates (x, y, width, height),
-// with the raw YUV data in |pixels|.
+// with the raw YUV data in |pixels|, which is an offset
+// into the pixel unpack buffer if one is bound.
 // We cannot view the result properly until
 // after conversion; this is to be used only
 // as input to the conversion shader.
 static void subUpdateYUVGLTex(GLenum texture_unit,
                               GLuint tex,
+                              GLenum format,
                               int x, int y, int width, int height,
-                              void* pixels) {
+                              const void* pixels) {
     s_gles2.glActiveTexture(texture_unit);
     s_gles2.glBindTexture(GL_TEXTURE_2D, tex);
     s_gles2.glTexSubImage2D(GL_TEXTURE_2D, 0,
                             x, y, width, height,
-                            GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                            format, GL_UNSIGNED_BYTE,
                             pixels);
     s_gles2.glActiveTexture(GL_TEXTURE0);
 }
@@ -198,7 +270,10 @@ static void subUpdateYUVGLTex(GLenum texture_unit,
 // createYUVGLShader() defines the vertex/fragment
 // shader that does the actual work of converting
 // YUV to RGB. The resulting program is stored in |program_out|.
-static void createYUVGLShader(GLuint* program_out,
+// Semi-planar formats read both chroma samples from |usampler|,
+// and have no |vsampler|.
+static void createYUVGLShader(FrameworkFormat format,
+                              GLuint* program_out,
                               GLint* ywidthcutoffloc_out,
                               GLint* cwidthcutoffloc_out,
                               GLint* ysamplerloc_out,
@@ -221,21 +296,44 @@ void main(void) {
     const GLchar* const kVShaders =
         static_cast<const GLchar*>(kVShader);
 
-    // Based on:
-    // http://stackoverflow.com/questions/11093061/yv12-to-rgb-using-glsl-in-ios-result-image-attached
-    // + account for 16-pixel alignment using |yWidthCutoff| / |cWidthCutoff|
-    // + use conversion matrix in
-    // frameworks/av/media/libstagefright/colorconversion/ColorConverter.cpp (YUV420p)
-    // + more precision from
-    // https://en.wikipedia.org/wiki/YCbCr#ITU-R_BT.601_conversion
-    static const char kFShader[] = R"(
+    static const char kFShaderHeader[] = R"(
 precision highp float;
 varying highp vec2 outCoord;
 uniform highp float yWidthCutoff;
 uniform highp float cWidthCutoff;
 uniform sampler2D ysampler;
+    )";
+
+    // sampleChroma() returns the U and V samples at |coords|.
+    static const char kFShaderPlanarChroma[] = R"(
 uniform sampler2D usampler;
 uniform sampler2D vsampler;
+highp vec2 sampleChroma(highp vec2 coords) {
+    return vec2(texture2D(usampler, coords).r,
+                texture2D(vsampler, coords).r);
+}
+    )";
+    static const char kFShaderNV12Chroma[] = R"(
+uniform sampler2D usampler;
+highp vec2 sampleChroma(highp vec2 coords) {
+    return texture2D(usampler, coords).ra;
+}
+    )";
+    static const char kFShaderNV21Chroma[] = R"(
+uniform sampler2D usampler;
+highp vec2 sampleChroma(highp vec2 coords) {
+    return texture2D(usampler, coords).ar;
+}
+    )";
+
+    // Based on:
+    // http://stackoverflow.com/questions/11093061/yv12-to-rgb-using-glsl-in-ios-result-image-attached
+    // + account for 16-pixel alignment using |yWidthCutoff| / |cWidthCutoff|
+    // + use conversion matrix in
+    // frameworks/av/media/libstagefright/colorconversion/ColorConverter.cpp (YUV420p)
+    // + more precision from
+    // https://en.wikipedia.org/wiki/YCbCr#ITU-R_BT.601_conversion
+    static const char kFShaderMain[] = R"(
 void main(void) {
     highp vec2 cutoffCoordsY;
     highp vec2 cutoffCoordsC;
@@ -246,8 +344,7 @@ void main(void) {
     cutoffCoordsC.x = outCoord.x * cWidthCutoff;
     cutoffCoordsC.y = outCoord.y;
     yuv[0] = texture2D(ysampler, cutoffCoordsY).r - 0.0625;
-    yuv[1] = texture2D(usampler, cutoffCoordsC).r - 0.5;
-    yuv[2] = texture2D(vsampler, cutoffCoordsC).r - 0.5;
+    yuv.yz = sampleChroma(cutoffCoordsC) - 0.5;
     highp float yscale = 1.1643835616438356;
     rgb = mat3(yscale,                           yscale,            yscale,
                0,                  -0.39176229009491365, 2.017232142857143,
@@ -256,16 +353,23 @@ void main(void) {
 }
     )";
 
-    const GLchar* const kFShaders =
-        static_cast<const GLchar*>(kFShader);
+    const char* chroma = kFShaderPlanarChroma;
+    if (format == FRAMEWORK_FORMAT_NV12) {
+        chroma = kFShaderNV12Chroma;
+    } else if (format == FRAMEWORK_FORMAT_NV21) {
+        chroma = kFShaderNV21Chroma;
+    }
+    const GLchar* const kFShaders[] = {kFShaderHeader, chroma, kFShaderMain};
 
     GLuint vshader = s_gles2.glCreateShader(GL_VERTEX_SHADER);
     GLuint fshader = s_gles2.glCreateShader(GL_FRAGMENT_SHADER);
 
     const GLint vtextLen = strlen(kVShader);
-    const GLint ftextLen = strlen(kFShader);
+    const GLint ftextLens[] = {(GLint)strlen(kFShaders[0]),
+                               (GLint)strlen(kFShaders[1]),
+                               (GLint)strlen(kFShaders[2])};
     s_gles2.glShaderSource(vshader, 1, &kVShaders, &vtextLen);
-    s_gles2.glShaderSource(fshader, 1, &kFShaders, &ftextLen);
+    s_gles2.glShaderSource(fshader, 3, kFShaders, ftextLens);
     s_gles2.glCompileShader(vshader);
     s_gles2.glCompileShader(fshader);
 
@@ -322,39 +426,16 @@ static void createYUVGLFullscreenQuad(GLuint* vbuf_out,
                          GL_STATIC_DRAW);
 }
 
-// doYUVConversionDraw() does the actual work of setting up
-// and submitting draw commands to the GPU.
-// It uses the textures, shaders, and fullscreen quad defined above
-// and executes the pipeline on them.
-// Note, however, that it is up to the caller to dig out
-// the result of the draw.
-static void doYUVConversionDraw(GLuint program,
-                                GLint yWidthCutoffLoc,
-                                GLint cWidthCutoffLoc,
-                                GLint ySamplerLoc,
-                                GLint uSamplerLoc,
-                                GLint vSamplerLoc,
-                                GLint inCoordLoc,
-                                GLint posLoc,
-                                GLuint vbuf, GLuint ibuf,
-                                int width, int ywidth,
-                                int halfwidth, int cwidth,
-                                float yWidthCutoff,
-                                float cWidthCutoff) {
-
+// setupYUVGLVertexAttribs() points the attributes of the conversion
+// shader at the fullscreen quad in |vbuf|, which is bound to
+// GL_ARRAY_BUFFER as a side effect.
+static void setupYUVGLVertexAttribs(GLint inCoordLoc,
+                                    GLint posLoc,
+                                    GLuint vbuf) {
     const GLsizei kVertexAttribStride = 5 * sizeof(GL_FLOAT);
     const GLvoid* kVertexAttribPosOffset = (GLvoid*)0;
     const GLvoid* kVertexAttribCoordOffset = (GLvoid*)(3 * sizeof(GL_FLOAT));
 
-    s_gles2.glUseProgram(program);
-
-    s_gles2.glUniform1f(yWidthCutoffLoc, yWidthCutoff);
-    s_gles2.glUniform1f(cWidthCutoffLoc, cWidthCutoff);
-
-    s_gles2.glUniform1i(ySamplerLoc, 0);
-    s_gles2.glUniform1i(uSamplerLoc, 1);
-    s_gles2.glUniform1i(vSamplerLoc, 2);
-
     s_gles2.glBindBuffer(GL_ARRAY_BUFFER, vbuf);
     s_gles2.glEnableVertexAttribArray(posLoc);
     s_gles2.glEnableVertexAttribArray(inCoordLoc);
@@ -365,6 +446,26 @@ static void doYUVConversionDraw(GLuint program,
     s_gles2.glVertexAttribPointer(inCoordLoc, 2, GL_FLOAT, false,
                                   kVertexAttribStride,
                                   kVertexAttribCoordOffset);
+}
+
+// doYUVConversionDraw() does the actual work of
+// submitting draw commands to the GPU, with the program,
+// uniforms and textures already in place.
+// Without a vertex array object |vao|, the vertex state is
+// set up here and reset afterwards.
+// Note, however, that it is up to the caller to dig out
+// the result of the draw.
+static void doYUVConversionDraw(GLuint vao,
+                                GLint inCoordLoc,
+                                GLint posLoc,
+                                GLuint vbuf, GLuint ibuf) {
+    if (vao) {
+        s_gles2.glBindVertexArray(vao);
+        s_gles2.glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
+        return;
+    }
+
+    setupYUVGLVertexAttribs(inCoordLoc, posLoc, vbuf);
 
     s_gles2.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibuf);
     s_gles2.glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
@@ -388,11 +489,17 @@ YUVConverter::YUVConverter(int width, int height, FrameworkFormat format) : mFor
                   &ywidth, &cwidth);
     cheight = height / 2;
 
-    createYUVGLTex(GL_TEXTURE0, ywidth, height, &mYtex);
-    createYUVGLTex(GL_TEXTURE1, cwidth, cheight, &mUtex);
-    createYUVGLTex(GL_TEXTURE2, cwidth, cheight, &mVtex);
+    createYUVGLTex(GL_TEXTURE0, GL_LUMINANCE, ywidth, height, &mYtex);
+    if (isSemiPlanar(mFormat)) {
+        createYUVGLTex(GL_TEXTURE1, GL_LUMINANCE_ALPHA, cwidth, cheight,
+                       &mUtex);
+    } else {
+        createYUVGLTex(GL_TEXTURE1, GL_LUMINANCE, cwidth, cheight, &mUtex);
+        createYUVGLTex(GL_TEXTURE2, GL_LUMINANCE, cwidth, cheight, &mVtex);
+    }
 
-    createYUVGLShader(&mProgram,
+    createYUVGLShader(mFormat,
+                      &mProgram,
                       &mYWidthCutoffLoc,
                       &mCWidthCutoffLoc,
                       &mYSamplerLoc,
@@ -401,16 +508,49 @@ YUVConverter::YUVConverter(int width, int height, FrameworkFormat format) : mFor
                       &mInCoordLoc,
                       &mPosLoc);
 
+    // The texture units never change, so the program keeps them.
+    GLint currProgram = 0;
+    s_gles2.glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
+    s_gles2.glUseProgram(mProgram);
+    s_gles2.glUniform1i(mYSamplerLoc, 0);
+    s_gles2.glUniform1i(mUSamplerLoc, 1);
+    s_gles2.glUniform1i(mVSamplerLoc, 2);
+    s_gles2.glUseProgram(currProgram);
+
     createYUVGLFullscreenQuad(&mVbuf, &mIbuf, width, ywidth);
+
+    if (!canUseGLES3()) {
+        return;
+    }
+
+    GLint currVao = 0;
+    s_gles2.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &currVao);
+    s_gles2.glGenVertexArrays(1, &mVao);
+    s_gles2.glBindVertexArray(mVao);
+    setupYUVGLVertexAttribs(mInCoordLoc, mPosLoc, mVbuf);
+    s_gles2.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbuf);
+    s_gles2.glBindVertexArray(currVao);
+
+    mUploadBufferSize = totalSize;
+    for (auto& buffer : mUploadRing) {
+        s_gles2.glGenBuffers(1, &buffer.pbo);
+        s_gles2.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+        s_gles2.glBufferData(GL_PIXEL_UNPACK_BUFFER, mUploadBufferSize,
+                             nullptr, GL_STREAM_DRAW);
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 void YUVConverter::saveGLState() {
     s_gles2.glGetFloatv(GL_VIEWPORT, mCurrViewport);
     s_gles2.glGetIntegerv(GL_ACTIVE_TEXTURE, &mCurrTexUnit);
-    s_gles2.glGetIntegerv(GL_TEXTURE_BINDING_2D, &mCurrTexBind);
     s_gles2.glGetIntegerv(GL_CURRENT_PROGRAM, &mCurrProgram);
-    s_gles2.glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &mCurrVbo);
-    s_gles2.glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &mCurrIbo);
+    if (mVao) {
+        s_gles2.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &mCurrVao);
+    } else {
+        s_gles2.glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &mCurrVbo);
+        s_gles2.glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &mCurrIbo);
+    }
 }
 
 void YUVConverter::restoreGLState() {
@@ -418,8 +558,49 @@ void YUVConverter::restoreGLState() {
                        mCurrViewport[2], mCurrViewport[3]);
     s_gles2.glActiveTexture(mCurrTexUnit);
     s_gles2.glUseProgram(mCurrProgram);
-    s_gles2.glBindBuffer(GL_ARRAY_BUFFER, mCurrVbo);
-    s_gles2.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mCurrIbo);
+    if (mVao) {
+        s_gles2.glBindVertexArray(mCurrVao);
+    } else {
+        s_gles2.glBindBuffer(GL_ARRAY_BUFFER, mCurrVbo);
+        s_gles2.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mCurrIbo);
+    }
+}
+
+const char* YUVConverter::stagePixels(const char* pixels, size_t size) {
+    if (!mUploadRing[0].pbo || size > mUploadBufferSize) {
+        return pixels;
+    }
+
+    UploadBuffer& buffer = mUploadRing[mNextUpload];
+    // Once the previous draw from this buffer is done, the driver doesn't
+    // need to synchronize the mapping with it.
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    if (buffer.fence) {
+        const GLenum status = s_gles2.glClientWaitSync(
+                buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, kUploadTimeoutNs);
+        if (status == GL_ALREADY_SIGNALED ||
+            status == GL_CONDITION_SATISFIED) {
+            access |= GL_MAP_UNSYNCHRONIZED_BIT;
+        }
+        s_gles2.glDeleteSync(buffer.fence);
+        buffer.fence = nullptr;
+    } else {
+        access |= GL_MAP_UNSYNCHRONIZED_BIT;
+    }
+
+    s_gles2.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+    void* dst = s_gles2.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                         access);
+    if (!dst) {
+        s_gles2.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return pixels;
+    }
+    memcpy(dst, pixels, size);
+    if (!s_gles2.glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        s_gles2.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return pixels;
+    }
+    return nullptr;
 }
 
 // drawConvert: per-frame updates.
@@ -433,6 +614,10 @@ void YUVConverter::drawConvert(int x, int y,
 
     s_gles2.glViewport(x, y, width, height);
 
+    uint32_t totalSize, yStride, cStride, cHeight;
+    totalSize = 0;
+    getYUVSizes(width, height, mFormat, &totalSize, &yStride, &cStride, &cHeight);
+
     uint32_t yoff, uoff, voff,
              ywidth, cwidth, cheight;
     getYUVOffsets(width, height, mFormat,
@@ -440,32 +625,51 @@ void YUVConverter::drawConvert(int x, int y,
                   &ywidth, &cwidth);
     cheight = height / 2;
 
-    subUpdateYUVGLTex(GL_TEXTURE0, mYtex,
-                      x, y, ywidth, height,
-                      pixels + yoff);
-    subUpdateYUVGLTex(GL_TEXTURE1, mUtex,
-                      x, y, cwidth, cheight,
-                      pixels + uoff);
-    subUpdateYUVGLTex(GL_TEXTURE2, mVtex,
-                      x, y, cwidth, cheight,
-                      pixels + voff);
+    // Planes come from an offset in the upload buffer if staged.
+    const char* src = stagePixels(pixels, totalSize);
+    const bool staged = src != pixels;
 
+    subUpdateYUVGLTex(GL_TEXTURE0, mYtex, GL_LUMINANCE,
+                      x, y, ywidth, height,
+                      src + yoff);
+    if (isSemiPlanar(mFormat)) {
+        subUpdateYUVGLTex(GL_TEXTURE1, mUtex, GL_LUMINANCE_ALPHA,
+                          x, y, cwidth, cheight,
+                          src + uoff);
+    } else {
+        subUpdateYUVGLTex(GL_TEXTURE1, mUtex, GL_LUMINANCE,
+                          x, y, cwidth, cheight,
+                          src + uoff);
+        subUpdateYUVGLTex(GL_TEXTURE2, mVtex, GL_LUMINANCE,
+                          x, y, cwidth, cheight,
+                          src + voff);
+    }
+    if (staged) {
+        s_gles2.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
 
     updateCutoffs(width, ywidth, width / 2, cwidth);
 
-    doYUVConversionDraw(mProgram,
-                        mYWidthCutoffLoc,
-                        mCWidthCutoffLoc,
-                        mYSamplerLoc,
-                        mUSamplerLoc,
-                        mVSamplerLoc,
+    s_gles2.glUseProgram(mProgram);
+    if (mYWidthCutoff != mProgramYWidthCutoff) {
+        s_gles2.glUniform1f(mYWidthCutoffLoc, mYWidthCutoff);
+        mProgramYWidthCutoff = mYWidthCutoff;
+    }
+    if (mCWidthCutoff != mProgramCWidthCutoff) {
+        s_gles2.glUniform1f(mCWidthCutoffLoc, mCWidthCutoff);
+        mProgramCWidthCutoff = mCWidthCutoff;
+    }
+
+    doYUVConversionDraw(mVao,
                         mInCoordLoc,
                         mPosLoc,
-                        mVbuf, mIbuf,
-                        width, ywidth,
-                        width / 2, cwidth,
-                        mYWidthCutoff,
-                        mCWidthCutoff);
+                        mVbuf, mIbuf);
+
+    if (staged) {
+        mUploadRing[mNextUpload].fence =
+                s_gles2.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mNextUpload = (mNextUpload + 1) % kUploadRingSize;
+    }
     restoreGLState();
 }
 
@@ -477,6 +681,8 @@ void YUVConverter::updateCutoffs(float width, float ywidth,
         mCWidthCutoff = ((float)halfwidth) / ((float)cwidth);
         break;
     case FRAMEWORK_FORMAT_YUV_420_888:
+    case FRAMEWORK_FORMAT_NV12:
+    case FRAMEWORK_FORMAT_NV21:
         mYWidthCutoff = 1.0f;
         mCWidthCutoff = 1.0f;
         break;
@@ -486,6 +692,11 @@ void YUVConverter::updateCutoffs(float width, float ywidth,
 }
 
 YUVConverter::~YUVConverter() {
+    for (auto& buffer : mUploadRing) {
+        if (buffer.fence) s_gles2.glDeleteSync(buffer.fence);
+        if (buffer.pbo) s_gles2.glDeleteBuffers(1, &buffer.pbo);
+    }
+    if (mVao) s_gles2.glDeleteVertexArrays(1, &mVao);
     if (mIbuf) s_gles2.glDeleteBuffers(1, &mIbuf);
     if (mVbuf) s_gles2.glDeleteBuffers(1, &mVbuf);
     if (mProgram) s_gles2.glDeleteProgram(mProgram);
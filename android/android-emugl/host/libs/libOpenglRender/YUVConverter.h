@@ -18,9 +18,12 @@
 
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
 
 #include "FrameworkFormats.h"
 
+#include <stddef.h>
+
 // The purpose of YUVConverter is to use
 // OpenGL shaders to convert YUV images to RGB
 // images that can be displayed on screen.
@@ -55,12 +58,19 @@ public:
 private:
     // For dealing with n-pixel-aligned buffers
     void updateCutoffs(float width, float ywidth, float halfwidth, float cwidth);
+    // Copies the |size| bytes of |pixels| to the next buffer of the upload
+    // ring, and returns the buffer offset to upload the planes from, with
+    // the buffer bound to GL_PIXEL_UNPACK_BUFFER. Returns |pixels| if
+    // there is no ring, or if the copy failed.
+    const char* stagePixels(const char* pixels, size_t size);
     FrameworkFormat mFormat;
     // We need the following GL objects:
     GLuint mProgram = 0;
     GLuint mVbuf = 0;
     GLuint mIbuf = 0;
+    GLuint mVao = 0;
     GLuint mYtex = 0;
+    // The interleaved chroma of semi-planar formats all goes to |mUtex|.
     GLuint mUtex = 0;
     GLuint mVtex = 0;
 
@@ -74,6 +84,22 @@ private:
     GLint mPosLoc = -1;
     float mYWidthCutoff = 1.0;
     float mCWidthCutoff = 1.0;
+    // The values last set in |mProgram|, which keeps them between draws.
+    float mProgramYWidthCutoff = -1.0;
+    float mProgramCWidthCutoff = -1.0;
+
+    // With GLES 3.0, frames go through a ring of pixel unpack buffers,
+    // so that the copy of a frame doesn't wait on the upload of the
+    // previous one. Each buffer is reused once the fence of the draw
+    // that last read from it is signaled.
+    static constexpr int kUploadRingSize = 3;
+    struct UploadBuffer {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+    };
+    UploadBuffer mUploadRing[kUploadRingSize];
+    size_t mUploadBufferSize = 0;
+    int mNextUpload = 0;
 
     // YUVConverter can end up being used
     // in a TextureDraw / subwindow context, and subsequently
@@ -81,14 +107,15 @@ private:
     // This section is so YUVConverter can be used in the middle
     // of any GL context without impacting what's
     // already going on there, by saving/restoring the state
-    // that it is impacting.
+    // that it is impacting. With a vertex array object, the vertex
+    // state is not part of it.
     void saveGLState();
     void restoreGLState();
     // Impacted state
     GLfloat mCurrViewport[4] = {};
     GLint mCurrTexUnit = 0;
     GLint mCurrProgram = 0;
-    GLint mCurrTexBind = 0;
+    GLint mCurrVao = 0;
     GLint mCurrVbo = 0;
     GLint mCurrIbo = 0;
 };
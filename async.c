@@ -270,6 +270,14 @@ aio_ctx_finalize(GSource     *source)
     }
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (ctx->linux_io_uring) {
+        luring_detach_aio_context(ctx->linux_io_uring, ctx);
+        luring_cleanup(ctx->linux_io_uring);
+        ctx->linux_io_uring = NULL;
+    }
+#endif
+
     qemu_mutex_lock(&ctx->bh_lock);
     while (ctx->first_bh) {
         QEMUBH *next = ctx->first_bh->next;
@@ -321,6 +329,19 @@ LinuxAioState *aio_get_linux_aio(AioContext *ctx)
 }
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+LuringState *aio_get_linux_io_uring(AioContext *ctx)
+{
+    if (!ctx->linux_io_uring) {
+        ctx->linux_io_uring = luring_init();
+        if (ctx->linux_io_uring) {
+            luring_attach_aio_context(ctx->linux_io_uring, ctx);
+        }
+    }
+    return ctx->linux_io_uring;
+}
+#endif
+
 void aio_notify(AioContext *ctx)
 {
     /* Write e.g. bh->scheduled before reading ctx->notify_me.  Pairs
@@ -380,6 +401,9 @@ AioContext *aio_context_new(Error **errp)
                            event_notifier_dummy_cb);
 #ifdef CONFIG_LINUX_AIO
     ctx->linux_aio = NULL;
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+    ctx->linux_io_uring = NULL;
 #endif
     ctx->thread_pool = NULL;
     qemu_mutex_init(&ctx->bh_lock);
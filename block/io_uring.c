@@ -0,0 +1,832 @@
+/*
+ * Linux io_uring support.
+ *
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "block/aio.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "block/block.h"
+#include "block/raw-aio.h"
+#include "qemu/event_notifier.h"
+#include "qemu/coroutine.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/*
+ * The io_uring ABI.
+ *
+ * This is a subset of linux/io_uring.h as of Linux 5.1, the first release
+ * with io_uring.  Our build sysroots predate it and liburing is not
+ * available, so talk to the kernel directly; like the aio_ring in
+ * linux-aio.c, the ABI is stable and only ever grows in reserved fields.
+ */
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup     425
+#define __NR_io_uring_enter     426
+#define __NR_io_uring_register  427
+#endif
+
+struct io_uring_sqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t rw_flags;
+    uint64_t user_data;
+    union {
+        uint16_t buf_index;
+        uint64_t __pad2[3];
+    };
+};
+
+struct io_uring_cqe {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+};
+
+struct io_sqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t flags;
+    uint32_t dropped;
+    uint32_t array;
+    uint32_t resv1;
+    uint64_t resv2;
+};
+
+struct io_cqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t overflow;
+    uint32_t cqes;
+    uint64_t resv[2];
+};
+
+struct io_uring_params {
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t flags;
+    uint32_t sq_thread_cpu;
+    uint32_t sq_thread_idle;
+    uint32_t resv[5];
+    struct io_sqring_offsets sq_off;
+    struct io_cqring_offsets cq_off;
+};
+
+#define IORING_OP_READV             1
+#define IORING_OP_WRITEV            2
+#define IORING_OP_READ_FIXED        4
+#define IORING_OP_WRITE_FIXED       5
+
+#define IORING_OFF_SQ_RING          0ULL
+#define IORING_OFF_CQ_RING          0x8000000ULL
+#define IORING_OFF_SQES             0x10000000ULL
+
+#define IORING_REGISTER_BUFFERS     0
+#define IORING_UNREGISTER_BUFFERS   1
+#define IORING_REGISTER_EVENTFD     4
+
+/*
+ * Queue size (per-AioContext).  The completion ring is twice as large and
+ * we never have more than MAX_ENTRIES requests in flight, so completions
+ * cannot overflow.
+ */
+#define MAX_ENTRIES 128
+
+/* The kernel limits each registered buffer to 1 GB and to UIO_MAXIOV
+ * buffers per ring.
+ */
+#define FIXED_BUF_MAX_SIZE  (1ULL << 30)
+#define FIXED_BUF_MAX_COUNT 1024
+
+typedef struct LuringAIOCB {
+    Coroutine *co;
+    ssize_t ret;
+    QEMUIOVector *qiov;
+    bool is_read;
+    int fd;
+    uint64_t offset;
+    QSIMPLEQ_ENTRY(LuringAIOCB) next;
+
+    /* Short reads are resubmitted for the remainder, which is described
+     * by @resubmit_qiov.
+     */
+    size_t total_read;
+    QEMUIOVector resubmit_qiov;
+} LuringAIOCB;
+
+typedef struct {
+    int plugged;
+    unsigned int in_queue;
+    unsigned int in_flight;
+    bool blocked;
+    QSIMPLEQ_HEAD(, LuringAIOCB) pending;
+} LuringQueue;
+
+typedef struct {
+    void *host;
+    size_t size;
+} LuringFixedBuf;
+
+struct LuringState {
+    AioContext *aio_context;
+
+    int ring_fd;
+    EventNotifier e;
+
+    /* Submission ring */
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+
+    /* Completion ring */
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* io queue for submit at batch */
+    LuringQueue io_q;
+
+    /* I/O completion processing */
+    QEMUBH *completion_bh;
+
+    /* Resubmission of what the kernel could not take (EAGAIN/EBUSY) when
+     * nothing in flight is going to kick us
+     */
+    QEMUBH *retry_bh;
+
+    /* Guest RAM registered with this ring, sorted by address.  Only once a
+     * drive asked for it with luring_enable_fixed_buffers().
+     */
+    bool use_fixed;
+    LuringFixedBuf *fixed;
+    unsigned int nb_fixed;
+    unsigned int fixed_gen;
+};
+
+/*
+ * Guest RAM that can be registered with the rings.  RAM blocks come and go
+ * under the BQL while the rings live in whatever thread runs their
+ * AioContext, so each ring takes a private copy whenever @gen moves.
+ */
+static struct {
+    QemuMutex lock;
+    GArray *bufs;
+    unsigned int gen;
+    /* rings with guest RAM registered */
+    unsigned int nb_fixed_rings;
+} luring_ram;
+
+static bool luring_unsupported;
+
+static void __attribute__((constructor)) luring_ram_init(void)
+{
+    qemu_mutex_init(&luring_ram.lock);
+    luring_ram.bufs = g_array_new(false, false, sizeof(LuringFixedBuf));
+}
+
+static int luring_ram_cmp(gconstpointer a, gconstpointer b)
+{
+    const LuringFixedBuf *x = a, *y = b;
+
+    return x->host < y->host ? -1 : x->host > y->host;
+}
+
+void luring_register_ram(void *host, size_t size)
+{
+    LuringFixedBuf buf;
+    size_t done;
+
+    qemu_mutex_lock(&luring_ram.lock);
+    for (done = 0; done < size; done += buf.size) {
+        buf.host = host + done;
+        buf.size = MIN(size - done, FIXED_BUF_MAX_SIZE);
+        g_array_append_val(luring_ram.bufs, buf);
+    }
+    g_array_sort(luring_ram.bufs, luring_ram_cmp);
+    atomic_inc(&luring_ram.gen);
+    qemu_mutex_unlock(&luring_ram.lock);
+}
+
+/*
+ * Called with the BQL held, before the RAM block is unmapped.  New
+ * requests stop using the registered buffers as soon as @gen moves, but
+ * fixed requests already in flight may still target the block, so wait
+ * for them.  The rings drop their registration on their next submission.
+ */
+void luring_unregister_ram(void *host, size_t size)
+{
+    unsigned int i;
+
+    qemu_mutex_lock(&luring_ram.lock);
+    for (i = luring_ram.bufs->len; i-- > 0; ) {
+        LuringFixedBuf *buf = &g_array_index(luring_ram.bufs,
+                                             LuringFixedBuf, i);
+        if (buf->host >= host && buf->host < host + size) {
+            g_array_remove_index(luring_ram.bufs, i);
+        }
+    }
+    atomic_inc(&luring_ram.gen);
+    qemu_mutex_unlock(&luring_ram.lock);
+
+    if (atomic_read(&luring_ram.nb_fixed_rings)) {
+        bdrv_drain_all();
+    }
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg,
+                             unsigned int nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void luring_drop_fixed(LuringState *s)
+{
+    if (s->nb_fixed) {
+        io_uring_register(s->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        s->nb_fixed = 0;
+        atomic_dec(&luring_ram.nb_fixed_rings);
+    }
+}
+
+/* Returns how much guest RAM a ring may pin, from RLIMIT_MEMLOCK. */
+static uint64_t luring_fixed_budget(void)
+{
+    struct rlimit rlim;
+
+    if (getrlimit(RLIMIT_MEMLOCK, &rlim) < 0) {
+        return 0;
+    }
+    return rlim.rlim_cur == RLIM_INFINITY ? UINT64_MAX : rlim.rlim_cur;
+}
+
+/*
+ * Re-registers guest RAM with the ring if it changed since last time.  The
+ * kernel pins registered pages, so only as much RAM as RLIMIT_MEMLOCK
+ * allows is registered, and requests elsewhere simply use the vectored
+ * opcodes.  Must only be called with nothing in flight, as in-flight fixed
+ * requests refer to the buffer indices.
+ */
+static void luring_update_fixed(LuringState *s)
+{
+    unsigned int gen = atomic_read(&luring_ram.gen);
+    uint64_t budget;
+    struct iovec *iov;
+    unsigned int i, n;
+
+    if (!s->use_fixed || gen == s->fixed_gen) {
+        return;
+    }
+    luring_drop_fixed(s);
+
+    budget = luring_fixed_budget();
+    qemu_mutex_lock(&luring_ram.lock);
+    s->fixed_gen = luring_ram.gen;
+    s->fixed = g_renew(LuringFixedBuf, s->fixed, luring_ram.bufs->len);
+    n = 0;
+    for (i = 0; i < luring_ram.bufs->len && n < FIXED_BUF_MAX_COUNT; i++) {
+        LuringFixedBuf *buf = &g_array_index(luring_ram.bufs,
+                                             LuringFixedBuf, i);
+        if (buf->size <= budget) {
+            budget -= buf->size;
+            s->fixed[n++] = *buf;
+        }
+    }
+    qemu_mutex_unlock(&luring_ram.lock);
+
+    if (n == 0) {
+        return;
+    }
+    iov = g_new(struct iovec, n);
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = s->fixed[i].host;
+        iov[i].iov_len = s->fixed[i].size;
+    }
+    if (io_uring_register(s->ring_fd, IORING_REGISTER_BUFFERS, iov, n) == 0) {
+        s->nb_fixed = n;
+        atomic_inc(&luring_ram.nb_fixed_rings);
+    }
+    g_free(iov);
+}
+
+void luring_enable_fixed_buffers(LuringState *s)
+{
+    s->use_fixed = true;
+}
+
+/* Returns the index of the registered buffer covering [base, base + len),
+ * or -1.
+ */
+static int luring_find_fixed(LuringState *s, void *base, size_t len)
+{
+    unsigned int lo = 0, hi = s->nb_fixed;
+
+    /* Guest RAM changed since the registration, which may now point to
+     * memory that is going away.
+     */
+    if (s->fixed_gen != atomic_read(&luring_ram.gen)) {
+        return -1;
+    }
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        LuringFixedBuf *buf = &s->fixed[mid];
+
+        if (base < buf->host) {
+            hi = mid;
+        } else if (base >= buf->host + buf->size) {
+            lo = mid + 1;
+        } else {
+            return base + len <= buf->host + buf->size ? mid : -1;
+        }
+    }
+    return -1;
+}
+
+static void ioq_submit(LuringState *s);
+
+/* Returns the number of requests in the submission ring that the kernel
+ * did not take yet.
+ */
+static unsigned int luring_sq_unsubmitted(LuringState *s)
+{
+    return *s->sq_tail - atomic_load_acquire(s->sq_head);
+}
+
+static void luring_resubmit(LuringState *s, LuringAIOCB *luringcb)
+{
+    QSIMPLEQ_INSERT_TAIL(&s->io_q.pending, luringcb, next);
+    s->io_q.in_queue++;
+}
+
+/*
+ * Completes an io_uring request: retries it if it was interrupted or came
+ * back short, otherwise wakes up the submitting coroutine.
+ */
+static void luring_process_completion(LuringState *s, LuringAIOCB *luringcb,
+                                      int ret)
+{
+    QEMUIOVector *qiov = luringcb->qiov;
+
+    if (ret == -EINTR || ret == -EAGAIN) {
+        luring_resubmit(s, luringcb);
+        return;
+    }
+
+    if (ret > 0 && luringcb->is_read &&
+        luringcb->total_read + ret < qiov->size) {
+        /* Buffered reads may stop short of EOF, go for the rest */
+        luringcb->total_read += ret;
+        luringcb->offset += ret;
+        if (!luringcb->resubmit_qiov.iov) {
+            qemu_iovec_init(&luringcb->resubmit_qiov, qiov->niov);
+        }
+        qemu_iovec_reset(&luringcb->resubmit_qiov);
+        qemu_iovec_concat(&luringcb->resubmit_qiov, qiov,
+                          luringcb->total_read,
+                          qiov->size - luringcb->total_read);
+        luring_resubmit(s, luringcb);
+        return;
+    }
+
+    if (ret >= 0) {
+        if (luringcb->total_read + ret == qiov->size) {
+            ret = 0;
+        } else if (luringcb->is_read) {
+            /* Short reads mean EOF, pad with zeros. */
+            qemu_iovec_memset(qiov, luringcb->total_read + ret, 0,
+                              qiov->size - luringcb->total_read - ret);
+            ret = 0;
+        } else {
+            ret = -ENOSPC;
+        }
+    }
+
+    if (luringcb->resubmit_qiov.iov) {
+        qemu_iovec_destroy(&luringcb->resubmit_qiov);
+    }
+
+    luringcb->ret = ret;
+    /* If the coroutine is already entered it must be in ioq_submit() and
+     * will notice luringcb->ret has been filled in when it eventually runs
+     * later.  Coroutines cannot be entered recursively so avoid doing that!
+     */
+    if (!qemu_coroutine_entered(luringcb->co)) {
+        qemu_coroutine_enter(luringcb->co);
+    }
+}
+
+/**
+ * luring_process_completions:
+ * @s: io_uring state
+ *
+ * Reaps completed requests straight from the shared completion ring, with
+ * no system call, and invokes their callbacks.
+ *
+ * Nested event loops are supported the same way as in linux-aio.c: the
+ * ring head is advanced before each callback runs, and the completion BH
+ * stays scheduled while we are in here so that a nested aio_poll() can
+ * pick up the remaining completions.
+ */
+static void luring_process_completions(LuringState *s)
+{
+    /* Reschedule so nested event loops see currently pending completions */
+    qemu_bh_schedule(s->completion_bh);
+
+    for (;;) {
+        unsigned int head = *s->cq_head;
+        struct io_uring_cqe *cqe;
+        LuringAIOCB *luringcb;
+        int ret;
+
+        if (head == atomic_load_acquire(s->cq_tail)) {
+            break;
+        }
+        cqe = &s->cqes[head & s->cq_mask];
+        luringcb = (LuringAIOCB *)(uintptr_t)cqe->user_data;
+        ret = cqe->res;
+        atomic_store_release(s->cq_head, head + 1);
+
+        /* Change counters one-by-one because we can be nested. */
+        s->io_q.in_flight--;
+        luring_process_completion(s, luringcb, ret);
+    }
+
+    qemu_bh_cancel(s->completion_bh);
+}
+
+static void luring_process_completions_and_submit(LuringState *s)
+{
+    luring_process_completions(s);
+    if (!s->io_q.plugged &&
+        (!QSIMPLEQ_EMPTY(&s->io_q.pending) || luring_sq_unsubmitted(s))) {
+        ioq_submit(s);
+    }
+}
+
+static void luring_retry_bh(void *opaque)
+{
+    LuringState *s = opaque;
+
+    ioq_submit(s);
+}
+
+static void luring_completion_bh(void *opaque)
+{
+    LuringState *s = opaque;
+
+    luring_process_completions_and_submit(s);
+}
+
+static void luring_completion_cb(EventNotifier *e)
+{
+    LuringState *s = container_of(e, LuringState, e);
+
+    if (event_notifier_test_and_clear(&s->e)) {
+        luring_process_completions_and_submit(s);
+    }
+}
+
+static void ioq_init(LuringQueue *io_q)
+{
+    QSIMPLEQ_INIT(&io_q->pending);
+    io_q->plugged = 0;
+    io_q->in_queue = 0;
+    io_q->in_flight = 0;
+    io_q->blocked = false;
+}
+
+/* Fills @sqe for @luringcb, using a registered buffer when the request is
+ * a single contiguous chunk of guest RAM.
+ */
+static void luring_prep_sqe(LuringState *s, LuringAIOCB *luringcb,
+                            struct io_uring_sqe *sqe)
+{
+    QEMUIOVector *qiov = luringcb->resubmit_qiov.iov ?
+                         &luringcb->resubmit_qiov : luringcb->qiov;
+    int idx = -1;
+
+    if (qiov->niov == 1) {
+        idx = luring_find_fixed(s, qiov->iov[0].iov_base,
+                                qiov->iov[0].iov_len);
+    }
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = luringcb->fd;
+    sqe->off = luringcb->offset;
+    sqe->user_data = (uintptr_t)luringcb;
+    if (idx >= 0) {
+        sqe->opcode = luringcb->is_read ? IORING_OP_READ_FIXED
+                                        : IORING_OP_WRITE_FIXED;
+        sqe->addr = (uintptr_t)qiov->iov[0].iov_base;
+        sqe->len = qiov->iov[0].iov_len;
+        sqe->buf_index = idx;
+    } else {
+        sqe->opcode = luringcb->is_read ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = (uintptr_t)qiov->iov;
+        sqe->len = qiov->niov;
+    }
+}
+
+/*
+ * Takes back the requests that the kernel did not consume from the
+ * submission ring, and fails them with @ret.
+ */
+static void luring_fail_unsubmitted(LuringState *s, int ret)
+{
+    LuringAIOCB *failed[MAX_ENTRIES];
+    unsigned int head = atomic_load_acquire(s->sq_head);
+    unsigned int tail = *s->sq_tail;
+    unsigned int i, n = 0;
+
+    for (; head != tail; head++) {
+        struct io_uring_sqe *sqe = &s->sqes[s->sq_array[head & s->sq_mask]];
+
+        failed[n++] = (LuringAIOCB *)(uintptr_t)sqe->user_data;
+    }
+    /* Without SQPOLL, the kernel only looks at the ring from
+     * io_uring_enter(), so the entries can be taken back.
+     */
+    atomic_store_release(s->sq_tail, atomic_load_acquire(s->sq_head));
+
+    for (i = 0; i < n; i++) {
+        s->io_q.in_flight--;
+        luring_process_completion(s, failed[i], ret);
+    }
+}
+
+/*
+ * Moves as many pending requests as possible into the submission ring and
+ * hands them to the kernel with a single io_uring_enter().
+ */
+static void ioq_submit(LuringState *s)
+{
+    unsigned int tail, queued, unsubmitted;
+    LuringAIOCB *luringcb;
+    int ret;
+
+    if (s->io_q.in_flight == 0) {
+        luring_update_fixed(s);
+    }
+
+    tail = *s->sq_tail;
+    queued = 0;
+    while (!QSIMPLEQ_EMPTY(&s->io_q.pending) &&
+           s->io_q.in_flight < MAX_ENTRIES &&
+           tail - atomic_load_acquire(s->sq_head) < MAX_ENTRIES) {
+        unsigned int idx = tail & s->sq_mask;
+
+        luringcb = QSIMPLEQ_FIRST(&s->io_q.pending);
+        QSIMPLEQ_REMOVE_HEAD(&s->io_q.pending, next);
+        luring_prep_sqe(s, luringcb, &s->sqes[idx]);
+        s->sq_array[idx] = idx;
+        tail++;
+        queued++;
+        s->io_q.in_queue--;
+        s->io_q.in_flight++;
+    }
+    atomic_store_release(s->sq_tail, tail);
+
+    /* Anything the kernel could not take last time (EAGAIN/EBUSY) is
+     * still in the ring, so submit everything between head and tail.
+     */
+    do {
+        ret = syscall(__NR_io_uring_enter, s->ring_fd,
+                      luring_sq_unsubmitted(s), 0, 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0 && errno != EAGAIN && errno != EBUSY) {
+        /* Like linux-aio, fail what could not be submitted */
+        luring_fail_unsubmitted(s, -errno);
+    }
+
+    unsubmitted = luring_sq_unsubmitted(s);
+    s->io_q.blocked = (s->io_q.in_queue > 0 || unsubmitted > 0);
+    if (unsubmitted > 0 && s->io_q.in_flight == unsubmitted) {
+        /* The kernel took nothing that will complete and get us here
+         * again, so retry from the event loop.
+         */
+        qemu_bh_schedule(s->retry_bh);
+    }
+
+    if (s->io_q.in_flight) {
+        /* We can try to complete something just right away if there are
+         * still requests in-flight.  Requests that come back for another
+         * round are picked up from the completion callback.
+         */
+        luring_process_completions(s);
+    }
+}
+
+void luring_io_plug(BlockDriverState *bs, LuringState *s)
+{
+    s->io_q.plugged++;
+}
+
+void luring_io_unplug(BlockDriverState *bs, LuringState *s)
+{
+    assert(s->io_q.plugged);
+    if (--s->io_q.plugged == 0 &&
+        !s->io_q.blocked && !QSIMPLEQ_EMPTY(&s->io_q.pending)) {
+        ioq_submit(s);
+    }
+}
+
+int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
+                                  uint64_t offset, QEMUIOVector *qiov, int type)
+{
+    LuringAIOCB luringcb = {
+        .co         = qemu_coroutine_self(),
+        .ret        = -EINPROGRESS,
+        .qiov       = qiov,
+        .is_read    = (type == QEMU_AIO_READ),
+        .fd         = fd,
+        .offset     = offset,
+    };
+
+    switch (type) {
+    case QEMU_AIO_READ:
+    case QEMU_AIO_WRITE:
+        break;
+    default:
+        fprintf(stderr, "%s: invalid AIO request type 0x%x.\n",
+                        __func__, type);
+        return -EIO;
+    }
+
+    QSIMPLEQ_INSERT_TAIL(&s->io_q.pending, &luringcb, next);
+    s->io_q.in_queue++;
+    if (!s->io_q.blocked &&
+        (!s->io_q.plugged ||
+         s->io_q.in_flight + s->io_q.in_queue >= MAX_ENTRIES)) {
+        ioq_submit(s);
+    }
+
+    if (luringcb.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return luringcb.ret;
+}
+
+void luring_detach_aio_context(LuringState *s, AioContext *old_context)
+{
+    aio_set_event_notifier(old_context, &s->e, false, NULL);
+    qemu_bh_delete(s->completion_bh);
+    qemu_bh_delete(s->retry_bh);
+}
+
+void luring_attach_aio_context(LuringState *s, AioContext *new_context)
+{
+    s->aio_context = new_context;
+    s->completion_bh = aio_bh_new(new_context, luring_completion_bh, s);
+    s->retry_bh = aio_bh_new(new_context, luring_retry_bh, s);
+    aio_set_event_notifier(new_context, &s->e, false,
+                           luring_completion_cb);
+}
+
+/*
+ * Returns whether the host kernel supports io_uring, as luring_init()
+ * needs it.  The answer is cached.
+ */
+bool luring_supported(void)
+{
+    static int supported = -1;
+    struct io_uring_params p;
+    EventNotifier e;
+    int fd, efd;
+
+    if (supported >= 0) {
+        return supported;
+    }
+    supported = 0;
+    memset(&p, 0, sizeof(p));
+    fd = syscall(__NR_io_uring_setup, 1, &p);
+    if (fd < 0) {
+        return false;
+    }
+    if (event_notifier_init(&e, false) == 0) {
+        efd = event_notifier_get_fd(&e);
+        supported = io_uring_register(fd, IORING_REGISTER_EVENTFD,
+                                      &efd, 1) == 0;
+        event_notifier_cleanup(&e);
+    }
+    close(fd);
+    return supported;
+}
+
+/*
+ * Returns NULL if the host kernel has no io_uring (before Linux 5.2, which
+ * added eventfd registration, or when it is disabled by policy); callers
+ * then fall back to the thread pool.
+ */
+LuringState *luring_init(void)
+{
+    struct io_uring_params p;
+    LuringState *s;
+    int efd;
+
+    if (atomic_read(&luring_unsupported)) {
+        return NULL;
+    }
+
+    s = g_malloc0(sizeof(*s));
+    memset(&p, 0, sizeof(p));
+    s->ring_fd = syscall(__NR_io_uring_setup, MAX_ENTRIES, &p);
+    if (s->ring_fd < 0) {
+        atomic_set(&luring_unsupported, true);
+        goto out_free_state;
+    }
+
+    s->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    s->sq_ptr = mmap(NULL, s->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, s->ring_fd,
+                     IORING_OFF_SQ_RING);
+    if (s->sq_ptr == MAP_FAILED) {
+        goto out_close_ring;
+    }
+    s->sq_head = s->sq_ptr + p.sq_off.head;
+    s->sq_tail = s->sq_ptr + p.sq_off.tail;
+    s->sq_mask = *(unsigned int *)(s->sq_ptr + p.sq_off.ring_mask);
+    s->sq_array = s->sq_ptr + p.sq_off.array;
+
+    s->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   s->ring_fd, IORING_OFF_SQES);
+    if (s->sqes == MAP_FAILED) {
+        goto out_unmap_sq;
+    }
+
+    s->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    s->cq_ptr = mmap(NULL, s->cq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, s->ring_fd,
+                     IORING_OFF_CQ_RING);
+    if (s->cq_ptr == MAP_FAILED) {
+        goto out_unmap_sqes;
+    }
+    s->cq_head = s->cq_ptr + p.cq_off.head;
+    s->cq_tail = s->cq_ptr + p.cq_off.tail;
+    s->cq_mask = *(unsigned int *)(s->cq_ptr + p.cq_off.ring_mask);
+    s->cqes = s->cq_ptr + p.cq_off.cqes;
+
+    if (event_notifier_init(&s->e, false) < 0) {
+        goto out_unmap_cq;
+    }
+    efd = event_notifier_get_fd(&s->e);
+    if (io_uring_register(s->ring_fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+        atomic_set(&luring_unsupported, true);
+        goto out_close_efd;
+    }
+
+    /* Nothing is registered yet, make the first submission pick up RAM */
+    s->fixed_gen = atomic_read(&luring_ram.gen) - 1;
+    ioq_init(&s->io_q);
+
+    return s;
+
+out_close_efd:
+    event_notifier_cleanup(&s->e);
+out_unmap_cq:
+    munmap(s->cq_ptr, s->cq_size);
+out_unmap_sqes:
+    munmap(s->sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+out_unmap_sq:
+    munmap(s->sq_ptr, s->sq_size);
+out_close_ring:
+    close(s->ring_fd);
+out_free_state:
+    g_free(s);
+    return NULL;
+}
+
+void luring_cleanup(LuringState *s)
+{
+    event_notifier_cleanup(&s->e);
+    munmap(s->cq_ptr, s->cq_size);
+    munmap(s->sqes, MAX_ENTRIES * sizeof(struct io_uring_sqe));
+    munmap(s->sq_ptr, s->sq_size);
+    luring_drop_fixed(s);
+    close(s->ring_fd);
+    g_free(s->fixed);
+    g_free(s);
+}
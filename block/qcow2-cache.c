@@ -25,14 +25,33 @@
 #include "qemu/osdep.h"
 #include "block/block_int.h"
 #include "qemu-common.h"
+#include "qemu/host-utils.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * The cache is sized adaptively between @min_size and @size tables: every
+ * ADAPT_WINDOW lookups it grows when too many of them missed, and gives
+ * back tables that went unused for a whole window when almost everything
+ * hits.  Tables beyond the current size are kept on a spare list and their
+ * memory is released.
+ */
+#define ADAPT_WINDOW            256
+#define ADAPT_GROW_MISS_PCT     5
+#define ADAPT_SHRINK_MISS_PCT   1
+
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    bool     prefetched;
+
+    /* Next entry in the same hash bucket, or in the spare list */
+    int      hash_next;
+    /* Unreferenced entries are kept on a LRU list, least recent first */
+    int      lru_prev;
+    int      lru_next;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -43,6 +62,26 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    /* offset -> entry index, chained through Qcow2CachedTable.hash_next */
+    int                    *buckets;
+    unsigned                bucket_mask;
+
+    int                     lru_head;
+    int                     lru_tail;
+
+    int                     min_size;
+    int                     cur_size;
+    int                     spare;
+
+    unsigned                window_lookups;
+    unsigned                window_misses;
+    uint64_t                window_lru_counter;
+
+    uint64_t                hits;
+    uint64_t                misses;
+    uint64_t                prefetches;
+    uint64_t                prefetch_hits;
 };
 
 static inline void *qcow2_cache_get_table_addr(BlockDriverState *bs,
@@ -80,6 +119,102 @@ static void qcow2_cache_table_release(BlockDriverState *bs, Qcow2Cache *c,
 #endif
 }
 
+static inline unsigned qcow2_cache_bucket(BlockDriverState *bs, Qcow2Cache *c,
+                                          uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t n = offset >> s->cluster_bits;
+
+    return (n ^ (n >> 16)) & c->bucket_mask;
+}
+
+static int qcow2_cache_lookup(BlockDriverState *bs, Qcow2Cache *c,
+                              uint64_t offset)
+{
+    int i;
+
+    for (i = c->buckets[qcow2_cache_bucket(bs, c, offset)]; i >= 0;
+         i = c->entries[i].hash_next) {
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void qcow2_cache_hash_insert(BlockDriverState *bs, Qcow2Cache *c, int i)
+{
+    unsigned b = qcow2_cache_bucket(bs, c, c->entries[i].offset);
+
+    c->entries[i].hash_next = c->buckets[b];
+    c->buckets[b] = i;
+}
+
+/* Forgets the table cached in entry @i, if any */
+static void qcow2_cache_hash_remove(BlockDriverState *bs, Qcow2Cache *c, int i)
+{
+    int *p;
+
+    if (!c->entries[i].offset) {
+        return;
+    }
+    p = &c->buckets[qcow2_cache_bucket(bs, c, c->entries[i].offset)];
+    while (*p != i) {
+        assert(*p >= 0);
+        p = &c->entries[*p].hash_next;
+    }
+    *p = c->entries[i].hash_next;
+    c->entries[i].hash_next = -1;
+    c->entries[i].offset = 0;
+    c->entries[i].prefetched = false;
+}
+
+static void qcow2_cache_lru_unlink(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->lru_prev >= 0) {
+        c->entries[t->lru_prev].lru_next = t->lru_next;
+    } else {
+        c->lru_head = t->lru_next;
+    }
+    if (t->lru_next >= 0) {
+        c->entries[t->lru_next].lru_prev = t->lru_prev;
+    } else {
+        c->lru_tail = t->lru_prev;
+    }
+    t->lru_prev = t->lru_next = -1;
+}
+
+static void qcow2_cache_lru_push_tail(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    t->lru_prev = c->lru_tail;
+    t->lru_next = -1;
+    if (c->lru_tail >= 0) {
+        c->entries[c->lru_tail].lru_next = i;
+    } else {
+        c->lru_head = i;
+    }
+    c->lru_tail = i;
+}
+
+/* Empty entries go first so that they are reused before anything else */
+static void qcow2_cache_lru_push_head(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    t->lru_prev = -1;
+    t->lru_next = c->lru_head;
+    if (c->lru_head >= 0) {
+        c->entries[c->lru_head].lru_prev = i;
+    } else {
+        c->lru_tail = i;
+    }
+    c->lru_head = i;
+}
+
 static inline bool can_clean_entry(Qcow2Cache *c, int i)
 {
     Qcow2CachedTable *t = &c->entries[i];
@@ -100,8 +235,10 @@ void qcow2_cache_clean_unused(BlockDriverState *bs, Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
+            qcow2_cache_hash_remove(bs, c, i);
             c->entries[i].lru_counter = 0;
+            qcow2_cache_lru_unlink(c, i);
+            qcow2_cache_lru_push_head(c, i);
             i++;
             to_clean++;
         }
@@ -114,22 +251,49 @@ void qcow2_cache_clean_unused(BlockDriverState *bs, Qcow2Cache *c)
     c->cache_clean_lru_counter = c->lru_counter;
 }
 
-Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables)
+Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
+                               int min_tables)
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    unsigned num_buckets = pow2ceil(num_tables);
+    int i;
 
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
+    c->min_size = MIN(min_tables, num_tables);
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->buckets = g_try_new(int, num_buckets);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * s->cluster_size);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->buckets || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->buckets);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    c->bucket_mask = num_buckets - 1;
+    for (i = 0; i < num_buckets; i++) {
+        c->buckets[i] = -1;
+    }
+
+    /* Start small, qcow2_cache_adapt() grows the cache if needed */
+    c->lru_head = c->lru_tail = -1;
+    c->spare = -1;
+    c->cur_size = c->min_size;
+    for (i = 0; i < num_tables; i++) {
+        c->entries[i].hash_next = -1;
+        c->entries[i].lru_prev = c->entries[i].lru_next = -1;
+    }
+    for (i = 0; i < c->cur_size; i++) {
+        qcow2_cache_lru_push_tail(c, i);
+    }
+    for (i = num_tables - 1; i >= c->cur_size; i--) {
+        c->entries[i].hash_next = c->spare;
+        c->spare = i;
     }
 
     return c;
@@ -144,6 +308,7 @@ int qcow2_cache_destroy(BlockDriverState *bs, Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->buckets);
     g_free(c->entries);
     g_free(c);
 
@@ -294,54 +459,100 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
+        qcow2_cache_hash_remove(bs, c, i);
         c->entries[i].lru_counter = 0;
     }
 
     qcow2_cache_table_release(bs, c, 0, c->size);
 
     c->lru_counter = 0;
+    c->window_lru_counter = 0;
 
     return 0;
 }
 
-static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
-    uint64_t offset, void **table, bool read_from_disk)
+static void qcow2_cache_grow(BlockDriverState *bs, Qcow2Cache *c, int n)
 {
-    BDRVQcow2State *s = bs->opaque;
-    int i;
-    int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
+    while (n-- > 0 && c->spare >= 0) {
+        int i = c->spare;
 
-    trace_qcow2_cache_get(qemu_coroutine_self(), c == s->l2_table_cache,
-                          offset, read_from_disk);
+        c->spare = c->entries[i].hash_next;
+        c->entries[i].hash_next = -1;
+        qcow2_cache_lru_push_head(c, i);
+        c->cur_size++;
+    }
+}
 
-    /* Check if the table is already cached */
-    i = lookup_index = (offset / s->cluster_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
+/* Gives back up to @n of the least recently used tables, stopping at the
+ * first one that was used during the last window.
+ */
+static void qcow2_cache_shrink(BlockDriverState *bs, Qcow2Cache *c, int n)
+{
+    while (n-- > 0 && c->cur_size > c->min_size && c->lru_head >= 0) {
+        int i = c->lru_head;
+
+        if (c->entries[i].offset &&
+            c->entries[i].lru_counter > c->window_lru_counter) {
+            break;
         }
-        if (++i == c->size) {
-            i = 0;
+        if (qcow2_cache_entry_flush(bs, c, i) < 0) {
+            break;
         }
-    } while (i != lookup_index);
+        qcow2_cache_lru_unlink(c, i);
+        qcow2_cache_hash_remove(bs, c, i);
+        c->entries[i].lru_counter = 0;
+        c->entries[i].hash_next = c->spare;
+        c->spare = i;
+        c->cur_size--;
+        qcow2_cache_table_release(bs, c, i, 1);
+    }
+}
+
+static void qcow2_cache_adapt(BlockDriverState *bs, Qcow2Cache *c, bool miss)
+{
+    BDRVQcow2State *s = bs->opaque;
+    unsigned miss_pct;
+    int old_size = c->cur_size;
+
+    c->window_misses += miss;
+    if (++c->window_lookups < ADAPT_WINDOW) {
+        return;
+    }
 
-    if (min_lru_index == -1) {
+    miss_pct = c->window_misses * 100 / c->window_lookups;
+    if (miss_pct >= ADAPT_GROW_MISS_PCT) {
+        qcow2_cache_grow(bs, c, MAX(c->cur_size / 2, 1));
+    } else if (miss_pct <= ADAPT_SHRINK_MISS_PCT) {
+        qcow2_cache_shrink(bs, c, c->cur_size / 4);
+    }
+    if (c->cur_size != old_size) {
+        trace_qcow2_cache_resize(qemu_coroutine_self(),
+                                 c == s->l2_table_cache, old_size,
+                                 c->cur_size);
+    }
+
+    c->window_lookups = 0;
+    c->window_misses = 0;
+    c->window_lru_counter = c->lru_counter;
+}
+
+/* Loads the table at @offset into the least recently used entry and returns
+ * the entry index, or -errno.  The entry is not referenced.
+ */
+static int qcow2_cache_load(BlockDriverState *bs, Qcow2Cache *c,
+                            uint64_t offset, bool read_from_disk)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i = c->lru_head;
+    int ret;
+
+    if (i < 0) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -352,7 +563,7 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_hash_remove(bs, c, i);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -367,15 +578,49 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     c->entries[i].offset = offset;
+    qcow2_cache_hash_insert(bs, c, i);
+
+    return i;
+}
+
+static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
+    uint64_t offset, void **table, bool read_from_disk)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i;
+    bool miss;
+
+    trace_qcow2_cache_get(qemu_coroutine_self(), c == s->l2_table_cache,
+                          offset, read_from_disk);
+
+    /* Check if the table is already cached */
+    i = qcow2_cache_lookup(bs, c, offset);
+    miss = i < 0;
+    if (miss) {
+        c->misses++;
+        i = qcow2_cache_load(bs, c, offset, read_from_disk);
+        if (i < 0) {
+            return i;
+        }
+    } else {
+        c->hits++;
+        if (c->entries[i].prefetched) {
+            c->prefetch_hits++;
+            c->entries[i].prefetched = false;
+        }
+    }
 
     /* And return the right table */
-found:
-    c->entries[i].ref++;
+    if (c->entries[i].ref++ == 0) {
+        qcow2_cache_lru_unlink(c, i);
+    }
     *table = qcow2_cache_get_table_addr(bs, c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
 
+    qcow2_cache_adapt(bs, c, miss);
+
     return 0;
 }
 
@@ -391,6 +636,31 @@ int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     return qcow2_cache_do_get(bs, c, offset, table, false);
 }
 
+int qcow2_cache_prefetch(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset)
+{
+    int i;
+
+    if (qcow2_cache_lookup(bs, c, offset) >= 0) {
+        return 0;
+    }
+    /* Don't push out a table that is about to be used for a guess */
+    if (c->lru_head < 0 || c->cur_size < 2) {
+        return -EBUSY;
+    }
+
+    i = qcow2_cache_load(bs, c, offset, true);
+    if (i < 0) {
+        return i;
+    }
+    c->prefetches++;
+    c->entries[i].prefetched = true;
+    c->entries[i].lru_counter = ++c->lru_counter;
+    qcow2_cache_lru_unlink(c, i);
+    qcow2_cache_lru_push_tail(c, i);
+
+    return 0;
+}
+
 void qcow2_cache_put(BlockDriverState *bs, Qcow2Cache *c, void **table)
 {
     int i = qcow2_cache_get_table_idx(bs, c, *table);
@@ -400,6 +670,7 @@ void qcow2_cache_put(BlockDriverState *bs, Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        qcow2_cache_lru_push_tail(c, i);
     }
 
     assert(c->entries[i].ref >= 0);
@@ -412,3 +683,25 @@ void qcow2_cache_entry_mark_dirty(BlockDriverState *bs, Qcow2Cache *c,
     assert(c->entries[i].offset != 0);
     c->entries[i].dirty = true;
 }
+
+Qcow2CacheInfo *qcow2_cache_get_info(BlockDriverState *bs, Qcow2Cache *c)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CacheInfo *info = g_new(Qcow2CacheInfo, 1);
+
+    *info = (Qcow2CacheInfo){
+        .hits           = c->hits,
+        .misses         = c->misses,
+        .prefetches     = c->prefetches,
+        .prefetch_hits  = c->prefetch_hits,
+        .size           = (int64_t) c->cur_size * s->cluster_size,
+        .max_size       = (int64_t) c->size * s->cluster_size,
+    };
+
+    return info;
+}
+
+bool qcow2_cache_used(Qcow2Cache *c)
+{
+    return c->hits || c->misses;
+}
@@ -162,6 +162,67 @@ static int l2_load(BlockDriverState *bs, uint64_t l2_offset,
                            (void **)l2_table);
 }
 
+typedef struct Qcow2L2Prefetch {
+    BlockDriverState *bs;
+    uint64_t l1_index;
+} Qcow2L2Prefetch;
+
+static void coroutine_fn l2_prefetch_entry(void *opaque)
+{
+    Qcow2L2Prefetch *p = opaque;
+    BlockDriverState *bs = p->bs;
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t l2_offset = 0;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&s->lock);
+    /* The L1 table may have changed while we waited for the lock */
+    if (p->l1_index < s->l1_size) {
+        l2_offset = s->l1_table[p->l1_index] & L1E_OFFSET_MASK;
+    }
+    if (l2_offset && !offset_into_cluster(s, l2_offset)) {
+        ret = qcow2_cache_prefetch(bs, s->l2_table_cache, l2_offset);
+    }
+    trace_qcow2_l2_prefetch(qemu_coroutine_self(), p->l1_index, l2_offset,
+                            ret);
+    s->l2_prefetch_pending = false;
+    qemu_co_mutex_unlock(&s->lock);
+
+    bdrv_dec_in_flight(bs);
+    g_free(p);
+}
+
+/*
+ * l2_prefetch_next
+ *
+ * Called on every L2 table lookup.  When a lookup moves on to the table
+ * right after the previous one, the guest is probably scanning the disk, so
+ * read the following table in a separate coroutine.  It waits for s->lock,
+ * so the load happens while the current request does its data I/O.
+ */
+static void l2_prefetch_next(BlockDriverState *bs, uint64_t l1_index)
+{
+    BDRVQcow2State *s = bs->opaque;
+    bool sequential = (l1_index == s->l2_last_l1_index + 1);
+    Qcow2L2Prefetch *p;
+
+    s->l2_last_l1_index = l1_index;
+    if (!sequential || s->l2_prefetch_pending || !qemu_in_coroutine() ||
+        l1_index + 1 >= s->l1_size ||
+        !(s->l1_table[l1_index + 1] & L1E_OFFSET_MASK)) {
+        return;
+    }
+
+    s->l2_prefetch_pending = true;
+    p = g_new(Qcow2L2Prefetch, 1);
+    *p = (Qcow2L2Prefetch) {
+        .bs         = bs,
+        .l1_index   = l1_index + 1,
+    };
+    bdrv_inc_in_flight(bs);
+    qemu_coroutine_enter(qemu_coroutine_create(l2_prefetch_entry, p));
+}
+
 /*
  * Writes one sector of the L1 table to the disk (can't update single entries
  * and we really don't want bdrv_pread to perform a read-modify-write)
@@ -532,6 +593,7 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
     if (ret < 0) {
         return ret;
     }
+    l2_prefetch_next(bs, l1_index);
 
     /* find the cluster offset for the given disk offset */
 
@@ -563,9 +563,14 @@ static void read_cache_sizes(BlockDriverState *bs, QemuOpts *opts,
         }
     } else {
         if (!l2_cache_size_set && !refcount_cache_size_set) {
-            *l2_cache_size = MAX(DEFAULT_L2_CACHE_BYTE_SIZE,
-                                 (uint64_t)DEFAULT_L2_CACHE_CLUSTERS
-                                 * s->cluster_size);
+            /* Allow the cache to grow up to the size needed to cover the
+             * whole image; it starts small and only grows on misses */
+            *l2_cache_size = MIN((uint64_t)s->l1_size * s->cluster_size,
+                                 DEFAULT_L2_CACHE_MAX_BYTE_SIZE);
+            *l2_cache_size = MAX(*l2_cache_size,
+                                 MAX(DEFAULT_L2_CACHE_BYTE_SIZE,
+                                     (uint64_t)DEFAULT_L2_CACHE_CLUSTERS
+                                     * s->cluster_size));
             *refcount_cache_size = *l2_cache_size
                                  / DEFAULT_L2_REFCOUNT_SIZE_RATIO;
         } else if (!l2_cache_size_set) {
@@ -597,6 +602,7 @@ static int qcow2_update_options_prepare(BlockDriverState *bs,
     const char *opt_overlap_check, *opt_overlap_check_template;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, refcount_cache_size;
+    int l2_cache_min, refcount_cache_min;
     int i;
     Error *local_err = NULL;
     int ret;
@@ -656,8 +662,13 @@ static int qcow2_update_options_prepare(BlockDriverState *bs,
         }
     }
 
-    r->l2_table_cache = qcow2_cache_create(bs, l2_cache_size);
-    r->refcount_block_cache = qcow2_cache_create(bs, refcount_cache_size);
+    l2_cache_min = MAX(DEFAULT_L2_CACHE_BYTE_SIZE / s->cluster_size,
+                       DEFAULT_L2_CACHE_CLUSTERS);
+    refcount_cache_min = MAX(l2_cache_min / DEFAULT_L2_REFCOUNT_SIZE_RATIO,
+                             MIN_REFCOUNT_CACHE_SIZE);
+    r->l2_table_cache = qcow2_cache_create(bs, l2_cache_size, l2_cache_min);
+    r->refcount_block_cache = qcow2_cache_create(bs, refcount_cache_size,
+                                                 refcount_cache_min);
     if (r->l2_table_cache == NULL || r->refcount_block_cache == NULL) {
         error_setg(errp, "Could not allocate metadata caches");
         ret = -ENOMEM;
@@ -2911,6 +2922,19 @@ static ImageInfoSpecific *qcow2_get_specific_info(BlockDriverState *bs)
         assert(false);
     }
 
+    /* Only report the caches once they have seen some I/O, a freshly
+     * opened image has nothing interesting to say */
+    if (qcow2_cache_used(s->l2_table_cache)) {
+        spec_info->u.qcow2.data->has_l2_cache = true;
+        spec_info->u.qcow2.data->l2_cache =
+            qcow2_cache_get_info(bs, s->l2_table_cache);
+    }
+    if (qcow2_cache_used(s->refcount_block_cache)) {
+        spec_info->u.qcow2.data->has_refcount_cache = true;
+        spec_info->u.qcow2.data->refcount_cache =
+            qcow2_cache_get_info(bs, s->refcount_block_cache);
+    }
+
     return spec_info;
 }
 
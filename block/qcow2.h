@@ -72,6 +72,9 @@
 #define DEFAULT_L2_CACHE_CLUSTERS 8 /* clusters */
 #define DEFAULT_L2_CACHE_BYTE_SIZE 1048576 /* bytes */
 
+/* Upper bound for the adaptive L2 cache when no size is given */
+#define DEFAULT_L2_CACHE_MAX_BYTE_SIZE (32 * 1048576) /* bytes */
+
 /* The refblock cache needs only a fourth of the L2 cache size to cover as many
  * clusters */
 #define DEFAULT_L2_REFCOUNT_SIZE_RATIO 4
@@ -243,6 +246,10 @@ typedef struct BDRVQcow2State {
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /* Sequential L2 table access detection for prefetching */
+    uint64_t l2_last_l1_index;
+    bool l2_prefetch_pending;
+
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
@@ -569,7 +576,8 @@ void qcow2_free_snapshots(BlockDriverState *bs);
 int qcow2_read_snapshots(BlockDriverState *bs);
 
 /* qcow2-cache.c functions */
-Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables);
+Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
+                               int min_tables);
 int qcow2_cache_destroy(BlockDriverState* bs, Qcow2Cache *c);
 
 void qcow2_cache_entry_mark_dirty(BlockDriverState *bs, Qcow2Cache *c,
@@ -588,5 +596,9 @@ int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
 void qcow2_cache_put(BlockDriverState *bs, Qcow2Cache *c, void **table);
+int qcow2_cache_prefetch(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset);
+
+Qcow2CacheInfo *qcow2_cache_get_info(BlockDriverState *bs, Qcow2Cache *c);
+bool qcow2_cache_used(Qcow2Cache *c);
 
 #endif
@@ -149,6 +149,8 @@ typedef struct BDRVRawState {
     bool has_write_zeroes:1;
     bool discard_zeroes:1;
     bool use_linux_aio:1;
+    bool use_linux_io_uring:1;
+    bool io_uring_fixed_buffers:1;
     bool has_fallocate;
     bool needs_alignment;
 } BDRVRawState;
@@ -408,7 +410,13 @@ static QemuOptsList raw_runtime_opts = {
         {
             .name = "aio",
             .type = QEMU_OPT_STRING,
-            .help = "host AIO implementation (threads, native)",
+            .help = "host AIO implementation (threads, native, io_uring)",
+        },
+        {
+            .name = "x-io-uring-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "let io_uring pin guest RAM to save page lookups "
+                    "(bounded by RLIMIT_MEMLOCK, default off)",
         },
         { /* end of list */ }
     },
@@ -441,9 +449,13 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         goto fail;
     }
 
-    aio_default = (bdrv_flags & BDRV_O_NATIVE_AIO)
-                  ? BLOCKDEV_AIO_OPTIONS_NATIVE
-                  : BLOCKDEV_AIO_OPTIONS_THREADS;
+    if (bdrv_flags & BDRV_O_NATIVE_AIO) {
+        aio_default = BLOCKDEV_AIO_OPTIONS_NATIVE;
+    } else if (bdrv_flags & BDRV_O_IO_URING) {
+        aio_default = BLOCKDEV_AIO_OPTIONS_IO_URING;
+    } else {
+        aio_default = BLOCKDEV_AIO_OPTIONS_THREADS;
+    }
     aio = qapi_enum_parse(BlockdevAioOptions_lookup, qemu_opt_get(opts, "aio"),
                           BLOCKDEV_AIO_OPTIONS__MAX, aio_default, &local_err);
     if (local_err) {
@@ -452,6 +464,10 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         goto fail;
     }
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
+    s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->io_uring_fixed_buffers = qemu_opt_get_bool(opts,
+                                                  "x-io-uring-fixed-buffers",
+                                                  false);
 
     s->open_flags = open_flags;
     raw_parse_flags(bdrv_flags, &s->open_flags);
@@ -485,6 +501,25 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     }
 #endif /* !defined(CONFIG_LINUX_AIO) */
 
+#ifdef CONFIG_LINUX_IO_URING
+    /* Older host kernels have no io_uring; fall back to linux-aio where it
+     * works, and to the thread pool otherwise.
+     */
+    if (s->use_linux_io_uring && !luring_supported()) {
+        s->use_linux_io_uring = false;
+#ifdef CONFIG_LINUX_AIO
+        s->use_linux_aio = !!(s->open_flags & O_DIRECT);
+#endif
+    }
+#else
+    if (s->use_linux_io_uring) {
+        error_setg(errp, "aio=io_uring was specified, but is not supported "
+                         "in this build.");
+        ret = -EINVAL;
+        goto fail;
+    }
+#endif
+
     s->has_discard = true;
     s->has_write_zeroes = true;
     bs->supported_zero_flags = BDRV_REQ_MAY_UNMAP;
@@ -1305,6 +1340,24 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, uint64_t offset,
         }
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    /* Unlike linux-aio, io_uring is asynchronous for buffered I/O as well,
+     * so only requests that need a bounce buffer go to the thread pool.
+     */
+    if (s->use_linux_io_uring && !(type & QEMU_AIO_MISALIGNED)) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        if (aio) {
+            assert(qiov->size == bytes);
+            if (s->io_uring_fixed_buffers) {
+                luring_enable_fixed_buffers(aio);
+            }
+            return luring_co_submit(bs, aio, s->fd, offset, qiov, type);
+        }
+        /* The host kernel has no io_uring, stick to the thread pool */
+        s->use_linux_io_uring = false;
+    }
+#endif
+
     return paio_submit_co(bs, s->fd, offset, qiov, bytes, type);
 }
 
@@ -1325,24 +1378,44 @@ static int coroutine_fn raw_co_pwritev(BlockDriverState *bs, uint64_t offset,
 
 static void raw_aio_plug(BlockDriverState *bs)
 {
-#ifdef CONFIG_LINUX_AIO
+#if defined(CONFIG_LINUX_AIO) || defined(CONFIG_LINUX_IO_URING)
     BDRVRawState *s = bs->opaque;
+#endif
+#ifdef CONFIG_LINUX_AIO
     if (s->use_linux_aio) {
         LinuxAioState *aio = aio_get_linux_aio(bdrv_get_aio_context(bs));
         laio_io_plug(bs, aio);
     }
 #endif
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        if (aio) {
+            luring_io_plug(bs, aio);
+        }
+    }
+#endif
 }
 
 static void raw_aio_unplug(BlockDriverState *bs)
 {
-#ifdef CONFIG_LINUX_AIO
+#if defined(CONFIG_LINUX_AIO) || defined(CONFIG_LINUX_IO_URING)
     BDRVRawState *s = bs->opaque;
+#endif
+#ifdef CONFIG_LINUX_AIO
     if (s->use_linux_aio) {
         LinuxAioState *aio = aio_get_linux_aio(bdrv_get_aio_context(bs));
         laio_io_unplug(bs, aio);
     }
 #endif
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        if (aio) {
+            luring_io_unplug(bs, aio);
+        }
+    }
+#endif
 }
 
 static BlockAIOCB *raw_aio_flush(BlockDriverState *bs,
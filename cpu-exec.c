@@ -350,6 +350,8 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
             }
 
             mmap_unlock();
+        } else {
+            tb_region_touch(tb);
         }
 
         /* We add the TB in the virtual pc hash table for the fast lookup */
@@ -65,6 +65,7 @@
 #ifndef _WIN32
 #include "qemu/mmap-alloc.h"
 #endif
+#include "block/raw-aio.h"
 
 //#define DEBUG_SUBPAGE
 
@@ -1677,6 +1678,12 @@ static void ram_block_add(RAMBlock *new_block, Error **errp)
         qemu_madvise(new_block->host, new_block->max_length, QEMU_MADV_HUGEPAGE);
         /* MADV_DONTFORK is also needed by KVM in absence of synchronous MMU */
         qemu_madvise(new_block->host, new_block->max_length, QEMU_MADV_DONTFORK);
+#ifdef CONFIG_LINUX_IO_URING
+        /* Guest RAM is where disk DMA lands; io_uring rings that were
+         * asked for fixed buffers register (and pin) it from this list.
+         */
+        luring_register_ram(new_block->host, new_block->max_length);
+#endif
     }
 }
 
@@ -1807,6 +1814,12 @@ void qemu_ram_free(RAMBlock *block)
         return;
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (block->host) {
+        luring_unregister_ram(block->host, block->max_length);
+    }
+#endif
+
     qemu_mutex_lock_ramlist();
     QLIST_REMOVE_RCU(block, next);
     ram_list.mru_block = NULL;
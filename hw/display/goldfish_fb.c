@@ -10,6 +10,7 @@
 ** GNU General Public License for more details.
 */
 #include "qemu/osdep.h"
+#include "qemu/host-utils.h"
 #include "framebuffer.h"
 #include "hw/hw.h"
 #include "hw/sysbus.h"
@@ -17,10 +18,15 @@
 #include "ui/pixel_ops.h"
 #include "trace.h"
 #include "exec/address-spaces.h"
+#include "sysemu/sysemu.h"
 #include "hw/display/goldfish_fb.h"
 
 #include <inttypes.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static int s_use_host_gpu = 0;
 static int s_display_bpp = 32;
 
@@ -63,6 +69,119 @@ void goldfish_fb_set_display_depth(int depth) {
 #define SOURCE_BITS 32
 #include "goldfish_fb_template.h"
 
+#ifdef __SSE2__
+/* The guest almost always uses RGB565 or RGBX8888, and the host surface is
+ * almost always 32 bits per pixel: convert 8 or 4 pixels at a time for the
+ * unrotated case, where destination pixels are contiguous.
+ */
+static void draw_line_16_32_sse2(void *opaque, uint8_t *d, const uint8_t *s,
+                                 int width, int deststep)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask_r = _mm_set1_epi32(0xf800);
+    const __m128i mask_g = _mm_set1_epi32(0x07e0);
+    const __m128i mask_b = _mm_set1_epi32(0x001f);
+
+    if (deststep != 4) {
+        draw_line_16_32(opaque, d, s, width, deststep);
+        return;
+    }
+    for (; width >= 8; width -= 8, s += 16, d += 32) {
+        __m128i rgb565 = _mm_loadu_si128((const __m128i *)s);
+        __m128i lo = _mm_unpacklo_epi16(rgb565, zero);
+        __m128i hi = _mm_unpackhi_epi16(rgb565, zero);
+
+        /* r << 16 | g << 8 | b, each channel scaled like rgb565 << 3/2/3 */
+        lo = _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi32(_mm_and_si128(lo, mask_r), 8),
+                             _mm_slli_epi32(_mm_and_si128(lo, mask_g), 5)),
+                _mm_slli_epi32(_mm_and_si128(lo, mask_b), 3));
+        hi = _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi32(_mm_and_si128(hi, mask_r), 8),
+                             _mm_slli_epi32(_mm_and_si128(hi, mask_g), 5)),
+                _mm_slli_epi32(_mm_and_si128(hi, mask_b), 3));
+        _mm_storeu_si128((__m128i *)d, lo);
+        _mm_storeu_si128((__m128i *)(d + 16), hi);
+    }
+    draw_line_16_32(opaque, d, s, width, deststep);
+}
+
+static void draw_line_32_32_sse2(void *opaque, uint8_t *d, const uint8_t *s,
+                                 int width, int deststep)
+{
+    const __m128i mask_rb = _mm_set1_epi32(0xff);
+    const __m128i mask_g = _mm_set1_epi32(0xff00);
+
+    if (deststep != 4) {
+        draw_line_32_32(opaque, d, s, width, deststep);
+        return;
+    }
+    for (; width >= 4; width -= 4, s += 16, d += 16) {
+        __m128i rgbx = _mm_loadu_si128((const __m128i *)s);
+
+        /* swap the R and B bytes, and clear X */
+        __m128i px = _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi32(_mm_and_si128(rgbx, mask_rb), 16),
+                             _mm_and_si128(rgbx, mask_g)),
+                _mm_and_si128(_mm_srli_epi32(rgbx, 16), mask_rb));
+        _mm_storeu_si128((__m128i *)d, px);
+    }
+    draw_line_32_32(opaque, d, s, width, deststep);
+}
+
+#define draw_line_16_32_fast draw_line_16_32_sse2
+#define draw_line_32_32_fast draw_line_32_32_sse2
+#else
+#define draw_line_16_32_fast draw_line_16_32
+#define draw_line_32_32_fast draw_line_32_32
+#endif
+
+/* Find the first and last bytes that differ between two rows of |len|
+ * bytes. Returns false if the rows are identical.
+ */
+static bool goldfish_fb_row_diff(const uint8_t *a, const uint8_t *b, int len,
+                                 int *first, int *last)
+{
+    int i = 0, j = len;
+
+#ifdef __SSE2__
+    while (i + 16 <= len) {
+        unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(a + i)),
+                _mm_loadu_si128((const __m128i *)(b + i))));
+        if (eq != 0xffff) {
+            i += ctz32(~eq);
+            break;
+        }
+        i += 16;
+    }
+#endif
+    while (i < len && a[i] == b[i]) {
+        i++;
+    }
+    if (i == len) {
+        return false;
+    }
+#ifdef __SSE2__
+    while (j - 16 > i) {
+        unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(a + j - 16)),
+                _mm_loadu_si128((const __m128i *)(b + j - 16))));
+        if (eq != 0xffff) {
+            j -= clz32(~eq << 16);
+            break;
+        }
+        j -= 16;
+    }
+#endif
+    while (a[j - 1] == b[j - 1]) {
+        j--;
+    }
+    *first = i;
+    *last = j - 1;
+    return true;
+}
+
 #define TYPE_GOLDFISH_FB "goldfish_fb"
 #define GOLDFISH_FB(obj) OBJECT_CHECK(struct goldfish_fb_state, (obj), TYPE_GOLDFISH_FB)
 /* These values *must* match the platform definitions found under
@@ -104,6 +223,7 @@ struct goldfish_fb_state {
     uint32_t need_update : 1;
     uint32_t need_int : 1;
     uint32_t blank : 1;
+    uint32_t need_redraw : 1;
     uint32_t int_status;
     uint32_t int_enable;
     int      rotation;   /* 0, 1, 2 or 3 */
@@ -111,6 +231,12 @@ struct goldfish_fb_state {
     int      format;
 
     MemoryRegionSection fbsection;
+
+    /* Copy of the guest framebuffer as of the last update, used to only
+     * convert and report the pixels that actually changed. */
+    uint8_t *shadow;
+    size_t   shadow_size;
+    drawfn   shadow_fn;
 };
 
 #define  GOLDFISH_FB_SAVE_VERSION  3
@@ -124,6 +250,7 @@ void goldfish_fb_set_rotation(int rotation)
         DisplaySurface *ds = qemu_console_surface(s->con);
         s->rotation = rotation;
         s->need_update = 1;
+        s->need_redraw = 1;
         qemu_console_resize(s->con, surface_height(ds), surface_width(ds));
     } else {
         fprintf(stderr,"%s: unable to find FB dev\n", __func__);
@@ -192,6 +319,7 @@ static int  goldfish_fb_load(QEMUFile*  f, void*  opaque, int  version_id)
 
     /* force a refresh */
     s->need_update = 1;
+    s->need_redraw = 1;
 
     ret = 0;
 Exit:
@@ -219,11 +347,119 @@ static int   stats_full_updates;
 static long  stats_total_full_updates;
 #endif
 
+/* The source framebuffer is scanned in bands of FB_BAND_ROWS rows: the
+ * dirty bitmap is checked once per band, the rows of dirty bands are
+ * compared with the shadow copy, and only the changed part of each row is
+ * converted. Changed bands are then coalesced into at most FB_MAX_RECTS
+ * rectangles for the display update.
+ */
+#define FB_BAND_ROWS  16
+#define FB_MAX_RECTS  8
+
+typedef struct {
+    int x, y, w, h;
+} FbRect;
+
+/* Test and clear the dirty bits of the pages covering [start, end) in
+ * |mem|. Consecutive bands can share a page, so the state of the last
+ * page of a band is kept in |*last_page| and |*last_dirty| for the next
+ * one: clearing it twice would lose the writes to the second band.
+ */
+static bool goldfish_fb_band_dirty(MemoryRegion *mem, hwaddr start,
+                                   hwaddr end, unsigned page_bits,
+                                   int64_t *last_page, bool *last_dirty)
+{
+    const hwaddr mem_size = memory_region_size(mem);
+    int64_t first = start >> page_bits;
+    int64_t last = (end - 1) >> page_bits;
+    bool dirty = false;
+
+    if (first == *last_page) {
+        dirty = *last_dirty;
+        first++;
+    }
+    if (first < last) {
+        dirty |= memory_region_test_and_clear_dirty(
+                mem, first << page_bits, (last - first) << page_bits,
+                DIRTY_MEMORY_VGA);
+    }
+    if (first <= last) {
+        hwaddr addr = last << page_bits;
+        *last_dirty = memory_region_test_and_clear_dirty(
+                mem, addr, MIN((hwaddr)1 << page_bits, mem_size - addr),
+                DIRTY_MEMORY_VGA);
+        *last_page = last;
+        dirty |= *last_dirty;
+    }
+    return dirty;
+}
+
+/* Add source rows [y0, y1], columns [x0, x1] to |rects|, merging them
+ * with the previous rectangle if they are in the next band, or if there
+ * is no room left.
+ */
+static void goldfish_fb_add_rect(FbRect *rects, int *count,
+                                 int x0, int x1, int y0, int y1)
+{
+    if (*count > 0) {
+        FbRect *r = &rects[*count - 1];
+
+        if (y0 - (r->y + r->h) < FB_BAND_ROWS || *count == FB_MAX_RECTS) {
+            int right = MAX(r->x + r->w, x1 + 1);
+
+            r->x = MIN(r->x, x0);
+            r->w = right - r->x;
+            r->h = y1 + 1 - r->y;
+            return;
+        }
+    }
+    rects[*count].x = x0;
+    rects[*count].y = y0;
+    rects[*count].w = x1 + 1 - x0;
+    rects[*count].h = y1 + 1 - y0;
+    (*count)++;
+}
+
+/* Map a rectangle of the source framebuffer to the display surface. */
+static FbRect goldfish_fb_rotate_rect(const FbRect *r, int rotation,
+                                      int dest_width, int dest_height)
+{
+    FbRect d;
+
+    switch (rotation) {
+    case 1:
+        d.x = dest_width - (r->y + r->h);
+        d.y = r->x;
+        d.w = r->h;
+        d.h = r->w;
+        break;
+    case 2:
+        d.x = dest_width - (r->x + r->w);
+        d.y = dest_height - (r->y + r->h);
+        d.w = r->w;
+        d.h = r->h;
+        break;
+    case 3:
+        d.x = r->y;
+        d.y = dest_height - (r->x + r->w);
+        d.w = r->h;
+        d.h = r->w;
+        break;
+    default:
+        d = *r;
+        break;
+    }
+    return d;
+}
+
 static void goldfish_fb_update_display(void *opaque)
 {
     struct goldfish_fb_state *s = (struct goldfish_fb_state *)opaque;
     DisplaySurface *ds = qemu_console_surface(s->con);
-    int full_update = 0;
+    int remap = 0, redraw = 0;
+    FbRect rects[FB_MAX_RECTS];
+    int num_rects = 0;
+    int i;
 
     if (!s || !s->con || surface_bits_per_pixel(ds) == 0 || !s->fb_base)
         return;
@@ -234,7 +470,10 @@ static void goldfish_fb_update_display(void *opaque)
     }
 
     if(s->need_update) {
-        full_update = 1;
+        /* A new base only needs the rows that differ from the current
+         * picture to be redrawn, anything else redraws everything. */
+        remap = 1;
+        redraw = s->need_redraw;
         if(s->need_int) {
             s->int_status |= FB_INT_BASE_UPDATE_DONE;
             if(s->int_enable & FB_INT_BASE_UPDATE_DONE)
@@ -242,34 +481,22 @@ static void goldfish_fb_update_display(void *opaque)
         }
         s->need_int = 0;
         s->need_update = 0;
+        s->need_redraw = 0;
     }
 
     int dest_width = surface_width(ds);
     int dest_height = surface_height(ds);
     int dest_pitch = surface_stride(ds);
-    int ymin, ymax;
-
-#if STATS
-    if (full_update)
-        stats_full_updates += 1;
-    if (++stats_counter == 120) {
-        stats_total               += stats_counter;
-        stats_total_full_updates  += stats_full_updates;
-
-        trace_goldfish_fb_update_stats(stats_full_updates*100.0/stats_counter,
-                stats_total_full_updates*100.0/stats_total );
-
-        stats_counter      = 0;
-        stats_full_updates = 0;
-    }
-#endif /* STATS */
 
     if (s->blank)
     {
         void *dst_line = surface_data(ds);
         memset( dst_line, 0, dest_height*dest_pitch );
-        ymin = 0;
-        ymax = dest_height-1;
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].w = dest_width;
+        rects[0].h = dest_height;
+        num_rects = 1;
     }
     else
     {
@@ -320,7 +547,7 @@ static void goldfish_fb_update_display(void *opaque)
             case 15: fn = draw_line_16_15; break;
             case 16: fn = draw_line_16_16; break;
             case 24: fn = draw_line_16_24; break;
-            case 32: fn = draw_line_16_32; break;
+            case 32: fn = draw_line_16_32_fast; break;
             default:
                 hw_error("goldfish_fb: bad dest color depth\n");
                 return;
@@ -333,7 +560,7 @@ static void goldfish_fb_update_display(void *opaque)
             case 15: fn = draw_line_32_15; break;
             case 16: fn = draw_line_32_16; break;
             case 24: fn = draw_line_32_24; break;
-            case 32: fn = draw_line_32_32; break;
+            case 32: fn = draw_line_32_32_fast; break;
             default:
                 hw_error("goldfish_fb: bad dest color depth\n");
                 return;
@@ -344,36 +571,120 @@ static void goldfish_fb_update_display(void *opaque)
             return;
         }
 
-        ymin = 0;
         // with -gpu on, the following check and return will save 2%
         // CPU time on OSX; saving on other platforms may differ.
         if (s_use_host_gpu) return;
 
-        if (full_update) {
+        const int src_pitch = src_width * source_bytes_per_pixel;
+        const size_t src_size = (size_t)src_height * src_pitch;
+
+        if (remap) {
             framebuffer_update_memory_section(
                     &s->fbsection, get_system_memory(), s->fb_base,
-                    src_height, src_width * source_bytes_per_pixel);
+                    src_height, src_pitch);
         }
-        framebuffer_update_display(ds, &s->fbsection,
-                                   src_width, src_height,
-                                   src_width * source_bytes_per_pixel,
-                                   dest_row_pitch, dest_col_pitch,
-                                   full_update,
-                                   fn, ds, &ymin, &ymax);
-    }
 
-    ymax += 1;
-    if (ymin >= 0) {
-        if (s->rotation % 2) {
-            /* In portrait mode we are drawing "sideways" so always
-             * need to update the whole screen */
-            trace_goldfish_fb_update_display(0, dest_height, 0, dest_width);
-            dpy_gfx_update(s->con, 0, 0, dest_width, dest_height);
-
-        } else {
-            trace_goldfish_fb_update_display(ymin, ymax-ymin, 0, dest_width);
-            dpy_gfx_update(s->con, 0, ymin, dest_width, ymax-ymin);
+        /* The shadow copy is only valid for the current geometry, format
+         * and conversion function. */
+        if (s->shadow_size != src_size || s->shadow_fn != fn) {
+            g_free(s->shadow);
+            s->shadow = g_malloc(src_size);
+            s->shadow_size = src_size;
+            s->shadow_fn = fn;
+            redraw = 1;
+        }
+
+        MemoryRegion *mem = s->fbsection.mr;
+        if (!mem) {
+            return;
+        }
+        memory_region_sync_dirty_bitmap(mem);
+
+        const hwaddr src_offset = s->fbsection.offset_within_region;
+        const uint8_t *src = memory_region_get_ram_ptr(mem) + src_offset;
+        uint8_t *dest = surface_data(ds);
+        if (dest_col_pitch < 0) {
+            dest -= dest_col_pitch * (src_width - 1);
         }
+        if (dest_row_pitch < 0) {
+            dest -= dest_row_pitch * (src_height - 1);
+        }
+
+        const unsigned page_bits = qemu_target_page_bits();
+        int64_t last_page = -1;
+        bool last_dirty = false;
+        int band, y;
+
+        for (band = 0; band < src_height; band += FB_BAND_ROWS) {
+            const int band_end = MIN(band + FB_BAND_ROWS, src_height);
+            int x0 = src_width, x1 = -1, y0 = -1, y1 = -1;
+
+            if (!goldfish_fb_band_dirty(mem, src_offset + band * src_pitch,
+                                        src_offset + band_end * src_pitch,
+                                        page_bits, &last_page, &last_dirty) &&
+                !remap && !redraw) {
+                continue;
+            }
+            for (y = band; y < band_end; y++) {
+                const uint8_t *src_row = src + y * src_pitch;
+                uint8_t *shadow_row = s->shadow + y * src_pitch;
+                int first = 0, last = src_pitch - 1;
+
+                if (!redraw && !goldfish_fb_row_diff(src_row, shadow_row,
+                                                     src_pitch, &first,
+                                                     &last)) {
+                    continue;
+                }
+                first /= source_bytes_per_pixel;
+                last /= source_bytes_per_pixel;
+
+                /* Draw from the shadow copy: the guest may be writing to
+                 * the framebuffer, and the shadow must match the display. */
+                memcpy(shadow_row + first * source_bytes_per_pixel,
+                       src_row + first * source_bytes_per_pixel,
+                       (last - first + 1) * source_bytes_per_pixel);
+                fn(ds, dest + y * dest_row_pitch + first * dest_col_pitch,
+                   shadow_row + first * source_bytes_per_pixel,
+                   last - first + 1, dest_col_pitch);
+
+                x0 = MIN(x0, first);
+                x1 = MAX(x1, last);
+                if (y0 < 0) {
+                    y0 = y;
+                }
+                y1 = y;
+            }
+            if (y0 >= 0) {
+                goldfish_fb_add_rect(rects, &num_rects, x0, x1, y0, y1);
+            }
+        }
+
+        for (i = 0; i < num_rects; i++) {
+            rects[i] = goldfish_fb_rotate_rect(&rects[i], s->rotation,
+                                               dest_width, dest_height);
+        }
+    }
+
+#if STATS
+    if (redraw)
+        stats_full_updates += 1;
+    if (++stats_counter == 120) {
+        stats_total               += stats_counter;
+        stats_total_full_updates  += stats_full_updates;
+
+        trace_goldfish_fb_update_stats(stats_full_updates*100.0/stats_counter,
+                stats_total_full_updates*100.0/stats_total );
+
+        stats_counter      = 0;
+        stats_full_updates = 0;
+    }
+#endif /* STATS */
+
+    for (i = 0; i < num_rects; i++) {
+        trace_goldfish_fb_update_display(rects[i].y, rects[i].h,
+                                         rects[i].x, rects[i].w);
+        dpy_gfx_update(s->con, rects[i].x, rects[i].y,
+                       rects[i].w, rects[i].h);
     }
 }
 
@@ -382,6 +693,7 @@ static void goldfish_fb_invalidate_display(void * opaque)
     // is this called?
     struct goldfish_fb_state *s = (struct goldfish_fb_state *)opaque;
     s->need_update = 1;
+    s->need_redraw = 1;
 }
 
 static uint64_t goldfish_fb_read(void *opaque, hwaddr offset, unsigned size)
@@ -480,6 +792,7 @@ static void goldfish_fb_write(void *opaque, hwaddr offset, uint64_t val,
         case FB_SET_BLANK:
             s->blank = val;
             s->need_update = 1;
+            s->need_redraw = 1;
             break;
         default:
             error_report("goldfish_fb_write: Bad offset 0x" TARGET_FMT_plx,
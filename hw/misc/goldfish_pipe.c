@@ -36,6 +36,7 @@
 
 #include "qemu-common.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/timer.h"
 #include "qemu/error-report.h"
 
@@ -287,6 +288,12 @@ struct GoldfishHwPipe {
     uint64_t command_buffer_addr;
     PipeCommand* command_buffer;
     uint32_t rw_params_max_count;
+    // Number of transfers running on this pipe without the BQL, and whether
+    // the guest or a reset closed it meanwhile: the last transfer to finish
+    // frees it then (see hwpipe_close_v2()).
+    unsigned unlocked_transfers;
+    bool free_deferred;
+    GoldfishPipeCloseReason free_reason;
 
     // v1-specific fields
     struct GoldfishHwPipe* next;
@@ -301,6 +308,19 @@ typedef struct GuestSignalledPipe {
     uint32_t flags;
 } GuestSignalledPipe;
 
+// An open-addressing hash table of the v1 pipes, keyed by their 64-bit
+// channel, with linear probing. Free slots have a NULL |pipe|.
+typedef struct PipeChannelEntry {
+    uint64_t channel;
+    HwPipe* pipe;
+} PipeChannelEntry;
+
+typedef struct PipeChannelTable {
+    PipeChannelEntry* entries;
+    unsigned capacity;  // always a power of 2
+    unsigned count;
+} PipeChannelTable;
+
 typedef struct OpenCommandParams {
     uint64_t command_buffer_ptr;
     uint32_t rw_params_max_count;
@@ -338,7 +358,7 @@ struct PipeDevice {
     HwPipe* wanted_pipe_after_channel_high;
 
     // Cache of the pipes by channel for a faster lookup.
-    GHashTable* pipes_by_channel;
+    PipeChannelTable pipes_by_channel;
 
     // i/o registers
     uint64_t address;
@@ -363,58 +383,94 @@ static uint32_t* hwpipe_get_command_rw_sizes(HwPipe* pipe) {
                 hwpipe_get_command_rw_ptrs(pipe) + pipe->rw_params_max_count);
 }
 
-// hashtable-related functions
-// 64-bit emulator just casts uint64_t to gpointer to get a key for the
-// GLib's hash table. 32-bit one has to dynamically allocate an 8-byte chunk
-// of memory and copy the channel value there, storing pointer as a key.
-static uint64_t hash_channel_from_key(gconstpointer key) {
-#ifdef __x86_64__
-    // keys are just channels
-    return (uint64_t)key;
-#else
-    // keys are pointers to channels
-    return *(uint64_t*)key;
-#endif
+// Channels are guest kernel pointers: multiply to mix the aligned low bits
+// into the high ones, and use these.
+static unsigned channel_table_home(const PipeChannelTable* t,
+                                   uint64_t channel) {
+    const uint64_t mixed = channel * 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(mixed >> 32) & (t->capacity - 1);
 }
 
-static gpointer hash_create_key_from_channel(uint64_t channel) {
-#ifdef __x86_64__
-    return (gpointer)channel;
-#else
-    uint64_t* on_heap = (uint64_t*)malloc(sizeof(channel));
-    if (!on_heap) {
-        APANIC("%s: failed to allocate RAM for a channel value\n", __func__);
+static void channel_table_init(PipeChannelTable* t, unsigned capacity) {
+    t->entries = g_new0(PipeChannelEntry, capacity);
+    t->capacity = capacity;
+    t->count = 0;
+}
+
+static void channel_table_clear(PipeChannelTable* t) {
+    memset(t->entries, 0, sizeof(*t->entries) * t->capacity);
+    t->count = 0;
+}
+
+// Return the slot of |channel|, or the free slot where it would go.
+static unsigned channel_table_find(const PipeChannelTable* t,
+                                   uint64_t channel) {
+    unsigned i = channel_table_home(t, channel);
+    while (t->entries[i].pipe && t->entries[i].channel != channel) {
+        i = (i + 1) & (t->capacity - 1);
     }
-    *on_heap = channel;
-    return on_heap;
-#endif
+    return i;
 }
 
-static gconstpointer hash_cast_key_from_channel(const uint64_t* channel) {
-#ifdef __x86_64__
-    return (gconstpointer)*channel;
-#else
-    return (gconstpointer)channel;
-#endif
+static HwPipe* channel_table_lookup(const PipeChannelTable* t,
+                                    uint64_t channel) {
+    return t->entries[channel_table_find(t, channel)].pipe;
 }
 
-static guint hash_channel(gconstpointer key) {
-    uint64_t channel = hash_channel_from_key(key);
-    return (guint)(channel ^ (channel >> 6));
+static void channel_table_insert(PipeChannelTable* t, uint64_t channel,
+                                 HwPipe* pipe);
+
+static void channel_table_grow(PipeChannelTable* t) {
+    PipeChannelTable old = *t;
+    unsigned i;
+    channel_table_init(t, old.capacity * 2);
+    for (i = 0; i < old.capacity; ++i) {
+        if (old.entries[i].pipe) {
+            channel_table_insert(t, old.entries[i].channel,
+                                 old.entries[i].pipe);
+        }
+    }
+    g_free(old.entries);
 }
 
-static gboolean hash_channel_equal(gconstpointer a, gconstpointer b) {
-    return hash_channel_from_key(a) == hash_channel_from_key(b);
+static void channel_table_insert(PipeChannelTable* t, uint64_t channel,
+                                 HwPipe* pipe) {
+    // Keep the load factor under 3/4 so probe sequences stay short.
+    if ((t->count + 1) * 4 > t->capacity * 3) {
+        channel_table_grow(t);
+    }
+    unsigned i = channel_table_find(t, channel);
+    if (!t->entries[i].pipe) {
+        ++t->count;
+    }
+    t->entries[i].channel = channel;
+    t->entries[i].pipe = pipe;
 }
 
-#ifdef __x86_64__
-// we don't need to free channels in 64-bit emulator as we store them in-place
-static void (*hash_channel_destroy)(gpointer a) = NULL;
-#else
-static void hash_channel_destroy(gpointer a) {
-    free((uint64_t*)a);
+static void channel_table_remove(PipeChannelTable* t, uint64_t channel) {
+    const unsigned mask = t->capacity - 1;
+    unsigned i = channel_table_find(t, channel);
+    unsigned j = i;
+    if (!t->entries[i].pipe) {
+        return;
+    }
+    // Shift back the following entries of the probe sequence, unless they
+    // would end up before their home slot.
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!t->entries[j].pipe) {
+            break;
+        }
+        const unsigned home = channel_table_home(t, t->entries[j].channel);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            t->entries[i] = t->entries[j];
+            i = j;
+        }
+    }
+    t->entries[i].channel = 0;
+    t->entries[i].pipe = NULL;
+    --t->count;
 }
-#endif
 
 static unsigned char hwpipe_get_and_clear_wanted(HwPipe* pipe) {
     unsigned char val = pipe->wanted;
@@ -577,13 +633,25 @@ static void close_all_pipes_v1(PipeDevice* dev, GoldfishPipeCloseReason reason)
     dev->pipes_list = NULL;
 }
 
+// Frees a v2 pipe that was removed from the device, unless a transfer
+// still uses it without the BQL: the host pipe and the command buffer must
+// stay valid until it returns, so it's freed by the transfer then.
+static void hwpipe_close_v2(HwPipe* pipe, GoldfishPipeCloseReason reason) {
+    if (pipe->unlocked_transfers) {
+        pipe->free_deferred = true;
+        pipe->free_reason = reason;
+        return;
+    }
+    unmap_command_buffer(pipe->command_buffer);
+    hwpipe_free(pipe, reason);
+}
+
 static void close_all_pipes_v2(PipeDevice* dev, GoldfishPipeCloseReason reason) {
     int i = 0;
     for (; i < dev->pipes_capacity; ++i) {
         HwPipe* pipe = dev->pipes[i];
         if (pipe) {
-            unmap_command_buffer(pipe->command_buffer);
-            hwpipe_free(pipe, reason);
+            hwpipe_close_v2(pipe, reason);
             dev->pipes[i] = NULL;
         }
     }
@@ -592,14 +660,13 @@ static void close_all_pipes_v2(PipeDevice* dev, GoldfishPipeCloseReason reason)
 static void reset_pipe_device(PipeDevice* dev) {
     dev->wanted_pipes_first = NULL;
     dev->wanted_pipe_after_channel_high = NULL;
-    g_hash_table_remove_all(dev->pipes_by_channel);
+    channel_table_clear(&dev->pipes_by_channel);
     qemu_set_irq(dev->ps->irq, 0);
     service_ops->dma_reset_host_mappings();
 }
 
 static void pipeDevice_doCommand_v1(PipeDevice* dev, uint32_t command) {
-    HwPipe* pipe = (HwPipe*)g_hash_table_lookup(
-            dev->pipes_by_channel, hash_cast_key_from_channel(&dev->channel));
+    HwPipe* pipe = channel_table_lookup(&dev->pipes_by_channel, dev->channel);
 
     /* Check that we're referring a known pipe channel */
     if (command != PIPE_CMD_OPEN && pipe == NULL) {
@@ -630,8 +697,7 @@ static void pipeDevice_doCommand_v1(PipeDevice* dev, uint32_t command) {
         pipe->next = dev->pipes_list;
         dev->pipes_list = pipe;
         dev->status = 0;
-        g_hash_table_insert(dev->pipes_by_channel,
-                            hash_create_key_from_channel(dev->channel), pipe);
+        channel_table_insert(&dev->pipes_by_channel, dev->channel, pipe);
         break;
 
     case PIPE_CMD_CLOSE: {
@@ -650,8 +716,7 @@ static void pipeDevice_doCommand_v1(PipeDevice* dev, uint32_t command) {
         }
         *pnode = pipe->next;
         pipe->next = NULL;
-        g_hash_table_remove(dev->pipes_by_channel,
-                            hash_cast_key_from_channel(&pipe->channel));
+        channel_table_remove(&dev->pipes_by_channel, pipe->channel);
         wanted_pipes_remove_v1(dev, pipe);
 
         hwpipe_free(pipe, GOLDFISH_PIPE_CLOSE_GRACEFUL);
@@ -783,6 +848,114 @@ static void pipeDevice_doOpenClose_v2(PipeDevice* dev, uint32_t id) {
     commandBuffer->status = 0;
 }
 
+// The i/o memory region doesn't use the global locking (see
+// goldfish_pipe_realize()), so that accelerated vCPU threads call us without
+// the BQL: take it for the duration of the access, except for transfers the
+// pipe service can run unlocked. This is true while the current thread runs
+// an access that started without the BQL.
+static __thread bool pipe_access_took_bql;
+
+static bool pipe_access_lock(void) {
+    if (qemu_mutex_iothread_locked()) {
+        return false;
+    }
+    qemu_mutex_lock_iothread();
+    pipe_access_took_bql = true;
+    return true;
+}
+
+static void pipe_access_unlock(bool took_bql) {
+    if (took_bql) {
+        pipe_access_took_bql = false;
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+// Run a PIPE_CMD_READ (if |willModifyData|) or PIPE_CMD_WRITE command.
+// This may be called without the BQL, see pipeDevice_doCommand_v2(): only
+// the pipe's own command buffer and the guest memory are touched here.
+static void pipeDevice_doTransfer_v2(HwPipe* pipe, bool willModifyData) {
+    pipe->command_buffer->rw_params.consumed_size = 0;
+    unsigned buffers_count = pipe->command_buffer->rw_params.buffers_count;
+    if (buffers_count > pipe->rw_params_max_count) {
+        buffers_count = pipe->rw_params_max_count;
+    }
+
+    // This isn't supposed to happen, what's the puprose of calling
+    // us with no data?
+    assert(buffers_count);
+
+    // We know that the |rw_params| fit into single page as of now, so
+    // we're free to estimate the maximum size this way.
+    uint64_t* const rwPtrs = hwpipe_get_command_rw_ptrs(pipe);
+    uint32_t* const rwSizes = hwpipe_get_command_rw_sizes(pipe);
+    assert(buffers_count <=
+           COMMAND_BUFFER_SIZE / (sizeof(*rwPtrs) + sizeof(*rwSizes)));
+    GoldfishPipeBuffer buffers[
+            COMMAND_BUFFER_SIZE / (sizeof(*rwPtrs) + sizeof(*rwSizes))];
+
+    buffers[0].size = rwSizes[0];
+    buffers[0].data = map_guest_buffer(rwPtrs[0], rwSizes[0], willModifyData);
+    if (!buffers[0].data) {
+        pipe->command_buffer->status = GOLDFISH_PIPE_ERROR_INVAL;
+        return;
+    }
+#if !defined(TARGET_MIPS)
+    // All passed buffers are allocated in the same guest process, so
+    // know they all have the same offset from the host address.
+    const ptrdiff_t diffFromGuest =
+            (intptr_t)buffers[0].data - (intptr_t)rwPtrs[0];
+#endif
+    unsigned i;
+    for (i = 1; i < buffers_count; ++i) {
+#if !defined(TARGET_MIPS)
+        buffers[i].data = (void*)(intptr_t)(rwPtrs[i] + diffFromGuest);
+#else
+        buffers[i].data = map_guest_buffer(rwPtrs[i], rwSizes[i],
+                                           willModifyData);
+#endif
+        buffers[i].size = rwSizes[i];
+        assert(buffers[i].data != NULL);
+        assert(buffers[i].size != 0);
+    }
+
+#ifndef NDEBUG
+    // Verify that our interpolated mappings are actually correct
+    for (i = 1; i < buffers_count; ++i) {
+        void* const mapping = map_guest_buffer(rwPtrs[i], rwSizes[i],
+                                               willModifyData);
+        assert(mapping == buffers[i].data);
+        cpu_physical_memory_unmap(mapping, rwSizes[i],
+                                  willModifyData, rwSizes[i]);
+    }
+#endif
+
+    pipe->command_buffer->status =
+            willModifyData
+                    ? service_ops->guest_recv(pipe->host_pipe, buffers,
+                                              buffers_count)
+                    : service_ops->guest_send(pipe->host_pipe, buffers,
+                                              buffers_count);
+    // TODO(zyy): create an extended version of send()/recv() functions
+    // to return both transferred size and resulting status in single
+    // call.
+    pipe->command_buffer->rw_params.consumed_size =
+            pipe->command_buffer->status < 0 ? 0
+                                             : pipe->command_buffer->status;
+    DD("%s: CMD_%s id=%d buffers=%d > status=%d", __func__,
+       (willModifyData ? "READ" : "WRITE"), (int)pipe->id,
+       (int)buffers_count, pipe->command_buffer->status);
+
+    cpu_physical_memory_unmap(buffers[0].data, buffers[0].size,
+                              willModifyData, buffers[0].size);
+#if defined(TARGET_MIPS)
+    for (i = 1; i < buffers_count; ++i) {
+        cpu_physical_memory_unmap(buffers[i].data, buffers[i].size,
+                                  willModifyData, buffers[i].size);
+    }
+#endif
+}
+
 static void pipeDevice_doCommand_v2(HwPipe* pipe) {
     assert(pipe);
     assert(pipe->command_buffer->cmd != PIPE_CMD_OPEN);
@@ -803,8 +976,7 @@ static void pipeDevice_doCommand_v2(HwPipe* pipe) {
             dev->pipes[pipe->id] = NULL;
             wanted_pipes_remove_v2(dev, pipe);
             pipe->command_buffer->status = 0;
-            unmap_command_buffer(pipe->command_buffer);
-            hwpipe_free(pipe, GOLDFISH_PIPE_CLOSE_GRACEFUL);
+            hwpipe_close_v2(pipe, GOLDFISH_PIPE_CLOSE_GRACEFUL);
             break;
         }
 
@@ -817,91 +989,26 @@ static void pipeDevice_doCommand_v2(HwPipe* pipe) {
 
         case PIPE_CMD_READ:
         case PIPE_CMD_WRITE: {
-            const bool willModifyData = command == PIPE_CMD_READ;
-            pipe->command_buffer->rw_params.consumed_size = 0;
-            unsigned buffers_count =
-                    pipe->command_buffer->rw_params.buffers_count;
-            if (buffers_count > pipe->rw_params_max_count) {
-                buffers_count = pipe->rw_params_max_count;
-            }
-
-            // This isn't supposed to happen, what's the puprose of calling
-            // us with no data?
-            assert(buffers_count);
-
-            // We know that the |rw_params| fit into single page as of now, so
-            // we're free to estimate the maximum size this way.
-            uint64_t* const rwPtrs = hwpipe_get_command_rw_ptrs(pipe);
-            uint32_t* const rwSizes = hwpipe_get_command_rw_sizes(pipe);
-            assert(buffers_count <=
-                   COMMAND_BUFFER_SIZE / (sizeof(*rwPtrs) + sizeof(*rwSizes)));
-            GoldfishPipeBuffer buffers[
-                    COMMAND_BUFFER_SIZE / (sizeof(*rwPtrs) + sizeof(*rwSizes))];
-
-            buffers[0].size = rwSizes[0];
-            buffers[0].data = map_guest_buffer(
-                                  rwPtrs[0], rwSizes[0], willModifyData);
-            if (!buffers[0].data) {
-                pipe->command_buffer->status = GOLDFISH_PIPE_ERROR_INVAL;
+            // Let other vCPUs and the main loop run while the service is
+            // busy, if it allows it. Only when the BQL was taken for this
+            // access though: a TCG vCPU thread must keep owning it.
+            const bool unlock = pipe_access_took_bql &&
+                                service_ops->guest_can_transfer_unlocked &&
+                                service_ops->guest_can_transfer_unlocked(
+                                        pipe->host_pipe);
+            if (!unlock) {
+                pipeDevice_doTransfer_v2(pipe, command == PIPE_CMD_READ);
                 break;
             }
-#if !defined(TARGET_MIPS)
-            // All passed buffers are allocated in the same guest process, so
-            // know they all have the same offset from the host address.
-            const ptrdiff_t diffFromGuest =
-                    (intptr_t)buffers[0].data - (intptr_t)rwPtrs[0];
-#endif
-            unsigned i;
-            for (i = 1; i < buffers_count; ++i) {
-#if !defined(TARGET_MIPS)
-                buffers[i].data = (void*)(intptr_t)(rwPtrs[i] + diffFromGuest);
-#else
-                buffers[i].data = map_guest_buffer(
-                                      rwPtrs[i], rwSizes[i], willModifyData);
-#endif
-                buffers[i].size = rwSizes[i];
-                assert(buffers[i].data != NULL);
-                assert(buffers[i].size != 0);
-            }
-
-#ifndef NDEBUG
-            // Verify that our interpolated mappings are actually correct
-            for (i = 1; i < buffers_count; ++i) {
-                void* const mapping = map_guest_buffer(rwPtrs[i], rwSizes[i],
-                                                       willModifyData);
-                assert(mapping == buffers[i].data);
-                cpu_physical_memory_unmap(mapping, rwSizes[i],
-                                          willModifyData, rwSizes[i]);
-            }
-#endif
-
-            pipe->command_buffer->status =
-                    willModifyData
-                            ? service_ops->guest_recv(pipe->host_pipe,
-                                                        buffers,
-                                                        buffers_count)
-                            : service_ops->guest_send(pipe->host_pipe,
-                                                        buffers,
-                                                        buffers_count);
-            // TODO(zyy): create an extended version of send()/recv() functions
-            // to return both transferred size and resulting status in single
-            // call.
-            pipe->command_buffer->rw_params.consumed_size =
-                    pipe->command_buffer->status < 0
-                            ? 0
-                            : pipe->command_buffer->status;
-            DD("%s: CMD_%s id=%d buffers=%d > status=%d", __func__,
-               (willModifyData ? "READ" : "WRITE"), (int)pipe->id,
-               (int)buffers_count, pipe->command_buffer->status);
-
-            cpu_physical_memory_unmap(buffers[0].data, buffers[0].size,
-                                      willModifyData, buffers[0].size);
-#if defined(TARGET_MIPS)
-            for (i = 1; i < buffers_count; ++i) {
-                cpu_physical_memory_unmap(buffers[i].data, buffers[i].size,
-                                          willModifyData, buffers[i].size);
+            // Another vCPU may close the pipe, or reset the device, while
+            // the BQL is released.
+            ++pipe->unlocked_transfers;
+            qemu_mutex_unlock_iothread();
+            pipeDevice_doTransfer_v2(pipe, command == PIPE_CMD_READ);
+            qemu_mutex_lock_iothread();
+            if (--pipe->unlocked_transfers == 0 && pipe->free_deferred) {
+                hwpipe_close_v2(pipe, pipe->free_reason);
             }
-#endif
             break;
         }
 
@@ -940,6 +1047,7 @@ static void pipe_dev_write(void* opaque,
                            unsigned size) {
     GoldfishPipeState* state = opaque;
     PipeDevice* dev = state->dev;
+    const bool took_bql = pipe_access_lock();
 
     DR("%s: offset = 0x%" HWADDR_PRIx " value=%" PRIu64 "/0x%" PRIx64, __func__,
        offset, value, value);
@@ -948,11 +1056,10 @@ static void pipe_dev_write(void* opaque,
     } else {
         dev->ops->dev_write(dev, offset, value);
     }
+    pipe_access_unlock(took_bql);
 }
 
-static uint64_t pipe_dev_read(void* opaque, hwaddr offset, unsigned size) {
-    GoldfishPipeState* s = (GoldfishPipeState*)opaque;
-    PipeDevice* dev = s->dev;
+static uint64_t pipe_dev_read_locked(PipeDevice* dev, hwaddr offset) {
     if (offset == PIPE_REG_VERSION) {
         // PIPE_REG_VERSION is issued on probe, which means that
         // we should clean up all existing stale pipes.
@@ -972,6 +1079,14 @@ static uint64_t pipe_dev_read(void* opaque, hwaddr offset, unsigned size) {
     return dev->ops->dev_read(dev, offset);
 }
 
+static uint64_t pipe_dev_read(void* opaque, hwaddr offset, unsigned size) {
+    GoldfishPipeState* s = (GoldfishPipeState*)opaque;
+    const bool took_bql = pipe_access_lock();
+    const uint64_t value = pipe_dev_read_locked(s->dev, offset);
+    pipe_access_unlock(took_bql);
+    return value;
+}
+
 static void pipe_dev_write_v1(PipeDevice* dev,
                               hwaddr offset,
                               uint64_t value) {
@@ -1386,11 +1501,9 @@ static int goldfish_pipe_load_v1(QEMUFile* file, PipeDevice* dev) {
     }
 
     /* Rebuild the pipes-by-channel table. */
-    g_hash_table_remove_all(dev->pipes_by_channel); /* Clean up old data. */
+    channel_table_clear(&dev->pipes_by_channel); /* Clean up old data. */
     for(pipe = dev->pipes_list; pipe; pipe = pipe->next) {
-        g_hash_table_insert(dev->pipes_by_channel,
-                            hash_create_key_from_channel(pipe->channel),
-                            pipe);
+        channel_table_insert(&dev->pipes_by_channel, pipe->channel, pipe);
     }
 
     /* Reconstruct wanted pipes list. */
@@ -1400,8 +1513,7 @@ static int goldfish_pipe_load_v1(QEMUFile* file, PipeDevice* dev) {
     uint64_t channel;
     for (pipe_n = 0; pipe_n < wanted_pipes_count; ++pipe_n) {
         channel = qemu_get_be64(file);
-        HwPipe* pipe = g_hash_table_lookup(dev->pipes_by_channel,
-                                           hash_cast_key_from_channel(&channel));
+        HwPipe* pipe = channel_table_lookup(&dev->pipes_by_channel, channel);
         if (pipe) {
             pipe->wanted_prev = *wanted_pipe_list_end;
             pipe->wanted_next = NULL;
@@ -1415,8 +1527,7 @@ static int goldfish_pipe_load_v1(QEMUFile* file, PipeDevice* dev) {
     if (qemu_get_byte(file)) {
         channel = qemu_get_be64(file);
         dev->wanted_pipe_after_channel_high =
-            g_hash_table_lookup(dev->pipes_by_channel,
-                                hash_cast_key_from_channel(&channel));
+            channel_table_lookup(&dev->pipes_by_channel, channel);
         if (!dev->wanted_pipe_after_channel_high) {
             free(force_closed_pipes);
             return -EIO;
@@ -1427,10 +1538,8 @@ static int goldfish_pipe_load_v1(QEMUFile* file, PipeDevice* dev) {
 
     /* Add forcibly closed pipes to wanted pipes list */
     for (pipe_n = 0; pipe_n < force_closed_pipes_count; pipe_n++) {
-        HwPipe* pipe =
-            g_hash_table_lookup(dev->pipes_by_channel,
-                                hash_cast_key_from_channel(
-                                    &force_closed_pipes[pipe_n]));
+        HwPipe* pipe = channel_table_lookup(&dev->pipes_by_channel,
+                                            force_closed_pipes[pipe_n]);
         hwpipe_set_wanted(pipe, GOLDFISH_PIPE_WAKE_CLOSED);
         pipe->closed = 1;
         if (!pipe->wanted_next &&
@@ -1623,14 +1732,12 @@ static void goldfish_pipe_realize(DeviceState* dev, Error** errp) {
         APANIC("%s: failed to initialize pipes array\n", __func__);
     }
 
-    s->dev->pipes_by_channel = g_hash_table_new_full(
-            hash_channel, hash_channel_equal, hash_channel_destroy, NULL);
-    if (!s->dev->pipes_by_channel) {
-        APANIC("%s: failed to initialize pipes hash\n", __func__);
-    }
+    channel_table_init(&s->dev->pipes_by_channel, 64);
 
     memory_region_init_io(&s->iomem, OBJECT(s), &goldfish_pipe_iomem_ops, s,
                           "goldfish_pipe", 0x2000 /*TODO: ?how big?*/);
+    /* pipe_dev_read() and pipe_dev_write() take the BQL themselves. */
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(sbdev, &s->iomem);
     sysbus_init_irq(sbdev, &s->irq);
 
@@ -1645,7 +1752,9 @@ void goldfish_pipe_reset(GoldfishHwPipe *pipe, GoldfishHostPipe *host_pipe) {
 
 void goldfish_pipe_signal_wake(GoldfishHwPipe *pipe,
                                GoldfishPipeWakeFlags flags) {
-    if (!pipe) return;
+    // A closed pipe waiting for its last transfer isn't on the device's
+    // lists anymore.
+    if (!pipe || pipe->free_deferred) return;
 
     PipeDevice *dev = pipe->dev;
 
@@ -125,6 +125,13 @@ struct AioContext {
     struct LinuxAioState *linux_aio;
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+    /* State for Linux io_uring.  Uses aio_context_acquire/release for
+     * locking.
+     */
+    struct LuringState *linux_io_uring;
+#endif
+
     /* TimerLists for calling timers - one per clock type */
     QEMUTimerListGroup tlg;
 
@@ -350,6 +357,11 @@ struct ThreadPool *aio_get_thread_pool(AioContext *ctx);
 /* Return the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_get_linux_aio(AioContext *ctx);
 
+/* Return the LuringState bound to this AioContext, or NULL if the host
+ * kernel does not support io_uring.
+ */
+struct LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
 /**
  * aio_timer_new:
  * @ctx: the aio context
@@ -26,8 +26,28 @@
 #define CODE_GEN_HTABLE_BITS     15
 #define CODE_GEN_HTABLE_SIZE     (1 << CODE_GEN_HTABLE_BITS)
 
+/* The code buffer is split into at most this many regions.  When the
+   current region fills up, translation moves on to an empty region, or
+   the least recently used region is evicted, instead of flushing all the
+   translated code at once.  */
+#define TB_REGION_MAX_COUNT      16
+#define TB_REGION_MIN_SIZE       (256 * 1024)
+
 typedef struct TranslationBlock TranslationBlock;
 typedef struct TBContext TBContext;
+typedef struct TBRegion TBRegion;
+
+struct TBRegion {
+    void *start;
+    void *end;
+    /* allocation pointer, only up to date when not the current region */
+    void *ptr;
+    /* slice of TBContext.tbs owned by this region, sorted by tc_ptr */
+    TranslationBlock *tbs;
+    int nb_tbs;
+    /* TBContext.region_clock value of the last translation or lookup */
+    unsigned long last_use;
+};
 
 struct TBContext {
 
@@ -37,9 +57,19 @@ struct TBContext {
     /* any access to the tbs or the page table must use this lock */
     QemuMutex tb_lock;
 
+    /* code buffer regions, set up once the prologue has been generated */
+    TBRegion regions[TB_REGION_MAX_COUNT];
+    int nb_regions;
+    int cur_region;
+    int region_max_tbs;
+    size_t region_size;
+    unsigned long region_clock;
+
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_region_evict_count;
     int tb_phys_invalidate_count;
+    uint64_t tb_gen_code_bytes;
 };
 
 #endif
@@ -148,6 +148,11 @@ typedef struct {
     // For snapshot save/load of DMA buffer state.
     void (*dma_save_mappings)(QEMUFile* file);
     void (*dma_load_mappings)(QEMUFile* file);
+
+    // Return true if guest_recv() and guest_send() can be called for
+    // |host_pipe| from a thread that doesn't own the BQL. The device then
+    // releases it for the duration of these transfers. Can be NULL.
+    bool (*guest_can_transfer_unlocked)(GoldfishHostPipe *host_pipe);
 } GoldfishPipeServiceOps;
 
 /* Called by the service implementation to register its callbacks.
@@ -70,6 +70,12 @@ static uint64_t bitmap_sync_count;
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
 
+/* Number of pages handed to a (de)compression thread at once. Each page is
+ * still written to the stream with its own header, so this doesn't change
+ * the wire format.
+ */
+#define COMPRESS_BATCH_PAGES 16
+
 static uint8_t *ZERO_TARGET_PAGE;
 
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
@@ -259,8 +265,10 @@ struct CompressParam {
     QEMUFile *file;
     QemuMutex mutex;
     QemuCond cond;
+    /* pages of |block| to compress, owned by the thread until done */
     RAMBlock *block;
-    ram_addr_t offset;
+    ram_addr_t offset[COMPRESS_BATCH_PAGES];
+    int nb_pages;
 };
 typedef struct CompressParam CompressParam;
 
@@ -269,9 +277,11 @@ struct DecompressParam {
     bool quit;
     QemuMutex mutex;
     QemuCond cond;
-    void *des;
+    /* |nb_pages| compressed pages stored back to back in |compbuf| */
+    void *des[COMPRESS_BATCH_PAGES];
+    int len[COMPRESS_BATCH_PAGES];
     uint8_t *compbuf;
-    int len;
+    int nb_pages;
 };
 typedef struct DecompressParam DecompressParam;
 
@@ -286,8 +296,16 @@ static QemuCond comp_done_cond;
 /* The empty QEMUFileOps will be used by file in CompressParam */
 static const QEMUFileOps empty_ops = { };
 
+/* pages queued for compression, not yet handed to a thread */
+static RAMBlock *comp_batch_block;
+static ram_addr_t comp_batch_offset[COMPRESS_BATCH_PAGES];
+static int comp_batch_pages;
+
 static bool compression_switch;
 static DecompressParam *decomp_param;
+/* the decompression thread whose batch is being filled, if any */
+static DecompressParam *decomp_batch;
+static int decomp_batch_size;
 static QemuThread *decompress_threads;
 static QemuMutex decomp_done_lock;
 static QemuCond decomp_done_cond;
@@ -299,17 +317,22 @@ static void *do_data_compress(void *opaque)
 {
     CompressParam *param = opaque;
     RAMBlock *block;
-    ram_addr_t offset;
+    int i, nb_pages;
 
     qemu_mutex_lock(&param->mutex);
     while (!param->quit) {
         if (param->block) {
             block = param->block;
-            offset = param->offset;
+            nb_pages = param->nb_pages;
             param->block = NULL;
             qemu_mutex_unlock(&param->mutex);
 
-            do_compress_ram_page(param->file, block, offset);
+            /* The offsets aren't touched by the migration thread until
+             * |done| is set again.
+             */
+            for (i = 0; i < nb_pages; i++) {
+                do_compress_ram_page(param->file, block, param->offset[i]);
+            }
 
             qemu_mutex_lock(&comp_done_lock);
             param->done = true;
@@ -360,6 +383,8 @@ void migrate_compress_threads_join(void)
     g_free(comp_param);
     compress_threads = NULL;
     comp_param = NULL;
+    comp_batch_block = NULL;
+    comp_batch_pages = 0;
 }
 
 void migrate_compress_threads_create(void)
@@ -370,6 +395,8 @@ void migrate_compress_threads_create(void)
         return;
     }
     compression_switch = true;
+    comp_batch_block = NULL;
+    comp_batch_pages = 0;
     thread_count = migrate_compress_threads();
     compress_threads = g_new0(QemuThread, thread_count);
     comp_param = g_new0(CompressParam, thread_count);
@@ -873,6 +900,46 @@ static int do_compress_ram_page(QEMUFile *f, RAMBlock *block,
 
 static uint64_t bytes_transferred;
 
+/* Hand the queued batch of pages to the first idle compression thread,
+ * sending the output of its previous batch to the stream.
+ */
+static void compress_batch_with_multi_thread(QEMUFile *f,
+                                             uint64_t *bytes_transferred)
+{
+    int idx, thread_count, bytes_xmit;
+    CompressParam *param;
+
+    thread_count = migrate_compress_threads();
+    qemu_mutex_lock(&comp_done_lock);
+    while (true) {
+        for (idx = 0; idx < thread_count; idx++) {
+            if (comp_param[idx].done) {
+                break;
+            }
+        }
+        if (idx < thread_count) {
+            break;
+        }
+        qemu_cond_wait(&comp_done_cond, &comp_done_lock);
+    }
+    param = &comp_param[idx];
+    param->done = false;
+    bytes_xmit = qemu_put_qemu_file(f, param->file);
+    *bytes_transferred += bytes_xmit;
+
+    qemu_mutex_lock(&param->mutex);
+    memcpy(param->offset, comp_batch_offset,
+           comp_batch_pages * sizeof(comp_batch_offset[0]));
+    param->nb_pages = comp_batch_pages;
+    param->block = comp_batch_block;
+    qemu_cond_signal(&param->cond);
+    qemu_mutex_unlock(&param->mutex);
+    qemu_mutex_unlock(&comp_done_lock);
+
+    comp_batch_block = NULL;
+    comp_batch_pages = 0;
+}
+
 static void flush_compressed_data(QEMUFile *f)
 {
     int idx, len, thread_count;
@@ -882,6 +949,10 @@ static void flush_compressed_data(QEMUFile *f)
     }
     thread_count = migrate_compress_threads();
 
+    if (comp_batch_pages > 0) {
+        compress_batch_with_multi_thread(f, &bytes_transferred);
+    }
+
     qemu_mutex_lock(&comp_done_lock);
     for (idx = 0; idx < thread_count; idx++) {
         while (!comp_param[idx].done) {
@@ -900,45 +971,25 @@ static void flush_compressed_data(QEMUFile *f)
     }
 }
 
-static inline void set_compress_params(CompressParam *param, RAMBlock *block,
-                                       ram_addr_t offset)
-{
-    param->block = block;
-    param->offset = offset;
-}
-
+/* Queue a page for compression. Pages are compressed by the threads in
+ * batches of COMPRESS_BATCH_PAGES pages of the same block, and the last
+ * partial batch is sent by flush_compressed_data().
+ */
 static int compress_page_with_multi_thread(QEMUFile *f, RAMBlock *block,
                                            ram_addr_t offset,
                                            uint64_t *bytes_transferred)
 {
-    int idx, thread_count, bytes_xmit = -1, pages = -1;
-
-    thread_count = migrate_compress_threads();
-    qemu_mutex_lock(&comp_done_lock);
-    while (true) {
-        for (idx = 0; idx < thread_count; idx++) {
-            if (comp_param[idx].done) {
-                comp_param[idx].done = false;
-                bytes_xmit = qemu_put_qemu_file(f, comp_param[idx].file);
-                qemu_mutex_lock(&comp_param[idx].mutex);
-                set_compress_params(&comp_param[idx], block, offset);
-                qemu_cond_signal(&comp_param[idx].cond);
-                qemu_mutex_unlock(&comp_param[idx].mutex);
-                pages = 1;
-                acct_info.norm_pages++;
-                *bytes_transferred += bytes_xmit;
-                break;
-            }
-        }
-        if (pages > 0) {
-            break;
-        } else {
-            qemu_cond_wait(&comp_done_cond, &comp_done_lock);
-        }
+    if (comp_batch_pages > 0 && comp_batch_block != block) {
+        compress_batch_with_multi_thread(f, bytes_transferred);
     }
-    qemu_mutex_unlock(&comp_done_lock);
+    comp_batch_block = block;
+    comp_batch_offset[comp_batch_pages++] = offset;
+    if (comp_batch_pages == COMPRESS_BATCH_PAGES) {
+        compress_batch_with_multi_thread(f, bytes_transferred);
+    }
+    acct_info.norm_pages++;
 
-    return pages;
+    return 1;
 }
 
 /**
@@ -2252,15 +2303,14 @@ void ram_handle_compressed(void *host, uint8_t ch, uint64_t size)
 static void *do_data_decompress(void *opaque)
 {
     DecompressParam *param = opaque;
-    uint8_t *des;
-    int len;
+    uint8_t *compbuf;
+    int i, nb_pages;
 
     qemu_mutex_lock(&param->mutex);
     while (!param->quit) {
-        if (param->des) {
-            des = param->des;
-            len = param->len;
-            param->des = 0;
+        if (param->nb_pages) {
+            nb_pages = param->nb_pages;
+            param->nb_pages = 0;
             qemu_mutex_unlock(&param->mutex);
 
             /* uncompress() will return failed in some case, especially
@@ -2268,8 +2318,12 @@ static void *do_data_decompress(void *opaque)
              * not a problem because the dirty page will be retransferred
              * and uncompress() won't break the data in other pages.
              */
-            compression_ops.uncompress(des, TARGET_PAGE_SIZE,
-                                       param->compbuf, len);
+            compbuf = param->compbuf;
+            for (i = 0; i < nb_pages; i++) {
+                compression_ops.uncompress(param->des[i], TARGET_PAGE_SIZE,
+                                           compbuf, param->len[i]);
+                compbuf += param->len[i];
+            }
 
             qemu_mutex_lock(&decomp_done_lock);
             param->done = true;
@@ -2286,6 +2340,23 @@ static void *do_data_decompress(void *opaque)
     return NULL;
 }
 
+/* Start decompressing the batch being filled, if any. */
+static void decompress_batch_start(void)
+{
+    DecompressParam *param = decomp_batch;
+
+    if (!param) {
+        return;
+    }
+    qemu_mutex_lock(&param->mutex);
+    param->nb_pages = decomp_batch_size;
+    qemu_cond_signal(&param->cond);
+    qemu_mutex_unlock(&param->mutex);
+
+    decomp_batch = NULL;
+    decomp_batch_size = 0;
+}
+
 static void wait_for_decompress_done(void)
 {
     int idx, thread_count;
@@ -2294,6 +2365,7 @@ static void wait_for_decompress_done(void)
         return;
     }
 
+    decompress_batch_start();
     thread_count = migrate_decompress_threads();
     qemu_mutex_lock(&decomp_done_lock);
     for (idx = 0; idx < thread_count; idx++) {
@@ -2316,7 +2388,8 @@ void migrate_decompress_threads_create(void)
     for (i = 0; i < thread_count; i++) {
         qemu_mutex_init(&decomp_param[i].mutex);
         qemu_cond_init(&decomp_param[i].cond);
-        decomp_param[i].compbuf = g_malloc0(compression_ops.max_compressed_size(TARGET_PAGE_SIZE));
+        decomp_param[i].compbuf = g_malloc0(COMPRESS_BATCH_PAGES *
+                compression_ops.max_compressed_size(TARGET_PAGE_SIZE));
         decomp_param[i].done = true;
         decomp_param[i].quit = false;
         qemu_thread_create(decompress_threads + i, "decompress",
@@ -2346,39 +2419,56 @@ void migrate_decompress_threads_join(void)
     g_free(decomp_param);
     decompress_threads = NULL;
     decomp_param = NULL;
+    decomp_batch = NULL;
+    decomp_batch_size = 0;
 }
 
+/* Read a compressed page into the batch of an idle decompression thread.
+ * The batch is started once full, or by wait_for_decompress_done() at the
+ * end of the section.
+ */
 static void decompress_data_with_multi_threads(QEMUFile *f,
                                                void *host, int len)
 {
-    int idx, thread_count;
+    int idx, thread_count, used;
+    DecompressParam *param;
 
     if (!decompress_threads) {
         migrate_decompress_threads_create();
     }
 
-    thread_count = migrate_decompress_threads();
-    qemu_mutex_lock(&decomp_done_lock);
-    while (true) {
-        for (idx = 0; idx < thread_count; idx++) {
-            if (decomp_param[idx].done) {
-                decomp_param[idx].done = false;
-                qemu_mutex_lock(&decomp_param[idx].mutex);
-                qemu_get_buffer(f, decomp_param[idx].compbuf, len);
-                decomp_param[idx].des = host;
-                decomp_param[idx].len = len;
-                qemu_cond_signal(&decomp_param[idx].cond);
-                qemu_mutex_unlock(&decomp_param[idx].mutex);
+    if (!decomp_batch) {
+        thread_count = migrate_decompress_threads();
+        qemu_mutex_lock(&decomp_done_lock);
+        while (true) {
+            for (idx = 0; idx < thread_count; idx++) {
+                if (decomp_param[idx].done) {
+                    break;
+                }
+            }
+            if (idx < thread_count) {
                 break;
             }
-        }
-        if (idx < thread_count) {
-            break;
-        } else {
             qemu_cond_wait(&decomp_done_cond, &decomp_done_lock);
         }
+        decomp_param[idx].done = false;
+        qemu_mutex_unlock(&decomp_done_lock);
+        decomp_batch = &decomp_param[idx];
+        decomp_batch_size = 0;
+    }
+
+    /* The thread doesn't look at its batch until decompress_batch_start() */
+    param = decomp_batch;
+    used = 0;
+    for (idx = 0; idx < decomp_batch_size; idx++) {
+        used += param->len[idx];
+    }
+    qemu_get_buffer(f, param->compbuf + used, len);
+    param->des[decomp_batch_size] = host;
+    param->len[decomp_batch_size] = len;
+    if (++decomp_batch_size == COMPRESS_BATCH_PAGES) {
+        decompress_batch_start();
     }
-    qemu_mutex_unlock(&decomp_done_lock);
 }
 
 /*
@@ -12,8 +12,69 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "include/migration/migration.h"
 
+/* Run finders: return the end of the run of equal (zrun) or different
+ * (nzrun) bytes starting at offset i.
+ */
+static inline int zrun_end_int(const uint8_t *old_buf, const uint8_t *new_buf,
+                               int i, int slen)
+{
+    /* not aligned to sizeof(long) */
+    long res = (slen - i) % sizeof(long);
+    while (res && old_buf[i] == new_buf[i]) {
+        i++;
+        res--;
+    }
+
+    /* word at a time for speed */
+    if (!res) {
+        while (i < slen &&
+               (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
+            i += sizeof(long);
+        }
+
+        /* go over the rest */
+        while (i < slen && old_buf[i] == new_buf[i]) {
+            i++;
+        }
+    }
+    return i;
+}
+
+static inline int nzrun_end_int(const uint8_t *old_buf,
+                                const uint8_t *new_buf, int i, int slen)
+{
+    /* not aligned to sizeof(long) */
+    long res = (slen - i) % sizeof(long);
+    while (res && old_buf[i] != new_buf[i]) {
+        i++;
+        res--;
+    }
+
+    /* word at a time for speed, use of 32-bit long okay */
+    if (!res) {
+        /* truncation to 32-bit long okay */
+        unsigned long mask = (unsigned long)0x0101010101010101ULL;
+        while (i < slen) {
+            unsigned long xor;
+            xor = *(unsigned long *)(old_buf + i)
+                ^ *(unsigned long *)(new_buf + i);
+            if ((xor - mask) & ~xor & (mask << 7)) {
+                /* found the end of an nzrun within the current long */
+                while (old_buf[i] != new_buf[i]) {
+                    i++;
+                }
+                break;
+            } else {
+                i += sizeof(long);
+            }
+        }
+    }
+    return i;
+}
+
 /*
   page = zrun nzrun
        | zrun nzrun page
@@ -23,17 +84,18 @@
   nzrun = length byte...
 
   length = uleb128 encoded integer
+
+  Runs are always as long as possible, so every run finder below produces
+  the same encoding.
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static inline __attribute__((always_inline)) int
+xbzrle_encode_runs(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                   uint8_t *dst, int dlen,
+                   int (*zrun_end)(const uint8_t *, const uint8_t *, int, int),
+                   int (*nzrun_end)(const uint8_t *, const uint8_t *, int, int))
 {
-    uint32_t zrun_len = 0, nzrun_len = 0;
-    int d = 0, i = 0;
-    long res;
-    uint8_t *nzrun_start = NULL;
-
-    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
-               sizeof(long)));
+    uint32_t zrun_len, nzrun_len;
+    int d = 0, i = 0, start;
 
     while (i < slen) {
         /* overflow */
@@ -41,28 +103,9 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
             return -1;
         }
 
-        /* not aligned to sizeof(long) */
-        res = (slen - i) % sizeof(long);
-        while (res && old_buf[i] == new_buf[i]) {
-            zrun_len++;
-            i++;
-            res--;
-        }
-
-        /* word at a time for speed */
-        if (!res) {
-            while (i < slen &&
-                   (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
-                i += sizeof(long);
-                zrun_len += sizeof(long);
-            }
-
-            /* go over the rest */
-            while (i < slen && old_buf[i] == new_buf[i]) {
-                zrun_len++;
-                i++;
-            }
-        }
+        start = i;
+        i = zrun_end(old_buf, new_buf, i, slen);
+        zrun_len = i - start;
 
         /* buffer unchanged */
         if (zrun_len == slen) {
@@ -76,56 +119,243 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
         d += uleb128_encode_small(dst + d, zrun_len);
 
-        zrun_len = 0;
-        nzrun_start = new_buf + i;
-
         /* overflow */
         if (d + 2 > dlen) {
             return -1;
         }
-        /* not aligned to sizeof(long) */
-        res = (slen - i) % sizeof(long);
-        while (res && old_buf[i] != new_buf[i]) {
-            i++;
-            nzrun_len++;
-            res--;
-        }
-
-        /* word at a time for speed, use of 32-bit long okay */
-        if (!res) {
-            /* truncation to 32-bit long okay */
-            unsigned long mask = (unsigned long)0x0101010101010101ULL;
-            while (i < slen) {
-                unsigned long xor;
-                xor = *(unsigned long *)(old_buf + i)
-                    ^ *(unsigned long *)(new_buf + i);
-                if ((xor - mask) & ~xor & (mask << 7)) {
-                    /* found the end of an nzrun within the current long */
-                    while (old_buf[i] != new_buf[i]) {
-                        nzrun_len++;
-                        i++;
-                    }
-                    break;
-                } else {
-                    i += sizeof(long);
-                    nzrun_len += sizeof(long);
-                }
-            }
-        }
+
+        start = i;
+        i = nzrun_end(old_buf, new_buf, i, slen);
+        nzrun_len = i - start;
 
         d += uleb128_encode_small(dst + d, nzrun_len);
         /* overflow */
         if (d + nzrun_len > dlen) {
             return -1;
         }
-        memcpy(dst + d, nzrun_start, nzrun_len);
+        memcpy(dst + d, new_buf + start, nzrun_len);
         d += nzrun_len;
-        nzrun_len = 0;
     }
 
     return d;
 }
 
+static int xbzrle_encode_int(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                             uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              zrun_end_int, nzrun_end_int);
+}
+
+#if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
+/* Do not use push_options pragmas unnecessarily, because clang
+ * does not support them.
+ */
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+#include <emmintrin.h>
+
+/* The SIMD finders compare 16 (or 32) bytes at a time and locate the end
+ * of the run with the movemask of the comparison.
+ */
+static inline int zrun_end_sse2(const uint8_t *old_buf,
+                                const uint8_t *new_buf, int i, int slen)
+{
+    while (i + 16 <= slen) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(old_buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(new_buf + i));
+        unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+
+        if (eq != 0xFFFF) {
+            return i + ctz32(~eq);
+        }
+        i += 16;
+    }
+    while (i < slen && old_buf[i] == new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static inline int nzrun_end_sse2(const uint8_t *old_buf,
+                                 const uint8_t *new_buf, int i, int slen)
+{
+    while (i + 16 <= slen) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(old_buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(new_buf + i));
+        unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+
+        if (eq) {
+            return i + ctz32(eq);
+        }
+        i += 16;
+    }
+    while (i < slen && old_buf[i] != new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_sse2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                              uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              zrun_end_sse2, nzrun_end_sse2);
+}
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC pop_options
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline int zrun_end_avx2(const uint8_t *old_buf,
+                                const uint8_t *new_buf, int i, int slen)
+{
+    while (i + 32 <= slen) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(old_buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(new_buf + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+
+        if (eq != 0xFFFFFFFF) {
+            return i + ctz32(~eq);
+        }
+        i += 32;
+    }
+    while (i < slen && old_buf[i] == new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static inline int nzrun_end_avx2(const uint8_t *old_buf,
+                                 const uint8_t *new_buf, int i, int slen)
+{
+    while (i + 32 <= slen) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(old_buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(new_buf + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+
+        if (eq) {
+            return i + ctz32(eq);
+        }
+        i += 32;
+    }
+    while (i < slen && old_buf[i] != new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_avx2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                              uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              zrun_end_avx2, nzrun_end_avx2);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+/* Note that for test_xbzrle_encode_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX2    1
+#define CACHE_SSE2    2
+
+#ifdef CONFIG_AVX2_OPT
+# define INIT_CACHE 0
+# define INIT_ACCEL xbzrle_encode_int
+#else
+# ifndef __SSE2__
+#  error "ISA selection confusion"
+# endif
+# define INIT_CACHE CACHE_SSE2
+# define INIT_ACCEL xbzrle_encode_sse2
+#endif
+
+static unsigned cpuid_cache = INIT_CACHE;
+static int (*encode_accel)(uint8_t *, uint8_t *, int, uint8_t *, int) =
+    INIT_ACCEL;
+
+static void init_accel(unsigned cache)
+{
+    int (*fn)(uint8_t *, uint8_t *, int, uint8_t *, int) = xbzrle_encode_int;
+    if (cache & CACHE_SSE2) {
+        fn = xbzrle_encode_sse2;
+    }
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = xbzrle_encode_avx2;
+    }
+#endif
+    encode_accel = fn;
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include <cpuid.h>
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (d & bit_SSE2) {
+            cache |= CACHE_SSE2;
+        }
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 6) == 6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    /* If no bits set, we just tested xbzrle_encode_int, and there
+       are no more acceleration options to test.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+#define ENCODE_ACCEL encode_accel
+#else
+bool test_xbzrle_encode_next_accel(void)
+{
+    return false;
+}
+
+#define ENCODE_ACCEL xbzrle_encode_int
+#endif
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
+               sizeof(long)));
+
+    return ENCODE_ACCEL(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
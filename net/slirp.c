@@ -35,6 +35,7 @@
 #include "monitor/monitor.h"
 #include "qemu/abort.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qemu/sockets.h"
 #include "slirp/libslirp.h"
 #include "slirp/ip6.h"
@@ -150,6 +151,31 @@ static ssize_t net_slirp_receive(NetClientState *nc, const uint8_t *buf, size_t
     return size;
 }
 
+static ssize_t net_slirp_receive_iov(NetClientState *nc,
+                                     const struct iovec *iov, int iovcnt)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+    SlirpShaper *shaper = &s->shaper_in;
+    size_t size = iov_size(iov, iovcnt);
+    uint8_t *buf;
+
+    if (!shaper->send) {
+        slirp_input_iov(s->slirp, iov, iovcnt);
+        return size;
+    }
+    if (iovcnt == 1) {
+        shaper->send(shaper->peer, iov[0].iov_base, size);
+        return size;
+    }
+
+    /* The shaper takes a flat frame, which it copies */
+    buf = g_malloc(size);
+    iov_to_buf(iov, iovcnt, 0, buf, size);
+    shaper->send(shaper->peer, buf, size);
+    g_free(buf);
+    return size;
+}
+
 static void slirp_smb_exit(Notifier *n, void *data)
 {
     SlirpState *s = container_of(n, SlirpState, exit_notifier);
@@ -172,6 +198,7 @@ static NetClientInfo net_slirp_info = {
     .type = NET_CLIENT_DRIVER_USER,
     .size = sizeof(SlirpState),
     .receive = net_slirp_receive,
+    .receive_iov = net_slirp_receive_iov,
     .cleanup = net_slirp_cleanup,
 };
 
@@ -29,6 +29,12 @@
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* Number of items a page can be stored in. The items of a set are
+ * contiguous, so a lookup touches at most two cache lines, and the least
+ * recently used item of the set is the one replaced.
+ */
+#define CACHE_WAYS 4
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
@@ -43,6 +49,8 @@ struct PageCache {
     int64_t max_num_items;
     uint64_t max_item_age;
     int64_t num_items;
+    int64_t num_sets;
+    unsigned int ways;
 };
 
 PageCache *cache_init(int64_t num_pages, unsigned int page_size)
@@ -71,8 +79,11 @@ PageCache *cache_init(int64_t num_pages, unsigned int page_size)
     cache->num_items = 0;
     cache->max_item_age = 0;
     cache->max_num_items = num_pages;
+    cache->ways = MIN(num_pages, CACHE_WAYS);
+    cache->num_sets = num_pages / cache->ways;
 
-    DPRINTF("Setting cache buckets to %" PRId64 "\n", cache->max_num_items);
+    DPRINTF("Setting cache buckets to %" PRId64 " (%u ways)\n",
+            cache->num_sets, cache->ways);
 
     /* We prefer not to abort if there is no memory */
     cache->page_cache = g_try_malloc((cache->max_num_items) *
@@ -108,28 +119,62 @@ void cache_fini(PageCache *cache)
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+/* Returns the first item of the set |address| maps to */
+static CacheItem *cache_get_set(const PageCache *cache, uint64_t address)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    size_t pos;
+
+    g_assert(cache);
+    g_assert(cache->page_cache);
+    g_assert(cache->num_sets);
+
+    pos = (address / cache->page_size) & (cache->num_sets - 1);
+    return &cache->page_cache[pos * cache->ways];
 }
 
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
-    size_t pos;
+    CacheItem *set = cache_get_set(cache, addr);
+    unsigned int i;
 
-    g_assert(cache);
-    g_assert(cache->page_cache);
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == addr) {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
 
-    pos = cache_get_cache_pos(cache, addr);
+/* Returns the item of the set to store |addr| in: the one already holding
+ * it, a free one, or else the least recently used one.
+ */
+static CacheItem *cache_get_victim(const PageCache *cache, uint64_t addr)
+{
+    CacheItem *set = cache_get_set(cache, addr);
+    CacheItem *victim = &set[0];
+    unsigned int i;
 
-    return &cache->page_cache[pos];
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == addr) {
+            return &set[i];
+        }
+    }
+    for (i = 0; i < cache->ways; i++) {
+        if (!set[i].it_data) {
+            return &set[i];
+        }
+        if (set[i].it_age < victim->it_age) {
+            victim = &set[i];
+        }
+    }
+    return victim;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
@@ -139,7 +184,7 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
         return true;
@@ -154,7 +199,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
     CacheItem *it;
 
     /* actual update of entry */
-    it = cache_get_by_addr(cache, addr);
+    it = cache_get_victim(cache, addr);
 
     if (it->it_data && it->it_addr != addr &&
         it->it_age + CACHED_PAGE_LIFETIME > current_age) {
@@ -209,7 +254,7 @@ int64_t cache_resize(PageCache *cache, int64_t new_num_pages)
         old_it = &cache->page_cache[i];
         if (old_it->it_addr != -1) {
             /* check for collision, if there is, keep MRU page */
-            new_it = cache_get_by_addr(new_cache, old_it->it_addr);
+            new_it = cache_get_victim(new_cache, old_it->it_addr);
             if (new_it->it_data && new_it->it_age >= old_it->it_age) {
                 /* keep the MRU page */
                 g_free(old_it->it_data);
@@ -229,6 +274,8 @@ int64_t cache_resize(PageCache *cache, int64_t new_num_pages)
     cache->page_cache = new_cache->page_cache;
     cache->max_num_items = new_cache->max_num_items;
     cache->num_items = new_cache->num_items;
+    cache->num_sets = new_cache->num_sets;
+    cache->ways = new_cache->ways;
 
     g_free(new_cache);
 
@@ -45,6 +45,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout);
 void slirp_pollfds_poll(GArray *pollfds, int select_error);
 
 void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len);
+void slirp_input_iov(Slirp *slirp, const struct iovec *iov, int iovcnt);
 
 /* you must provide the following functions: */
 void slirp_output(void *opaque, const uint8_t *pkt, int pkt_len);
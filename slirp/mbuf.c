@@ -18,7 +18,12 @@
 #include "qemu/osdep.h"
 #include "slirp.h"
 
-#define MBUF_THRESH 30
+/*
+ * Free mbufs kept around for reuse.  A busy connection cycles through
+ * hundreds of them per main loop iteration, so the pool has to be large
+ * enough for malloc() to stay out of the per packet path.
+ */
+#define MBUF_POOL_MAX 512
 
 /*
  * Find a nice value for msize
@@ -58,15 +63,13 @@ void m_cleanup(Slirp *slirp)
  * Get an mbuf from the free list, if there are none
  * malloc one
  *
- * Because fragmentation can occur if we alloc new mbufs and
- * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
- * which tells m_free to actually free() it
+ * m_free() puts mbufs back on the free list until it holds
+ * MBUF_POOL_MAX of them, and only free()s the ones beyond that
  */
 struct mbuf *
 m_get(Slirp *slirp)
 {
 	register struct mbuf *m;
-	int flags = 0;
 
 	DEBUG_CALL("m_get");
 
@@ -74,17 +77,16 @@ m_get(Slirp *slirp)
 		m = (struct mbuf *)malloc(SLIRP_MSIZE);
 		if (m == NULL) goto end_error;
 		slirp->mbuf_alloced++;
-		if (slirp->mbuf_alloced > MBUF_THRESH)
-			flags = M_DOFREE;
 		m->slirp = slirp;
 	} else {
 		m = (struct mbuf *) slirp->m_freelist.qh_link;
 		remque(m);
+		slirp->mbuf_free--;
 	}
 
 	/* Insert it in the used list */
 	insque(m,&slirp->m_usedlist);
-	m->m_flags = (flags | M_USEDLIST);
+	m->m_flags = M_USEDLIST;
 
 	/* Initialise it */
 	m->m_size = SLIRP_MSIZE - offsetof(struct mbuf, m_dat);
@@ -118,11 +120,14 @@ m_free(struct mbuf *m)
 	/*
 	 * Either free() it or put it on the free list
 	 */
-	if (m->m_flags & M_DOFREE) {
+	if ((m->m_flags & M_DOFREE) ||
+	    ((m->m_flags & M_FREELIST) == 0 &&
+	     m->slirp->mbuf_free >= MBUF_POOL_MAX)) {
 		m->slirp->mbuf_alloced--;
 		free(m);
 	} else if ((m->m_flags & M_FREELIST) == 0) {
 		insque(m,&m->slirp->m_freelist);
+		m->slirp->mbuf_free++;
 		m->m_flags = M_FREELIST; /* Clobber other flags */
 	}
   } /* if(m) */
@@ -95,6 +95,16 @@ sbappend(struct socket *so, struct mbuf *m)
 		return;
 	}
 
+	/*
+	 * Host sockets are written in one go at the end of the burst
+	 */
+	if (so->s != -1) {
+		sbappendsb(&so->so_rcv, m);
+		m_free(m);
+		sowrite_deferred(so);
+		return;
+	}
+
 	/*
 	 * We only write if there's nothing in the buffer,
 	 * ottherwise it'll arrive out of order, and hence corrupt
@@ -29,6 +29,7 @@
 #include "slirp.h"
 #include "hw/hw.h"
 #include "qemu/cutils.h"
+#include "qemu/iov.h"
 
 #ifndef _WIN32
 #include <net/if.h>
@@ -461,6 +462,19 @@ Slirp *slirp_init(int restricted, bool in_enabled, struct in_addr vnetwork,
 
     slirp->opaque = opaque;
 
+    slirp->write_bh = qemu_bh_new(sowrite_flush, slirp);
+
+#ifdef CONFIG_EPOLL
+#ifdef CONFIG_EPOLL_CREATE1
+    slirp->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    slirp->epoll_fd = epoll_create(SLIRP_EPOLL_EVENTS);
+    if (slirp->epoll_fd != -1) {
+        qemu_set_cloexec(slirp->epoll_fd);
+    }
+#endif
+#endif
+
     register_savevm(NULL, "slirp", 0, 4,
                     slirp_state_save, slirp_state_load, slirp);
 
@@ -479,6 +493,14 @@ void slirp_cleanup(Slirp *slirp)
     ip6_cleanup(slirp);
     m_cleanup(slirp);
 
+    qemu_bh_delete(slirp->write_bh);
+
+#ifdef CONFIG_EPOLL
+    if (slirp->epoll_fd != -1) {
+        close(slirp->epoll_fd);
+    }
+#endif
+
     g_rand_free(slirp->grand);
 
     g_free(slirp->vdnssearch);
@@ -516,6 +538,162 @@ static void slirp_update_timeout(uint32_t *timeout)
     *timeout = t;
 }
 
+static void slirp_tcp_socket_poll(struct socket *so, int revents);
+static void slirp_udp_socket_poll(struct socket *so, int revents);
+static void slirp_icmp_socket_poll(struct socket *so, int revents);
+
+#ifdef CONFIG_EPOLL
+/*
+ * With hundreds of guest connections, building and scanning a GPollFD per
+ * socket dominates the cost of an idle main loop iteration.  Sockets are
+ * instead kept in a level-triggered epoll set whose interest is only
+ * updated when it changes, the main loop polls the epoll descriptor, and
+ * only the sockets it reports are looked at.
+ */
+static uint32_t slirp_epoll_from_gio(int events)
+{
+    return (events & G_IO_IN ? EPOLLIN : 0) |
+           (events & G_IO_PRI ? EPOLLPRI : 0) |
+           (events & G_IO_OUT ? EPOLLOUT : 0) |
+           (events & G_IO_ERR ? EPOLLERR : 0) |
+           (events & G_IO_HUP ? EPOLLHUP : 0);
+}
+
+static int slirp_epoll_to_gio(uint32_t events)
+{
+    return (events & EPOLLIN ? G_IO_IN : 0) |
+           (events & EPOLLPRI ? G_IO_PRI : 0) |
+           (events & EPOLLOUT ? G_IO_OUT : 0) |
+           (events & EPOLLERR ? G_IO_ERR : 0) |
+           (events & EPOLLHUP ? G_IO_HUP : 0);
+}
+
+static void slirp_epoll_update(struct socket *so, int events,
+                               void (*handler)(struct socket *, int))
+{
+    Slirp *slirp = so->slirp;
+    struct epoll_event ev;
+    int op;
+
+    if (so->so_epoll_fd != so->s) {
+        /* The old descriptor was closed, which took it out of the set */
+        so->so_epoll_fd = -1;
+        so->so_epoll_events = 0;
+    }
+    so->so_epoll_handler = handler;
+    if (events == so->so_epoll_events) {
+        return;
+    }
+
+    if (!events) {
+        /* Errors and hangups are reported even with an empty mask */
+        epoll_ctl(slirp->epoll_fd, EPOLL_CTL_DEL, so->s, NULL);
+        so->so_epoll_fd = -1;
+        so->so_epoll_events = 0;
+        return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = slirp_epoll_from_gio(events);
+    ev.data.ptr = so;
+    op = so->so_epoll_fd == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(slirp->epoll_fd, op, so->s, &ev) < 0) {
+        /* The descriptor number may have been reused behind our back */
+        op = op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(slirp->epoll_fd, op, so->s, &ev) < 0) {
+            DEBUG_MISC((dfd, "epoll_ctl failed: %s\n", strerror(errno)));
+            so->so_epoll_fd = -1;
+            so->so_epoll_events = 0;
+            slirp->epoll_failed = true;
+            return;
+        }
+    }
+    so->so_epoll_fd = so->s;
+    so->so_epoll_events = events;
+}
+
+/* Drop @so from the epoll set, before it is freed or its fd replaced */
+void slirp_epoll_remove(struct socket *so)
+{
+    Slirp *slirp = so->slirp;
+    int i;
+
+    if (slirp->epoll_fd == -1) {
+        return;
+    }
+    if (so->so_epoll_fd != -1 && so->so_epoll_fd == so->s) {
+        epoll_ctl(slirp->epoll_fd, EPOLL_CTL_DEL, so->s, NULL);
+    }
+    so->so_epoll_fd = -1;
+    so->so_epoll_events = 0;
+    for (i = 0; i < slirp->epoll_nevents; i++) {
+        if (slirp->epoll_events[i].data.ptr == so) {
+            slirp->epoll_events[i].data.ptr = NULL;
+        }
+    }
+}
+
+static void slirp_epoll_dispatch(Slirp *slirp, GArray *pollfds)
+{
+    int i, n;
+
+    if (slirp->epoll_pollfds_idx == -1 ||
+        !(g_array_index(pollfds, GPollFD,
+                        slirp->epoll_pollfds_idx).revents & G_IO_IN)) {
+        return;
+    }
+
+    do {
+        n = epoll_wait(slirp->epoll_fd, slirp->epoll_events,
+                       SLIRP_EPOLL_EVENTS, 0);
+    } while (n < 0 && errno == EINTR);
+
+    /* Sockets left over are level-triggered, they show up next time */
+    slirp->epoll_nevents = MAX(n, 0);
+    for (i = 0; i < slirp->epoll_nevents; i++) {
+        struct socket *so = slirp->epoll_events[i].data.ptr;
+
+        /* NULL if an earlier handler freed the socket */
+        if (so) {
+            so->so_epoll_handler(so,
+                    slirp_epoll_to_gio(slirp->epoll_events[i].events));
+        }
+    }
+    slirp->epoll_nevents = 0;
+}
+#endif
+
+/*
+ * Ask for @events on @so during the next poll, @handler being what
+ * slirp_pollfds_poll() runs when some of them are reported.
+ */
+static void slirp_poll_socket(GArray *pollfds, struct socket *so, int events,
+                              void (*handler)(struct socket *, int))
+{
+#ifdef CONFIG_EPOLL
+    if (so->slirp->epoll_fd != -1) {
+        slirp_epoll_update(so, events, handler);
+        return;
+    }
+#endif
+    if (events) {
+        GPollFD pfd = {
+            .fd = so->s,
+            .events = events,
+        };
+        so->pollfds_idx = pollfds->len;
+        g_array_append_val(pollfds, pfd);
+    }
+}
+
+static int slirp_socket_revents(GArray *pollfds, struct socket *so)
+{
+    if (so->pollfds_idx == -1) {
+        return 0;
+    }
+    return g_array_index(pollfds, GPollFD, so->pollfds_idx).revents;
+}
+
 void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
 {
     Slirp *slirp;
@@ -530,6 +708,16 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
      */
 
     QTAILQ_FOREACH(slirp, &slirp_instances, entry) {
+#ifdef CONFIG_EPOLL
+        if (slirp->epoll_failed) {
+            /* Poll every socket on its own from now on */
+            close(slirp->epoll_fd);
+            slirp->epoll_fd = -1;
+            slirp->epoll_failed = false;
+        }
+        slirp->epoll_pollfds_idx = -1;
+#endif
+
         /*
          * *_slowtimo needs calling if there are IP fragments
          * in the fragment queue, or there are TCP connections active
@@ -558,6 +746,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * newly socreated() sockets etc. Don't want to select these.
              */
             if (so->so_state & SS_NOFDREF || so->s == -1) {
+                slirp_poll_socket(pollfds, so, 0, slirp_tcp_socket_poll);
                 continue;
             }
 
@@ -565,12 +754,8 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * Set for reading sockets which are accepting
              */
             if (so->so_state & SS_FACCEPTCONN) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_IN | G_IO_HUP | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                slirp_poll_socket(pollfds, so, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                  slirp_tcp_socket_poll);
                 continue;
             }
 
@@ -578,12 +763,8 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * Set for writing sockets which are connecting
              */
             if (so->so_state & SS_ISFCONNECTING) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_OUT | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                slirp_poll_socket(pollfds, so, G_IO_OUT | G_IO_ERR,
+                                  slirp_tcp_socket_poll);
                 continue;
             }
 
@@ -604,14 +785,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
                 events |= G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_PRI;
             }
 
-            if (events) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = events,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
-            }
+            slirp_poll_socket(pollfds, so, events, slirp_tcp_socket_poll);
         }
 
         /*
@@ -619,6 +793,8 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
          */
         for (so = slirp->udb.so_next; so != &slirp->udb;
                 so = so_next) {
+            int events = 0;
+
             so_next = so->so_next;
 
             so->pollfds_idx = -1;
@@ -646,13 +822,9 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * (XXX <= 4 ?)
              */
             if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_IN | G_IO_HUP | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                events = G_IO_IN | G_IO_HUP | G_IO_ERR;
             }
+            slirp_poll_socket(pollfds, so, events, slirp_udp_socket_poll);
         }
 
         /*
@@ -660,6 +832,8 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
          */
         for (so = slirp->icmp.so_next; so != &slirp->icmp;
                 so = so_next) {
+            int events = 0;
+
             so_next = so->so_next;
 
             so->pollfds_idx = -1;
@@ -677,23 +851,211 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
             }
 
             if (so->so_state & SS_ISFCONNECTED) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_IN | G_IO_HUP | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                events = G_IO_IN | G_IO_HUP | G_IO_ERR;
             }
+            slirp_poll_socket(pollfds, so, events, slirp_icmp_socket_poll);
+        }
+
+#ifdef CONFIG_EPOLL
+        if (slirp->epoll_fd != -1) {
+            GPollFD pfd = {
+                .fd = slirp->epoll_fd,
+                .events = G_IO_IN,
+            };
+            slirp->epoll_pollfds_idx = pollfds->len;
+            g_array_append_val(pollfds, pfd);
         }
+#endif
     }
     slirp_update_timeout(timeout);
 }
 
+static void slirp_tcp_socket_poll(struct socket *so, int revents)
+{
+    int ret;
+
+    if (so->so_state & SS_NOFDREF || so->s == -1) {
+        return;
+    }
+
+    /*
+     * Check for URG data
+     * This will soread as well, so no need to
+     * test for G_IO_IN below if this succeeds
+     */
+    if (revents & G_IO_PRI) {
+        ret = sorecvoob(so);
+        if (ret < 0) {
+            /* Socket error might have resulted in the socket being
+             * removed, do not try to do anything more with it. */
+            return;
+        }
+    }
+    /*
+     * Check sockets for reading
+     */
+    else if (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) {
+        /*
+         * Check for incoming connections
+         */
+        if (so->so_state & SS_FACCEPTCONN) {
+            tcp_connect(so);
+            return;
+        } /* else */
+        ret = soread(so);
+
+        /* Output it if we read something */
+        if (ret > 0) {
+            tcp_output(sototcpcb(so));
+        }
+        if (ret < 0) {
+            /* Socket error might have resulted in the socket being
+             * removed, do not try to do anything more with it. */
+            return;
+        }
+    }
+
+    /*
+     * Check sockets for writing
+     */
+    if (!(so->so_state & SS_NOFDREF) &&
+            (revents & (G_IO_OUT | G_IO_ERR))) {
+        /*
+         * Check for non-blocking, still-connecting sockets
+         */
+        if (so->so_state & SS_ISFCONNECTING) {
+            /* Connected */
+            so->so_state &= ~SS_ISFCONNECTING;
+
+            ret = send(so->s, (const void *) &ret, 0, 0);
+            if (ret < 0) {
+                /* XXXXX Must fix, zero bytes is a NOP */
+                if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINPROGRESS || errno == ENOTCONN) {
+                    return;
+                }
+
+                /* else failed */
+                so->so_state &= SS_PERSISTENT_MASK;
+                so->so_state |= SS_NOFDREF;
+            }
+            /* else so->so_state &= ~SS_ISFCONNECTING; */
+
+            /*
+             * Continue tcp_input
+             */
+            tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
+                      so->so_ffamily);
+            /* continue; */
+        } else {
+            ret = sowrite(so);
+        }
+        /*
+         * XXXXX If we wrote something (a lot), there
+         * could be a need for a window update.
+         * In the worst case, the remote will send
+         * a window probe to get things going again
+         */
+    }
+
+    /*
+     * Probe a still-connecting, non-blocking socket
+     * to check if it's still alive
+     */
+#ifdef PROBE_CONN
+    if (so->so_state & SS_ISFCONNECTING) {
+        ret = qemu_recv(so->s, &ret, 0, 0);
+
+        if (ret < 0) {
+            /* XXX */
+            if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                errno == EINPROGRESS || errno == ENOTCONN) {
+                return; /* Still connecting, continue */
+            }
+
+            /* else failed */
+            so->so_state &= SS_PERSISTENT_MASK;
+            so->so_state |= SS_NOFDREF;
+
+            /* tcp_input will take care of it */
+        } else {
+            ret = send(so->s, &ret, 0, 0);
+            if (ret < 0) {
+                /* XXX */
+                if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINPROGRESS || errno == ENOTCONN) {
+                    return;
+                }
+                /* else failed */
+                so->so_state &= SS_PERSISTENT_MASK;
+                so->so_state |= SS_NOFDREF;
+            } else {
+                so->so_state &= ~SS_ISFCONNECTING;
+            }
+
+        }
+        tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
+                  so->so_ffamily);
+    } /* SS_ISFCONNECTING */
+#endif
+}
+
+/*
+ * Incoming packets are sent straight away, they're not buffered.
+ * Incoming UDP data isn't buffered either.
+ */
+static void slirp_udp_socket_poll(struct socket *so, int revents)
+{
+    if (so->s != -1 &&
+        (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
+        sorecvfrom(so);
+    }
+}
+
+/*
+ * Check incoming ICMP relies.
+ */
+static void slirp_icmp_socket_poll(struct socket *so, int revents)
+{
+    if (so->s != -1 &&
+        (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
+        if (so->so_type == IPPROTO_ICMPV6)
+            icmp6_receive(so);
+        else
+            icmp_receive(so);
+    }
+}
+
+static void slirp_dispatch_sockets(Slirp *slirp, GArray *pollfds)
+{
+    struct socket *so, *so_next;
+
+#ifdef CONFIG_EPOLL
+    if (slirp->epoll_fd != -1) {
+        slirp_epoll_dispatch(slirp, pollfds);
+        return;
+    }
+#endif
+
+    for (so = slirp->tcb.so_next; so != &slirp->tcb; so = so_next) {
+        so_next = so->so_next;
+        slirp_tcp_socket_poll(so, slirp_socket_revents(pollfds, so));
+    }
+
+    for (so = slirp->udb.so_next; so != &slirp->udb; so = so_next) {
+        so_next = so->so_next;
+        slirp_udp_socket_poll(so, slirp_socket_revents(pollfds, so));
+    }
+
+    for (so = slirp->icmp.so_next; so != &slirp->icmp; so = so_next) {
+        so_next = so->so_next;
+        slirp_icmp_socket_poll(so, slirp_socket_revents(pollfds, so));
+    }
+}
+
 void slirp_pollfds_poll(GArray *pollfds, int select_error)
 {
     Slirp *slirp;
-    struct socket *so, *so_next;
-    int ret;
 
     if (QTAILQ_EMPTY(&slirp_instances)) {
         return;
@@ -721,193 +1083,7 @@ void slirp_pollfds_poll(GArray *pollfds, int select_error)
          * Check sockets
          */
         if (!select_error) {
-            /*
-             * Check TCP sockets
-             */
-            for (so = slirp->tcb.so_next; so != &slirp->tcb;
-                    so = so_next) {
-                int revents;
-
-                so_next = so->so_next;
-
-                revents = 0;
-                if (so->pollfds_idx != -1) {
-                    revents = g_array_index(pollfds, GPollFD,
-                                            so->pollfds_idx).revents;
-                }
-
-                if (so->so_state & SS_NOFDREF || so->s == -1) {
-                    continue;
-                }
-
-                /*
-                 * Check for URG data
-                 * This will soread as well, so no need to
-                 * test for G_IO_IN below if this succeeds
-                 */
-                if (revents & G_IO_PRI) {
-                    ret = sorecvoob(so);
-                    if (ret < 0) {
-                        /* Socket error might have resulted in the socket being
-                         * removed, do not try to do anything more with it. */
-                        continue;
-                    }
-                }
-                /*
-                 * Check sockets for reading
-                 */
-                else if (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) {
-                    /*
-                     * Check for incoming connections
-                     */
-                    if (so->so_state & SS_FACCEPTCONN) {
-                        tcp_connect(so);
-                        continue;
-                    } /* else */
-                    ret = soread(so);
-
-                    /* Output it if we read something */
-                    if (ret > 0) {
-                        tcp_output(sototcpcb(so));
-                    }
-                    if (ret < 0) {
-                        /* Socket error might have resulted in the socket being
-                         * removed, do not try to do anything more with it. */
-                        continue;
-                    }
-                }
-
-                /*
-                 * Check sockets for writing
-                 */
-                if (!(so->so_state & SS_NOFDREF) &&
-                        (revents & (G_IO_OUT | G_IO_ERR))) {
-                    /*
-                     * Check for non-blocking, still-connecting sockets
-                     */
-                    if (so->so_state & SS_ISFCONNECTING) {
-                        /* Connected */
-                        so->so_state &= ~SS_ISFCONNECTING;
-
-                        ret = send(so->s, (const void *) &ret, 0, 0);
-                        if (ret < 0) {
-                            /* XXXXX Must fix, zero bytes is a NOP */
-                            if (errno == EAGAIN || errno == EWOULDBLOCK ||
-                                errno == EINPROGRESS || errno == ENOTCONN) {
-                                continue;
-                            }
-
-                            /* else failed */
-                            so->so_state &= SS_PERSISTENT_MASK;
-                            so->so_state |= SS_NOFDREF;
-                        }
-                        /* else so->so_state &= ~SS_ISFCONNECTING; */
-
-                        /*
-                         * Continue tcp_input
-                         */
-                        tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
-                                  so->so_ffamily);
-                        /* continue; */
-                    } else {
-                        ret = sowrite(so);
-                    }
-                    /*
-                     * XXXXX If we wrote something (a lot), there
-                     * could be a need for a window update.
-                     * In the worst case, the remote will send
-                     * a window probe to get things going again
-                     */
-                }
-
-                /*
-                 * Probe a still-connecting, non-blocking socket
-                 * to check if it's still alive
-                 */
-#ifdef PROBE_CONN
-                if (so->so_state & SS_ISFCONNECTING) {
-                    ret = qemu_recv(so->s, &ret, 0, 0);
-
-                    if (ret < 0) {
-                        /* XXX */
-                        if (errno == EAGAIN || errno == EWOULDBLOCK ||
-                            errno == EINPROGRESS || errno == ENOTCONN) {
-                            continue; /* Still connecting, continue */
-                        }
-
-                        /* else failed */
-                        so->so_state &= SS_PERSISTENT_MASK;
-                        so->so_state |= SS_NOFDREF;
-
-                        /* tcp_input will take care of it */
-                    } else {
-                        ret = send(so->s, &ret, 0, 0);
-                        if (ret < 0) {
-                            /* XXX */
-                            if (errno == EAGAIN || errno == EWOULDBLOCK ||
-                                errno == EINPROGRESS || errno == ENOTCONN) {
-                                continue;
-                            }
-                            /* else failed */
-                            so->so_state &= SS_PERSISTENT_MASK;
-                            so->so_state |= SS_NOFDREF;
-                        } else {
-                            so->so_state &= ~SS_ISFCONNECTING;
-                        }
-
-                    }
-                    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
-                              so->so_ffamily);
-                } /* SS_ISFCONNECTING */
-#endif
-            }
-
-            /*
-             * Now UDP sockets.
-             * Incoming packets are sent straight away, they're not buffered.
-             * Incoming UDP data isn't buffered either.
-             */
-            for (so = slirp->udb.so_next; so != &slirp->udb;
-                    so = so_next) {
-                int revents;
-
-                so_next = so->so_next;
-
-                revents = 0;
-                if (so->pollfds_idx != -1) {
-                    revents = g_array_index(pollfds, GPollFD,
-                            so->pollfds_idx).revents;
-                }
-
-                if (so->s != -1 &&
-                    (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
-                    sorecvfrom(so);
-                }
-            }
-
-            /*
-             * Check incoming ICMP relies.
-             */
-            for (so = slirp->icmp.so_next; so != &slirp->icmp;
-                    so = so_next) {
-                    int revents;
-
-                    so_next = so->so_next;
-
-                    revents = 0;
-                    if (so->pollfds_idx != -1) {
-                        revents = g_array_index(pollfds, GPollFD,
-                                                so->pollfds_idx).revents;
-                    }
-
-                    if (so->s != -1 &&
-                        (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
-                        if (so->so_type == IPPROTO_ICMPV6)
-                            icmp6_receive(so);
-                        else
-                            icmp_receive(so);
-                }
-            }
+            slirp_dispatch_sockets(slirp, pollfds);
         }
 
         if_start(slirp);
@@ -978,17 +1154,40 @@ static void arp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
 }
 
 void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
+{
+    struct iovec iov = {
+        .iov_base = (void *)pkt,
+        .iov_len = pkt_len,
+    };
+
+    slirp_input_iov(slirp, &iov, 1);
+}
+
+/*
+ * Frames handed over by the NIC as a scatter-gather list are copied
+ * straight into the mbuf, instead of being flattened by the net layer
+ * first.
+ */
+void slirp_input_iov(Slirp *slirp, const struct iovec *iov, int iovcnt)
 {
     struct mbuf *m;
+    uint8_t eh[ETH_HLEN];
+    uint8_t arp_pkt[ETH_HLEN + sizeof(struct slirp_arphdr)];
+    int pkt_len = iov_size(iov, iovcnt);
     int proto;
 
     if (pkt_len < ETH_HLEN)
         return;
 
-    proto = ntohs(*(uint16_t *)(pkt + 12));
+    iov_to_buf(iov, iovcnt, 0, eh, sizeof(eh));
+    proto = ntohs(*(uint16_t *)(eh + 12));
     switch(proto) {
     case ETH_P_ARP:
-        arp_input(slirp, pkt, pkt_len);
+        if (pkt_len < sizeof(arp_pkt)) {
+            return;
+        }
+        iov_to_buf(iov, iovcnt, 0, arp_pkt, sizeof(arp_pkt));
+        arp_input(slirp, arp_pkt, sizeof(arp_pkt));
         break;
     case ETH_P_IP:
     case ETH_P_IPV6:
@@ -1001,7 +1200,7 @@ void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
             m_inc(m, pkt_len + TCPIPHDR_DELTA + 2);
         }
         m->m_len = pkt_len + TCPIPHDR_DELTA + 2;
-        memcpy(m->m_data + TCPIPHDR_DELTA + 2, pkt, pkt_len);
+        iov_to_buf(iov, iovcnt, 0, m->m_data + TCPIPHDR_DELTA + 2, pkt_len);
 
         m->m_data += TCPIPHDR_DELTA + 2 + ETH_HLEN;
         m->m_len -= TCPIPHDR_DELTA + 2 + ETH_HLEN;
@@ -1502,6 +1701,7 @@ static int slirp_socket_load(QEMUFile *f, struct socket *so, int version_id)
                 "so_ffamily unknown, unable to restore so_laddr and so_lport");
         }
     }
+    sohash(so->slirp->tcb_hash, so);
     so->so_iptos = qemu_get_byte(f);
     so->so_emu = qemu_get_byte(f);
     so->so_type = qemu_get_byte(f);
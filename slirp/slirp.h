@@ -52,6 +52,10 @@ typedef char *caddr_t;
 # include <sys/select.h>
 #endif
 
+#ifdef CONFIG_EPOLL
+# include <sys/epoll.h>
+#endif
+
 #ifdef HAVE_SYS_WAIT_H
 # include <sys/wait.h>
 #endif
@@ -153,6 +157,9 @@ bool ndp_table_search(Slirp *slirp, struct in6_addr ip_addr,
 
 #define SLIRP_MAX_DNS_SERVERS 4
 
+/* Ready sockets handled per main loop iteration with epoll */
+#define SLIRP_EPOLL_EVENTS 64
+
 struct Slirp {
     QTAILQ_ENTRY(Slirp) entry;
     u_int time_fasttimo;
@@ -185,6 +192,7 @@ struct Slirp {
     struct quehead m_freelist;
     struct quehead m_usedlist;
     int mbuf_alloced;
+    int mbuf_free;          /* mbufs on m_freelist */
 
     /* if states */
     struct quehead if_fastq;   /* fast queue (for interactive data) */
@@ -202,15 +210,21 @@ struct Slirp {
     size_t vdnssearch_len;
     uint8_t *vdnssearch;
 
+    /* sockets whose so_rcv gets written by write_bh */
+    struct socket *write_list;
+    QEMUBH *write_bh;
+
     /* tcp states */
     struct socket tcb;
     struct socket *tcp_last_so;
+    struct socket *tcb_hash[SO_HASH_SIZE];
     tcp_seq tcp_iss;        /* tcp initial send seq # */
     uint32_t tcp_now;       /* for RFC 1323 timestamps */
 
     /* udp states */
     struct socket udb;
     struct socket *udp_last_so;
+    struct socket *udb_hash[SO_HASH_SIZE];
 
     /* icmp states */
     struct socket icmp;
@@ -226,6 +240,16 @@ struct Slirp {
     GRand *grand;
     QEMUTimer *ra_timer;
 
+#ifdef CONFIG_EPOLL
+    /* Socket readiness; -1 when sockets are polled as GPollFDs */
+    int epoll_fd;
+    int epoll_pollfds_idx;
+    bool epoll_failed;
+    /* Events being dispatched, cleared as their sockets are freed */
+    struct epoll_event epoll_events[SLIRP_EPOLL_EVENTS];
+    int epoll_nevents;
+#endif
+
     void *opaque;
 };
 
@@ -246,6 +270,11 @@ void if_start(Slirp *);
 
 static const short kDnsPort = 53;
 
+#ifdef CONFIG_EPOLL
+/* slirp.c */
+void slirp_epoll_remove(struct socket *so);
+#endif
+
 /* dnssearch.c */
 int translate_dnssearch(Slirp *s, const char ** names);
 
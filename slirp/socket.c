@@ -7,6 +7,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu-common.h"
+#include "qemu/main-loop.h"
 #include "slirp.h"
 #include "ip_icmp.h"
 #include "proxy.h"
@@ -17,18 +18,51 @@
 static void sofcantrcvmore(struct socket *so);
 static void sofcantsendmore(struct socket *so);
 
-struct socket *solookup(struct socket **last, struct socket *head,
+static unsigned int sohashfn(struct sockaddr_storage *lhost)
+{
+    uint32_t h;
+
+    switch (lhost->ss_family) {
+    case AF_INET:
+    {
+        struct sockaddr_in *sin = (struct sockaddr_in *) lhost;
+        h = sin->sin_addr.s_addr ^ sin->sin_port;
+        break;
+    }
+    case AF_INET6:
+    {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) lhost;
+        uint32_t w[4];
+
+        memcpy(w, &sin6->sin6_addr, sizeof(w));
+        h = w[0] ^ w[1] ^ w[2] ^ w[3] ^ sin6->sin6_port;
+        break;
+    }
+    default:
+        h = 0;
+        break;
+    }
+
+    return (h * 0x9e3779b1u) >> (32 - SO_HASH_BITS);
+}
+
+/*
+ * Sockets are hashed on their local (guest side) address only: UDP
+ * lookups don't know the foreign address, and TCP lookups compare it
+ * while walking the bucket.
+ */
+struct socket *solookup(struct socket **last, struct socket **hash,
         struct sockaddr_storage *lhost, struct sockaddr_storage *fhost)
 {
     struct socket *so = *last;
 
-    /* Optimization */
-    if (so != head && sockaddr_equal(&(so->lhost.ss), lhost)
+    /* Optimization; *last may be the list head, whose family is unset */
+    if (sockaddr_equal(&(so->lhost.ss), lhost)
             && (!fhost || sockaddr_equal(&so->fhost.ss, fhost))) {
         return so;
     }
 
-    for (so = head->so_next; so != head; so = so->so_next) {
+    for (so = hash[sohashfn(lhost)]; so; so = so->so_hash_next) {
         if (sockaddr_equal(&(so->lhost.ss), lhost)
                 && (!fhost || sockaddr_equal(&so->fhost.ss, fhost))) {
             *last = so;
@@ -39,6 +73,36 @@ struct socket *solookup(struct socket **last, struct socket *head,
     return (struct socket *)NULL;
 }
 
+/*
+ * (Re)insert a socket in a lookup table, once its local address is set.
+ * It has to be called again whenever that address changes.
+ */
+void sohash(struct socket **hash, struct socket *so)
+{
+    struct socket **bucket = &hash[sohashfn(&so->lhost.ss)];
+
+    sounhash(so);
+    so->so_hash_next = *bucket;
+    if (*bucket) {
+        (*bucket)->so_hash_pprev = &so->so_hash_next;
+    }
+    so->so_hash_pprev = bucket;
+    *bucket = so;
+}
+
+void sounhash(struct socket *so)
+{
+    if (!so->so_hash_pprev) {
+        return;
+    }
+    *so->so_hash_pprev = so->so_hash_next;
+    if (so->so_hash_next) {
+        so->so_hash_next->so_hash_pprev = so->so_hash_pprev;
+    }
+    so->so_hash_next = NULL;
+    so->so_hash_pprev = NULL;
+}
+
 /*
  * Create a new socket, initialise the fields
  * It is the responsibility of the caller to
@@ -56,6 +120,9 @@ socreate(Slirp *slirp)
     so->s = -1;
     so->slirp = slirp;
     so->pollfds_idx = -1;
+#ifdef CONFIG_EPOLL
+    so->so_epoll_fd = -1;
+#endif
   }
   return(so);
 }
@@ -101,6 +168,19 @@ sofree(struct socket *so)
   }
   m_free(so->so_m);
 
+  sounhash(so);
+  if (so->so_write_pending) {
+      struct socket **p = &slirp->write_list;
+
+      while (*p != so) {
+          p = &(*p)->so_write_next;
+      }
+      *p = so->so_write_next;
+  }
+#ifdef CONFIG_EPOLL
+  slirp_epoll_remove(so);
+#endif
+
   if(so->so_next && so->so_prev)
     remque(so);  /* crashes if so is not in a queue */
 
@@ -475,6 +555,44 @@ sowrite(struct socket *so)
 	return nn;
 }
 
+/*
+ * Have so_rcv written out once the frames the guest sent in the current
+ * burst have all been handled, so that a burst of segments costs one
+ * writev() per connection rather than one send() per segment.
+ */
+void
+sowrite_deferred(struct socket *so)
+{
+	Slirp *slirp = so->slirp;
+
+	if (so->so_write_pending)
+		return;
+	so->so_write_pending = true;
+	so->so_write_next = slirp->write_list;
+	slirp->write_list = so;
+	qemu_bh_schedule(slirp->write_bh);
+}
+
+void
+sowrite_flush(void *opaque)
+{
+	Slirp *slirp = opaque;
+	struct socket *so;
+
+	while ((so = slirp->write_list) != NULL) {
+		slirp->write_list = so->so_write_next;
+		so->so_write_next = NULL;
+		so->so_write_pending = false;
+
+		if (so->s == -1 || so->so_rcv.sb_cc == 0 ||
+		    (so->so_state & (SS_NOFDREF | SS_ISFCONNECTING)))
+			continue;
+		/* Advertise the room made in the window */
+		if (sowrite(so) > 0)
+			tcp_output(sototcpcb(so));
+	}
+}
+
 /*
  * recvfrom() a UDP socket
  */
@@ -707,6 +825,7 @@ tcp_listen(Slirp *slirp, uint32_t haddr, u_int hport, uint32_t laddr,
 	so->so_lfamily = AF_INET;
 	so->so_lport = lport; /* Kept in network format */
 	so->so_laddr.s_addr = laddr; /* Ditto */
+	sohash(slirp->tcb_hash, so);
 
 	addr.sin_family = AF_INET;
 	addr.sin_addr.s_addr = haddr;
@@ -11,6 +11,10 @@
 #define SO_EXPIRE 240000
 #define SO_EXPIREFAST 10000
 
+/* Buckets of the per-protocol socket lookup tables, see solookup() */
+#define SO_HASH_BITS 9
+#define SO_HASH_SIZE (1 << SO_HASH_BITS)
+
 /*
  * Our socket structure
  */
@@ -25,6 +29,17 @@ struct socket {
 #endif
 
   int pollfds_idx;                 /* GPollFD GArray index */
+#ifdef CONFIG_EPOLL
+  int so_epoll_fd;                 /* fd in slirp->epoll_fd, or -1 */
+  int so_epoll_events;             /* GIOCondition it is registered for */
+  void (*so_epoll_handler)(struct socket *, int);
+#endif
+
+  struct socket *so_hash_next;     /* Next socket in the lookup bucket */
+  struct socket **so_hash_pprev;   /* Pointer to us in the bucket, or NULL */
+
+  struct socket *so_write_next;    /* Next in slirp->write_list */
+  bool so_write_pending;           /* so_rcv is due to be written */
 
   Slirp *slirp;			   /* managing slirp instance */
 
@@ -142,14 +157,18 @@ static inline socklen_t sockaddr_size(struct sockaddr_storage *a)
 
 const char* sockaddr_to_string(const struct sockaddr_storage* ss);
 
-struct socket *solookup(struct socket **, struct socket *,
+struct socket *solookup(struct socket **, struct socket **,
         struct sockaddr_storage *, struct sockaddr_storage *);
+void sohash(struct socket **, struct socket *);
+void sounhash(struct socket *);
 struct socket *socreate(Slirp *);
 void sofree(struct socket *);
 int soread(struct socket *);
 int sorecvoob(struct socket *);
 int sosendoob(struct socket *);
 int sowrite(struct socket *);
+void sowrite_deferred(struct socket *);
+void sowrite_flush(void *);
 void sorecvfrom(struct socket *);
 int sosendto(struct socket *, struct mbuf *);
 struct socket * tcp_listen(Slirp *, uint32_t, u_int, uint32_t, u_int,
@@ -396,7 +396,7 @@ findso:
 	    g_assert_not_reached();
 	}
 
-	so = solookup(&slirp->tcp_last_so, &slirp->tcb, &lhost, &fhost);
+	so = solookup(&slirp->tcp_last_so, slirp->tcb_hash, &lhost, &fhost);
 
 	/*
 	 * If the state is CLOSED (i.e., TCB does not exist) then
@@ -443,6 +443,7 @@ findso:
 
 	  so->lhost.ss = lhost;
 	  so->fhost.ss = fhost;
+	  sohash(slirp->tcb_hash, so);
 
 	  so->so_iptos = tcp_tos(so);
 	  if (so->so_iptos == 0) {
@@ -513,6 +513,7 @@ void tcp_connect(struct socket *inso)
         }
         so->lhost = inso->lhost;
         so->so_ffamily = inso->so_ffamily;
+        sohash(slirp->tcb_hash, so);
     }
 
     tcp_mss(sototcpcb(so), 0);
@@ -163,7 +163,7 @@ udp_input(register struct mbuf *m, int iphlen)
 	/*
 	 * Locate pcb for datagram.
 	 */
-	so = solookup(&slirp->udp_last_so, &slirp->udb, &lhost, NULL);
+	so = solookup(&slirp->udp_last_so, slirp->udb_hash, &lhost, NULL);
 
 	if (so == NULL) {
 	  /*
@@ -195,6 +195,7 @@ udp_input(register struct mbuf *m, int iphlen)
 	  so->so_lfamily = AF_INET;
 	  so->so_laddr = ip->ip_src;
 	  so->so_lport = uh->uh_sport;
+	  sohash(slirp->udb_hash, so);
 
 	  if ((so->so_iptos = udp_tos(so)) == 0)
 	    so->so_iptos = ip->ip_tos;
@@ -321,6 +322,10 @@ udp_reattach(struct socket *so, unsigned short af)
             /* Nothing to reattach. */
             return so->s;
         }
+#ifdef CONFIG_EPOLL
+        /* The new socket may well get the same descriptor number */
+        slirp_epoll_remove(so);
+#endif
         closesocket(so->s);
     }
     so->s = qemu_socket(af, SOCK_DGRAM, 0);
@@ -388,6 +393,7 @@ udp_listen(Slirp *slirp, uint32_t haddr, u_int hport, uint32_t laddr,
 	so->so_lfamily = AF_INET;
 	so->so_lport = lport;
 	so->so_laddr.s_addr = laddr;
+	sohash(slirp->udb_hash, so);
 	if (flags != SS_FACCEPTONCE)
 	   so->so_expire = 0;
 
@@ -85,7 +85,7 @@ void udp6_input(struct mbuf *m)
         goto bad;
     }
 
-    so = solookup(&slirp->udp_last_so, &slirp->udb,
+    so = solookup(&slirp->udp_last_so, slirp->udb_hash,
                   (struct sockaddr_storage *) &lhost, NULL);
 
     if (so == NULL) {
@@ -105,6 +105,7 @@ void udp6_input(struct mbuf *m)
         so->so_lfamily = AF_INET6;
         so->so_laddr6 = ip->ip_src;
         so->so_lport6 = uh->uh_sport;
+        sohash(slirp->udb_hash, so);
     }
 
     so->so_ffamily = AF_INET6;
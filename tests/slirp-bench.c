@@ -0,0 +1,273 @@
+/*
+ * Slirp main loop and socket lookup benchmark.
+ *
+ * Opens N host sockets in a slirp instance and measures the cost of a
+ * slirp_pollfds_fill() / g_poll() / slirp_pollfds_poll() iteration, with
+ * some of them made readable every time, and the cost of routing guest
+ * UDP packets to their socket.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "qemu/sockets.h"
+#include "migration/vmstate.h"
+#include "monitor/monitor.h"
+#include "slirp/libslirp.h"
+#include "slirp/proxy.h"
+
+static unsigned int duration = 1;
+static unsigned int n_sockets = 256;
+static unsigned int n_active = 1;
+static bool use_tcp;
+
+static Slirp *slirp;
+static int *active_fds;
+static struct sockaddr_in *udp_addrs;
+static uint64_t n_output;
+
+static const char commands_string[] =
+    " -d = duration in seconds\n"
+    " -n = number of host sockets\n"
+    " -a = number of sockets made readable per iteration (UDP only)\n"
+    " -t = open TCP listeners instead of UDP sockets";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/* What the network backend and the rest of QEMU would provide */
+void slirp_output(void *opaque, const uint8_t *pkt, int pkt_len)
+{
+    n_output++;
+}
+
+int register_savevm(DeviceState *dev, const char *idstr, int instance_id,
+                    int version_id, SaveStateHandler *save_state,
+                    LoadStateHandler *load_state, void *opaque)
+{
+    return 0;
+}
+
+void unregister_savevm(DeviceState *dev, const char *idstr, void *opaque)
+{
+}
+
+void monitor_printf(Monitor *mon, const char *fmt, ...)
+{
+}
+
+static bool bench_proxy_try_connect(const struct sockaddr_storage *addr,
+                                    SlirpProxyConnectFunc *connect_func,
+                                    void *connect_opaque)
+{
+    return false;
+}
+
+static void bench_proxy_remove(void *connect_opaque)
+{
+}
+
+static const SlirpProxyOps bench_proxy_ops = {
+    .try_connect = bench_proxy_try_connect,
+    .remove = bench_proxy_remove,
+};
+
+static void make_slirp(void)
+{
+    struct in_addr net = { .s_addr = htonl(0x0a000200) };    /* 10.0.2.0 */
+    struct in_addr mask = { .s_addr = htonl(0xffffff00) };
+    struct in_addr host = { .s_addr = htonl(0x0a000202) };
+    struct in_addr dhcp = { .s_addr = htonl(0x0a00020f) };
+    struct in_addr dns = { .s_addr = htonl(0x0a000203) };
+    struct in_addr guest = { .s_addr = htonl(0x0a00020f) };
+    struct in_addr loopback = { .s_addr = htonl(INADDR_LOOPBACK) };
+    struct in6_addr prefix6 = { .s6_addr = { 0xfe, 0xc0 } };
+    struct in6_addr host6 = { .s6_addr = { 0xfe, 0xc0, [15] = 2 } };
+    struct in6_addr dns6 = { .s6_addr = { 0xfe, 0xc0, [15] = 3 } };
+    unsigned int i;
+
+    slirp_proxy = &bench_proxy_ops;
+    slirp = slirp_init(false, true, net, mask, host, false, prefix6, 64,
+                       host6, NULL, NULL, NULL, dhcp, dns, dns6, NULL, NULL);
+
+    active_fds = g_new(int, n_active);
+    udp_addrs = g_new0(struct sockaddr_in, n_sockets);
+    for (i = 0; i < n_sockets; i++) {
+        int port = 20000 + i;
+
+        /* Forward consecutive host ports, skipping those already in use */
+        while (slirp_add_hostfwd(slirp, !use_tcp, loopback, port,
+                                 guest, 1024 + i) < 0) {
+            if (++port > 65535) {
+                fprintf(stderr, "could not open socket #%u\n", i);
+                exit(1);
+            }
+        }
+        udp_addrs[i].sin_family = AF_INET;
+        udp_addrs[i].sin_addr = loopback;
+        udp_addrs[i].sin_port = htons(port);
+    }
+    for (i = 0; i < n_active; i++) {
+        active_fds[i] = qemu_socket(AF_INET, SOCK_DGRAM, 0);
+        qemu_set_nonblock(active_fds[i]);
+    }
+}
+
+static void main_loop_iteration(GArray *pollfds)
+{
+    uint32_t timeout = 0;
+    int ret;
+
+    g_array_set_size(pollfds, 0);
+    slirp_pollfds_fill(pollfds, &timeout);
+    ret = g_poll((GPollFD *)pollfds->data, pollfds->len, 0);
+    slirp_pollfds_poll(pollfds, ret < 0);
+}
+
+static double bench_poll(uint64_t *iterations)
+{
+    GArray *pollfds = g_array_new(FALSE, FALSE, sizeof(GPollFD));
+    int64_t start = get_clock();
+    int64_t deadline = start + duration * NANOSECONDS_PER_SECOND;
+    unsigned int i, next = 0;
+    char byte = 0;
+
+    *iterations = 0;
+    do {
+        /* Wake up a rotating set of sockets, as guest traffic would */
+        if (!use_tcp) {
+            for (i = 0; i < n_active; i++) {
+                sendto(active_fds[i], &byte, 1, 0,
+                       (struct sockaddr *)&udp_addrs[next],
+                       sizeof(udp_addrs[next]));
+                next = (next + 1) % n_sockets;
+            }
+        }
+        main_loop_iteration(pollfds);
+        (*iterations)++;
+    } while (get_clock() < deadline);
+    g_array_free(pollfds, TRUE);
+    return (get_clock() - start) / 1e9;
+}
+
+static uint16_t ip_checksum(const uint8_t *p, int len)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < len; i += 2) {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+/*
+ * Guest UDP packets from n_sockets different source ports to the host's
+ * discard port: each flow gets its own slirp socket on the first round,
+ * later rounds only look it up.
+ */
+static double bench_lookup(uint64_t *packets)
+{
+    uint8_t pkt[14 + 20 + 8 + 4];
+    uint8_t *ip = pkt + 14, *udp = ip + 20;
+    int64_t start = get_clock();
+    int64_t deadline = start + duration * NANOSECONDS_PER_SECOND;
+    uint16_t csum;
+    unsigned int i;
+
+    memset(pkt, 0, sizeof(pkt));
+    memcpy(pkt + 6, "\x52\x54\x00\x12\x34\x56", 6);
+    pkt[12] = 0x08;                             /* ETH_P_IP */
+    ip[0] = 0x45;
+    ip[3] = 20 + 8 + 4;                         /* total length */
+    ip[8] = 64;                                 /* TTL */
+    ip[9] = IPPROTO_UDP;
+    memcpy(ip + 12, "\x0a\x00\x02\x0f", 4);     /* 10.0.2.15 */
+    memcpy(ip + 16, "\x0a\x00\x02\x02", 4);     /* 10.0.2.2 */
+    csum = ip_checksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum;
+    udp[3] = 9;                                 /* discard */
+    udp[5] = 8 + 4;
+
+    *packets = 0;
+    do {
+        for (i = 0; i < n_sockets; i++) {
+            uint16_t sport = 40000 + i;
+
+            udp[0] = sport >> 8;
+            udp[1] = sport;
+            slirp_input(slirp, pkt, sizeof(pkt));
+        }
+        *packets += n_sockets;
+    } while (get_clock() < deadline);
+    return (get_clock() - start) / 1e9;
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %u\n", duration);
+    printf(" sockets:           %u %s\n", n_sockets, use_tcp ? "TCP" : "UDP");
+    printf(" active:            %u\n", use_tcp ? 0 : n_active);
+}
+
+static void run_bench(void)
+{
+    uint64_t iterations, packets;
+    double t;
+
+    printf("Results:\n");
+    t = bench_poll(&iterations);
+    printf(" Main loop:          %.2f us/iteration\n", t * 1e6 / iterations);
+    t = bench_lookup(&packets);
+    printf(" Guest UDP input:    %.2f Mpackets/s\n", packets / t / 1e6);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "ha:d:n:t");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'a':
+            n_active = atoi(optarg);
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'n':
+            n_sockets = MAX(atoi(optarg), 1);
+            break;
+        case 't':
+            use_tcp = true;
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    qemu_init_main_loop(&error_abort);
+    pr_params();
+    make_slirp();
+    run_bench();
+    return 0;
+}
@@ -174,6 +174,70 @@ static void test_encode_decode(void)
     }
 }
 
+/* All the encoders must produce the same stream, down to the overflow
+ * behaviour, so compare each of them with the preferred one.
+ */
+static void test_encode_accel(void)
+{
+    enum { NUM_PAGES = 256 };
+    uint8_t *old_buf = g_malloc(PAGE_SIZE * NUM_PAGES);
+    uint8_t *new_buf = g_malloc(PAGE_SIZE * NUM_PAGES);
+    uint8_t *compressed = g_malloc(PAGE_SIZE);
+    uint8_t *expected = g_malloc(PAGE_SIZE * NUM_PAGES);
+    int expected_len[NUM_PAGES];
+    int dlen[NUM_PAGES];
+    int i, j, rc;
+    bool first = true;
+
+    for (i = 0; i < NUM_PAGES; i++) {
+        uint8_t *o = old_buf + i * PAGE_SIZE;
+        uint8_t *n = new_buf + i * PAGE_SIZE;
+        int runs = g_test_rand_int_range(0, 64);
+        int max_run = g_test_rand_int_range(1, 300);
+
+        for (j = 0; j < PAGE_SIZE; j++) {
+            o[j] = g_test_rand_int();
+        }
+        memcpy(n, o, PAGE_SIZE);
+        while (runs--) {
+            int start = g_test_rand_int_range(0, PAGE_SIZE);
+            int len = g_test_rand_int_range(1, max_run + 1);
+
+            for (j = start; j < start + len && j < PAGE_SIZE; j++) {
+                n[j] = g_test_rand_int_range(0, 4) ? ~o[j] : o[j];
+            }
+        }
+        /* also exercise the overflow paths */
+        dlen[i] = i % 4 ? PAGE_SIZE : g_test_rand_int_range(0, 600);
+    }
+
+    do {
+        for (i = 0; i < NUM_PAGES; i++) {
+            rc = xbzrle_encode_buffer(old_buf + i * PAGE_SIZE,
+                                      new_buf + i * PAGE_SIZE, PAGE_SIZE,
+                                      compressed, dlen[i]);
+            if (first) {
+                expected_len[i] = rc;
+                if (rc > 0) {
+                    memcpy(expected + i * PAGE_SIZE, compressed, rc);
+                }
+            } else {
+                g_assert_cmpint(rc, ==, expected_len[i]);
+                if (rc > 0) {
+                    g_assert(memcmp(expected + i * PAGE_SIZE, compressed,
+                                    rc) == 0);
+                }
+            }
+        }
+        first = false;
+    } while (test_xbzrle_encode_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(compressed);
+    g_free(expected);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +250,7 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
@@ -0,0 +1,286 @@
+/*
+ * XBZRLE encoder/decoder and page cache benchmark.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+#include "include/migration/migration.h"
+#include "migration/page_cache.h"
+
+#define PAGE_SIZE 4096
+
+enum corpus {
+    CORPUS_SPARSE,  /* a few words changed: counters, pointers, flags */
+    CORPUS_STRIPES, /* short runs changed every few cache lines */
+    CORPUS_DENSE,   /* large parts of the page rewritten */
+    CORPUS_MIXED,   /* all of the above, page by page */
+    CORPUS_MAX,
+};
+
+static const char * const corpus_names[CORPUS_MAX] = {
+    [CORPUS_SPARSE] = "sparse",
+    [CORPUS_STRIPES] = "stripes",
+    [CORPUS_DENSE] = "dense",
+    [CORPUS_MIXED] = "mixed",
+};
+
+static unsigned int duration = 1;
+static unsigned int n_pages = 4096;
+static unsigned int cache_pages = 1024;
+static enum corpus corpus = CORPUS_MIXED;
+static unsigned int n_accel;
+
+static uint8_t *old_pages;
+static uint8_t *new_pages;
+static uint8_t *encoded;
+static int *encoded_len;
+
+static const char commands_string[] =
+    " -d = duration in seconds\n"
+    " -n = number of pages in the corpus\n"
+    " -c = number of pages in the page cache\n"
+    " -k = corpus kind: sparse, stripes, dense or mixed\n"
+    " -a = number of encoder accelerations to skip (0 = best one)";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static void make_delta(uint8_t *o, uint8_t *n, enum corpus kind, uint64_t *r)
+{
+    unsigned int i, j, runs, len, start;
+
+    memcpy(n, o, PAGE_SIZE);
+    switch (kind) {
+    case CORPUS_SPARSE:
+        runs = 1 + (*r = xorshift64star(*r)) % 8;
+        for (i = 0; i < runs; i++) {
+            *r = xorshift64star(*r);
+            start = (*r % (PAGE_SIZE / 8)) * 8;
+            n[start] ^= 1 + (*r >> 32) % 255;
+        }
+        break;
+    case CORPUS_STRIPES:
+        for (i = 0; i < PAGE_SIZE; i += 256) {
+            *r = xorshift64star(*r);
+            start = i + *r % 192;
+            len = 4 + (*r >> 32) % 60;
+            for (j = start; j < start + len; j++) {
+                n[j] = ~o[j];
+            }
+        }
+        break;
+    case CORPUS_DENSE:
+        *r = xorshift64star(*r);
+        start = *r % (PAGE_SIZE / 4);
+        for (j = start; j < PAGE_SIZE; j++) {
+            *r = xorshift64star(*r);
+            /* rewritten data still matches the old one here and there */
+            n[j] = (*r & 7) ? (uint8_t)*r : o[j];
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static void make_corpus(void)
+{
+    uint64_t r = 0x9e3779b97f4a7c15ULL;
+    unsigned int i, j;
+
+    old_pages = qemu_memalign(64, (size_t)n_pages * PAGE_SIZE);
+    new_pages = qemu_memalign(64, (size_t)n_pages * PAGE_SIZE);
+    encoded = g_malloc((size_t)n_pages * PAGE_SIZE);
+    encoded_len = g_new(int, n_pages);
+
+    for (i = 0; i < n_pages; i++) {
+        uint8_t *o = old_pages + (size_t)i * PAGE_SIZE;
+        enum corpus kind = corpus == CORPUS_MIXED ? i % CORPUS_MIXED : corpus;
+
+        for (j = 0; j < PAGE_SIZE; j += 8) {
+            r = xorshift64star(r);
+            memcpy(o + j, &r, 8);
+        }
+        make_delta(o, new_pages + (size_t)i * PAGE_SIZE, kind, &r);
+    }
+}
+
+static double bench_encode(uint64_t *bytes, uint64_t *out_bytes)
+{
+    int64_t start = get_clock();
+    int64_t deadline = start + duration * NANOSECONDS_PER_SECOND;
+    unsigned int i;
+
+    *bytes = *out_bytes = 0;
+    do {
+        for (i = 0; i < n_pages; i++) {
+            encoded_len[i] = xbzrle_encode_buffer(
+                old_pages + (size_t)i * PAGE_SIZE,
+                new_pages + (size_t)i * PAGE_SIZE, PAGE_SIZE,
+                encoded + (size_t)i * PAGE_SIZE, PAGE_SIZE);
+            *out_bytes += encoded_len[i] > 0 ? encoded_len[i] : PAGE_SIZE;
+        }
+        *bytes += (uint64_t)n_pages * PAGE_SIZE;
+    } while (get_clock() < deadline);
+    return (get_clock() - start) / 1e9;
+}
+
+static double bench_decode(uint64_t *bytes)
+{
+    uint8_t *page = qemu_memalign(64, PAGE_SIZE);
+    int64_t start = get_clock();
+    int64_t deadline = start + duration * NANOSECONDS_PER_SECOND;
+    unsigned int i;
+
+    *bytes = 0;
+    do {
+        for (i = 0; i < n_pages; i++) {
+            if (encoded_len[i] <= 0) {
+                continue;
+            }
+            memcpy(page, old_pages + (size_t)i * PAGE_SIZE, PAGE_SIZE);
+            xbzrle_decode_buffer(encoded + (size_t)i * PAGE_SIZE,
+                                 encoded_len[i], page, PAGE_SIZE);
+        }
+        *bytes += (uint64_t)n_pages * PAGE_SIZE;
+    } while (get_clock() < deadline);
+    qemu_vfree(page);
+    return (get_clock() - start) / 1e9;
+}
+
+/* Replays the XBZRLE cache accesses of a migration: every round, a skewed
+ * set of pages is dirtied and each one is looked up, then (re)inserted.
+ */
+static double bench_cache(uint64_t *lookups, uint64_t *hits)
+{
+    PageCache *cache = cache_init(cache_pages, PAGE_SIZE);
+    int64_t start = get_clock();
+    int64_t deadline = start + duration * NANOSECONDS_PER_SECOND;
+    uint64_t r = 1, age = 0;
+    unsigned int i;
+
+    *lookups = *hits = 0;
+    do {
+        age++;
+        for (i = 0; i < n_pages; i++) {
+            uint64_t addr;
+
+            r = xorshift64star(r);
+            /* 3/4 of the writes go to 1/8 of the pages */
+            addr = (r & 3) ? r % (n_pages / 8 + 1) : r % (n_pages * 4);
+            addr *= PAGE_SIZE;
+            if (cache_is_cached(cache, addr, age)) {
+                (*hits)++;
+            }
+            cache_insert(cache, addr, old_pages + (size_t)(i % n_pages) *
+                         PAGE_SIZE, age);
+            (*lookups)++;
+        }
+    } while (get_clock() < deadline);
+    cache_fini(cache);
+    return (get_clock() - start) / 1e9;
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %u\n", duration);
+    printf(" corpus:            %s, %u pages\n", corpus_names[corpus], n_pages);
+    printf(" cache:             %u pages\n", cache_pages);
+    printf(" skipped accels:    %u\n", n_accel);
+}
+
+static void run_bench(void)
+{
+    uint64_t bytes, out_bytes, lookups, hits;
+    double t;
+
+    printf("Results:\n");
+    t = bench_encode(&bytes, &out_bytes);
+    printf(" Encode:             %.2f MB/s (ratio %.2f%%)\n",
+           bytes / t / 1e6, out_bytes * 100.0 / bytes);
+    t = bench_decode(&bytes);
+    printf(" Decode:             %.2f MB/s\n", bytes / t / 1e6);
+    t = bench_cache(&lookups, &hits);
+    printf(" Cache:              %.2f Mlookups/s (hit rate %.2f%%)\n",
+           lookups / t / 1e6, hits * 100.0 / lookups);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c, i;
+
+    for (;;) {
+        c = getopt(argc, argv, "ha:c:d:k:n:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'a':
+            n_accel = atoi(optarg);
+            break;
+        case 'c':
+            cache_pages = pow2floor(atoi(optarg));
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'k':
+            for (i = 0; i < CORPUS_MAX; i++) {
+                if (!strcmp(optarg, corpus_names[i])) {
+                    corpus = i;
+                    break;
+                }
+            }
+            if (i == CORPUS_MAX) {
+                usage_complete(argv);
+                exit(1);
+            }
+            break;
+        case 'n':
+            n_pages = MAX(atoi(optarg), 8);
+            break;
+        }
+    }
+    if (cache_pages == 0) {
+        cache_pages = 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int i;
+
+    parse_args(argc, argv);
+    for (i = 0; i < n_accel; i++) {
+        if (!test_xbzrle_encode_next_accel()) {
+            break;
+        }
+    }
+    pr_params();
+    make_corpus();
+    run_bench();
+    return 0;
+}
@@ -836,22 +836,135 @@ void tcg_exec_init(unsigned long tb_size)
 #endif
 }
 
+/* Split the code buffer into regions.  This has to wait until the
+   prologue has been generated, which happens after tcg_exec_init() in
+   user-mode emulation, so it is done on the first TB allocation.  */
+static void tb_regions_init(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    uint8_t *buf = tcg_ctx.code_gen_buffer;
+    size_t size = tcg_ctx.code_gen_buffer_size;
+    int i, n;
+
+    n = size / TB_REGION_MIN_SIZE;
+    if (n > TB_REGION_MAX_COUNT) {
+        n = TB_REGION_MAX_COUNT;
+    }
+    if (n < 1) {
+        n = 1;
+    }
+    ctx->nb_regions = n;
+    ctx->region_size = (size / n) & ~(size_t)(CODE_GEN_ALIGN - 1);
+    ctx->region_max_tbs = tcg_ctx.code_gen_max_blocks / n;
+
+    for (i = 0; i < n; i++) {
+        TBRegion *r = &ctx->regions[i];
+
+        r->start = buf + i * ctx->region_size;
+        r->end = i == n - 1 ? buf + size : buf + (i + 1) * ctx->region_size;
+        r->ptr = r->start;
+        r->tbs = ctx->tbs + i * ctx->region_max_tbs;
+        r->nb_tbs = 0;
+        r->last_use = 0;
+    }
+    ctx->cur_region = 0;
+    tcg_ctx.code_gen_ptr = ctx->regions[0].start;
+    tcg_ctx.code_gen_highwater = (uint8_t *)ctx->regions[0].end - 1024;
+}
+
+/* Make region 'i' the one new code is generated into.  */
+static void tb_region_set_current(int i)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[i];
+
+    ctx->regions[ctx->cur_region].ptr = tcg_ctx.code_gen_ptr;
+    ctx->cur_region = i;
+    atomic_set(&r->last_use, atomic_fetch_inc(&ctx->region_clock) + 1);
+    tcg_ctx.code_gen_ptr = r->ptr;
+    /* Same margin as the one computed by tcg_prologue_init().  */
+    tcg_ctx.code_gen_highwater = (uint8_t *)r->end - 1024;
+}
+
+/* Find the region containing host code address 'tc_ptr', or NULL.  */
+static TBRegion *tb_region_find(uintptr_t tc_ptr)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i;
+
+    if (ctx->nb_regions == 0 ||
+        tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer) {
+        return NULL;
+    }
+    i = MIN((tc_ptr - (uintptr_t)tcg_ctx.code_gen_buffer) / ctx->region_size,
+            TB_REGION_MAX_COUNT);
+    if (i >= ctx->nb_regions) {
+        /* the last region absorbs the rounding slack */
+        i = ctx->nb_regions - 1;
+    }
+    if (tc_ptr >= (uintptr_t)ctx->regions[i].end) {
+        return NULL;
+    }
+    return &ctx->regions[i];
+}
+
+/* Move translation to an empty region, if there is one left.
+ *
+ * Called with tb_lock held.
+ */
+static bool tb_region_switch(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i;
+
+    for (i = 1; i < ctx->nb_regions; i++) {
+        int n = (ctx->cur_region + i) % ctx->nb_regions;
+
+        if (ctx->regions[n].nb_tbs == 0) {
+            tb_region_set_current(n);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Record that a TB was looked up, to keep its region out of eviction.  */
+void tb_region_touch(TranslationBlock *tb)
+{
+    TBRegion *r = tb_region_find((uintptr_t)tb->tc_ptr);
+
+    if (r) {
+        /* Runs outside tb_lock, concurrently with other vCPUs.  */
+        atomic_set(&r->last_use,
+                   atomic_fetch_inc(&tcg_ctx.tb_ctx.region_clock) + 1);
+    }
+}
+
 /*
- * Allocate a new translation block. Flush the translation buffer if
- * too many translation blocks or too much generated code.
+ * Allocate a new translation block in the current region. Returns NULL
+ * if the region has no TB slot left; running out of code space is
+ * detected later by tcg_gen_code().
  *
  * Called with tb_lock held.
  */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
     TranslationBlock *tb;
 
     assert_tb_lock();
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks) {
+    if (unlikely(ctx->nb_regions == 0)) {
+        tb_regions_init();
+    }
+    r = &ctx->regions[ctx->cur_region];
+    if (r->nb_tbs >= ctx->region_max_tbs) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &r->tbs[r->nb_tbs++];
+    ctx->nb_tbs++;
+    atomic_set(&r->last_use, atomic_fetch_inc(&ctx->region_clock) + 1);
     tb->pc = pc;
     tb->cflags = 0;
     tb->invalid = false;
@@ -861,14 +974,20 @@ static TranslationBlock *tb_alloc(target_ulong pc)
 /* Called with tb_lock held.  */
 void tb_free(TranslationBlock *tb)
 {
+    TBRegion *r;
+
     assert_tb_lock();
 
+    if (tcg_ctx.tb_ctx.nb_regions == 0) {
+        return;
+    }
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    r = &tcg_ctx.tb_ctx.regions[tcg_ctx.tb_ctx.cur_region];
+    if (r->nb_tbs > 0 && tb == &r->tbs[r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
+        r->nb_tbs--;
         tcg_ctx.tb_ctx.nb_tbs--;
     }
 }
@@ -952,6 +1071,18 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     page_flush_tb();
 
     tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
+    if (tcg_ctx.tb_ctx.nb_regions) {
+        int i;
+
+        for (i = 0; i < tcg_ctx.tb_ctx.nb_regions; i++) {
+            TBRegion *r = &tcg_ctx.tb_ctx.regions[i];
+
+            r->nb_tbs = 0;
+            r->ptr = r->start;
+        }
+        tcg_ctx.tb_ctx.cur_region = 0;
+        tb_region_set_current(0);
+    }
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tcg_ctx.tb_ctx.tb_flush_count,
@@ -970,6 +1101,65 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+/* evict the least recently used region and translate into it */
+static void do_tb_region_evict(CPUState *cpu, run_on_cpu_data evict_count)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r;
+    int i, victim;
+
+    tb_lock();
+
+    /* If it is already been done on request of another CPU,
+     * just retry.
+     */
+    if (ctx->tb_region_evict_count != evict_count.host_int) {
+        goto done;
+    }
+
+    victim = 0;
+    for (i = 1; i < ctx->nb_regions; i++) {
+        if (atomic_read(&ctx->regions[i].last_use) <
+            atomic_read(&ctx->regions[victim].last_use)) {
+            victim = i;
+        }
+    }
+    r = &ctx->regions[victim];
+
+#if defined(DEBUG_TB_FLUSH)
+    printf("qemu: evict region=%d nb_tbs=%d\n", victim, r->nb_tbs);
+#endif
+    /* Invalidating each TB unlinks it from the TBs of the other regions
+       that jump into it, and drops it from the hash table, the page
+       lists and the jump caches.  */
+    for (i = 0; i < r->nb_tbs; i++) {
+        if (!r->tbs[i].invalid) {
+            tb_phys_invalidate(&r->tbs[i], -1);
+        }
+    }
+    ctx->nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    if (victim == ctx->cur_region) {
+        tcg_ctx.code_gen_ptr = r->start;
+    }
+    r->ptr = r->start;
+    tb_region_set_current(victim);
+
+    atomic_mb_set(&ctx->tb_region_evict_count,
+                  ctx->tb_region_evict_count + 1);
+
+done:
+    tb_unlock();
+}
+
+static void tb_region_evict(CPUState *cpu)
+{
+    unsigned evict_count = atomic_mb_read(&tcg_ctx.tb_ctx.tb_region_evict_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_region_evict,
+                          RUN_ON_CPU_HOST_INT(evict_count));
+}
+
 #ifdef DEBUG_TB_CHECK
 
 static void
@@ -1283,11 +1473,20 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         cflags |= CF_USE_ICOUNT;
     }
 
+ restart:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
  buffer_overflow:
-        /* flush must be done */
-        tb_flush(cpu);
+        /* give back the slot of a partially generated TB */
+        if (tb) {
+            tb_free(tb);
+        }
+        /* switching to an empty region does not disturb any existing
+           code, otherwise a region must be evicted with all CPUs stopped */
+        if (tb_region_switch()) {
+            goto restart;
+        }
+        tb_region_evict(cpu);
         mmap_unlock();
         cpu_loop_exit(cpu);
     }
@@ -1366,6 +1565,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx.code_gen_ptr = (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN);
+    tcg_ctx.tb_ctx.tb_gen_code_bytes += gen_code_size;
 
     /* init jump list */
     assert(((uintptr_t)tb & 3) == 0);
@@ -1668,20 +1868,24 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
     int m_min, m_max, m;
     uintptr_t v;
     TranslationBlock *tb;
+    TBRegion *r;
+    void *end;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    r = tb_region_find(tc_ptr);
+    if (r == NULL || r->nb_tbs <= 0) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    end = r == &tcg_ctx.tb_ctx.regions[tcg_ctx.tb_ctx.cur_region] ?
+          tcg_ctx.code_gen_ptr : r->ptr;
+    if (tc_ptr < (uintptr_t)r->tbs[0].tc_ptr || tc_ptr >= (uintptr_t)end) {
         return NULL;
     }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_max = r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &r->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1691,7 +1895,7 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return &r->tbs[m_max];
 }
 
 #if !defined(CONFIG_USER_ONLY)
@@ -1873,9 +2077,15 @@ static void print_qht_statistics(FILE *f, fprintf_function cpu_fprintf,
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    static int64_t last_query_ns;
+    static uint64_t last_query_bytes;
+    int i, j, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    size_t code_size;
+    int64_t now_ns;
+    uint64_t gen_bytes;
     TranslationBlock *tb;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
     struct qht_stats hst;
 
     tb_lock();
@@ -1885,61 +2095,76 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
-            direct_jmp_count++;
-            if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
-                direct_jmp2_count++;
+    code_size = 0;
+    for (j = 0; j < ctx->nb_regions; j++) {
+        TBRegion *r = &ctx->regions[j];
+
+        code_size += (uint8_t *)(j == ctx->cur_region ? tcg_ctx.code_gen_ptr
+                                                      : r->ptr) -
+                     (uint8_t *)r->start;
+        for (i = 0; i < r->nb_tbs; i++) {
+            tb = &r->tbs[i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+                direct_jmp_count++;
+                if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_highwater - tcg_ctx.code_gen_buffer);
+    cpu_fprintf(f, "gen code size       %zd/%zd\n",
+                code_size, tcg_ctx.code_gen_buffer_size);
+    cpu_fprintf(f, "code regions        %d x %zd bytes (current %d)\n",
+                ctx->nb_regions, ctx->region_size, ctx->cur_region);
     cpu_fprintf(f, "TB count            %d/%d\n",
-            tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
+            ctx->nb_tbs, tcg_ctx.code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
-            tcg_ctx.tb_ctx.nb_tbs ? target_code_size /
-                    tcg_ctx.tb_ctx.nb_tbs : 0,
+            ctx->nb_tbs ? target_code_size / ctx->nb_tbs : 0,
             max_target_code_size);
-    cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+    cpu_fprintf(f, "TB avg host size    %zd bytes (expansion ratio: %0.1f)\n",
+            ctx->nb_tbs ? code_size / ctx->nb_tbs : 0,
+            target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
-            tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
-                                    tcg_ctx.tb_ctx.nb_tbs : 0);
+            ctx->nb_tbs ? (cross_page * 100) / ctx->nb_tbs : 0);
     cpu_fprintf(f, "direct jump count   %d (%d%%) (2 jumps=%d %d%%)\n",
                 direct_jmp_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0,
+                ctx->nb_tbs ? (direct_jmp_count * 100) / ctx->nb_tbs : 0,
                 direct_jmp2_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp2_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0);
+                ctx->nb_tbs ? (direct_jmp2_count * 100) / ctx->nb_tbs : 0);
 
-    qht_statistics_init(&tcg_ctx.tb_ctx.htable, &hst);
+    qht_statistics_init(&ctx->htable, &hst);
     print_qht_statistics(f, cpu_fprintf, hst);
     qht_statistics_destroy(&hst);
 
+    /* the translation rate is measured since the previous query */
+    now_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    gen_bytes = ctx->tb_gen_code_bytes;
+
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
-            atomic_read(&tcg_ctx.tb_ctx.tb_flush_count));
+            atomic_read(&ctx->tb_flush_count));
+    cpu_fprintf(f, "TB region evictions %u\n",
+            atomic_read(&ctx->tb_region_evict_count));
     cpu_fprintf(f, "TB invalidate count %d\n",
-            tcg_ctx.tb_ctx.tb_phys_invalidate_count);
+            ctx->tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "gen code total      %" PRIu64 " bytes\n", gen_bytes);
+    if (last_query_ns && now_ns > last_query_ns) {
+        cpu_fprintf(f, "gen code rate       %" PRIu64 " bytes/s\n",
+                    (gen_bytes - last_query_bytes) * NANOSECONDS_PER_SECOND /
+                    (now_ns - last_query_ns));
+    }
+    last_query_ns = now_ns;
+    last_query_bytes = gen_bytes;
     tcg_dump_info(f, cpu_fprintf);
 
     tb_unlock();